@@ -0,0 +1,422 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+#include "Utils.hpp"
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace stlr {
+    /// <summary>
+    /// The on-disk layout of an asset pack, as written by the AssetCooker tool.
+    ///
+    /// A pack is a Header followed by tables of TextureEntry, MeshEntry, Region and Attribute,
+    /// then the blobs they point to. Every blob starts at a multiple of blob_alignment, which
+    /// satisfies any optimalBufferCopyOffsetAlignment and texel block size, so a blob can be copied
+    /// into staging memory at an aligned offset as is. Texel data is already in its Vulkan format
+    /// with every mip level, and vertex and index data are in the layout the pipeline reads.
+    /// All integers are little-endian.
+    /// </summary>
+    namespace asset_pack {
+        constexpr std::array<char, 8> magic { 'S', 'T', 'L', 'R', 'P', 'A', 'C', 'K' };
+        constexpr uint32_t version = 1;
+        constexpr uint64_t blob_alignment = 256;
+        /// Names are stored null-terminated in a fixed array.
+        constexpr size_t name_size = 64;
+
+        struct Header {
+            std::array<char, 8> magic;
+            uint32_t version;
+            uint32_t texture_count;
+            uint32_t mesh_count;
+            uint32_t region_count;
+            uint32_t attribute_count;
+            uint32_t reserved;
+            uint64_t textures_offset;
+            uint64_t meshes_offset;
+            uint64_t regions_offset;
+            uint64_t attributes_offset;
+        };
+
+        struct TextureEntry {
+            char name[name_size];
+            /// A VkFormat.
+            uint32_t format;
+            uint32_t width;
+            uint32_t height;
+            uint32_t level_count;
+            uint32_t layer_count;
+            /// The texture's regions in the region table, one per level and layer.
+            uint32_t first_region;
+            uint32_t region_count;
+            uint32_t reserved;
+            uint64_t data_offset;
+            uint64_t data_size;
+        };
+
+        /// <summary>
+        /// One mip level of one layer, as a range of its texture's data.
+        /// </summary>
+        struct Region {
+            uint32_t level;
+            uint32_t layer;
+            uint64_t offset;
+            uint64_t size;
+        };
+
+        struct MeshEntry {
+            char name[name_size];
+            uint32_t vertex_stride;
+            uint32_t vertex_count;
+            uint32_t index_count;
+            /// A VkIndexType.
+            uint32_t index_type;
+            /// The mesh's vertex attributes in the attribute table, all read from one binding.
+            uint32_t first_attribute;
+            uint32_t attribute_count;
+            uint64_t vertex_offset;
+            uint64_t vertex_size;
+            uint64_t index_offset;
+            uint64_t index_size;
+        };
+
+        struct Attribute {
+            uint32_t location;
+            /// A VkFormat.
+            uint32_t format;
+            uint32_t offset;
+            uint32_t reserved;
+        };
+
+        static_assert( std::is_trivially_copyable_v<Header> && sizeof( Header ) == 64 );
+        static_assert( std::is_trivially_copyable_v<TextureEntry> && sizeof( TextureEntry ) == 112 );
+        static_assert( std::is_trivially_copyable_v<Region> && sizeof( Region ) == 24 );
+        static_assert( std::is_trivially_copyable_v<MeshEntry> && sizeof( MeshEntry ) == 120 );
+        static_assert( std::is_trivially_copyable_v<Attribute> && sizeof( Attribute ) == 16 );
+
+        inline uint64_t align( uint64_t offset ) noexcept {
+            return ( offset + blob_alignment - 1 ) & ~( blob_alignment - 1 );
+        }
+    }
+
+    /// <summary>
+    /// A read-only file mapped into memory. Reading its bytes pages them in from the page cache
+    /// without a read() into an intermediate buffer.
+    /// </summary>
+    class MappedFile {
+        const char* data;
+        size_t size;
+#ifdef _WIN32
+        HANDLE file;
+        HANDLE mapping;
+#else
+        int file;
+#endif
+
+    public:
+        explicit MappedFile( const std::filesystem::path& path )
+            : data( nullptr )
+            , size( 0 ) {
+#ifdef _WIN32
+            file = CreateFileW( path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+            if( file == INVALID_HANDLE_VALUE )
+                throw std::runtime_error( "Failed to open " + path.string() );
+
+            LARGE_INTEGER file_size;
+            GetFileSizeEx( file, &file_size );
+            size = static_cast<size_t>( file_size.QuadPart );
+            mapping = size > 0 ? CreateFileMappingW( file, nullptr, PAGE_READONLY, 0, 0, nullptr ) : nullptr;
+            if( size > 0 ) {
+                data = mapping != nullptr ? static_cast<const char*>( MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) ) : nullptr;
+                if( data == nullptr ) {
+                    if( mapping != nullptr )
+                        CloseHandle( mapping );
+                    CloseHandle( file );
+                    throw std::runtime_error( "Failed to map " + path.string() );
+                }
+            }
+#else
+            file = open( path.c_str(), O_RDONLY );
+            if( file < 0 )
+                throw std::runtime_error( "Failed to open " + path.string() );
+
+            struct stat s;
+            fstat( file, &s );
+            size = static_cast<size_t>( s.st_size );
+            if( size > 0 ) {
+                void* m { mmap( nullptr, size, PROT_READ, MAP_PRIVATE, file, 0 ) };
+                if( m == MAP_FAILED ) {
+                    close( file );
+                    throw std::runtime_error( "Failed to map " + path.string() );
+                }
+                data = static_cast<const char*>( m );
+            }
+#endif
+        }
+
+        ~MappedFile() {
+#ifdef _WIN32
+            if( data != nullptr )
+                UnmapViewOfFile( data );
+            if( mapping != nullptr )
+                CloseHandle( mapping );
+            CloseHandle( file );
+#else
+            if( data != nullptr )
+                munmap( const_cast<char*>( data ), size );
+            close( file );
+#endif
+        }
+
+        MappedFile( const MappedFile& ) = delete;
+        MappedFile& operator=( const MappedFile& ) = delete;
+
+        const char* get_data() const noexcept {
+            return data;
+        }
+
+        size_t get_size() const noexcept {
+            return size;
+        }
+
+        /// <summary>
+        /// Hints that a range is about to be read, so the OS starts paging it in ahead of the copy.
+        /// </summary>
+        void prefetch( uint64_t offset, uint64_t length ) const noexcept {
+            if( length == 0 )
+                return;
+#ifdef _WIN32
+            WIN32_MEMORY_RANGE_ENTRY range { const_cast<char*>( data + offset ), static_cast<SIZE_T>( length ) };
+            PrefetchVirtualMemory( GetCurrentProcess(), 1, &range, 0 );
+#else
+            // madvise needs a page-aligned start.
+            const uint64_t page { static_cast<uint64_t>( sysconf( _SC_PAGESIZE ) ) };
+            const uint64_t start { offset & ~( page - 1 ) };
+            madvise( const_cast<char*>( data + start ), static_cast<size_t>( offset + length - start ), MADV_WILLNEED );
+#endif
+        }
+    };
+
+    /// <summary>
+    /// A cooked asset pack, mapped into memory. Its blobs are used where they are in the mapping,
+    /// so loading an asset is a single copy from the page cache into staging memory.
+    ///
+    /// The tables and every range they point to are checked when the pack is opened, so the
+    /// accessors never read outside the file.
+    /// </summary>
+    class AssetPack {
+        MappedFile file;
+        const asset_pack::Header* header;
+        const asset_pack::TextureEntry* textures;
+        const asset_pack::MeshEntry* meshes;
+        const asset_pack::Region* regions;
+        const asset_pack::Attribute* attributes;
+
+    public:
+        explicit AssetPack( const std::filesystem::path& path )
+            : file( path ) {
+            if( file.get_size() < sizeof( asset_pack::Header ) )
+                throw std::runtime_error( "Not an asset pack: " + path.string() );
+
+            header = reinterpret_cast<const asset_pack::Header*>( file.get_data() );
+            if( header->magic != asset_pack::magic )
+                throw std::runtime_error( "Not an asset pack: " + path.string() );
+            if( header->version != asset_pack::version )
+                throw std::runtime_error( "Unsupported asset pack version: " + path.string() );
+
+            textures = get_table<asset_pack::TextureEntry>( header->textures_offset, header->texture_count );
+            meshes = get_table<asset_pack::MeshEntry>( header->meshes_offset, header->mesh_count );
+            regions = get_table<asset_pack::Region>( header->regions_offset, header->region_count );
+            attributes = get_table<asset_pack::Attribute>( header->attributes_offset, header->attribute_count );
+
+            for( const auto& t : get_textures() ) {
+                check_name( t.name );
+                check_range( t.data_offset, t.data_size );
+                if( uint64_t { t.first_region } + t.region_count > header->region_count )
+                    throw std::runtime_error( "A texture's regions are outside of the asset pack." );
+                // get_copy_regions() shifts the extent by each region's level.
+                if( t.level_count > get_full_mip_level_count( t.width, t.height ) )
+                    throw std::runtime_error( "A texture has more levels than its size allows." );
+                for( uint32_t i = 0; i < t.region_count; ++i ) {
+                    const asset_pack::Region& r { regions[t.first_region + i] };
+                    if( r.offset > t.data_size || r.size > t.data_size - r.offset )
+                        throw std::runtime_error( "A texture region is outside of its data." );
+                    if( r.level >= t.level_count || r.layer >= t.layer_count )
+                        throw std::runtime_error( "A texture region is outside of its texture's levels or layers." );
+                }
+            }
+            for( const auto& m : get_meshes() ) {
+                check_name( m.name );
+                check_range( m.vertex_offset, m.vertex_size );
+                check_range( m.index_offset, m.index_size );
+                if( uint64_t { m.first_attribute } + m.attribute_count > header->attribute_count )
+                    throw std::runtime_error( "A mesh's attributes are outside of the asset pack." );
+                // The counts are what the draws read, so they must fit in the ranges checked above.
+                const uint64_t index_size { get_index_size( m.index_type ) };
+                if( index_size == 0 )
+                    throw std::runtime_error( "A mesh's index type isn't 16 or 32 bit." );
+                if( m.index_count * index_size > m.index_size )
+                    throw std::runtime_error( "A mesh's indices are outside of its index data." );
+                if( uint64_t { m.vertex_count } * m.vertex_stride > m.vertex_size )
+                    throw std::runtime_error( "A mesh's vertices are outside of its vertex data." );
+                for( uint32_t i = 0; i < m.attribute_count; ++i ) {
+                    const asset_pack::Attribute& a { attributes[m.first_attribute + i] };
+                    const auto format { format_utils::format_table.find( static_cast<VkFormat>( a.format ) ) };
+                    if( format == format_utils::format_table.end() || format->second.size == 0 )
+                        throw std::runtime_error( "A mesh attribute's format is unknown." );
+                    if( uint64_t { a.offset } + format->second.size > m.vertex_stride )
+                        throw std::runtime_error( "A mesh attribute is outside of its vertex." );
+                }
+            }
+        }
+
+        vk::ArrayProxyNoTemporaries<const asset_pack::TextureEntry> get_textures() const noexcept {
+            return { header->texture_count, textures };
+        }
+
+        vk::ArrayProxyNoTemporaries<const asset_pack::MeshEntry> get_meshes() const noexcept {
+            return { header->mesh_count, meshes };
+        }
+
+        /// <returns>The texture, or null if the pack has none of that name.</returns>
+        const asset_pack::TextureEntry* find_texture( std::string_view name ) const noexcept {
+            for( const auto& t : get_textures() ) {
+                if( name == t.name )
+                    return &t;
+            }
+            return nullptr;
+        }
+
+        /// <returns>The mesh, or null if the pack has none of that name.</returns>
+        const asset_pack::MeshEntry* find_mesh( std::string_view name ) const noexcept {
+            for( const auto& m : get_meshes() ) {
+                if( name == m.name )
+                    return &m;
+            }
+            return nullptr;
+        }
+
+        const asset_pack::TextureEntry& get_texture( std::string_view name ) const {
+            const asset_pack::TextureEntry* t { find_texture( name ) };
+            if( t == nullptr )
+                throw std::runtime_error( "The asset pack has no texture named " + std::string( name ) );
+            return *t;
+        }
+
+        const asset_pack::MeshEntry& get_mesh( std::string_view name ) const {
+            const asset_pack::MeshEntry* m { find_mesh( name ) };
+            if( m == nullptr )
+                throw std::runtime_error( "The asset pack has no mesh named " + std::string( name ) );
+            return *m;
+        }
+
+        /// <summary>
+        /// The texture's texels, pointing into the mapping. Starts paging them in.
+        /// </summary>
+        const char* get_texture_data( const asset_pack::TextureEntry& texture ) const noexcept {
+            file.prefetch( texture.data_offset, texture.data_size );
+            return file.get_data() + texture.data_offset;
+        }
+
+        const char* get_vertex_data( const asset_pack::MeshEntry& mesh ) const noexcept {
+            file.prefetch( mesh.vertex_offset, mesh.vertex_size );
+            return file.get_data() + mesh.vertex_offset;
+        }
+
+        const char* get_index_data( const asset_pack::MeshEntry& mesh ) const noexcept {
+            file.prefetch( mesh.index_offset, mesh.index_size );
+            return file.get_data() + mesh.index_offset;
+        }
+
+        static vk::Format get_format( const asset_pack::TextureEntry& texture ) noexcept {
+            return static_cast<vk::Format>( texture.format );
+        }
+
+        static vk::IndexType get_index_type( const asset_pack::MeshEntry& mesh ) noexcept {
+            return static_cast<vk::IndexType>( mesh.index_type );
+        }
+
+        vk::ImageSubresourceRange get_subresource_range( const asset_pack::TextureEntry& texture ) const noexcept {
+            return vk::ImageSubresourceRange { vk::ImageAspectFlagBits::eColor, 0, texture.level_count, 0, texture.layer_count };
+        }
+
+        /// <summary>
+        /// The copies of every region from a buffer holding the texture's data at buffer_offset.
+        /// </summary>
+        std::vector<vk::BufferImageCopy> get_copy_regions( const asset_pack::TextureEntry& texture, vk::DeviceSize buffer_offset = 0 ) const {
+            std::vector<vk::BufferImageCopy> copies;
+            copies.reserve( texture.region_count );
+            for( uint32_t i = 0; i < texture.region_count; ++i ) {
+                const asset_pack::Region& r { regions[texture.first_region + i] };
+                copies.push_back( vk::BufferImageCopy {
+                    buffer_offset + r.offset,
+                    0,
+                    0,
+                    vk::ImageSubresourceLayers { vk::ImageAspectFlagBits::eColor, r.level, r.layer, 1 },
+                    vk::Offset3D { 0, 0, 0 },
+                    vk::Extent3D { std::max( texture.width >> r.level, 1u ), std::max( texture.height >> r.level, 1u ), 1 }
+                } );
+            }
+            return copies;
+        }
+
+        /// <summary>
+        /// The mesh's vertex attributes, all read from one binding of vertex_stride bytes.
+        /// </summary>
+        std::vector<vk::VertexInputAttributeDescription> get_vertex_attributes( const asset_pack::MeshEntry& mesh, uint32_t binding = 0 ) const {
+            std::vector<vk::VertexInputAttributeDescription> descriptions;
+            descriptions.reserve( mesh.attribute_count );
+            for( uint32_t i = 0; i < mesh.attribute_count; ++i ) {
+                const asset_pack::Attribute& a { attributes[mesh.first_attribute + i] };
+                descriptions.push_back( vk::VertexInputAttributeDescription { a.location, binding, static_cast<vk::Format>( a.format ), a.offset } );
+            }
+            return descriptions;
+        }
+
+    private:
+        template <typename T>
+        const T* get_table( uint64_t offset, uint32_t count ) const {
+            check_range( offset, sizeof( T ) * uint64_t { count } );
+            if( offset % alignof( T ) != 0 )
+                throw std::runtime_error( "An asset pack table is misaligned." );
+            return reinterpret_cast<const T*>( file.get_data() + offset );
+        }
+
+        void check_range( uint64_t offset, uint64_t size ) const {
+            if( offset > file.get_size() || size > file.get_size() - offset )
+                throw std::runtime_error( "An asset pack range is outside of the file." );
+        }
+
+        /// The bytes of an index of the type, or 0 if the pack can't hold it.
+        static uint64_t get_index_size( uint32_t index_type ) noexcept {
+            switch( static_cast<vk::IndexType>( index_type ) ) {
+            case vk::IndexType::eUint16: return 2;
+            case vk::IndexType::eUint32: return 4;
+            default: return 0;
+            }
+        }
+
+        static void check_name( const char ( &name )[asset_pack::name_size] ) {
+            if( std::memchr( name, 0, asset_pack::name_size ) == nullptr )
+                throw std::runtime_error( "An asset pack name isn't terminated." );
+        }
+    };
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace stlr {
+    /// <summary>
+    /// One descriptor set holding every texture and storage buffer in large update-after-bind
+    /// arrays, indexed from shaders with the handles returned when resources are added.
+    ///
+    /// The set is bound once per frame (per pipeline layout) instead of per draw; draws pass
+    /// their handles in push constants or buffers. Descriptors are only written when a resource
+    /// is added, and a removed handle isn't reused until every frame that could still index it
+    /// has finished.
+    ///
+    /// In GLSL (with GL_EXT_nonuniform_qualifier):
+    ///     layout( set = 0, binding = 0 ) uniform sampler2D textures[];
+    ///     layout( set = 0, binding = 1 ) buffer Buffers { uint data[]; } buffers[];
+    /// </summary>
+    class BindlessDescriptors {
+    public:
+        using Handle = uint32_t;
+        static constexpr Handle invalid_handle = UINT32_MAX;
+
+        static constexpr uint32_t texture_binding = 0;
+        static constexpr uint32_t buffer_binding = 1;
+
+    private:
+        struct Array {
+            uint32_t capacity = 0;
+            /// Handles below this have been handed out at least once.
+            uint32_t high_water = 0;
+            std::vector<Handle> free_handles;
+            /// Handles removed while each frame was recorded, freed when the frame comes around again.
+            std::vector<std::vector<Handle>> retired_handles;
+        };
+
+        vk::Device device;
+        vk::UniqueDescriptorSetLayout layout;
+        vk::UniqueDescriptorPool pool;
+        vk::DescriptorSet set;
+        Array textures;
+        Array buffers;
+        uint32_t current_frame;
+        std::mutex mutex;
+
+    public:
+        /// <summary>
+        /// Checks the Vulkan 1.2 descriptor indexing features the set needs.
+        /// </summary>
+        static bool is_supported( const vk::PhysicalDeviceVulkan12Features& features ) noexcept {
+            return features.runtimeDescriptorArray
+                && features.descriptorBindingPartiallyBound
+                && features.descriptorBindingUpdateUnusedWhilePending
+                && features.descriptorBindingSampledImageUpdateAfterBind
+                && features.descriptorBindingStorageBufferUpdateAfterBind
+                && features.shaderSampledImageArrayNonUniformIndexing
+                && features.shaderStorageBufferArrayNonUniformIndexing;
+        }
+
+        /// <summary>
+        /// Creates the set layout, pool and set. The features checked by is_supported() must be enabled.
+        /// </summary>
+        /// <param name="frame_count">The number of frames in flight, which decides how long removed handles wait to be reused.</param>
+        /// <param name="max_textures">The size of the texture array, clamped to the device's limit.</param>
+        /// <param name="max_buffers">The size of the storage buffer array, clamped to the device's limit.</param>
+        BindlessDescriptors( vk::PhysicalDevice physical_device, vk::Device device, uint32_t frame_count, uint32_t max_textures = 16384, uint32_t max_buffers = 4096 );
+
+        BindlessDescriptors( const BindlessDescriptors& ) = delete;
+        BindlessDescriptors& operator=( const BindlessDescriptors& ) = delete;
+
+        vk::DescriptorSetLayout get_layout() const noexcept {
+            return layout.get();
+        }
+
+        vk::DescriptorSet get_set() const noexcept {
+            return set;
+        }
+
+        /// <summary>
+        /// Makes the handles removed during the frame's previous use available again. The frame's
+        /// fence must have been waited on.
+        /// </summary>
+        void begin_frame( uint32_t frame_index );
+
+        /// <summary>
+        /// Writes a combined image sampler into the texture array.
+        /// </summary>
+        /// <returns>The index of the texture in the array, or invalid_handle if it's full.</returns>
+        Handle add_texture( vk::ImageView view, vk::Sampler sampler, vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal );
+
+        /// <summary>
+        /// Writes a storage buffer range into the buffer array.
+        /// </summary>
+        /// <returns>The index of the buffer in the array, or invalid_handle if it's full.</returns>
+        Handle add_buffer( vk::Buffer buffer, vk::DeviceSize offset = 0, vk::DeviceSize range = VK_WHOLE_SIZE );
+
+        /// <summary>
+        /// Releases a handle. The resource must stay alive until the frames in flight have finished;
+        /// to replace a resource, add the new one and remove the old handle.
+        /// </summary>
+        void remove_texture( Handle handle );
+        void remove_buffer( Handle handle );
+
+        /// <summary>
+        /// Binds the set. Pipeline layouts that share it as their first set stay compatible, so
+        /// binding it once per frame covers every pipeline bound afterwards.
+        /// </summary>
+        void bind( vk::CommandBuffer command_buffer, vk::PipelineBindPoint bind_point, vk::PipelineLayout pipeline_layout, uint32_t set_index = 0 ) const {
+            command_buffer.bindDescriptorSets( bind_point, pipeline_layout, set_index, set, nullptr );
+        }
+
+    private:
+        static Handle allocate_handle( Array& array );
+    };
+}
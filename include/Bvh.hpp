@@ -0,0 +1,148 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace stlr {
+    /// <summary>
+    /// A bounding volume hierarchy over scene objects' axis aligned boxes, for culling, picking and
+    /// overlap queries on the CPU.
+    ///
+    /// Every node has up to four children, and stores their boxes rather than its own, one array
+    /// per coordinate. A traversal step loads a single node and tests all four boxes at once with
+    /// SSE, and only descends into the children that pass. A child is either another node or a
+    /// single object. Nodes are laid out parent first, so refit() can walk them backwards and update
+    /// the boxes of only the nodes above objects that moved.
+    ///
+    /// Refitting keeps the tree's shape, which gets looser as objects move far from where they
+    /// were when it was built; call build() again when that happens.
+    ///
+    /// Not thread-safe, but the const queries can run in parallel with each other.
+    /// </summary>
+    class Bvh {
+    public:
+        using ObjectId = uint32_t;
+
+        struct Aabb {
+            std::array<float, 3> min;
+            std::array<float, 3> max;
+        };
+
+        /// <summary>
+        /// Left, right, bottom, top, near and far planes as (normal, distance) with unit normals
+        /// pointing inwards, as GpuCulling::get_frustum() extracts them.
+        /// </summary>
+        using Frustum = std::array<std::array<float, 4>, 6>;
+
+        struct Ray {
+            std::array<float, 3> origin;
+            std::array<float, 3> direction;
+            float max_distance;
+        };
+
+        struct Hit {
+            ObjectId object;
+            /// Where the ray enters the object's box, in multiples of its direction.
+            float distance;
+        };
+
+    private:
+        static constexpr uint32_t invalid_index = UINT32_MAX;
+        /// Set on a child that's an object rather than a node.
+        static constexpr uint32_t object_bit = 0x80000000u;
+
+        /// <summary>
+        /// The boxes of up to four children. Unused slots come after the used ones.
+        /// </summary>
+        struct alignas( 16 ) Node {
+            std::array<float, 4> min_x;
+            std::array<float, 4> min_y;
+            std::array<float, 4> min_z;
+            std::array<float, 4> max_x;
+            std::array<float, 4> max_y;
+            std::array<float, 4> max_z;
+            std::array<uint32_t, 4> children;
+            uint32_t child_count;
+            uint32_t parent;
+            /// The objects under the node are order[first, first + count).
+            uint32_t first;
+            uint32_t count;
+        };
+        static_assert( sizeof( Node ) == 128, "A node should take two cache lines." );
+
+        /// The slot an object's box is stored in.
+        struct Location {
+            uint32_t node;
+            uint32_t slot;
+        };
+
+        std::vector<Node> nodes;
+        std::vector<ObjectId> order;
+        std::vector<Aabb> boxes;
+        std::vector<Location> locations;
+        std::vector<uint8_t> dirty;
+
+    public:
+        Bvh() = default;
+
+        /// <summary>
+        /// Builds the tree over boxes; an object's id is its index in them.
+        /// </summary>
+        void build( std::vector<Aabb> object_boxes );
+
+        /// <summary>
+        /// Moves an object's box. Queries are only exact again after the next refit(): until then the
+        /// nodes above it keep their old boxes, so a query can miss the object where it moved to.
+        /// </summary>
+        void update( ObjectId object, const Aabb& box );
+
+        /// <summary>
+        /// Updates the boxes of the nodes above the objects updated since the last refit.
+        /// </summary>
+        void refit();
+
+        /// <summary>
+        /// Appends the objects whose boxes intersect or are inside the frustum.
+        /// </summary>
+        void cull( const Frustum& frustum, std::vector<ObjectId>& visible ) const;
+
+        /// <summary>
+        /// Appends the objects whose boxes overlap box.
+        /// </summary>
+        void query( const Aabb& box, std::vector<ObjectId>& result ) const;
+
+        /// <summary>
+        /// Appends the objects whose boxes the ray passes through, in no particular order.
+        /// </summary>
+        void query( const Ray& ray, std::vector<Hit>& result ) const;
+
+        /// <summary>
+        /// The object whose box the ray enters first, if any.
+        /// </summary>
+        std::optional<Hit> raycast( const Ray& ray ) const;
+
+        uint32_t get_object_count() const noexcept {
+            return static_cast<uint32_t>( boxes.size() );
+        }
+
+        const Aabb& get_box( ObjectId object ) const noexcept {
+            return boxes[object];
+        }
+
+        /// <summary>
+        /// The box around every object, as of the last refit.
+        /// </summary>
+        Aabb get_bounds() const noexcept;
+
+    private:
+        uint32_t build_node( uint32_t first, uint32_t count, uint32_t parent );
+        /// Sorts order[first, first + count) about its median along the longest axis of the centers.
+        /// Returns the number of objects in the first half.
+        uint32_t split( uint32_t first, uint32_t count );
+        Aabb get_node_bounds( uint32_t node ) const noexcept;
+        void set_slot( uint32_t node, uint32_t slot, const Aabb& box ) noexcept;
+        void append_objects( const Node& node, std::vector<ObjectId>& result ) const;
+    };
+}
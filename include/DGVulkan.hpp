@@ -9,8 +9,22 @@
 
 #include <vulkan/vulkan.hpp>
 #include <fstream>
+#include <cstring>
 #include <GLFW/glfw3.h>
 #include <GLFW/glfw3native.h>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include "MemoryAllocator.hpp"
+#include "PipelineCache.hpp"
+#include "UniformRing.hpp"
+#include "DescriptorUpdateTemplate.hpp"
+#include "MipmapGenerator.hpp"
+#include "TextureFile.hpp"
+#include "ImageLoader.hpp"
+#include "AssetPack.hpp"
+#include "VertexLayout.hpp"
+#include "SwapchainSettings.hpp"
 //#include "Timer.hpp"
 
 namespace DG {
@@ -23,10 +37,10 @@ namespace DG {
 		T _object;
 		vk::DeviceSize _deviceSize;
 		vk::MemoryRequirements _memoryRequirements;
-		vk::DeviceMemory _deviceMemory;
+		stlr::MemoryAllocator::Allocation _allocation;
 
 	protected:
-		Resource(T obj, vk::DeviceSize devSize, vk::MemoryRequirements memReqs, vk::DeviceMemory devMem) : _object(obj), _deviceSize(devSize), _memoryRequirements(memReqs), _deviceMemory(devMem) {
+		Resource(T obj, vk::DeviceSize devSize, vk::MemoryRequirements memReqs, stlr::MemoryAllocator::Allocation allocation) : _object(obj), _deviceSize(devSize), _memoryRequirements(memReqs), _allocation(allocation) {
 			static_assert(std::is_same_v<T, vk::Buffer> || std::is_same_v<T, vk::Image>, "Resource must be a buffer or an image.");
 		}
 	};
@@ -37,13 +51,27 @@ namespace DG {
 		uint32_t _channels;
 		vk::Format _format;
 		vk::ImageLayout _imageLayout;
+		uint32_t _mipLevels;
 
-		Image(vk::Image image, vk::DeviceSize devSize, vk::MemoryRequirements memReqs, vk::DeviceMemory devMem, uint32_t width, uint32_t height, uint32_t channels, vk::Format format, vk::ImageLayout layout) : Resource<vk::Image>(image, devSize, memReqs, devMem), _width(width), _height(height), _channels(channels), _format(format), _imageLayout(layout) {}
+		Image(vk::Image image, vk::DeviceSize devSize, vk::MemoryRequirements memReqs, stlr::MemoryAllocator::Allocation allocation, uint32_t width, uint32_t height, uint32_t channels, vk::Format format, vk::ImageLayout layout, uint32_t mipLevels = 1) : Resource<vk::Image>(image, devSize, memReqs, allocation), _width(width), _height(height), _channels(channels), _format(format), _imageLayout(layout), _mipLevels(mipLevels) {}
 	};
 
 	struct Buffer : Resource<vk::Buffer> {
 
-		Buffer(vk::Buffer buffer, vk::DeviceSize devSize, vk::MemoryRequirements memReqs, vk::DeviceMemory devMem) : Resource<vk::Buffer>(buffer, devSize, memReqs, devMem) {}
+		Buffer(vk::Buffer buffer, vk::DeviceSize devSize, vk::MemoryRequirements memReqs, stlr::MemoryAllocator::Allocation allocation) : Resource<vk::Buffer>(buffer, devSize, memReqs, allocation) {}
+	};
+
+	/// <summary>
+	/// The vertex and index buffers of a mesh loaded from an asset pack.
+	/// </summary>
+	struct Mesh {
+		Buffer _vertexBuffer;
+		Buffer _indexBuffer;
+		uint32_t _vertexCount;
+		uint32_t _indexCount;
+		vk::IndexType _indexType;
+
+		Mesh(Buffer vertexBuffer, Buffer indexBuffer, uint32_t vertexCount, uint32_t indexCount, vk::IndexType indexType) : _vertexBuffer(vertexBuffer), _indexBuffer(indexBuffer), _vertexCount(vertexCount), _indexCount(indexCount), _indexType(indexType) {}
 	};
 
 	template <typename T, typename E>
@@ -147,6 +175,52 @@ namespace DG {
 		void add_vertex_input_attribute(uint32_t binding, uint32_t location, vk::Format format, uint32_t offset) {
 			_vertexInputAttributeDescriptions.push_back(vk::VertexInputAttributeDescription(location, binding, format, offset));
 		}
+
+		/// <summary>
+		/// Adds a binding and its attributes described by a stlr::VertexLayout, so the stride, formats and offsets come from the vertex struct.
+		/// </summary>
+		/// <param name="binding">The vertex input binding the vertices are read from.</param>
+		/// <param name="rate">Whether the binding advances per vertex or per instance.</param>
+		/// <param name="firstLocation">The shader location of the struct's first member; the rest follow it.</param>
+		template <typename Layout>
+		void add_vertex_layout(uint32_t binding, vk::VertexInputRate rate = vk::VertexInputRate::eVertex, uint32_t firstLocation = 0) {
+			_vertexInputBindingDescriptions.push_back(Layout::get_binding(binding, rate));
+			for (const auto& attribute : Layout::get_attributes(binding, firstLocation)) {
+				_vertexInputAttributeDescriptions.push_back(attribute);
+			}
+		}
+	};
+
+	/// <summary>
+	/// The objects needed to record and submit one frame while other frames are still in flight.
+	/// </summary>
+	struct Frame {
+		vk::CommandBuffer _commandBuffer;
+		vk::Semaphore _imageAcquiredSemaphore;
+		vk::Semaphore _imageReadySemaphore;
+		vk::Fence _fence;
+
+		Frame(vk::CommandBuffer commandBuffer, vk::Semaphore imageAcquiredSemaphore, vk::Semaphore imageReadySemaphore, vk::Fence fence) : _commandBuffer(commandBuffer), _imageAcquiredSemaphore(imageAcquiredSemaphore), _imageReadySemaphore(imageReadySemaphore), _fence(fence) {}
+	};
+
+	/// <summary>
+	/// One submission of upload_loaded_images(), with everything the GPU reads from until its fence signals.
+	/// </summary>
+	struct ImageUpload {
+		vk::CommandBuffer _commandBuffer;
+		vk::Fence _fence;
+		std::vector<stlr::ImageLoader::Decoded> _decoded;
+		std::vector<std::pair<stlr::ImageLoader::Handle, Image>> _images;
+		std::vector<stlr::MipmapGenerator::Resources> _mipmapResources;
+	};
+
+	/// <summary>
+	/// A swapchain replaced by recreate_swapchain(), kept until the frames that presented to it are done.
+	/// </summary>
+	struct RetiredSwapchain {
+		vk::SwapchainKHR _swapchain;
+		// The frame it was replaced in.
+		uint64_t _frame;
 	};
 
 	class DGVulkan {
@@ -156,6 +230,7 @@ namespace DG {
 		vk::PhysicalDevice _physicalDevice;
 		vk::PhysicalDeviceMemoryProperties _physicalDeviceMemoryProperties;
 		vk::Device _device;
+		std::unique_ptr<stlr::MemoryAllocator> _allocator;
 		vk::Queue _queue;
 		vk::CommandPool _commandPool;
 		vk::CommandBuffer _commandBuffer;
@@ -163,28 +238,66 @@ namespace DG {
 		vk::SurfaceCapabilitiesKHR _surfaceCapabilites;
 		vk::SurfaceFormatKHR _surfaceFormat;
 		vk::SwapchainKHR _swapchain;
+		std::vector<RetiredSwapchain> _retiredSwapchains;
+		stlr::SwapchainSettings _swapchainSettings;
+		vk::PresentModeKHR _presentMode;
+		vk::Extent2D _swapchainExtent;
+		// The window's size when the swapchain was last created, to notice resizes the surface doesn't report.
+		vk::Extent2D _windowExtent;
+		bool _swapchainOutdated = false;
 		std::vector<vk::Image> _swapchainImages;
 		std::vector<vk::ImageView> _swapchainImageViews;
 		vk::Image _depthImage;
 		vk::ImageView _depthImageView;
+		vk::Format _depthFormat = vk::Format::eUndefined;
+		// The depth image created at the new size when the swapchain is recreated; the first one belongs to the caller.
+		std::optional<Image> _resizedDepthImage;
 		vk::Sampler _sampler;
 		vk::DescriptorPool _descriptorPool;
 		vk::DescriptorSetLayout _descriptorSetLayout;
+		std::vector<vk::DescriptorSetLayoutBinding> _descriptorSetLayoutBindings;
 		vk::DescriptorSet _descriptorSet;
+		std::unique_ptr<stlr::DescriptorUpdateTemplate> _descriptorUpdateTemplate;
+		bool _descriptorUpdateTemplates = false;
 		vk::RenderPass _renderPass;
 		std::vector<vk::Framebuffer> _framebuffers;
 		vk::ShaderModule _vertexShaderModule;
 		vk::ShaderModule _fragmentShaderModule;
 		vk::PipelineLayout _pipelineLayout;
+		std::unique_ptr<stlr::UniformRing> _uniformRing;
+		std::vector<char> _constants;
+		vk::ShaderStageFlags _constantStages;
+		bool _pushConstants = false;
+		std::unique_ptr<stlr::PipelineCache> _pipelineCache;
+		std::unique_ptr<stlr::MipmapGenerator> _mipmapGenerator;
+		std::vector<stlr::MipmapGenerator::Resources> _mipmapResources;
+		std::unique_ptr<stlr::ImageLoader> _imageLoader;
+		std::unordered_map<stlr::ImageLoader::Handle, vk::Format> _loadingImageFormats;
+		std::vector<ImageUpload> _imageUploads;
+		std::unordered_map<stlr::ImageLoader::Handle, Image> _loadedImages;
+		std::optional<Image> _placeholderImage;
+		bool _pipelineCreationFeedback = false;
 		vk::Pipeline _pipeline;
-		vk::Semaphore _imageAcquiredSemaphore;
-		vk::Semaphore _imageReadySemaphore;
-		vk::Fence _fence;
+		std::vector<Frame> _frames;
+		uint32_t _frameIndex = 0;
+		// Frames rendered so far, to tell when a retired swapchain is no longer presented from.
+		uint64_t _frameNumber = 0;
 		vk::Viewport _viewport;
 		vk::Rect2D _scissor;
 		vk::Buffer* _vertexBuffer;
 		vk::Buffer* _indexBuffer;
 		uint32_t _indexCount;
+		vk::IndexType _indexType = vk::IndexType::eUint32;
+		vk::Buffer* _instanceBuffer = nullptr;
+		uint32_t _instanceBinding = 1;
+		uint32_t _instanceCount = 1;
+		vk::Buffer* _indirectBuffer = nullptr;
+		vk::DeviceSize _indirectOffset = 0;
+		uint32_t _maxDrawCount = 0;
+		vk::Buffer* _drawCountBuffer = nullptr;
+		vk::DeviceSize _drawCountOffset = 0;
+		bool _multiDrawIndirect = false;
+		bool _drawIndirectCount = false;
 		uint32_t _imageIndex;
 
 	public:
@@ -217,9 +330,20 @@ namespace DG {
             #endif
 			};
 
+			// The newest of Vulkan 1.2 and 1.1 the loader has is asked for, for descriptor update templates and indirect draw counts.
+			auto instanceVersion = vk::enumerateInstanceVersion();
+			auto apiVersion = instanceVersion >= VK_API_VERSION_1_2 ? VK_API_VERSION_1_2 : instanceVersion >= VK_API_VERSION_1_1 ? VK_API_VERSION_1_1 : VK_API_VERSION_1_0;
+			auto applicationInfo = vk::ApplicationInfo(
+				"DGVulkan",
+				1,
+				"DGVulkan",
+				1,
+				apiVersion
+			);
+
 			auto instanceCI = vk::InstanceCreateInfo(
 				vk::InstanceCreateFlags(),
-				nullptr,
+				&applicationInfo,
 				layerNames.size(),
 				layerNames.data(),
 				extensionNames.size(),
@@ -230,12 +354,27 @@ namespace DG {
 
 			_physicalDevice = _instance.enumeratePhysicalDevices().front();
 			_physicalDeviceMemoryProperties = _physicalDevice.getMemoryProperties();
+			_descriptorUpdateTemplates = instanceVersion >= VK_API_VERSION_1_1 && _physicalDevice.getProperties().apiVersion >= VK_API_VERSION_1_1;
 			
-			//auto deviceExtensions = _physicalDevice.enumerateDeviceExtensionProperties();
 			std::vector<const char*> deviceExtensionNames = {
 				VK_KHR_SWAPCHAIN_EXTENSION_NAME
 			};
+			// Creation feedback lets the pipeline cache report its hit rate.
+			for (const auto& e : _physicalDevice.enumerateDeviceExtensionProperties()) {
+				if (std::strcmp(e.extensionName, VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME) == 0) {
+					deviceExtensionNames.push_back(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+					_pipelineCreationFeedback = true;
+				}
+			}
 			auto physicalDeviceFeatures = _physicalDevice.getFeatures();
+			_multiDrawIndirect = physicalDeviceFeatures.multiDrawIndirect;
+			// vkCmdDrawIndexedIndirectCount is core in 1.2, behind the drawIndirectCount feature.
+			auto vulkan12Features = vk::PhysicalDeviceVulkan12Features();
+			if (instanceVersion >= VK_API_VERSION_1_2 && _physicalDevice.getProperties().apiVersion >= VK_API_VERSION_1_2) {
+				auto supported12Features = _physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>().get<vk::PhysicalDeviceVulkan12Features>();
+				vulkan12Features.drawIndirectCount = supported12Features.drawIndirectCount;
+				_drawIndirectCount = supported12Features.drawIndirectCount;
+			}
 			float queuePriority = 1.0f;
 			vk::DeviceQueueCreateInfo deviceQueueCI = vk::DeviceQueueCreateInfo(
 				vk::DeviceQueueCreateFlags(),
@@ -253,7 +392,11 @@ namespace DG {
 				deviceExtensionNames.data(),
 				&physicalDeviceFeatures
 			);
+			if (_drawIndirectCount)
+				deviceCI.setPNext(&vulkan12Features);
 			_device = _physicalDevice.createDevice(deviceCI);
+			// On a 1.0 instance or device the allocator sticks to the 1.0 memory requirement queries.
+			_allocator = std::make_unique<stlr::MemoryAllocator>(_physicalDevice, _device, apiVersion);
 			
 			_queue = _device.getQueue(0, 0);
 
@@ -267,6 +410,24 @@ namespace DG {
 			_commandBuffer = _device.allocateCommandBuffers(commandBufferAI).front();
 		}
 
+		/// <summary>
+		/// Waits for the frames in flight and any other submitted work to finish, so that nothing the GPU
+		/// is still using is destroyed with the members or by the caller afterwards.
+		/// </summary>
+		~DGVulkan() {
+			if (!_device)
+				return;
+
+			_device.waitIdle();
+			for (auto& upload : _imageUploads) {
+				for (auto& d : upload._decoded)
+					_imageLoader->free_staging(d);
+				_device.destroyFence(upload._fence);
+			}
+			for (auto& r : _retiredSwapchains)
+				_device.destroySwapchainKHR(r._swapchain);
+		}
+
         GLFWwindow* get_window(){
             return _glfwWindow;
         }
@@ -277,19 +438,37 @@ namespace DG {
 		vk::Format get_surface_format() {
 			return _surfaceFormat.format;
 		}
+		vk::Sampler get_sampler() {
+			return _sampler;
+		}
 
         uint32_t get_surface_width(){
-            return _surfaceCapabilites.currentExtent.width;
+            return _swapchainExtent.width;
         }
 
         uint32_t get_surface_height(){
-            return _surfaceCapabilites.currentExtent.height;
+            return _swapchainExtent.height;
         }
+
+		vk::PresentModeKHR get_present_mode() {
+			return _presentMode;
+		}
+
 		/// <summary>
-		/// Initiates the surface and swapchain using the default information obtained from the surface.
+		/// Changes the present policy, image count or frame latency. The swapchain is recreated with them before the next frame.
 		/// </summary>
-		/// <param name="hwnd">The window's handle.</param>
-        void init_surface_and_swapchain() {
+		void set_swapchain_settings(const stlr::SwapchainSettings& settings) {
+			_swapchainSettings = settings;
+			_swapchainOutdated = true;
+		}
+
+		/// <summary>
+		/// Initiates the surface and a swapchain whose format, present mode and image count are chosen by the settings
+		/// from what the surface supports.
+		/// </summary>
+		/// <param name="settings">The present policy, image count and frame latency limit.</param>
+        void init_surface_and_swapchain(const stlr::SwapchainSettings& settings = {}) {
+			_swapchainSettings = settings;
 
 #ifdef VK_USE_PLATFORM_WIN32_KHR
 			vk::Win32SurfaceCreateInfoKHR win32SurfaceCI = vk::Win32SurfaceCreateInfoKHR(vk::Win32SurfaceCreateFlagsKHR(), nullptr, hwnd);
@@ -301,32 +480,14 @@ namespace DG {
             _surface = _instance.createXlibSurfaceKHR(xlibSurfaceCI);
 #endif
 			auto surfaceSupported = _physicalDevice.getSurfaceSupportKHR(0, _surface);
-			_surfaceCapabilites = _physicalDevice.getSurfaceCapabilitiesKHR(_surface);
-			_surfaceFormat = _physicalDevice.getSurfaceFormatsKHR(_surface).front();
-			auto ci = vk::SwapchainCreateInfoKHR(
-				vk::SwapchainCreateFlagsKHR(),
-				_surface,
-				_surfaceCapabilites.minImageCount,
-				_surfaceFormat.format,
-				_surfaceFormat.colorSpace,
-				_surfaceCapabilites.currentExtent,
-				1,
-				vk::ImageUsageFlagBits::eColorAttachment,
-				vk::SharingMode::eExclusive,
-				0,
-				nullptr,
-				_surfaceCapabilites.currentTransform,
-				vk::CompositeAlphaFlagBitsKHR::eOpaque,
-                vk::PresentModeKHR::eImmediate,
-				VK_TRUE,
-				nullptr
-			);
-			
-			_swapchain = _device.createSwapchainKHR(ci);
+			_surfaceFormat = _swapchainSettings.choose_format(_physicalDevice, _physicalDevice.getSurfaceFormatsKHR(_surface));
+			_windowExtent = get_window_extent();
+			create_swapchain(nullptr);
 		}
 
 		void init_swapchain_image_views() {
 			_swapchainImages = _device.getSwapchainImagesKHR(_swapchain);
+			_swapchainImageViews.clear();
 
 			for (auto& i : _swapchainImages) {
 				auto ci = vk::ImageViewCreateInfo(
@@ -344,6 +505,7 @@ namespace DG {
 
 		void init_depth_image_and_view(Image* image) {
 			_depthImage = image->_object;
+			_depthFormat = image->_format;
 			auto ci = vk::ImageViewCreateInfo(
 				vk::ImageViewCreateFlags(),
 				_depthImage,
@@ -356,7 +518,34 @@ namespace DG {
 			_depthImageView = _device.createImageView(ci);
 		}
 
+		/// <summary>
+		/// Initiates the mipmap generator used by cmd_generate_mipmaps().
+		/// </summary>
+		/// <param name="computeShaderFile">The compiled mip-cs.comp, only loaded for formats that blits can't filter.</param>
+		void init_mipmap_generator(std::string computeShaderFile) {
+			_mipmapGenerator = std::make_unique<stlr::MipmapGenerator>(_physicalDevice, _device, computeShaderFile);
+		}
+
+		/// <summary>
+		/// The number of mip levels a sampled image of the format should be created with; 1 if they can't be generated for it.
+		/// The mipmap generator must be already initialized.
+		/// </summary>
+		uint32_t get_mip_level_count(uint32_t width, uint32_t height, vk::Format format) {
+			return _mipmapGenerator->get_mip_level_count(format, width, height);
+		}
+
+		/// <summary>
+		/// The usage an image of the format needs for cmd_generate_mipmaps().
+		/// </summary>
+		vk::ImageUsageFlags get_mipmap_usage(vk::Format format) {
+			return _mipmapGenerator->get_required_usage(format);
+		}
+
+		/// <summary>
+		/// Initiates a trilinear sampler over every mip level, with the device's highest anisotropy when it supports anisotropic filtering.
+		/// </summary>
 		void init_sampler() {
+			auto anisotropy = _physicalDevice.getFeatures().samplerAnisotropy;
 			auto ci = vk::SamplerCreateInfo(
 				vk::SamplerCreateFlags(),
 				vk::Filter::eLinear,
@@ -366,12 +555,12 @@ namespace DG {
 				vk::SamplerAddressMode::eRepeat,
 				vk::SamplerAddressMode::eRepeat,
 				0.0f,
-				false,
-				0.0f,
+				anisotropy,
+				anisotropy ? _physicalDevice.getProperties().limits.maxSamplerAnisotropy : 1.0f,
 				false,
 				vk::CompareOp::eNever,
 				0.0f,
-				0.0f,
+				VK_LOD_CLAMP_NONE,
 				vk::BorderColor::eIntOpaqueBlack,
 				false
 			);
@@ -406,6 +595,7 @@ namespace DG {
 			);
 
 			_descriptorSetLayout = _device.createDescriptorSetLayout(ci);
+			_descriptorSetLayoutBindings = bindings._bindings;
 		}
 
 		/// <summary>
@@ -416,6 +606,14 @@ namespace DG {
 			_descriptorSet = _device.allocateDescriptorSets(ai).front();
 		}
 
+		/// <summary>
+		/// Initiates the update template that writes the whole descriptor set from one struct; see update_descriptor_set().
+		/// The descriptor set layout must be already initialized.
+		/// </summary>
+		void init_descriptor_update_template() {
+			_descriptorUpdateTemplate = std::make_unique<stlr::DescriptorUpdateTemplate>(_device, _descriptorSetLayout, _descriptorSetLayoutBindings, _descriptorUpdateTemplates);
+		}
+
 		void init_render_pass(RenderPassAttachments attachments) {
 			auto s = vk::SubpassDescription(
 				vk::SubpassDescriptionFlags(),
@@ -444,6 +642,7 @@ namespace DG {
 		}
 
 		void init_framebuffers() {
+			_framebuffers.clear();
 			for (auto& i : _swapchainImageViews) {
 				auto attachments = std::array<vk::ImageView, 2>{i, _depthImageView};
 				auto ci = vk::FramebufferCreateInfo(
@@ -451,8 +650,8 @@ namespace DG {
 					_renderPass,
 					attachments.size(),
 					attachments.data(),
-					_surfaceCapabilites.currentExtent.width,
-					_surfaceCapabilites.currentExtent.height,
+					_swapchainExtent.width,
+					_swapchainExtent.height,
 					1
 				);
 
@@ -495,6 +694,66 @@ namespace DG {
 			_pipelineLayout = _device.createPipelineLayout(ci);
 		}
 
+		/// <summary>
+		/// Initiates the uniform ring that constants too large to push are copied into, with a region per frame in flight.
+		/// </summary>
+		/// <param name="framesInFlight">The number of frames init_sync_objects will create.</param>
+		/// <param name="sizePerFrame">The bytes of constants each frame can use.</param>
+		void init_uniform_ring(uint32_t framesInFlight, vk::DeviceSize sizePerFrame = 1 << 20) {
+			_uniformRing = std::make_unique<stlr::UniformRing>(_physicalDevice, _device, *_allocator, framesInFlight, sizePerFrame);
+		}
+
+		/// <summary>
+		/// Initiates the pipeline layout with per-draw constants of type T after the descriptor set.
+		/// Constants of up to 128 bytes are push constants; larger ones are read from set 1, binding 0,
+		/// a dynamic uniform buffer in the uniform ring, which must be initiated first.
+		/// </summary>
+		/// <typeparam name="T">The constants' type, matching the shader's push constant or uniform block.</typeparam>
+		/// <param name="stages">The shader stages that read the constants.</param>
+		template<typename T>
+		void init_pipeline_layout_with_constants(vk::ShaderStageFlags stages) {
+			_constantStages = stages;
+			_pushConstants = stlr::UniformRing::uses_push_constants<T>();
+
+			auto setLayouts = std::vector<vk::DescriptorSetLayout>{ _descriptorSetLayout };
+			auto pushConstantRange = vk::PushConstantRange(stages, 0, sizeof(T));
+			if (!_pushConstants) {
+				if (!_uniformRing)
+					throw std::logic_error("The uniform ring must be initiated for constants larger than 128 bytes.");
+				setLayouts.push_back(_uniformRing->get_set_layout());
+			}
+
+			auto ci = vk::PipelineLayoutCreateInfo(
+				vk::PipelineLayoutCreateFlags(),
+				setLayouts.size(),
+				setLayouts.data(),
+				_pushConstants ? 1 : 0,
+				_pushConstants ? &pushConstantRange : nullptr
+			);
+
+			_pipelineLayout = _device.createPipelineLayout(ci);
+		}
+
+		/// <summary>
+		/// Sets the constants drawn with from the next render() on. Unlike writing a uniform buffer,
+		/// this doesn't need to wait for the frames in flight.
+		/// </summary>
+		template<typename T>
+		void set_constants(const T& constants) {
+			static_assert(std::is_trivially_copyable_v<T>, "Constants are copied byte for byte.");
+			_constants.resize(sizeof(T));
+			std::memcpy(_constants.data(), &constants, sizeof(T));
+		}
+
+		/// <summary>
+		/// Initiates the pipeline cache, loading it from a file that was saved for the same device and driver.
+		/// The cache is written back to the file when the DGVulkan is destroyed.
+		/// </summary>
+		/// <param name="filePath">The file to load from and save to. An empty path keeps the cache in memory.</param>
+		void init_pipeline_cache(std::string filePath) {
+			_pipelineCache = std::make_unique<stlr::PipelineCache>(_physicalDevice, _device, filePath, _pipelineCreationFeedback);
+		}
+
 		void init_pipeline(Pipeline pipeline) {
 			auto vertexShaderStage = vk::PipelineShaderStageCreateInfo(
 				vk::PipelineShaderStageCreateFlags(),
@@ -615,13 +874,63 @@ namespace DG {
 				0
 			);
 
-			_pipeline = _device.createGraphicsPipeline(vk::PipelineCache(), ci).value;
+			if (!_pipelineCache) {
+				init_pipeline_cache("");
+			}
+			_pipeline = _pipelineCache->create_pipeline(ci);
+		}
+
+		/// <summary>
+		/// Initiates the command buffer, semaphores and fence of each frame that can be in flight.
+		/// The fences start signaled so that the first use of each frame doesn't wait.
+		/// </summary>
+		/// <param name="framesInFlight">The number of frames the CPU can record ahead of the GPU.</param>
+		void init_sync_objects(uint32_t framesInFlight = 2) {
+			auto commandBufferAI = vk::CommandBufferAllocateInfo(_commandPool, vk::CommandBufferLevel::ePrimary, framesInFlight);
+			auto commandBuffers = _device.allocateCommandBuffers(commandBufferAI);
+
+			_frames.clear();
+			_frames.reserve(framesInFlight);
+			for (uint32_t i = 0; i < framesInFlight; i++) {
+				_frames.push_back(Frame(
+					commandBuffers[i],
+					_device.createSemaphore(vk::SemaphoreCreateInfo()),
+					_device.createSemaphore(vk::SemaphoreCreateInfo()),
+					_device.createFence(vk::FenceCreateInfo(vk::FenceCreateFlagBits::eSignaled))
+				));
+			}
+			_frameIndex = 0;
+		}
+
+		uint32_t get_frames_in_flight() {
+			return static_cast<uint32_t>(_frames.size());
+		}
+
+		/// <summary>
+		/// The number of pipelines created through the pipeline cache and how many of them were hits.
+		/// </summary>
+		stlr::PipelineCache::Statistics get_pipeline_cache_statistics() {
+			return _pipelineCache ? _pipelineCache->get_statistics() : stlr::PipelineCache::Statistics();
+		}
+
+		/// <summary>
+		/// Prints the pipeline cache's statistics, if init_pipeline_cache() was called.
+		/// </summary>
+		void report_pipeline_cache(std::ostream& out) {
+			if (_pipelineCache)
+				_pipelineCache->report(out);
 		}
 
-		void init_sync_objects() {
-			_imageAcquiredSemaphore = _device.createSemaphore(vk::SemaphoreCreateInfo());
-			_imageReadySemaphore = _device.createSemaphore(vk::SemaphoreCreateInfo());
-			_fence = _device.createFence(vk::FenceCreateInfo());
+		/// <summary>
+		/// Waits until the GPU has finished with the frame that will be recorded next.
+		/// Call this before writing to memory that the previous use of the frame may still be reading.
+		/// </summary>
+		void wait_for_frame() {
+			[[maybe_unused]] auto res = _device.waitForFences(_frames[_frameIndex]._fence, true, UINT64_MAX);
+			// With a lower latency limit, also wait for the frame submitted that many frames ago.
+			auto latency = _swapchainSettings.get_frame_latency(get_frames_in_flight());
+			if (latency < get_frames_in_flight())
+				res = _device.waitForFences(_frames[(_frameIndex + get_frames_in_flight() - latency) % get_frames_in_flight()]._fence, true, UINT64_MAX);
 		}
 
 		void init_viewport(float x, float y, float width, float height) {
@@ -639,12 +948,72 @@ namespace DG {
 			_vertexBuffer = &buffer->_object;
 		}
 
-		void set_index_buffer(Buffer* buffer) {
+		/// <summary>
+		/// Sets the index buffer and the size of its indices. 16-bit indices halve the buffer and the bandwidth reading it,
+		/// so meshes with fewer than 65536 vertices should use them.
+		/// </summary>
+		void set_index_buffer(Buffer* buffer, vk::IndexType indexType = vk::IndexType::eUint32) {
 			_indexBuffer = &buffer->_object;
+			_indexType = indexType;
 		}
 		void set_index_count(uint32_t count) {
 			_indexCount = count;
 		}
+
+		/// <summary>
+		/// Draws a mesh loaded with load_mesh(): sets its vertex and index buffers, index type and index count.
+		/// </summary>
+		void set_mesh(Mesh* mesh) {
+			set_vertex_buffer(&mesh->_vertexBuffer);
+			set_index_buffer(&mesh->_indexBuffer, mesh->_indexType);
+			set_index_count(mesh->_indexCount);
+		}
+
+		/// <summary>
+		/// Binds a buffer of per-instance attributes next to the vertex buffer. The pipeline describes it with
+		/// add_vertex_input_binding(binding, stride, vk::VertexInputRate::eInstance) and its attributes.
+		/// </summary>
+		/// <param name="buffer">The instance data, or null to stop binding one.</param>
+		/// <param name="binding">The vertex input binding it's read from.</param>
+		void set_instance_buffer(Buffer* buffer, uint32_t binding = 1) {
+			_instanceBuffer = buffer != nullptr ? &buffer->_object : nullptr;
+			_instanceBinding = binding;
+		}
+
+		/// <summary>
+		/// The number of instances of the indices drawn when not drawing indirectly.
+		/// </summary>
+		void set_instance_count(uint32_t count) {
+			_instanceCount = count;
+		}
+
+		/// <summary>
+		/// Draws from a buffer of vk::DrawIndexedIndirectCommand instead of set_index_count() and set_instance_count(),
+		/// so every object in it is drawn with one call. The buffer needs eIndirectBuffer usage.
+		/// Devices without multiDrawIndirect get one call per command instead.
+		/// </summary>
+		/// <param name="commands">The draw commands, or null to go back to drawing directly.</param>
+		/// <param name="maxDrawCount">The number of commands, or the most that countBuffer may ask for.</param>
+		/// <param name="countBuffer">If not null, the GPU reads the number of draws from a uint32_t in it, e.g. written by a culling shader. Needs is_draw_indirect_count_supported().</param>
+		/// <param name="countOffset">The offset of the count in countBuffer.</param>
+		/// <param name="offset">The offset of the first command in commands.</param>
+		void set_indirect_buffer(Buffer* commands, uint32_t maxDrawCount, Buffer* countBuffer = nullptr, vk::DeviceSize countOffset = 0, vk::DeviceSize offset = 0) {
+			if (countBuffer != nullptr && !_drawIndirectCount)
+				throw std::runtime_error("The device doesn't support drawIndirectCount.");
+
+			_indirectBuffer = commands != nullptr ? &commands->_object : nullptr;
+			_indirectOffset = offset;
+			_maxDrawCount = maxDrawCount;
+			_drawCountBuffer = countBuffer != nullptr ? &countBuffer->_object : nullptr;
+			_drawCountOffset = countOffset;
+		}
+
+		/// <summary>
+		/// Whether set_indirect_buffer() can take a count buffer, which needs a Vulkan 1.2 device with drawIndirectCount.
+		/// </summary>
+		bool is_draw_indirect_count_supported() {
+			return _drawIndirectCount;
+		}
 		/// <summary>
 		/// Writes the buffer to the descriptor set.
 		/// </summary>
@@ -653,7 +1022,7 @@ namespace DG {
 		/// <param name="type">The type of descriptor to write to.</param>
 		/// <param name="index">The starting index of the descriptor if it is an array.</param>
 		/// <param name="count">The number of descriptors after the starting index to write to.</param>
-		void write_buffer_to_descriptor_set(Buffer buffer, uint32_t binding, vk::DescriptorType type, uint32_t index = 0, uint32_t count = 1) {
+		void write_buffer_to_descriptor_set(const Buffer& buffer, uint32_t binding, vk::DescriptorType type, uint32_t index = 0, uint32_t count = 1) {
 			auto bi = vk::DescriptorBufferInfo(buffer._object, 0, VK_WHOLE_SIZE);
 			auto write = vk::WriteDescriptorSet(
 				_descriptorSet,
@@ -669,7 +1038,7 @@ namespace DG {
 			_device.updateDescriptorSets(write, nullptr);
 		}
 
-		void write_image_view_to_descriptor_set(ImageView view, vk::ImageLayout layout, uint32_t binding, vk::DescriptorType type, uint32_t index = 0, uint32_t count = 1) {
+		void write_image_view_to_descriptor_set(const ImageView& view, vk::ImageLayout layout, uint32_t binding, vk::DescriptorType type, uint32_t index = 0, uint32_t count = 1) {
 			auto ii = vk::DescriptorImageInfo(
 				_sampler,
 				view._view,
@@ -689,9 +1058,19 @@ namespace DG {
 			_device.updateDescriptorSets(write, nullptr);
 		}
 
+		/// <summary>
+		/// Writes every descriptor of the descriptor set in one call instead of one write per binding.
+		/// The update template must be already initialized.
+		/// </summary>
+		/// <typeparam name="T">A struct with a vk::DescriptorImageInfo, vk::DescriptorBufferInfo or vk::BufferView per descriptor, in binding order.</typeparam>
+		template <typename T>
+		void update_descriptor_set(const T& descriptors) {
+			_descriptorUpdateTemplate->update(_descriptorSet, descriptors);
+		}
+
 		/// <summary>
 		/// Creates a buffer with no flags and exclusive sharing mode.
-		/// Additionally, it binds the buffer to it's allocated memory.
+		/// Additionally, it binds the buffer to memory sub-allocated from the allocator.
 		/// </summary>
 		/// <param name="size">The size of the buffer.</param>
 		/// <param name="usage">The usage type of the buffer.</param>
@@ -708,29 +1087,27 @@ namespace DG {
 			);
 			auto buffer = _device.createBuffer(ci);
 			auto bufferMR = _device.getBufferMemoryRequirements(buffer);
-			auto bufferMemoryAI = vk::MemoryAllocateInfo(bufferMR.size, get_memory_type_index(bufferMR, memProps));
-			auto bufferDM = _device.allocateMemory(bufferMemoryAI);
+			auto allocation = _allocator->allocate(buffer, memProps);
 
-			_device.bindBufferMemory(buffer, bufferDM, 0);
-
-			return Buffer(buffer, size, bufferMR, bufferDM);
+			return Buffer(buffer, size, bufferMR, allocation);
 		}
 
 		/// <summary>
-		/// Creates a 2D image with no flags, optimal image tiling, exlusive sharing mode, 1 depth, mip level, array layer, and sample count.
-		/// Additionally, it binds the image to it's allocated memory.
+		/// Creates a 2D image with no flags, optimal image tiling, exlusive sharing mode, 1 depth, array layer, and sample count.
+		/// Additionally, it binds the image to memory sub-allocated from the allocator.
 		/// </summary>
 		/// <param name="usage">The usage type of the image.</param>
 		/// <param name="format">The format of the image.</param>
 		/// <param name="memProps">The memory properties to use for selecting the memory type to allocate from.</param>
+		/// <param name="mipLevels">The number of mip levels, e.g. from get_mip_level_count().</param>
 		/// <returns>An image resouce.</returns>
-		Image create_image_2D(uint32_t width, uint32_t height, uint32_t channels, vk::ImageUsageFlags usage, vk::Format format, vk::MemoryPropertyFlags memProps) {
+		Image create_image_2D(uint32_t width, uint32_t height, uint32_t channels, vk::ImageUsageFlags usage, vk::Format format, vk::MemoryPropertyFlags memProps, uint32_t mipLevels = 1) {
 			auto ci = vk::ImageCreateInfo(
 				vk::ImageCreateFlags(),
 				vk::ImageType::e2D,
 				format,
 				vk::Extent3D(width, height, 1),
-				1,
+				mipLevels,
 				1,
 				vk::SampleCountFlagBits::e1,
 				vk::ImageTiling::eOptimal,
@@ -743,13 +1120,10 @@ namespace DG {
 
 			auto image = _device.createImage(ci);
 			auto imageMR = _device.getImageMemoryRequirements(image);
-			auto imageMemoryAI = vk::MemoryAllocateInfo(imageMR.size, get_memory_type_index(imageMR, memProps));
-			auto imageDM = _device.allocateMemory(imageMemoryAI);
-
-			_device.bindImageMemory(image, imageDM, 0);
+			auto allocation = _allocator->allocate(image, memProps);
 
 			vk::DeviceSize size = static_cast<vk::DeviceSize>(width) * height * channels;
-			return Image(image, size, imageMR, imageDM, width, height, channels, format, vk::ImageLayout::eUndefined);
+			return Image(image, size, imageMR, allocation, width, height, channels, format, vk::ImageLayout::eUndefined, mipLevels);
 		}
 
 		Image create_image_2D_cube(uint32_t length, uint32_t channels, vk::ImageUsageFlags usage, vk::Format format, vk::MemoryPropertyFlags memProps) {
@@ -771,13 +1145,10 @@ namespace DG {
 
 			auto image = _device.createImage(ci);
 			auto imageMR = _device.getImageMemoryRequirements(image);
-			auto imageMemoryAI = vk::MemoryAllocateInfo(imageMR.size, get_memory_type_index(imageMR, memProps));
-			auto imageDM = _device.allocateMemory(imageMemoryAI);
-
-			_device.bindImageMemory(image, imageDM, 0);
+			auto allocation = _allocator->allocate(image, memProps);
 
 			vk::DeviceSize size = static_cast<vk::DeviceSize>(length) * length * channels;
-			return Image(image, size, imageMR, imageDM, length, length, channels, format, vk::ImageLayout::eUndefined);
+			return Image(image, size, imageMR, allocation, length, length, channels, format, vk::ImageLayout::eUndefined);
 		}
 
 		ImageView create_image_view_2D(Image* image, vk::ImageAspectFlags aspects) {
@@ -787,7 +1158,7 @@ namespace DG {
 				vk::ImageViewType::e2D,
 				image->_format,
 				vk::ComponentMapping(),
-				vk::ImageSubresourceRange(aspects, 0, 1, 0, 1)
+				vk::ImageSubresourceRange(aspects, 0, image->_mipLevels, 0, 1)
 			);
 
 			auto view = _device.createImageView(ci);
@@ -816,27 +1187,55 @@ namespace DG {
 		/// <param name="resource">The resource to destroy.</param>
 		template<typename T>
 		void destroy_resource(Resource<T>* resource) {
-			_device.freeMemory(resource->_deviceMemory);
-			if (std::is_same<T, vk::Buffer>::value)
+			if constexpr (std::is_same<T, vk::Buffer>::value)
 				_device.destroyBuffer(resource->_object);
 			else
 				_device.destroyImage(resource->_object);
+			_allocator->free(resource->_allocation);
 
 			resource->_memoryRequirements = vk::MemoryRequirements();
 		}
 
+		/// <summary>
+		/// Destroys an image view, leaving its image alone.
+		/// </summary>
+		void destroy_image_view(ImageView* view) {
+			_device.destroyImageView(view->_view);
+			view->_view = nullptr;
+		}
+
 		/// <summary>
 		/// Copies data to the resources device memory. Assumes that the whole resource size will be used.
+		/// The resource must be host visible; its memory is mapped once when it's allocated.
+		/// </summary>
+		/// <typeparam name="T">The resource type.</typeparam>
+		/// <param name="resource">The resource to copy data to.</param>
+		/// <param name="data">The data to copy from to the resource.</param>
+		template<typename T>
+		void copy_to_resource_memory(Resource<T>* resource, const void* data) {
+			write_to_resource_memory(resource, data, 0, resource->_deviceSize);
+			flush_resource_writes();
+		}
+
+		/// <summary>
+		/// Copies data to part of a host visible resource's memory. On non-coherent memory the
+		/// range is only flushed by flush_resource_writes(), which render() and submit_commands() call.
 		/// </summary>
 		/// <typeparam name="T">The resource type.</typeparam>
 		/// <param name="resource">The resource to copy data to.</param>
 		/// <param name="data">The data to copy from to the resource.</param>
+		/// <param name="offset">The byte offset into the resource to copy to.</param>
+		/// <param name="size">The number of bytes to copy.</param>
 		template<typename T>
-		void copy_to_resource_memory(Resource<T>* resource, void* data) {
-			void* pMap = nullptr;
-            auto res = _device.mapMemory(resource->_deviceMemory, 0, VK_WHOLE_SIZE, vk::MemoryMapFlags(), &pMap);
-			memcpy(pMap, data, resource->_deviceSize);
-			_device.unmapMemory(resource->_deviceMemory);
+		void write_to_resource_memory(Resource<T>* resource, const void* data, vk::DeviceSize offset, vk::DeviceSize size) {
+			_allocator->write(resource->_allocation, data, size, offset);
+		}
+
+		/// <summary>
+		/// Flushes all ranges written since the last flush, merged into one flushMappedMemoryRanges call.
+		/// </summary>
+		void flush_resource_writes() {
+			_allocator->flush();
 		}
 
 		/// <summary>
@@ -910,7 +1309,7 @@ namespace DG {
 				VK_QUEUE_FAMILY_IGNORED,
 				VK_QUEUE_FAMILY_IGNORED,
 				image->_object,
-				vk::ImageSubresourceRange(aspects, 0, 1, 0, 1)
+				vk::ImageSubresourceRange(aspects, 0, image->_mipLevels, 0, 1)
 			);
 
 			_commandBuffer.pipelineBarrier(
@@ -951,6 +1350,226 @@ namespace DG {
 			image->_imageLayout = layout;
 		}
 
+		/// <summary>
+		/// Loads a KTX2 or DDS texture and all of its mip levels into a sampled image in eShaderReadOnlyOptimal.
+		/// Block-compressed data is copied to the image as is; if the device can't sample its format, it's decoded to RGBA8 first.
+		/// </summary>
+		/// <param name="file">The texture file. It must hold a single 2D layer.</param>
+		/// <param name="srgb">Whether a DDS file that doesn't record its color space holds sRGB colors.</param>
+		/// <returns>An image resource.</returns>
+		Image load_texture(const std::string& file, bool srgb = false) {
+			auto texture = stlr::TextureFile::load(file, srgb).to_supported(_physicalDevice);
+			if (texture.layer_count != 1)
+				throw std::runtime_error("Only textures with a single layer can be loaded.");
+
+			return upload_texture(texture.data.data(), texture.data.size(), texture.format, texture.width, texture.height, texture.level_count, texture.get_copy_regions());
+		}
+
+		/// <summary>
+		/// Loads a texture cooked into an asset pack into a sampled image in eShaderReadOnlyOptimal.
+		/// Its texels are copied from the pack's mapping straight into staging memory, already in their format and with every mip level.
+		/// </summary>
+		/// <param name="pack">The asset pack. It must hold a single 2D layer of the texture in a format the device can sample.</param>
+		/// <param name="name">The name the texture was cooked with.</param>
+		/// <returns>An image resource.</returns>
+		Image load_texture(const stlr::AssetPack& pack, const std::string& name) {
+			const auto& texture = pack.get_texture(name);
+			if (texture.layer_count != 1)
+				throw std::runtime_error("Only textures with a single layer can be loaded.");
+
+			return upload_texture(pack.get_texture_data(texture), texture.data_size, stlr::AssetPack::get_format(texture), texture.width, texture.height, texture.level_count, pack.get_copy_regions(texture));
+		}
+
+		/// <summary>
+		/// Creates a sampled image with every level given and copies them into it through a staging buffer.
+		/// </summary>
+		/// <param name="regions">The copies of each level, with buffer offsets relative to data.</param>
+		/// <returns>An image resource in eShaderReadOnlyOptimal.</returns>
+		Image upload_texture(const void* data, vk::DeviceSize size, vk::Format format, uint32_t width, uint32_t height, uint32_t levelCount, const std::vector<vk::BufferImageCopy>& regions) {
+			auto stagingBuffer = create_buffer(size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible);
+			copy_to_resource_memory(&stagingBuffer, data);
+
+			auto image = create_image_2D(width, height, stlr::format_utils::get_format_component_count(format), vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled, format, vk::MemoryPropertyFlagBits::eDeviceLocal, levelCount);
+
+			cmd_start_recording();
+			cmd_change_image_layout(&image, vk::AccessFlags(), vk::AccessFlagBits::eTransferWrite, vk::ImageLayout::eTransferDstOptimal, vk::ImageAspectFlagBits::eColor, vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer);
+			_commandBuffer.copyBufferToImage(stagingBuffer._object, image._object, vk::ImageLayout::eTransferDstOptimal, regions);
+			cmd_change_image_layout(&image, vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageAspectFlagBits::eColor, vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader);
+			cmd_end_recording();
+			submit_commands();
+
+			destroy_resource(&stagingBuffer);
+			return image;
+		}
+
+		/// <summary>
+		/// Loads a mesh cooked into an asset pack into host visible vertex and index buffers, copied straight from the pack's mapping.
+		/// Its vertex layout is pack.get_vertex_attributes() with a stride of the entry's vertex_stride.
+		/// </summary>
+		/// <param name="pack">The asset pack.</param>
+		/// <param name="name">The name the mesh was cooked with.</param>
+		/// <returns>The mesh's buffers.</returns>
+		Mesh load_mesh(const stlr::AssetPack& pack, const std::string& name) {
+			const auto& mesh = pack.get_mesh(name);
+			auto vertexBuffer = create_buffer(mesh.vertex_size, vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible);
+			write_to_resource_memory(&vertexBuffer, pack.get_vertex_data(mesh), 0, mesh.vertex_size);
+			auto indexBuffer = create_buffer(mesh.index_size, vk::BufferUsageFlagBits::eIndexBuffer, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible);
+			write_to_resource_memory(&indexBuffer, pack.get_index_data(mesh), 0, mesh.index_size);
+			flush_resource_writes();
+
+			return Mesh(vertexBuffer, indexBuffer, mesh.vertex_count, mesh.index_count, stlr::AssetPack::get_index_type(mesh));
+		}
+
+		/// <summary>
+		/// Starts the threads that decode images for load_image_async() and uploads the 1x1 gray image shown until they're ready.
+		/// The mipmap generator must be already initialized.
+		/// </summary>
+		/// <param name="threadCount">The number of decoding threads. 0 uses one per hardware thread.</param>
+		void init_image_loader(uint32_t threadCount = 0) {
+			_imageLoader = std::make_unique<stlr::ImageLoader>(_device, *_allocator, threadCount);
+
+			const uint32_t gray = 0xff808080;
+			auto stagingBuffer = create_buffer(sizeof(gray), vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible);
+			copy_to_resource_memory(&stagingBuffer, &gray);
+			_placeholderImage = create_image_2D(1, 1, 4, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled, vk::Format::eR8G8B8A8Unorm, vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+			cmd_start_recording();
+			cmd_change_image_layout(&*_placeholderImage, vk::AccessFlags(), vk::AccessFlagBits::eTransferWrite, vk::ImageLayout::eTransferDstOptimal, vk::ImageAspectFlagBits::eColor, vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer);
+			cmd_copy_buffer_to_image(&stagingBuffer, &*_placeholderImage, vk::ImageAspectFlagBits::eColor);
+			cmd_change_image_layout(&*_placeholderImage, vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageAspectFlagBits::eColor, vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader);
+			cmd_end_recording();
+			submit_commands();
+			destroy_resource(&stagingBuffer);
+		}
+
+		/// <summary>
+		/// Queues an image file to be decoded to RGBA8 on the image loader's threads and returns straight away.
+		/// Until upload_loaded_images() has uploaded it, get_loaded_image() returns the placeholder.
+		/// </summary>
+		/// <param name="file">Any image stb_image reads.</param>
+		/// <param name="format">eR8G8B8A8Srgb for colors, eR8G8B8A8Unorm for data such as normals.</param>
+		/// <returns>The handle to get the image with.</returns>
+		stlr::ImageLoader::Handle load_image_async(const std::string& file, vk::Format format = vk::Format::eR8G8B8A8Srgb) {
+			auto handle = _imageLoader->load(file);
+			_loadingImageFormats.emplace(handle, format);
+			return handle;
+		}
+
+		/// <summary>
+		/// Copies every image decoded since the last call into a sampled image and generates its mips, all in one submission
+		/// that is not waited for. Call it once per frame: a later call hands the images over once the submission's fence signals.
+		/// Images that failed to decode keep the placeholder, and the first failure is thrown once the rest are submitted.
+		/// </summary>
+		/// <returns>The handles whose images became ready, to rebind in descriptor sets.</returns>
+		std::vector<stlr::ImageLoader::Handle> upload_loaded_images() {
+			std::vector<stlr::ImageLoader::Handle> ready;
+			for (auto it = _imageUploads.begin(); it != _imageUploads.end();) {
+				if (_device.getFenceStatus(it->_fence) != vk::Result::eSuccess) {
+					++it;
+					continue;
+				}
+
+				for (auto& d : it->_decoded)
+					_imageLoader->free_staging(d);
+				for (auto& [handle, image] : it->_images) {
+					_loadedImages.emplace(handle, image);
+					ready.push_back(handle);
+				}
+				_device.destroyFence(it->_fence);
+				_device.freeCommandBuffers(_commandPool, it->_commandBuffer);
+				it = _imageUploads.erase(it);
+			}
+			// The frames in flight were recorded with the descriptor sets and views the caller replaces for these images.
+			if (!ready.empty())
+				wait_for_all_frames();
+
+			auto decoded = _imageLoader->take_decoded();
+			if (decoded.empty())
+				return ready;
+
+			ImageUpload upload;
+			upload._commandBuffer = _device.allocateCommandBuffers(vk::CommandBufferAllocateInfo(_commandPool, vk::CommandBufferLevel::ePrimary, 1)).front();
+			upload._fence = _device.createFence(vk::FenceCreateInfo());
+			upload._commandBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+			std::string error;
+			for (auto& d : decoded) {
+				auto format = _loadingImageFormats.at(d.handle);
+				_loadingImageFormats.erase(d.handle);
+				if (!d.staging) {
+					if (error.empty())
+						error = "Failed to decode " + d.file.string() + ": " + d.error;
+					continue;
+				}
+
+				auto image = create_image_2D(d.width, d.height, 4, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled | get_mipmap_usage(format), format, vk::MemoryPropertyFlagBits::eDeviceLocal, get_mip_level_count(d.width, d.height, format));
+				auto barrier = vk::ImageMemoryBarrier(
+					vk::AccessFlags(),
+					vk::AccessFlagBits::eTransferWrite,
+					vk::ImageLayout::eUndefined,
+					vk::ImageLayout::eTransferDstOptimal,
+					VK_QUEUE_FAMILY_IGNORED,
+					VK_QUEUE_FAMILY_IGNORED,
+					image._object,
+					vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, image._mipLevels, 0, 1)
+				);
+				upload._commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), nullptr, nullptr, barrier);
+				auto bufferImageCopy = vk::BufferImageCopy(
+					0,
+					0,
+					0,
+					vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1),
+					vk::Offset3D(0, 0, 0),
+					vk::Extent3D(d.width, d.height, 1)
+				);
+				upload._commandBuffer.copyBufferToImage(d.staging, image._object, vk::ImageLayout::eTransferDstOptimal, bufferImageCopy);
+				upload._mipmapResources.push_back(_mipmapGenerator->generate(upload._commandBuffer, image._object, image._format, image._width, image._height, image._mipLevels, vk::ImageLayout::eShaderReadOnlyOptimal, vk::PipelineStageFlagBits::eFragmentShader, vk::AccessFlagBits::eShaderRead));
+				image._imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+
+				upload._images.emplace_back(d.handle, image);
+			}
+			upload._commandBuffer.end();
+
+			flush_resource_writes();
+			_queue.submit(vk::SubmitInfo(0, nullptr, nullptr, 1, &upload._commandBuffer), upload._fence);
+			upload._decoded = std::move(decoded);
+			_imageUploads.push_back(std::move(upload));
+
+			if (!error.empty())
+				throw std::runtime_error(error);
+
+			return ready;
+		}
+
+		/// <summary>
+		/// Whether an image queued with load_image_async() has been uploaded.
+		/// </summary>
+		bool is_image_loaded(stlr::ImageLoader::Handle handle) {
+			return _loadedImages.find(handle) != _loadedImages.end();
+		}
+
+		/// <summary>
+		/// The image queued with load_image_async(), or the placeholder until it's been uploaded.
+		/// </summary>
+		Image* get_loaded_image(stlr::ImageLoader::Handle handle) {
+			auto it = _loadedImages.find(handle);
+			return it != _loadedImages.end() ? &it->second : &*_placeholderImage;
+		}
+
+		/// <summary>
+		/// Fills the image's mip levels from its first one, with blits or, for formats blits can't filter, a compute shader.
+		/// Every level must be in eTransferDstOptimal with the first one written; afterwards they are all in layout.
+		/// The mipmap generator must be already initialized.
+		/// </summary>
+		/// <param name="image">The image to generate the mip levels of.</param>
+		/// <param name="layout">The layout to leave every level in.</param>
+		/// <param name="dstAccess">The access the image is used with next.</param>
+		/// <param name="dstStage">The pipeline stage the image is used in next.</param>
+		void cmd_generate_mipmaps(Image* image, vk::ImageLayout layout, vk::AccessFlags dstAccess, vk::PipelineStageFlags dstStage) {
+			_mipmapResources.push_back(_mipmapGenerator->generate(_commandBuffer, image->_object, image->_format, image->_width, image->_height, image->_mipLevels, layout, dstStage, dstAccess));
+			image->_imageLayout = layout;
+		}
+
 		/// <summary>
 		/// Submits commands to the queue.
 		/// </summary>
@@ -969,16 +1588,48 @@ namespace DG {
 				signalSems.data()
 			);
 
+			flush_resource_writes();
 			_queue.submit(submitInfo, fence);
 			_queue.waitIdle();
+			_mipmapResources.clear();
 		}
 
+		/// <summary>
+		/// Records, submits and presents the current frame, then moves on to the next frame without
+		/// waiting for the GPU. The only wait is for the GPU to release the frame being reused.
+		/// </summary>
 		void render() {
-			if (_imageIndex >= _swapchainImages.size()) {
-				_imageIndex = 0;
+			Frame& frame = _frames[_frameIndex];
+			wait_for_frame();
+			destroy_retired_swapchains();
+
+			// Not every platform reports a resize as out of date, so the window's size is checked too.
+			if (get_window_extent() != _windowExtent)
+				_swapchainOutdated = true;
+			// A minimized window skips frames until it's restored.
+			if (_swapchainOutdated && !recreate_swapchain())
+				return;
+
+            vk::Result res = _device.acquireNextImageKHR(_swapchain, UINT64_MAX, frame._imageAcquiredSemaphore, nullptr, &_imageIndex);
+			// Nothing was acquired and the semaphore won't be signaled, so the frame can retry on a new swapchain.
+			if (res == vk::Result::eErrorOutOfDateKHR) {
+				if (!recreate_swapchain())
+					return;
+				res = _device.acquireNextImageKHR(_swapchain, UINT64_MAX, frame._imageAcquiredSemaphore, nullptr, &_imageIndex);
 			}
-
-            vk::Result res = _device.acquireNextImageKHR(_swapchain, UINT64_MAX, _imageAcquiredSemaphore, nullptr, &_imageIndex);
+			// A suboptimal image was still acquired; it's rendered and presented, then the swapchain is recreated.
+			if (res == vk::Result::eSuboptimalKHR) {
+				_swapchainOutdated = true;
+			}
+			else if (res == vk::Result::eErrorOutOfDateKHR) {
+				_swapchainOutdated = true;
+				return;
+			}
+			else if (res != vk::Result::eSuccess) {
+				throw std::runtime_error("Failed to acquire a swapchain image: " + vk::to_string(res));
+			}
+			if (_uniformRing)
+				_uniformRing->begin_frame(_frameIndex);
 
 			auto clearValues = std::array<vk::ClearValue, 2>{
 				vk::ClearValue(std::array<float, 4>{ 0.0f, 0.0f, 0.0f, 255.0f}),
@@ -987,16 +1638,16 @@ namespace DG {
 			auto piplineStageFlags = vk::PipelineStageFlags(vk::PipelineStageFlagBits::eColorAttachmentOutput);
 			auto submitInfo = vk::SubmitInfo(
 				1,
-				&_imageAcquiredSemaphore,
+				&frame._imageAcquiredSemaphore,
 				&piplineStageFlags,
 				1,
-				&_commandBuffer,
+				&frame._commandBuffer,
 				1,
-				&_imageReadySemaphore
+				&frame._imageReadySemaphore
 			);
 			auto presentInfo = vk::PresentInfoKHR(
 				1,
-				&_imageReadySemaphore,
+				&frame._imageReadySemaphore,
 				1,
 				&_swapchain,
 				&_imageIndex,
@@ -1012,30 +1663,166 @@ namespace DG {
 				clearValues.data()
 			);
 
-			_commandBuffer.begin(vk::CommandBufferBeginInfo());
-			_commandBuffer.beginRenderPass(renderPassBI, vk::SubpassContents::eInline);
-			_commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, _pipeline);
-			_commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, _pipelineLayout, 0, _descriptorSet, nullptr);
-			_commandBuffer.bindVertexBuffers(0, *_vertexBuffer, static_cast<vk::DeviceSize>(0));
-			_commandBuffer.bindIndexBuffer(*_indexBuffer, 0, vk::IndexType::eUint32);
-			_commandBuffer.setViewport(0, _viewport);
-			_commandBuffer.setScissor(0, _scissor);
-			_commandBuffer.drawIndexed(_indexCount, 1, 0, 0, 0);
-			_commandBuffer.endRenderPass();
-			_commandBuffer.end();
+			frame._commandBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+			frame._commandBuffer.beginRenderPass(renderPassBI, vk::SubpassContents::eInline);
+			frame._commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, _pipeline);
+			frame._commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, _pipelineLayout, 0, _descriptorSet, nullptr);
+			if (!_constants.empty()) {
+				if (_pushConstants) {
+					frame._commandBuffer.pushConstants(_pipelineLayout, _constantStages, 0, static_cast<uint32_t>(_constants.size()), _constants.data());
+				}
+				else {
+					auto offset = _uniformRing->push(_constants.data(), _constants.size());
+					frame._commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, _pipelineLayout, 1, _uniformRing->get_set(), offset);
+				}
+			}
+			frame._commandBuffer.bindVertexBuffers(0, *_vertexBuffer, static_cast<vk::DeviceSize>(0));
+			if (_instanceBuffer != nullptr)
+				frame._commandBuffer.bindVertexBuffers(_instanceBinding, *_instanceBuffer, static_cast<vk::DeviceSize>(0));
+			frame._commandBuffer.bindIndexBuffer(*_indexBuffer, 0, _indexType);
+			frame._commandBuffer.setViewport(0, _viewport);
+			frame._commandBuffer.setScissor(0, _scissor);
+			if (_indirectBuffer == nullptr) {
+				frame._commandBuffer.drawIndexed(_indexCount, _instanceCount, 0, 0, 0);
+			}
+			else if (_drawCountBuffer != nullptr) {
+				frame._commandBuffer.drawIndexedIndirectCount(*_indirectBuffer, _indirectOffset, *_drawCountBuffer, _drawCountOffset, _maxDrawCount, sizeof(vk::DrawIndexedIndirectCommand));
+			}
+			else if (_multiDrawIndirect) {
+				frame._commandBuffer.drawIndexedIndirect(*_indirectBuffer, _indirectOffset, _maxDrawCount, sizeof(vk::DrawIndexedIndirectCommand));
+			}
+			else {
+				for (uint32_t i = 0; i < _maxDrawCount; i++) {
+					frame._commandBuffer.drawIndexedIndirect(*_indirectBuffer, _indirectOffset + i * sizeof(vk::DrawIndexedIndirectCommand), 1, sizeof(vk::DrawIndexedIndirectCommand));
+				}
+			}
+			frame._commandBuffer.endRenderPass();
+			frame._commandBuffer.end();
+
+			// After recording, which may have copied constants into the uniform ring.
+			flush_resource_writes();
+			_device.resetFences(frame._fence);
+			_queue.submit(submitInfo, frame._fence);
+
+			// The pointer overload returns out of date instead of throwing it.
+            res = _queue.presentKHR(&presentInfo);
+			if (res == vk::Result::eErrorOutOfDateKHR || res == vk::Result::eSuboptimalKHR)
+				_swapchainOutdated = true;
+			else if (res != vk::Result::eSuccess)
+				throw std::runtime_error("Failed to present: " + vk::to_string(res));
+
+			_frameIndex = (_frameIndex + 1) % _frames.size();
+			++_frameNumber;
+		}
+
+		/// <summary>
+		/// Waits for every frame in flight to finish on the GPU.
+		/// </summary>
+		void wait_for_all_frames() {
+			for (auto& f : _frames) {
+				[[maybe_unused]] auto res = _device.waitForFences(f._fence, true, UINT64_MAX);
+			}
+		}
 
-			_queue.submit(submitInfo, _fence);
+	protected:
+		vk::Extent2D get_window_extent() {
+			int width = 0;
+			int height = 0;
+			glfwGetFramebufferSize(_glfwWindow, &width, &height);
+			return vk::Extent2D(static_cast<uint32_t>(std::max(width, 0)), static_cast<uint32_t>(std::max(height, 0)));
+		}
+
+		/// <summary>
+		/// Destroys the retired swapchains that no frame still in flight presented to.
+		/// </summary>
+		void destroy_retired_swapchains() {
+			// Frames finish in submission order, so once this frame's fence has been waited on, every frame up to
+			// frames in flight ago is done with the swapchain it used.
+			while (!_retiredSwapchains.empty() && _frameNumber >= _retiredSwapchains.front()._frame + _frames.size()) {
+				_device.destroySwapchainKHR(_retiredSwapchains.front()._swapchain);
+				_retiredSwapchains.erase(_retiredSwapchains.begin());
+			}
+		}
 
-            res = _queue.presentKHR(presentInfo);
+		/// <summary>
+		/// Creates the swapchain at the surface's current extent, handing over oldSwapchain's resources if there is one.
+		/// </summary>
+		void create_swapchain(vk::SwapchainKHR oldSwapchain) {
+			_surfaceCapabilites = _physicalDevice.getSurfaceCapabilitiesKHR(_surface);
+			_presentMode = _swapchainSettings.choose_present_mode(_physicalDevice.getSurfacePresentModesKHR(_surface));
+			_swapchainExtent = stlr::SwapchainSettings::choose_extent(_surfaceCapabilites, _windowExtent);
+			auto ci = vk::SwapchainCreateInfoKHR(
+				vk::SwapchainCreateFlagsKHR(),
+				_surface,
+				_swapchainSettings.choose_image_count(_presentMode, _surfaceCapabilites),
+				_surfaceFormat.format,
+				_surfaceFormat.colorSpace,
+				_swapchainExtent,
+				1,
+				vk::ImageUsageFlagBits::eColorAttachment,
+				vk::SharingMode::eExclusive,
+				0,
+				nullptr,
+				_surfaceCapabilites.currentTransform,
+				stlr::SwapchainSettings::choose_composite_alpha(_surfaceCapabilites),
+				_presentMode,
+				VK_TRUE,
+				oldSwapchain
+			);
 
-            res = _device.waitForFences(_fence, false, UINT32_MAX);
-            _device.resetFences(_fence);
+			_swapchain = _device.createSwapchainKHR(ci);
+		}
 
-			_imageIndex++;
+		/// <summary>
+		/// Recreates the swapchain, its image views, the depth image and the framebuffers at the window's new size, keeping
+		/// the device, pipeline and every other resource. Viewports and scissors covering the old extent are resized with it.
+		/// </summary>
+		/// <returns>False while the window is minimized and there's nothing to present to.</returns>
+		bool recreate_swapchain() {
+			_windowExtent = get_window_extent();
+			_surfaceCapabilites = _physicalDevice.getSurfaceCapabilitiesKHR(_surface);
+			auto extent = stlr::SwapchainSettings::choose_extent(_surfaceCapabilites, _windowExtent);
+			if (extent.width == 0 || extent.height == 0)
+				return false;
+
+			// The framebuffers and depth image may still be used by the frames in flight, but no other queue or work is waited on.
+			wait_for_all_frames();
+			for (auto f : _framebuffers) {
+				_device.destroyFramebuffer(f);
+			}
+			for (auto v : _swapchainImageViews) {
+				_device.destroyImageView(v);
+			}
+			if (_depthImageView)
+				_device.destroyImageView(_depthImageView);
+			if (_resizedDepthImage) {
+				destroy_resource(&*_resizedDepthImage);
+				_resizedDepthImage.reset();
+			}
 
+			// The old swapchain keeps presenting until the new one replaces it. Its last presents aren't covered by
+			// the fences waited on above, so it's destroyed once every frame in flight has been reused.
+			auto oldExtent = _swapchainExtent;
+			auto oldSwapchain = _swapchain;
+			create_swapchain(oldSwapchain);
+			_retiredSwapchains.push_back(RetiredSwapchain{ oldSwapchain, _frameNumber });
+			init_swapchain_image_views();
+
+			if (_depthFormat != vk::Format::eUndefined) {
+				_resizedDepthImage = create_image_2D(_swapchainExtent.width, _swapchainExtent.height, 1, vk::ImageUsageFlagBits::eDepthStencilAttachment, _depthFormat, vk::MemoryPropertyFlagBits::eDeviceLocal);
+				init_depth_image_and_view(&*_resizedDepthImage);
+			}
+			if (_renderPass)
+				init_framebuffers();
+
+			if (_viewport.width == oldExtent.width && _viewport.height == oldExtent.height)
+				init_viewport(_viewport.x, _viewport.y, _swapchainExtent.width, _swapchainExtent.height);
+			if (_scissor.extent == oldExtent)
+				_scissor.extent = _swapchainExtent;
+			_swapchainOutdated = false;
+			return true;
 		}
 
-	protected:
 		/// <summary>
 		/// Gets the index of the memory type desired.
 		/// </summary>
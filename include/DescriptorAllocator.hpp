@@ -0,0 +1,145 @@
+#pragma once
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace stlr {
+    /// <summary>
+    /// Allocates descriptor sets of any layout from a chain of pools, creating another pool
+    /// whenever the current one runs out instead of failing.
+    ///
+    /// Sets are never freed one at a time: reset() returns every set at once by resetting the
+    /// pools, which keeps them for reuse. A per-frame allocator is reset when its frame's fence
+    /// has been waited on; a long-lived one is never reset.
+    ///
+    /// Not thread-safe; give each recording thread its own allocator.
+    /// </summary>
+    class DescriptorAllocator {
+    public:
+        /// <summary>
+        /// The number of descriptors of a type to make room for per set in a pool.
+        /// </summary>
+        struct PoolSizeRatio {
+            vk::DescriptorType type;
+            float ratio;
+        };
+
+        static inline const std::vector<PoolSizeRatio> default_ratios {
+            { vk::DescriptorType::eUniformBuffer, 1.0f },
+            { vk::DescriptorType::eUniformBufferDynamic, 1.0f },
+            { vk::DescriptorType::eStorageBuffer, 1.0f },
+            { vk::DescriptorType::eCombinedImageSampler, 4.0f },
+            { vk::DescriptorType::eSampledImage, 1.0f },
+            { vk::DescriptorType::eStorageImage, 1.0f },
+            { vk::DescriptorType::eSampler, 0.5f }
+        };
+
+    private:
+        static constexpr uint32_t max_sets_per_pool = 4096;
+
+        vk::Device device;
+        std::vector<PoolSizeRatio> ratios;
+        uint32_t sets_per_pool;
+        /// Pools with sets allocated from them since the last reset; the last one is current.
+        std::vector<vk::UniqueDescriptorPool> used_pools;
+        /// Reset pools waiting to be reused.
+        std::vector<vk::UniqueDescriptorPool> free_pools;
+
+    public:
+        /// <param name="sets_per_pool">The sets the first pool has room for. Each new pool is half again as large.</param>
+        DescriptorAllocator( vk::Device device, uint32_t sets_per_pool = 64, std::vector<PoolSizeRatio> ratios = default_ratios );
+
+        DescriptorAllocator( DescriptorAllocator&& ) = default;
+        DescriptorAllocator& operator=( DescriptorAllocator&& ) = default;
+
+        /// <summary>
+        /// Allocates a set, moving on to a new pool if the current one is out of memory.
+        /// </summary>
+        vk::DescriptorSet allocate( vk::DescriptorSetLayout layout );
+
+        /// <summary>
+        /// Returns every set allocated since the last reset. None of them may still be in use by the GPU.
+        /// </summary>
+        void reset();
+
+        /// <summary>
+        /// The number of pools created so far.
+        /// </summary>
+        size_t get_pool_count() const noexcept {
+            return used_pools.size() + free_pools.size();
+        }
+
+    private:
+        vk::UniqueDescriptorPool get_pool();
+    };
+
+    /// <summary>
+    /// Creates each distinct descriptor set layout and pipeline layout once. Requests are keyed
+    /// by their contents, so materials that declare the same bindings share one layout, and
+    /// pipeline layouts built from shared set layouts are shared in turn.
+    ///
+    /// The cache owns the layouts; they live as long as it does.
+    /// </summary>
+    class DescriptorLayoutCache {
+        struct Binding {
+            uint32_t binding;
+            vk::DescriptorType type;
+            uint32_t count;
+            vk::ShaderStageFlags stages;
+            std::vector<vk::Sampler> immutable_samplers;
+
+            bool operator==( const Binding& other ) const noexcept;
+        };
+
+        struct SetLayoutKey {
+            vk::DescriptorSetLayoutCreateFlags flags;
+            std::vector<Binding> bindings;
+
+            bool operator==( const SetLayoutKey& other ) const noexcept;
+        };
+
+        struct PipelineLayoutKey {
+            std::vector<vk::DescriptorSetLayout> set_layouts;
+            std::vector<vk::PushConstantRange> push_constants;
+
+            bool operator==( const PipelineLayoutKey& other ) const noexcept;
+        };
+
+        struct Hash {
+            size_t operator()( const SetLayoutKey& key ) const noexcept;
+            size_t operator()( const PipelineLayoutKey& key ) const noexcept;
+        };
+
+        vk::Device device;
+        std::unordered_map<SetLayoutKey, vk::UniqueDescriptorSetLayout, Hash> set_layouts;
+        std::unordered_map<PipelineLayoutKey, vk::UniquePipelineLayout, Hash> pipeline_layouts;
+        std::mutex mutex;
+
+    public:
+        explicit DescriptorLayoutCache( vk::Device device );
+
+        DescriptorLayoutCache( const DescriptorLayoutCache& ) = delete;
+        DescriptorLayoutCache& operator=( const DescriptorLayoutCache& ) = delete;
+
+        /// <summary>
+        /// Gets the set layout with these bindings, creating it the first time. The order the
+        /// bindings are listed in doesn't matter.
+        /// </summary>
+        vk::DescriptorSetLayout get_set_layout( vk::ArrayProxy<const vk::DescriptorSetLayoutBinding> bindings, vk::DescriptorSetLayoutCreateFlags flags = {} );
+
+        /// <summary>
+        /// Gets the pipeline layout with these set layouts and push constant ranges, creating it the first time.
+        /// </summary>
+        vk::PipelineLayout get_pipeline_layout( vk::ArrayProxy<const vk::DescriptorSetLayout> layouts, vk::ArrayProxy<const vk::PushConstantRange> push_constants = {} );
+
+        size_t get_set_layout_count() const noexcept {
+            return set_layouts.size();
+        }
+
+        size_t get_pipeline_layout_count() const noexcept {
+            return pipeline_layouts.size();
+        }
+    };
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace stlr {
+    /// <summary>
+    /// Writes every descriptor of a set from one packed struct in a single call.
+    ///
+    /// The struct holds one info per descriptor, in binding order: a vk::DescriptorImageInfo for
+    /// samplers, images and input attachments, a vk::DescriptorBufferInfo for uniform and storage
+    /// buffers and a vk::BufferView for texel buffers, with arrays for bindings of more than one
+    /// descriptor. All three are 8-byte aligned, so such a struct has no padding and its layout
+    /// matches the template's entries.
+    ///
+    /// On Vulkan 1.1 devices the struct is handed to vkUpdateDescriptorSetWithTemplate, which reads
+    /// it without building a write per binding. On 1.0 devices the same entries become writes that
+    /// point into the struct, made with one vkUpdateDescriptorSets call.
+    ///
+    /// Not thread-safe: the fallback reuses its scratch writes between calls.
+    /// </summary>
+    class DescriptorUpdateTemplate {
+        vk::Device device;
+        std::vector<vk::DescriptorUpdateTemplateEntry> entries;
+        size_t data_size;
+        vk::UniqueDescriptorUpdateTemplate update_template;
+        std::vector<vk::WriteDescriptorSet> writes;
+
+    public:
+        /// <summary>
+        /// Lays out one entry per binding of the set layout.
+        /// </summary>
+        /// <param name="bindings">The bindings the set layout was created with, in any order.</param>
+        /// <param name="use_template">Whether the device supports Vulkan 1.1 update templates.</param>
+        DescriptorUpdateTemplate( vk::Device device, vk::DescriptorSetLayout set_layout, vk::ArrayProxy<const vk::DescriptorSetLayoutBinding> bindings, bool use_template = true )
+            : device( device )
+            , data_size( 0 ) {
+            std::vector<vk::DescriptorSetLayoutBinding> sorted( bindings.begin(), bindings.end() );
+            std::sort( sorted.begin(), sorted.end(), []( const auto& a, const auto& b ) { return a.binding < b.binding; } );
+
+            entries.reserve( sorted.size() );
+            for( const auto& b : sorted ) {
+                if( b.descriptorCount == 0 )
+                    continue;
+
+                const size_t stride { get_info_size( b.descriptorType ) };
+                entries.push_back( vk::DescriptorUpdateTemplateEntry { b.binding, 0, b.descriptorCount, b.descriptorType, data_size, stride } );
+                data_size += stride * b.descriptorCount;
+            }
+
+            if( use_template ) {
+                vk::DescriptorUpdateTemplateCreateInfo ci {
+                    {},
+                    static_cast<uint32_t>( entries.size() ),
+                    entries.data(),
+                    vk::DescriptorUpdateTemplateType::eDescriptorSet,
+                    set_layout
+                };
+                update_template = device.createDescriptorUpdateTemplateUnique( ci );
+            }
+        }
+
+        DescriptorUpdateTemplate( const DescriptorUpdateTemplate& ) = delete;
+        DescriptorUpdateTemplate& operator=( const DescriptorUpdateTemplate& ) = delete;
+        DescriptorUpdateTemplate( DescriptorUpdateTemplate&& ) = default;
+        DescriptorUpdateTemplate& operator=( DescriptorUpdateTemplate&& ) = default;
+
+        /// <summary>
+        /// The size of the packed struct a set is updated from.
+        /// </summary>
+        size_t get_data_size() const noexcept {
+            return data_size;
+        }
+
+        bool uses_template() const noexcept {
+            return static_cast<bool>( update_template );
+        }
+
+        /// <summary>
+        /// Writes all of the set's descriptors from data, which is get_data_size() bytes.
+        /// </summary>
+        void update( vk::DescriptorSet set, const void* data ) {
+            update( set, data, 0 );
+        }
+
+        /// <summary>
+        /// Writes the descriptors of many sets: the i-th set from the struct at data + i * stride.
+        /// </summary>
+        void update( vk::ArrayProxy<const vk::DescriptorSet> sets, const void* data, size_t stride ) {
+            if( sets.empty() )
+                return;
+
+            if( update_template ) {
+                const char* d { static_cast<const char*>( data ) };
+                for( const auto& s : sets ) {
+                    device.updateDescriptorSetWithTemplate( s, update_template.get(), d );
+                    d += stride;
+                }
+                return;
+            }
+
+            writes.clear();
+            writes.reserve( sets.size() * entries.size() );
+            const char* d { static_cast<const char*>( data ) };
+            for( const auto& s : sets ) {
+                for( const auto& e : entries ) {
+                    append_write( s, e, d + e.offset );
+                }
+                d += stride;
+            }
+            device.updateDescriptorSets( writes, nullptr );
+        }
+
+        template <typename T>
+        void update( vk::DescriptorSet set, const T& data ) {
+            check_type<T>();
+            update( set, static_cast<const void*>( &data ) );
+        }
+
+        template <typename T>
+        void update( vk::ArrayProxy<const vk::DescriptorSet> sets, const std::vector<T>& data ) {
+            check_type<T>();
+            if( data.size() < sets.size() )
+                throw std::invalid_argument( "There must be a descriptor struct for each set." );
+            update( sets, data.data(), sizeof( T ) );
+        }
+
+    private:
+        static size_t get_info_size( vk::DescriptorType type ) {
+            switch( type ) {
+            case vk::DescriptorType::eSampler:
+            case vk::DescriptorType::eCombinedImageSampler:
+            case vk::DescriptorType::eSampledImage:
+            case vk::DescriptorType::eStorageImage:
+            case vk::DescriptorType::eInputAttachment:
+                return sizeof( vk::DescriptorImageInfo );
+            case vk::DescriptorType::eUniformBuffer:
+            case vk::DescriptorType::eStorageBuffer:
+            case vk::DescriptorType::eUniformBufferDynamic:
+            case vk::DescriptorType::eStorageBufferDynamic:
+                return sizeof( vk::DescriptorBufferInfo );
+            case vk::DescriptorType::eUniformTexelBuffer:
+            case vk::DescriptorType::eStorageTexelBuffer:
+                return sizeof( vk::BufferView );
+            default:
+                throw std::invalid_argument( "The descriptor type can't be written from an update template." );
+            }
+        }
+
+        template <typename T>
+        void check_type() const {
+            static_assert( std::is_trivially_copyable_v<T>, "Descriptor structs are read byte for byte." );
+            if( sizeof( T ) != data_size )
+                throw std::invalid_argument( "The descriptor struct doesn't match the template's layout." );
+        }
+
+        void append_write( vk::DescriptorSet set, const vk::DescriptorUpdateTemplateEntry& e, const char* info ) {
+            vk::WriteDescriptorSet w { set, e.dstBinding, e.dstArrayElement, e.descriptorCount, e.descriptorType };
+            switch( e.descriptorType ) {
+            case vk::DescriptorType::eUniformBuffer:
+            case vk::DescriptorType::eStorageBuffer:
+            case vk::DescriptorType::eUniformBufferDynamic:
+            case vk::DescriptorType::eStorageBufferDynamic:
+                w.pBufferInfo = reinterpret_cast<const vk::DescriptorBufferInfo*>( info );
+                break;
+            case vk::DescriptorType::eUniformTexelBuffer:
+            case vk::DescriptorType::eStorageTexelBuffer:
+                w.pTexelBufferView = reinterpret_cast<const vk::BufferView*>( info );
+                break;
+            default:
+                w.pImageInfo = reinterpret_cast<const vk::DescriptorImageInfo*>( info );
+            }
+            writes.push_back( w );
+        }
+    };
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <array>
+#include <filesystem>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+#include "MemoryAllocator.hpp"
+
+namespace stlr {
+    /// <summary>
+    /// Culls objects against the camera frustum in a compute shader and compacts the survivors into
+    /// an indirect draw buffer, so the CPU never reads back which objects are visible.
+    ///
+    /// Each frame in flight has its own objects buffer, written by the host, and its own draw and
+    /// count buffers, written by cull-cs.comp. An object is a world matrix, a bounding sphere in
+    /// object space and the indexed draw it's drawn with. The shader moves the sphere to world space,
+    /// tests it against the six planes and appends the draws of the objects that touch the frustum,
+    /// with firstInstance set to the object's index so the vertex shader can read its world matrix
+    /// from the same objects buffer, which needs drawIndirectFirstInstance enabled on the device.
+    /// draw() then issues however many were appended with vkCmdDrawIndexedIndirectCount, which
+    /// needs drawIndirectCount.
+    ///
+    /// When the compute and graphics queues are of different families the buffers are shared
+    /// concurrently between them, so no ownership transfers are recorded; the graphics submission
+    /// only has to wait on the culling submission's semaphore at eDrawIndirect.
+    /// </summary>
+    class GpuCulling {
+    public:
+        static constexpr uint32_t group_size = 64;
+
+        /// <summary>
+        /// An object as cull-cs.comp reads it, with std430 layout.
+        /// </summary>
+        struct Object {
+            /// Column major, like glm::mat4.
+            std::array<float, 16> world;
+            /// The bounding sphere's center in object space and its radius.
+            std::array<float, 4> sphere;
+            uint32_t first_index;
+            uint32_t index_count;
+            int32_t vertex_offset;
+            uint32_t reserved;
+        };
+        static_assert( sizeof( Object ) == 96, "Object must match the std430 layout of cull-cs.comp." );
+
+        /// <summary>
+        /// The frustum's left, right, bottom, top, near and far planes as (normal, distance), with
+        /// normals of unit length pointing inwards.
+        /// </summary>
+        using Frustum = std::array<std::array<float, 4>, 6>;
+
+    private:
+        struct PushConstants {
+            Frustum planes;
+            uint32_t object_count;
+        };
+
+        struct FrameBuffers {
+            vk::UniqueBuffer objects;
+            MemoryAllocator::UniqueAllocation objects_allocation;
+            vk::UniqueBuffer draws;
+            MemoryAllocator::UniqueAllocation draws_allocation;
+            vk::UniqueBuffer count;
+            MemoryAllocator::UniqueAllocation count_allocation;
+            vk::DescriptorSet set;
+        };
+
+        vk::Device device;
+        MemoryAllocator& allocator;
+        uint32_t max_objects;
+        vk::UniqueDescriptorSetLayout set_layout;
+        vk::UniquePipelineLayout pipeline_layout;
+        vk::UniqueShaderModule shader;
+        vk::UniquePipeline pipeline;
+        vk::UniqueDescriptorPool pool;
+        std::vector<FrameBuffers> frames;
+
+    public:
+        /// <param name="shader_file">The compiled cull-cs.comp.</param>
+        /// <param name="frame_count">The number of frames in flight; each gets its own buffers.</param>
+        /// <param name="max_objects">The most objects a frame can cull.</param>
+        /// <param name="queue_family_indices">The families of the compute and graphics queues, which may be the same.</param>
+        GpuCulling( vk::Device device, MemoryAllocator& allocator, const std::filesystem::path& shader_file, uint32_t frame_count, uint32_t max_objects, std::array<uint32_t, 2> queue_family_indices );
+
+        GpuCulling( const GpuCulling& ) = delete;
+        GpuCulling& operator=( const GpuCulling& ) = delete;
+
+        /// <summary>
+        /// Extracts the frustum's planes from a projection times view matrix, column major and with
+        /// Vulkan's 0 to 1 depth range.
+        /// </summary>
+        static Frustum get_frustum( const std::array<float, 16>& view_projection ) noexcept;
+
+        uint32_t get_max_objects() const noexcept {
+            return max_objects;
+        }
+
+        /// <summary>
+        /// Copies objects into the frame's objects buffer from first on. Its previous contents may
+        /// only be overwritten once the frame's fence has been waited on, and non-coherent memory must
+        /// be flushed by the allocator before record()'s commands are submitted.
+        /// </summary>
+        void write_objects( uint32_t frame, const Object* objects, uint32_t count, uint32_t first = 0 );
+
+        /// <summary>
+        /// The frame's objects buffer, for the vertex shader to read world matrices from by instance index.
+        /// </summary>
+        vk::Buffer get_objects_buffer( uint32_t frame ) const noexcept {
+            return frames[frame].objects.get();
+        }
+
+        /// <summary>
+        /// Records the culling of the frame's first object_count objects into a command buffer of the
+        /// compute queue's family. The draws are complete when the command buffer's submission is.
+        /// </summary>
+        void record( vk::CommandBuffer command_buffer, uint32_t frame, uint32_t object_count, const Frustum& frustum ) const;
+
+        /// <summary>
+        /// Records the indexed draws of the frame's visible objects. The pipeline, index buffer and
+        /// vertex buffers must be bound, and the submission must wait for the culling at eDrawIndirect.
+        /// </summary>
+        void draw( vk::CommandBuffer command_buffer, uint32_t frame ) const;
+
+    private:
+        void create_pipeline( const std::filesystem::path& shader_file );
+        FrameBuffers create_frame_buffers( const std::vector<uint32_t>& queue_families );
+    };
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+#include "Timer.hpp"
+
+namespace stlr {
+    /// <summary>
+    /// Measures GPU work with timestamp queries and writes it, together with CPU Timer
+    /// scopes, to a Chrome trace (chrome://tracing or ui.perfetto.dev).
+    ///
+    /// Graphics scopes are written into one query pool per frame in flight. A pool is read
+    /// back when its frame comes around again, after the frame's fence has been waited on,
+    /// so reading results never stalls. Transfer scopes live in their own pool and are
+    /// resolved when the batch that wrote them has retired.
+    /// </summary>
+    class GpuProfiler {
+    public:
+        enum class Track : uint32_t {
+            eCpu,
+            eGraphics,
+            eTransfer
+        };
+
+        struct Event {
+            std::string name;
+            Track track;
+            /// Microseconds since the profiler was created.
+            double start;
+            /// Microseconds.
+            double duration;
+        };
+
+        static constexpr uint32_t invalid_scope = UINT32_MAX;
+
+        /// <summary>
+        /// Ends a graphics scope when it goes out of scope.
+        /// </summary>
+        class Scope {
+            GpuProfiler* profiler;
+            vk::CommandBuffer command_buffer;
+            uint32_t scope;
+
+        public:
+            Scope( GpuProfiler& profiler, vk::CommandBuffer command_buffer, std::string name )
+                : profiler( &profiler )
+                , command_buffer( command_buffer )
+                , scope( profiler.begin_scope( command_buffer, std::move( name ) ) ) {}
+
+            ~Scope() {
+                profiler->end_scope( command_buffer, scope );
+            }
+
+            Scope( const Scope& ) = delete;
+            Scope& operator=( const Scope& ) = delete;
+        };
+
+    private:
+        struct PendingScope {
+            std::string name;
+            uint32_t query;
+        };
+
+        struct FramePool {
+            vk::UniqueQueryPool pool;
+            uint32_t query_count = 0;
+            std::vector<PendingScope> scopes;
+        };
+
+        /// A GPU timestamp of one queue family and the CPU time it was written at. Queue families
+        /// aren't required to share a timebase, so each is lined up with the CPU clock on its own.
+        struct Calibration {
+            vk::Queue queue;
+            vk::UniqueCommandPool command_pool;
+            uint64_t ticks = 0;
+            std::chrono::steady_clock::time_point time;
+        };
+
+        vk::Device device;
+        bool shared_family;
+        double timestamp_period;
+        uint64_t graphics_mask;
+        uint64_t transfer_mask;
+        bool host_query_reset;
+        uint32_t queries_per_frame;
+
+        std::vector<FramePool> frame_pools;
+        uint32_t current_pool;
+
+        vk::UniqueQueryPool transfer_pool;
+        /// Each transfer scope uses the pair of queries starting at twice its index.
+        std::vector<uint32_t> free_transfer_scopes;
+
+        Calibration graphics_calibration;
+        Calibration transfer_calibration;
+        std::chrono::steady_clock::time_point origin;
+
+        bool capturing;
+        std::vector<Event> capture;
+        std::vector<Event> last_frame;
+        uint32_t dropped_scopes;
+        std::mutex mutex;
+
+    public:
+        /// <summary>
+        /// Creates the query pools. Profiling is disabled when the graphics queue family doesn't
+        /// support timestamps, and transfer scopes are disabled when the transfer family doesn't or
+        /// the hostQueryReset feature isn't enabled.
+        /// </summary>
+        /// <param name="graphics_queue">The queue used to line graphics timestamps up with the CPU clock.</param>
+        /// <param name="transfer_queue">The queue used to line transfer timestamps up with the CPU clock.</param>
+        /// <param name="frame_count">The number of frames in flight; one query pool is created per frame.</param>
+        /// <param name="host_query_reset">Whether the hostQueryReset feature is enabled.</param>
+        /// <param name="max_scopes_per_frame">The number of graphics scopes recorded per frame before they're dropped.</param>
+        GpuProfiler( vk::PhysicalDevice physical_device, vk::Device device, vk::Queue graphics_queue, uint32_t graphics_family, vk::Queue transfer_queue, uint32_t transfer_family, uint32_t frame_count, bool host_query_reset, uint32_t max_scopes_per_frame = 256 );
+
+        GpuProfiler( const GpuProfiler& ) = delete;
+        GpuProfiler& operator=( const GpuProfiler& ) = delete;
+
+        bool is_enabled() const noexcept {
+            return !frame_pools.empty();
+        }
+
+        /// <summary>
+        /// Reads back the results of the frame's previous use and resets its pool. The frame's
+        /// fence must have been waited on.
+        /// </summary>
+        /// <param name="frame_index">The frame in flight being recorded.</param>
+        /// <param name="command_buffer">The frame's command buffer, used to reset the pool without hostQueryReset.</param>
+        void begin_frame( uint32_t frame_index, vk::CommandBuffer command_buffer );
+
+        /// <summary>
+        /// Writes a timestamp at the top of the pipe into a command buffer submitted to the graphics queue.
+        /// </summary>
+        /// <returns>The scope to end, or invalid_scope if it was dropped.</returns>
+        uint32_t begin_scope( vk::CommandBuffer command_buffer, std::string name );
+
+        /// <summary>
+        /// Writes a timestamp at the bottom of the pipe for a scope from begin_scope().
+        /// </summary>
+        void end_scope( vk::CommandBuffer command_buffer, uint32_t scope );
+
+        /// <summary>
+        /// Writes the starting timestamp of a transfer queue scope.
+        /// </summary>
+        /// <returns>The scope to end and resolve, or invalid_scope if transfer profiling is unavailable.</returns>
+        uint32_t begin_transfer_scope( vk::CommandBuffer command_buffer );
+        void end_transfer_scope( vk::CommandBuffer command_buffer, uint32_t scope );
+
+        /// <summary>
+        /// Reads a transfer scope once the submission that wrote it has completed, then frees it.
+        /// </summary>
+        void resolve_transfer_scope( uint32_t scope, std::string name );
+
+        /// <summary>
+        /// Adds the time between a stopped timer's start and stop as a CPU scope.
+        /// </summary>
+        void add_cpu_scope( std::string name, const Timer& timer );
+
+        /// <summary>
+        /// Starts collecting events and realigns the GPU clocks with the CPU clock. This submits to
+        /// the graphics and transfer queues, so call it from the thread that submits frames and uploads.
+        /// </summary>
+        void begin_capture();
+
+        /// <summary>
+        /// Stops collecting events and writes them as Chrome trace JSON. GPU scopes still in
+        /// flight when the capture ends aren't included.
+        /// </summary>
+        void end_capture( const std::filesystem::path& file_path );
+
+        constexpr bool is_capturing() const noexcept {
+            return capturing;
+        }
+
+        /// <summary>
+        /// The graphics scopes of the most recently read back frame.
+        /// </summary>
+        std::vector<Event> get_last_frame_events();
+
+        /// <summary>
+        /// The number of scopes dropped because a pool was full.
+        /// </summary>
+        constexpr uint32_t get_dropped_scope_count() const noexcept {
+            return dropped_scopes;
+        }
+
+    private:
+        void calibrate();
+        void calibrate( Calibration& calibration, bool reset_on_host );
+        double to_microseconds( uint64_t ticks, uint64_t mask, const Calibration& calibration ) const noexcept;
+        double to_microseconds( std::chrono::steady_clock::time_point time ) const noexcept;
+        void record( Event event );
+    };
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stb/stb_image.h>
+#include <vulkan/vulkan.hpp>
+#include "MemoryAllocator.hpp"
+
+namespace stlr {
+    /// <summary>
+    /// Decodes image files to RGBA8 on a pool of worker threads.
+    ///
+    /// A worker reads and decodes the file, then creates a host visible staging buffer the size
+    /// of the image and writes the texels into its persistently mapped memory. stb_image
+    /// allocates its own output, so that's the one copy the texels make before the GPU reads
+    /// them, and it happens on the worker. The thread that queued the load only collects the
+    /// finished staging buffers with take_decoded(), records their copies and frees them.
+    ///
+    /// Jobs share a queue, so loading many images keeps every worker busy and decoding time
+    /// divides by the thread count.
+    /// </summary>
+    class ImageLoader {
+    public:
+        using Handle = uint32_t;
+
+        /// <summary>
+        /// A decoded image in a staging buffer, ready to be copied into an image's first level.
+        /// </summary>
+        struct Decoded {
+            Handle handle = 0;
+            std::filesystem::path file;
+            uint32_t width = 0;
+            uint32_t height = 0;
+            /// Tightly packed RGBA8 texels. Null if decoding failed.
+            vk::Buffer staging;
+            MemoryAllocator::Allocation allocation;
+            /// Why decoding failed, or empty if it didn't.
+            std::string error;
+        };
+
+    private:
+        struct Job {
+            Handle handle;
+            std::filesystem::path file;
+        };
+
+        vk::Device device;
+        MemoryAllocator& allocator;
+        std::vector<std::thread> workers;
+
+        std::mutex mutex;
+        std::condition_variable job_ready;
+        std::deque<Job> jobs;
+        std::vector<Decoded> decoded;
+        Handle next_handle;
+        /// Jobs queued or being decoded.
+        uint32_t pending;
+        bool stopping;
+
+    public:
+        /// <param name="thread_count">The number of decoding threads. 0 uses one per hardware thread.</param>
+        ImageLoader( vk::Device device, MemoryAllocator& allocator, uint32_t thread_count = 0 )
+            : device( device )
+            , allocator( allocator )
+            , next_handle( 0 )
+            , pending( 0 )
+            , stopping( false ) {
+            if( thread_count == 0 )
+                thread_count = std::max( std::thread::hardware_concurrency(), 1u );
+
+            workers.reserve( thread_count );
+            for( uint32_t i = 0; i < thread_count; ++i ) {
+                workers.emplace_back( &ImageLoader::worker_loop, this );
+            }
+        }
+
+        /// <summary>
+        /// Drops the jobs that haven't started, waits for the ones that have and frees every
+        /// staging buffer that wasn't taken.
+        /// </summary>
+        ~ImageLoader() {
+            {
+                std::lock_guard<std::mutex> lock( mutex );
+                stopping = true;
+                jobs.clear();
+            }
+            job_ready.notify_all();
+
+            for( auto& w : workers ) {
+                w.join();
+            }
+            for( auto& d : decoded ) {
+                free_staging( d );
+            }
+        }
+
+        ImageLoader( const ImageLoader& ) = delete;
+        ImageLoader& operator=( const ImageLoader& ) = delete;
+
+        /// <summary>
+        /// Queues an image file to be decoded. Any format stb_image reads is accepted.
+        /// </summary>
+        /// <returns>The handle its Decoded will carry.</returns>
+        Handle load( std::filesystem::path file ) {
+            Handle handle;
+            {
+                std::lock_guard<std::mutex> lock( mutex );
+                handle = next_handle++;
+                jobs.push_back( Job { handle, std::move( file ) } );
+                ++pending;
+            }
+            job_ready.notify_one();
+            return handle;
+        }
+
+        /// <summary>
+        /// Takes the images decoded since the last call, in the order they finished. Their
+        /// staging buffers belong to the caller from then on; pass each to free_staging() once
+        /// the GPU has copied from it.
+        /// </summary>
+        std::vector<Decoded> take_decoded() {
+            std::vector<Decoded> result;
+            std::lock_guard<std::mutex> lock( mutex );
+            result.swap( decoded );
+            return result;
+        }
+
+        /// <summary>
+        /// The number of images queued or being decoded.
+        /// </summary>
+        uint32_t get_pending_count() {
+            std::lock_guard<std::mutex> lock( mutex );
+            return pending;
+        }
+
+        void free_staging( Decoded& image ) {
+            if( !image.staging )
+                return;
+            device.destroyBuffer( image.staging );
+            allocator.free( image.allocation );
+            image.staging = nullptr;
+        }
+
+    private:
+        void worker_loop() {
+            for( ;; ) {
+                Job job;
+                {
+                    std::unique_lock<std::mutex> lock( mutex );
+                    job_ready.wait( lock, [this] { return stopping || !jobs.empty(); } );
+                    if( stopping )
+                        return;
+                    job = std::move( jobs.front() );
+                    jobs.pop_front();
+                }
+
+                Decoded d { decode( job ) };
+
+                {
+                    std::lock_guard<std::mutex> lock( mutex );
+                    decoded.push_back( std::move( d ) );
+                    --pending;
+                }
+            }
+        }
+
+        Decoded decode( const Job& job ) {
+            Decoded d;
+            d.handle = job.handle;
+            d.file = job.file;
+
+            int width { 0 };
+            int height { 0 };
+            stbi_uc* texels { stbi_load( job.file.string().c_str(), &width, &height, nullptr, STBI_rgb_alpha ) };
+            if( texels == nullptr ) {
+                d.error = stbi_failure_reason();
+                return d;
+            }
+
+            try {
+                const vk::DeviceSize size { static_cast<vk::DeviceSize>( width ) * height * STBI_rgb_alpha };
+                vk::BufferCreateInfo ci {
+                    {},
+                    size,
+                    vk::BufferUsageFlagBits::eTransferSrc,
+                    vk::SharingMode::eExclusive
+                };
+                d.staging = device.createBuffer( ci );
+                // The allocator locks around its block lists, so workers can allocate at the same time.
+                d.allocation = allocator.allocate( d.staging, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent );
+                allocator.write( d.allocation, texels, size );
+                d.width = static_cast<uint32_t>( width );
+                d.height = static_cast<uint32_t>( height );
+            }
+            catch( const std::exception& e ) {
+                if( d.staging ) {
+                    device.destroyBuffer( d.staging );
+                    d.staging = nullptr;
+                }
+                d.error = e.what();
+            }
+
+            stbi_image_free( texels );
+            return d;
+        }
+    };
+}
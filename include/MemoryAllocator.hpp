@@ -0,0 +1,493 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+namespace stlr {
+    /// <summary>
+    /// Sub-allocates buffers and images from large device memory blocks, one
+    /// set of blocks per memory type. Linear (buffer) and optimal (image)
+    /// resources are kept in separate blocks so that bufferImageGranularity
+    /// never has to be accounted for between neighbouring allocations.
+    ///
+    /// Host-visible memory is mapped once when its block is created and stays
+    /// mapped until the block is released. Writes through write() on
+    /// non-coherent memory are recorded and flushed together by flush().
+    /// </summary>
+    class MemoryAllocator {
+    public:
+        static constexpr vk::DeviceSize default_block_size = 64ull * 1024 * 1024;
+        static constexpr uint32_t dedicated_block = UINT32_MAX;
+
+        /// <summary>
+        /// A range of device memory that a resource is bound to.
+        /// </summary>
+        struct Allocation {
+            vk::DeviceMemory memory;
+            vk::DeviceSize offset = 0;
+            vk::DeviceSize size = 0;
+            uint32_t memory_type_index = UINT32_MAX;
+            uint32_t block_index = dedicated_block;
+            bool linear = true;
+            /// The host address of offset, or null if the memory isn't host visible.
+            void* mapped = nullptr;
+            bool coherent = true;
+
+            constexpr bool is_dedicated() const noexcept {
+                return block_index == dedicated_block;
+            }
+        };
+
+        /// <summary>
+        /// Owns an allocation and returns it to its allocator when destroyed.
+        /// </summary>
+        class UniqueAllocation {
+        private:
+            MemoryAllocator* allocator;
+            Allocation allocation;
+
+        public:
+            UniqueAllocation() : allocator( nullptr ), allocation() {}
+            UniqueAllocation( MemoryAllocator& allocator, const Allocation& allocation ) : allocator( &allocator ), allocation( allocation ) {}
+            UniqueAllocation( const UniqueAllocation& ) = delete;
+            UniqueAllocation( UniqueAllocation&& other ) noexcept : allocator( other.allocator ), allocation( other.allocation ) {
+                other.allocator = nullptr;
+            }
+
+            UniqueAllocation& operator=( const UniqueAllocation& ) = delete;
+            UniqueAllocation& operator=( UniqueAllocation&& other ) noexcept {
+                if( this != &other ) {
+                    reset();
+                    allocator = other.allocator;
+                    allocation = other.allocation;
+                    other.allocator = nullptr;
+                }
+                return *this;
+            }
+
+            ~UniqueAllocation() {
+                reset();
+            }
+
+            const Allocation& get() const noexcept {
+                return allocation;
+            }
+
+            const Allocation* operator->() const noexcept {
+                return &allocation;
+            }
+
+            void write( const void* data, vk::DeviceSize size, vk::DeviceSize offset = 0 ) {
+                allocator->write( allocation, data, size, offset );
+            }
+
+            void reset() {
+                if( allocator != nullptr ) {
+                    allocator->free( allocation );
+                    allocator = nullptr;
+                }
+            }
+        };
+
+        struct Statistics {
+            uint32_t device_allocation_count = 0;
+            uint32_t resource_count = 0;
+            vk::DeviceSize reserved_bytes = 0;
+            vk::DeviceSize used_bytes = 0;
+        };
+
+    private:
+        struct Block {
+            vk::DeviceMemory memory;
+            void* mapped = nullptr;
+            vk::DeviceSize size = 0;
+            uint32_t allocation_count = 0;
+            /// Free ranges keyed by offset, mapped to their size.
+            std::map<vk::DeviceSize, vk::DeviceSize> free_ranges;
+        };
+
+        struct Pool {
+            std::vector<Block> blocks;
+        };
+
+        vk::Device device;
+        vk::PhysicalDeviceMemoryProperties memory_properties;
+        vk::DeviceSize non_coherent_atom_size;
+        vk::DeviceSize preferred_block_size;
+        /// Whether the Vulkan 1.1 memory requirement queries and dedicated allocations can be used.
+        bool dedicated_allocations;
+        /// Indexed by memory type * 2 + (linear ? 0 : 1).
+        std::vector<Pool> pools;
+        /// Written, not yet flushed ranges of non-coherent memory, already widened to whole atoms.
+        std::vector<vk::MappedMemoryRange> dirty_ranges;
+        Statistics statistics;
+        std::mutex mutex;
+
+    public:
+        /// <summary>
+        /// Creates an allocator for the device's memory types.
+        /// </summary>
+        /// <param name="api_version">The Vulkan version the instance was created with. Below 1.1, or on a 1.0 device,
+        /// memory requirements are queried with the 1.0 commands and no allocation is dedicated to its resource.</param>
+        MemoryAllocator( vk::PhysicalDevice physical_device, vk::Device device, uint32_t api_version = VK_API_VERSION_1_1, vk::DeviceSize block_size = default_block_size )
+            : device( device )
+            , memory_properties( physical_device.getMemoryProperties() )
+            , non_coherent_atom_size( physical_device.getProperties().limits.nonCoherentAtomSize )
+            , preferred_block_size( block_size )
+            , dedicated_allocations( std::min( api_version, physical_device.getProperties().apiVersion ) >= VK_API_VERSION_1_1 )
+            , pools( static_cast<size_t>( memory_properties.memoryTypeCount ) * 2 )
+            , statistics() {}
+
+        MemoryAllocator( const MemoryAllocator& ) = delete;
+        MemoryAllocator& operator=( const MemoryAllocator& ) = delete;
+
+        ~MemoryAllocator() {
+            for( auto& p : pools ) {
+                for( auto& b : p.blocks ) {
+                    if( b.memory ) {
+                        device.freeMemory( b.memory );
+                    }
+                }
+            }
+        }
+
+        /// <summary>
+        /// Allocates memory for a buffer and binds the buffer to it.
+        /// </summary>
+        /// <param name="buffer">The buffer to allocate for.</param>
+        /// <param name="properties">The properties the memory type must have.</param>
+        /// <returns>The allocation the buffer is bound to.</returns>
+        Allocation allocate( vk::Buffer buffer, vk::MemoryPropertyFlags properties ) {
+            Allocation a;
+            if( dedicated_allocations ) {
+                auto reqs = device.getBufferMemoryRequirements2<vk::MemoryRequirements2, vk::MemoryDedicatedRequirements>( vk::BufferMemoryRequirementsInfo2 { buffer } );
+                const auto& dedicated = reqs.get<vk::MemoryDedicatedRequirements>();
+                a = allocate( reqs.get<vk::MemoryRequirements2>().memoryRequirements, properties, true, dedicated.prefersDedicatedAllocation || dedicated.requiresDedicatedAllocation, vk::MemoryDedicatedAllocateInfo { {}, buffer } );
+            }
+            else {
+                a = allocate( device.getBufferMemoryRequirements( buffer ), properties, true, false, vk::MemoryDedicatedAllocateInfo {} );
+            }
+            device.bindBufferMemory( buffer, a.memory, a.offset );
+            return a;
+        }
+
+        /// <summary>
+        /// Allocates memory for an optimally tiled image and binds the image to it.
+        /// </summary>
+        /// <param name="image">The image to allocate for.</param>
+        /// <param name="properties">The properties the memory type must have.</param>
+        /// <returns>The allocation the image is bound to.</returns>
+        Allocation allocate( vk::Image image, vk::MemoryPropertyFlags properties ) {
+            Allocation a;
+            if( dedicated_allocations ) {
+                auto reqs = device.getImageMemoryRequirements2<vk::MemoryRequirements2, vk::MemoryDedicatedRequirements>( vk::ImageMemoryRequirementsInfo2 { image } );
+                const auto& dedicated = reqs.get<vk::MemoryDedicatedRequirements>();
+                a = allocate( reqs.get<vk::MemoryRequirements2>().memoryRequirements, properties, false, dedicated.prefersDedicatedAllocation || dedicated.requiresDedicatedAllocation, vk::MemoryDedicatedAllocateInfo { image, {} } );
+            }
+            else {
+                a = allocate( device.getImageMemoryRequirements( image ), properties, false, false, vk::MemoryDedicatedAllocateInfo {} );
+            }
+            device.bindImageMemory( image, a.memory, a.offset );
+            return a;
+        }
+
+        /// <summary>
+        /// Allocates memory without binding anything to it, for memory that several
+        /// resources are bound to, e.g. aliased transient attachments.
+        /// </summary>
+        /// <param name="requirements">The combined requirements of every resource that will be bound.</param>
+        /// <param name="properties">The properties the memory type must have.</param>
+        /// <param name="linear">Whether linear resources (buffers, linear images) will be bound.</param>
+        Allocation allocate( const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags properties, bool linear ) {
+            return allocate( requirements, properties, linear, false, vk::MemoryDedicatedAllocateInfo {} );
+        }
+
+        template <typename T>
+        UniqueAllocation allocate_unique( T handle, vk::MemoryPropertyFlags properties ) {
+            return UniqueAllocation( *this, allocate( handle, properties ) );
+        }
+
+        /// <summary>
+        /// Returns an allocation's range to its block, merging it with any free
+        /// neighbours. Empty blocks are released unless they're the last block of
+        /// their pool.
+        /// </summary>
+        /// <param name="allocation">The allocation to free.</param>
+        void free( const Allocation& allocation ) {
+            std::lock_guard<std::mutex> lock( mutex );
+            statistics.resource_count--;
+            statistics.used_bytes -= allocation.size;
+
+            // Drop pending flushes of the freed range so they can't outlive the memory.
+            dirty_ranges.erase( std::remove_if( dirty_ranges.begin(), dirty_ranges.end(), [&]( const vk::MappedMemoryRange& r ) {
+                return r.memory == allocation.memory && r.offset < allocation.offset + allocation.size && allocation.offset < r.offset + r.size;
+            } ), dirty_ranges.end() );
+
+            if( allocation.is_dedicated() ) {
+                device.freeMemory( allocation.memory );
+                statistics.device_allocation_count--;
+                statistics.reserved_bytes -= allocation.size;
+                return;
+            }
+
+            Pool& pool = pools[pool_index( allocation.memory_type_index, allocation.linear )];
+            Block& block = pool.blocks[allocation.block_index];
+            auto& ranges = block.free_ranges;
+
+            vk::DeviceSize offset = allocation.offset;
+            vk::DeviceSize size = allocation.size;
+
+            auto next = ranges.lower_bound( offset );
+            if( next != ranges.begin() ) {
+                auto prev = std::prev( next );
+                if( prev->first + prev->second == offset ) {
+                    offset = prev->first;
+                    size += prev->second;
+                    ranges.erase( prev );
+                }
+            }
+            if( next != ranges.end() && offset + size == next->first ) {
+                size += next->second;
+                ranges.erase( next );
+            }
+            ranges[offset] = size;
+
+            block.allocation_count--;
+            if( block.allocation_count == 0 && count_live_blocks( pool ) > 1 ) {
+                device.freeMemory( block.memory );
+                statistics.device_allocation_count--;
+                statistics.reserved_bytes -= block.size;
+                block = Block();
+            }
+        }
+
+        /// <summary>
+        /// Copies data into a mapped allocation. On non-coherent memory the
+        /// range is remembered until the next flush().
+        /// </summary>
+        /// <param name="allocation">The host-visible allocation to write to.</param>
+        /// <param name="data">The data to copy.</param>
+        /// <param name="size">The number of bytes to copy.</param>
+        /// <param name="offset">The offset from the start of the allocation.</param>
+        void write( const Allocation& allocation, const void* data, vk::DeviceSize size, vk::DeviceSize offset = 0 ) {
+            if( allocation.mapped == nullptr || offset + size > allocation.size ) {
+                throw std::out_of_range( "Write is outside of the mapped allocation." );
+            }
+
+            memcpy( static_cast<char*>( allocation.mapped ) + offset, data, static_cast<size_t>( size ) );
+
+            if( !allocation.coherent && size > 0 ) {
+                // Non-coherent allocations are atom aligned, so widening never leaves the allocation.
+                vk::DeviceSize begin = ( allocation.offset + offset ) / non_coherent_atom_size * non_coherent_atom_size;
+                vk::DeviceSize end = align_up( allocation.offset + offset + size, non_coherent_atom_size );
+
+                std::lock_guard<std::mutex> lock( mutex );
+                dirty_ranges.push_back( vk::MappedMemoryRange { allocation.memory, begin, end - begin } );
+            }
+        }
+
+        /// <summary>
+        /// Flushes every range written since the last flush with a single call.
+        /// Overlapping and touching ranges in the same memory are merged first.
+        /// </summary>
+        void flush() {
+            std::lock_guard<std::mutex> lock( mutex );
+            if( dirty_ranges.empty() ) {
+                return;
+            }
+
+            std::sort( dirty_ranges.begin(), dirty_ranges.end(), []( const vk::MappedMemoryRange& a, const vk::MappedMemoryRange& b ) {
+                return a.memory != b.memory ? static_cast<VkDeviceMemory>( a.memory ) < static_cast<VkDeviceMemory>( b.memory ) : a.offset < b.offset;
+            } );
+
+            std::vector<vk::MappedMemoryRange> merged;
+            merged.reserve( dirty_ranges.size() );
+            for( const auto& r : dirty_ranges ) {
+                if( !merged.empty() && merged.back().memory == r.memory && r.offset <= merged.back().offset + merged.back().size ) {
+                    merged.back().size = std::max( merged.back().offset + merged.back().size, r.offset + r.size ) - merged.back().offset;
+                }
+                else {
+                    merged.push_back( r );
+                }
+            }
+
+            device.flushMappedMemoryRanges( merged );
+            dirty_ranges.clear();
+        }
+
+        Statistics get_statistics() {
+            std::lock_guard<std::mutex> lock( mutex );
+            return statistics;
+        }
+
+        const vk::PhysicalDeviceMemoryProperties& get_memory_properties() const noexcept {
+            return memory_properties;
+        }
+
+    private:
+        static constexpr size_t pool_index( uint32_t memory_type_index, bool linear ) noexcept {
+            return static_cast<size_t>( memory_type_index ) * 2 + ( linear ? 0 : 1 );
+        }
+
+        static constexpr vk::DeviceSize align_up( vk::DeviceSize value, vk::DeviceSize alignment ) noexcept {
+            return ( value + alignment - 1 ) / alignment * alignment;
+        }
+
+        static size_t count_live_blocks( const Pool& pool ) noexcept {
+            size_t n = 0;
+            for( const auto& b : pool.blocks ) {
+                if( b.memory ) {
+                    n++;
+                }
+            }
+            return n;
+        }
+
+        vk::DeviceSize block_size_for( uint32_t memory_type_index ) const noexcept {
+            const vk::MemoryHeap& heap = memory_properties.memoryHeaps[memory_properties.memoryTypes[memory_type_index].heapIndex];
+            // Keep small heaps (e.g. the 256MB BAR heap) from being claimed by a couple of blocks.
+            return std::min( preferred_block_size, heap.size / 8 / non_coherent_atom_size * non_coherent_atom_size );
+        }
+
+        bool is_host_visible( uint32_t memory_type_index ) const noexcept {
+            return static_cast<bool>( memory_properties.memoryTypes[memory_type_index].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible );
+        }
+
+        bool is_non_coherent( uint32_t memory_type_index ) const noexcept {
+            return is_host_visible( memory_type_index ) &&
+                !( memory_properties.memoryTypes[memory_type_index].propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent );
+        }
+
+        void* map( vk::DeviceMemory memory, uint32_t memory_type_index ) {
+            return is_host_visible( memory_type_index ) ? device.mapMemory( memory, 0, VK_WHOLE_SIZE ) : nullptr;
+        }
+
+        Allocation allocate( const vk::MemoryRequirements& reqs, vk::MemoryPropertyFlags properties, bool linear, bool prefers_dedicated, const vk::MemoryDedicatedAllocateInfo& dedicated_info ) {
+            std::lock_guard<std::mutex> lock( mutex );
+
+            // Try every compatible memory type in order, moving on when one runs out of space.
+            for( uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i ) {
+                if( !( reqs.memoryTypeBits & ( 1 << i ) ) ||
+                    ( memory_properties.memoryTypes[i].propertyFlags & properties ) != properties )
+                    continue;
+
+                // Non-coherent memory is flushed in whole atoms, so keep allocations atom aligned.
+                vk::MemoryRequirements type_reqs { reqs };
+                if( is_non_coherent( i ) ) {
+                    type_reqs.alignment = std::max( type_reqs.alignment, non_coherent_atom_size );
+                    type_reqs.size = align_up( type_reqs.size, non_coherent_atom_size );
+                }
+
+                try {
+                    const vk::DeviceSize block_size = block_size_for( i );
+                    if( prefers_dedicated || type_reqs.size > block_size / 2 ) {
+                        return allocate_dedicated( type_reqs, i, linear, dedicated_info );
+                    }
+                    return allocate_from_pool( type_reqs, i, linear, block_size );
+                }
+                catch( const vk::OutOfDeviceMemoryError& ) {
+                    continue;
+                }
+            }
+
+            throw std::runtime_error( "No memory type can satisfy the allocation." );
+        }
+
+        Allocation allocate_dedicated( const vk::MemoryRequirements& reqs, uint32_t memory_type_index, bool linear, const vk::MemoryDedicatedAllocateInfo& dedicated_info ) {
+            vk::MemoryAllocateInfo ai { reqs.size, memory_type_index };
+            // Without 1.1, a large resource still gets its own memory, just without telling the driver whose it is.
+            if( dedicated_allocations )
+                ai.setPNext( &dedicated_info );
+            vk::DeviceMemory memory { device.allocateMemory( ai ) };
+            void* mapped { map( memory, memory_type_index ) };
+
+            statistics.device_allocation_count++;
+            statistics.reserved_bytes += reqs.size;
+            statistics.resource_count++;
+            statistics.used_bytes += reqs.size;
+
+            return Allocation { memory, 0, reqs.size, memory_type_index, dedicated_block, linear, mapped, !is_non_coherent( memory_type_index ) };
+        }
+
+        Allocation allocate_from_pool( const vk::MemoryRequirements& reqs, uint32_t memory_type_index, bool linear, vk::DeviceSize block_size ) {
+            Pool& pool = pools[pool_index( memory_type_index, linear )];
+
+            for( uint32_t b = 0; b < pool.blocks.size(); ++b ) {
+                if( pool.blocks[b].memory ) {
+                    auto offset = allocate_from_block( pool.blocks[b], reqs );
+                    if( offset.has_value() ) {
+                        return make_allocation( pool.blocks[b], b, offset.value(), reqs.size, memory_type_index, linear );
+                    }
+                }
+            }
+
+            // No room, so reuse a released slot or add a new block.
+            uint32_t b = 0;
+            while( b < pool.blocks.size() && pool.blocks[b].memory ) {
+                b++;
+            }
+            if( b == pool.blocks.size() ) {
+                pool.blocks.emplace_back();
+            }
+
+            Block& block = pool.blocks[b];
+            block.memory = device.allocateMemory( vk::MemoryAllocateInfo { block_size, memory_type_index } );
+            block.mapped = map( block.memory, memory_type_index );
+            block.size = block_size;
+            block.allocation_count = 0;
+            block.free_ranges = { { 0, block_size } };
+            statistics.device_allocation_count++;
+            statistics.reserved_bytes += block_size;
+
+            return make_allocation( block, b, allocate_from_block( block, reqs ).value(), reqs.size, memory_type_index, linear );
+        }
+
+        /// <summary>
+        /// Finds the smallest free range that fits the requirements once aligned
+        /// and carves the allocation out of it.
+        /// </summary>
+        static std::optional<vk::DeviceSize> allocate_from_block( Block& block, const vk::MemoryRequirements& reqs ) {
+            auto best = block.free_ranges.end();
+            for( auto it = block.free_ranges.begin(); it != block.free_ranges.end(); ++it ) {
+                vk::DeviceSize aligned = align_up( it->first, reqs.alignment );
+                if( aligned + reqs.size <= it->first + it->second &&
+                    ( best == block.free_ranges.end() || it->second < best->second ) ) {
+                    best = it;
+                }
+            }
+
+            if( best == block.free_ranges.end() ) {
+                return std::nullopt;
+            }
+
+            const vk::DeviceSize range_offset = best->first;
+            const vk::DeviceSize range_end = best->first + best->second;
+            const vk::DeviceSize aligned = align_up( range_offset, reqs.alignment );
+            block.free_ranges.erase( best );
+
+            if( aligned > range_offset ) {
+                block.free_ranges[range_offset] = aligned - range_offset;
+            }
+            if( aligned + reqs.size < range_end ) {
+                block.free_ranges[aligned + reqs.size] = range_end - ( aligned + reqs.size );
+            }
+
+            return aligned;
+        }
+
+        Allocation make_allocation( Block& block, uint32_t block_index, vk::DeviceSize offset, vk::DeviceSize size, uint32_t memory_type_index, bool linear ) {
+            block.allocation_count++;
+            statistics.resource_count++;
+            statistics.used_bytes += size;
+            void* mapped { block.mapped != nullptr ? static_cast<char*>( block.mapped ) + offset : nullptr };
+            return Allocation { block.memory, offset, size, memory_type_index, block_index, linear, mapped, !is_non_coherent( memory_type_index ) };
+        }
+    };
+}
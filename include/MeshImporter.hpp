@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace stlr {
+    /// <summary>
+    /// The vertex every imported mesh is made of, as the asset cooker writes it.
+    /// </summary>
+    struct MeshVertex {
+        std::array<float, 3> position;
+        std::array<float, 2> uv;
+        std::array<float, 3> normal;
+    };
+    static_assert( sizeof( MeshVertex ) == 32, "MeshVertex must be tightly packed." );
+
+    /// <summary>
+    /// An indexed triangle list.
+    /// </summary>
+    struct MeshData {
+        std::string name;
+        std::vector<MeshVertex> vertices;
+        std::vector<uint32_t> indices;
+
+        /// <summary>
+        /// Whether every index fits in 16 bits, halving the index buffer and its bandwidth.
+        /// </summary>
+        bool uses_16_bit_indices() const noexcept {
+            return vertices.size() < 65536;
+        }
+
+        uint32_t get_index_size() const noexcept {
+            return uses_16_bit_indices() ? 2 : 4;
+        }
+
+        /// <summary>
+        /// The indices packed into 16 bits each if uses_16_bit_indices(), or 32 otherwise.
+        /// </summary>
+        std::vector<char> get_index_data() const {
+            std::vector<char> data( indices.size() * get_index_size() );
+            if( uses_16_bit_indices() ) {
+                for( size_t i = 0; i < indices.size(); ++i ) {
+                    const uint16_t index { static_cast<uint16_t>( indices[i] ) };
+                    std::memcpy( data.data() + i * sizeof( index ), &index, sizeof( index ) );
+                }
+            }
+            else {
+                std::memcpy( data.data(), indices.data(), data.size() );
+            }
+            return data;
+        }
+    };
+
+    /// <summary>
+    /// Reads meshes from OBJ and glTF 2.0 files and prepares them for drawing.
+    ///
+    /// optimize() merges identical vertices, reorders the triangles with Tom Forsyth's linear-speed
+    /// vertex cache optimization, so consecutive triangles reuse vertices the GPU has just shaded,
+    /// and then renumbers the vertices in the order the triangles first use them, so vertex fetches
+    /// walk through memory. The triangles themselves, and their winding, don't change.
+    /// </summary>
+    namespace mesh_import {
+        /// <summary>
+        /// Loads the meshes of an .obj, .gltf or .glb file, by its extension, and optimizes them.
+        /// </summary>
+        std::vector<MeshData> load( const std::filesystem::path& file );
+
+        /// <summary>
+        /// Reads an OBJ's faces, fanned into triangles, as one mesh. Its V coordinates are flipped
+        /// to Vulkan's top-left origin.
+        /// </summary>
+        MeshData load_obj( const std::filesystem::path& file );
+
+        /// <summary>
+        /// Reads each mesh of a glTF 2.0 file, with its triangle primitives merged into one list.
+        /// Buffers may be embedded in a .glb, base64 data URIs or files next to the .gltf. Meshes
+        /// keep their own space; node transforms aren't applied.
+        /// </summary>
+        std::vector<MeshData> load_gltf( const std::filesystem::path& file );
+
+        /// <summary>
+        /// Merges vertices that are equal bit for bit.
+        /// </summary>
+        void deduplicate( MeshData& mesh );
+
+        /// <summary>
+        /// Reorders triangles so their vertices hit the post-transform cache.
+        /// </summary>
+        void optimize_vertex_cache( std::vector<uint32_t>& indices, uint32_t vertex_count );
+
+        /// <summary>
+        /// Renumbers vertices in the order the indices first use them and drops unused ones.
+        /// </summary>
+        void optimize_vertex_fetch( MeshData& mesh );
+
+        void optimize( MeshData& mesh );
+
+        /// <summary>
+        /// The average number of vertices shaded per triangle with a FIFO cache of cache_size
+        /// vertices: 3 with no reuse, about 0.5 at best for a regular grid.
+        /// </summary>
+        float get_acmr( const std::vector<uint32_t>& indices, uint32_t vertex_count, uint32_t cache_size = 16 );
+    }
+}
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+#include "Utils.hpp"
+
+namespace stlr {
+    /// <summary>
+    /// Records the commands that fill an image's mip chain from its first level.
+    ///
+    /// Formats that blits can filter linearly are downsampled by a cascade of vkCmdBlitImage, each
+    /// level from the one above it. Formats that can't, but can be written as storage images, are
+    /// downsampled by a compute shader that averages 2x2 texels, one dispatch per level. Any other
+    /// format gets no mips, so get_mip_level_count() is 1 for it.
+    ///
+    /// The compute path needs shaderStorageImageWriteWithoutFormat enabled on the device.
+    /// </summary>
+    class MipmapGenerator {
+    public:
+        enum class Method {
+            eNone,
+            eBlit,
+            eCompute
+        };
+
+        /// <summary>
+        /// The descriptor sets and views a compute downsample reads. They must be kept until the
+        /// commands that use them have completed. Empty for blits.
+        /// </summary>
+        struct Resources {
+            vk::UniqueDescriptorPool pool;
+            std::vector<vk::UniqueImageView> views;
+        };
+
+    private:
+        static constexpr uint32_t group_size = 8;
+
+        vk::PhysicalDevice physical_device;
+        vk::Device device;
+        std::filesystem::path shader_file;
+        bool storage_write_without_format;
+        vk::UniqueSampler sampler;
+        vk::UniqueDescriptorSetLayout set_layout;
+        vk::UniquePipelineLayout pipeline_layout;
+        vk::UniqueShaderModule shader;
+        vk::UniquePipeline pipeline;
+
+    public:
+        /// <param name="shader_file">The compiled mip-cs.comp, only loaded the first time a format needs it.</param>
+        MipmapGenerator( vk::PhysicalDevice physical_device, vk::Device device, std::filesystem::path shader_file )
+            : physical_device( physical_device )
+            , device( device )
+            , shader_file( std::move( shader_file ) )
+            , storage_write_without_format( physical_device.getFeatures().shaderStorageImageWriteWithoutFormat ) {}
+
+        MipmapGenerator( const MipmapGenerator& ) = delete;
+        MipmapGenerator& operator=( const MipmapGenerator& ) = delete;
+
+        Method get_method( vk::Format format ) const {
+            const vk::FormatFeatureFlags features { physical_device.getFormatProperties( format ).optimalTilingFeatures };
+            const vk::FormatFeatureFlags blit { vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst | vk::FormatFeatureFlagBits::eSampledImageFilterLinear };
+            const vk::FormatFeatureFlags compute { vk::FormatFeatureFlagBits::eSampledImage | vk::FormatFeatureFlagBits::eStorageImage };
+
+            if( ( features & blit ) == blit )
+                return Method::eBlit;
+            if( ( features & compute ) == compute && storage_write_without_format )
+                return Method::eCompute;
+            return Method::eNone;
+        }
+
+        /// <summary>
+        /// The number of levels to create an image of this format with.
+        /// </summary>
+        uint32_t get_mip_level_count( vk::Format format, uint32_t width, uint32_t height ) const {
+            return get_method( format ) == Method::eNone ? 1 : get_full_mip_level_count( width, height );
+        }
+
+        /// <summary>
+        /// The usage an image of this format needs on top of its own for generate().
+        /// </summary>
+        vk::ImageUsageFlags get_required_usage( vk::Format format ) const {
+            switch( get_method( format ) ) {
+            case Method::eBlit:
+                return vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst;
+            case Method::eCompute:
+                return vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage;
+            default:
+                return {};
+            }
+        }
+
+        /// <summary>
+        /// Fills levels 1 and up from level 0. Every level must be in eTransferDstOptimal, with level 0
+        /// written by a transfer. Afterwards every level is in final_layout and visible to dst_stage.
+        /// </summary>
+        Resources generate( vk::CommandBuffer command_buffer, vk::Image image, vk::Format format, uint32_t width, uint32_t height, uint32_t levels, vk::ImageLayout final_layout, vk::PipelineStageFlags dst_stage, vk::AccessFlags dst_access ) {
+            if( levels <= 1 ) {
+                barrier( command_buffer, image, 0, VK_REMAINING_MIP_LEVELS, vk::ImageLayout::eTransferDstOptimal, final_layout, vk::AccessFlagBits::eTransferWrite, dst_access, vk::PipelineStageFlagBits::eTransfer, dst_stage );
+                return {};
+            }
+
+            switch( get_method( format ) ) {
+            case Method::eBlit:
+                record_blits( command_buffer, image, width, height, levels, final_layout, dst_stage, dst_access );
+                return {};
+            case Method::eCompute:
+                return record_dispatches( command_buffer, image, format, width, height, levels, final_layout, dst_stage, dst_access );
+            default:
+                throw std::invalid_argument( "Mipmaps can't be generated for the format; create the image with get_mip_level_count() levels." );
+            }
+        }
+
+    private:
+        static void barrier( vk::CommandBuffer command_buffer, vk::Image image, uint32_t base_level, uint32_t level_count, vk::ImageLayout old_layout, vk::ImageLayout new_layout, vk::AccessFlags src_access, vk::AccessFlags dst_access, vk::PipelineStageFlags src_stage, vk::PipelineStageFlags dst_stage ) {
+            vk::ImageMemoryBarrier b {
+                src_access,
+                dst_access,
+                old_layout,
+                new_layout,
+                VK_QUEUE_FAMILY_IGNORED,
+                VK_QUEUE_FAMILY_IGNORED,
+                image,
+                vk::ImageSubresourceRange { vk::ImageAspectFlagBits::eColor, base_level, level_count, 0, 1 }
+            };
+            command_buffer.pipelineBarrier( src_stage, dst_stage, {}, nullptr, nullptr, b );
+        }
+
+        void record_blits( vk::CommandBuffer command_buffer, vk::Image image, uint32_t width, uint32_t height, uint32_t levels, vk::ImageLayout final_layout, vk::PipelineStageFlags dst_stage, vk::AccessFlags dst_access ) {
+            int32_t w { static_cast<int32_t>( width ) };
+            int32_t h { static_cast<int32_t>( height ) };
+
+            for( uint32_t i = 1; i < levels; ++i ) {
+                barrier( command_buffer, image, i - 1, 1, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferSrcOptimal, vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eTransferRead, vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer );
+
+                const int32_t next_w { std::max( w / 2, 1 ) };
+                const int32_t next_h { std::max( h / 2, 1 ) };
+                vk::ImageBlit blit {
+                    vk::ImageSubresourceLayers { vk::ImageAspectFlagBits::eColor, i - 1, 0, 1 },
+                    { vk::Offset3D { 0, 0, 0 }, vk::Offset3D { w, h, 1 } },
+                    vk::ImageSubresourceLayers { vk::ImageAspectFlagBits::eColor, i, 0, 1 },
+                    { vk::Offset3D { 0, 0, 0 }, vk::Offset3D { next_w, next_h, 1 } }
+                };
+                command_buffer.blitImage( image, vk::ImageLayout::eTransferSrcOptimal, image, vk::ImageLayout::eTransferDstOptimal, blit, vk::Filter::eLinear );
+
+                // The level has been read for the last time, so it can go to its final layout now.
+                barrier( command_buffer, image, i - 1, 1, vk::ImageLayout::eTransferSrcOptimal, final_layout, vk::AccessFlagBits::eTransferRead, dst_access, vk::PipelineStageFlagBits::eTransfer, dst_stage );
+
+                w = next_w;
+                h = next_h;
+            }
+
+            barrier( command_buffer, image, levels - 1, 1, vk::ImageLayout::eTransferDstOptimal, final_layout, vk::AccessFlagBits::eTransferWrite, dst_access, vk::PipelineStageFlagBits::eTransfer, dst_stage );
+        }
+
+        Resources record_dispatches( vk::CommandBuffer command_buffer, vk::Image image, vk::Format format, uint32_t width, uint32_t height, uint32_t levels, vk::ImageLayout final_layout, vk::PipelineStageFlags dst_stage, vk::AccessFlags dst_access ) {
+            create_pipeline();
+
+            Resources r;
+            const uint32_t set_count { levels - 1 };
+            std::array<vk::DescriptorPoolSize, 2> pool_sizes {
+                vk::DescriptorPoolSize { vk::DescriptorType::eCombinedImageSampler, set_count },
+                vk::DescriptorPoolSize { vk::DescriptorType::eStorageImage, set_count }
+            };
+            r.pool = device.createDescriptorPoolUnique( vk::DescriptorPoolCreateInfo { {}, set_count, static_cast<uint32_t>( pool_sizes.size() ), pool_sizes.data() } );
+
+            // Each level has its own view: read as the source of the level below it, written as a storage image.
+            r.views.reserve( levels );
+            for( uint32_t i = 0; i < levels; ++i ) {
+                vk::ImageViewCreateInfo ci {
+                    {},
+                    image,
+                    vk::ImageViewType::e2D,
+                    format,
+                    {},
+                    vk::ImageSubresourceRange { vk::ImageAspectFlagBits::eColor, i, 1, 0, 1 }
+                };
+                r.views.push_back( device.createImageViewUnique( ci ) );
+            }
+
+            std::vector<vk::DescriptorSetLayout> layouts( set_count, set_layout.get() );
+            std::vector<vk::DescriptorSet> sets { device.allocateDescriptorSets( vk::DescriptorSetAllocateInfo { r.pool.get(), set_count, layouts.data() } ) };
+
+            std::vector<vk::DescriptorImageInfo> infos;
+            std::vector<vk::WriteDescriptorSet> writes;
+            infos.reserve( set_count * 2 );
+            writes.reserve( set_count * 2 );
+            for( uint32_t i = 0; i < set_count; ++i ) {
+                infos.push_back( vk::DescriptorImageInfo { sampler.get(), r.views[i].get(), vk::ImageLayout::eGeneral } );
+                writes.push_back( vk::WriteDescriptorSet { sets[i], 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &infos.back() } );
+                infos.push_back( vk::DescriptorImageInfo { nullptr, r.views[i + 1].get(), vk::ImageLayout::eGeneral } );
+                writes.push_back( vk::WriteDescriptorSet { sets[i], 1, 0, 1, vk::DescriptorType::eStorageImage, &infos.back() } );
+            }
+            device.updateDescriptorSets( writes, nullptr );
+
+            // General lets each level be written and then read without another layout change.
+            barrier( command_buffer, image, 0, levels, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eGeneral, vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite, vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader );
+
+            command_buffer.bindPipeline( vk::PipelineBindPoint::eCompute, pipeline.get() );
+            uint32_t w { width };
+            uint32_t h { height };
+            for( uint32_t i = 0; i < set_count; ++i ) {
+                w = std::max( w / 2, 1u );
+                h = std::max( h / 2, 1u );
+                const std::array<int32_t, 2> size { static_cast<int32_t>( w ), static_cast<int32_t>( h ) };
+
+                command_buffer.bindDescriptorSets( vk::PipelineBindPoint::eCompute, pipeline_layout.get(), 0, sets[i], nullptr );
+                command_buffer.pushConstants( pipeline_layout.get(), vk::ShaderStageFlagBits::eCompute, 0, sizeof( size ), size.data() );
+                command_buffer.dispatch( ( w + group_size - 1 ) / group_size, ( h + group_size - 1 ) / group_size, 1 );
+
+                barrier( command_buffer, image, i + 1, 1, vk::ImageLayout::eGeneral, vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader );
+            }
+
+            barrier( command_buffer, image, 0, levels, vk::ImageLayout::eGeneral, final_layout, vk::AccessFlagBits::eShaderWrite, dst_access, vk::PipelineStageFlagBits::eComputeShader, dst_stage );
+
+            return r;
+        }
+
+        void create_pipeline() {
+            if( pipeline )
+                return;
+
+            std::ifstream file( shader_file, std::ios::binary | std::ios::ate );
+            if( !file.is_open() )
+                throw std::runtime_error( "Failed to open the mipmap shader: " + shader_file.string() );
+            std::vector<char> code( static_cast<size_t>( file.tellg() ) );
+            file.seekg( 0 );
+            file.read( code.data(), code.size() );
+
+            shader = device.createShaderModuleUnique( vk::ShaderModuleCreateInfo { {}, code.size(), reinterpret_cast<const uint32_t*>( code.data() ) } );
+
+            vk::SamplerCreateInfo sampler_ci {
+                {},
+                vk::Filter::eNearest,
+                vk::Filter::eNearest,
+                vk::SamplerMipmapMode::eNearest,
+                vk::SamplerAddressMode::eClampToEdge,
+                vk::SamplerAddressMode::eClampToEdge,
+                vk::SamplerAddressMode::eClampToEdge
+            };
+            sampler = device.createSamplerUnique( sampler_ci );
+
+            std::array<vk::DescriptorSetLayoutBinding, 2> bindings {
+                vk::DescriptorSetLayoutBinding { 0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute, nullptr },
+                vk::DescriptorSetLayoutBinding { 1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute, nullptr }
+            };
+            set_layout = device.createDescriptorSetLayoutUnique( vk::DescriptorSetLayoutCreateInfo { {}, static_cast<uint32_t>( bindings.size() ), bindings.data() } );
+
+            vk::PushConstantRange push_constants { vk::ShaderStageFlagBits::eCompute, 0, sizeof( int32_t ) * 2 };
+            pipeline_layout = device.createPipelineLayoutUnique( vk::PipelineLayoutCreateInfo { {}, 1, &set_layout.get(), 1, &push_constants } );
+
+            vk::ComputePipelineCreateInfo ci {
+                {},
+                vk::PipelineShaderStageCreateInfo { {}, vk::ShaderStageFlagBits::eCompute, shader.get(), "main" },
+                pipeline_layout.get()
+            };
+            pipeline = std::move( device.createComputePipelineUnique( nullptr, ci ).value );
+        }
+    };
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace stlr {
+    /// <summary>
+    /// Records secondary command buffers on a pool of worker threads.
+    ///
+    /// Every thread (the calling thread included) has its own command pool per frame in flight,
+    /// so recording never synchronizes on a pool, and a frame's pools are reset wholesale once
+    /// its fence has been waited on instead of resetting buffers one at a time.
+    ///
+    /// A call to record() splits its tasks into contiguous ranges, records each range into a
+    /// secondary command buffer on whichever thread picks it up, and returns the buffers in
+    /// range order. The division only depends on the task count and the thread count, so the
+    /// primary command buffer executes the same commands in the same order every time.
+    /// </summary>
+    class ParallelRecorder {
+    public:
+        /// <summary>
+        /// Records the tasks [first, last) into a secondary command buffer that has already begun.
+        /// </summary>
+        using RecordFunction = std::function<void( vk::CommandBuffer command_buffer, uint32_t first, uint32_t last )>;
+
+    private:
+        struct FramePool {
+            vk::UniqueCommandPool pool;
+            /// Allocated once and reused after every reset of the pool.
+            std::vector<vk::CommandBuffer> command_buffers;
+            uint32_t used = 0;
+        };
+
+        struct ThreadPools {
+            std::vector<FramePool> frames;
+        };
+
+        vk::Device device;
+        /// Index 0 belongs to the thread that calls record(), the rest to the workers.
+        std::vector<ThreadPools> thread_pools;
+        std::vector<std::thread> workers;
+        uint32_t current_frame;
+
+        // The job being recorded. Workers wait for job_generation to change.
+        std::mutex mutex;
+        std::condition_variable job_ready;
+        std::condition_variable job_done;
+        uint64_t job_generation;
+        bool stopping;
+        const RecordFunction* job_function;
+        vk::CommandBufferInheritanceInfo job_inheritance;
+        uint32_t job_task_count;
+        uint32_t job_range_count;
+        std::vector<vk::CommandBuffer> job_results;
+        std::atomic<uint32_t> next_range;
+        uint32_t busy_workers;
+        std::exception_ptr job_exception;
+
+    public:
+        /// <summary>
+        /// Creates the command pools and starts the workers.
+        /// </summary>
+        /// <param name="queue_family">The family of the queue the primary command buffers are submitted to.</param>
+        /// <param name="frame_count">The number of frames in flight; each thread gets one pool per frame.</param>
+        /// <param name="thread_count">The number of threads that record, including the caller. 0 uses one per hardware thread.</param>
+        ParallelRecorder( vk::Device device, uint32_t queue_family, uint32_t frame_count, uint32_t thread_count = 0 );
+        ~ParallelRecorder();
+
+        ParallelRecorder( const ParallelRecorder& ) = delete;
+        ParallelRecorder& operator=( const ParallelRecorder& ) = delete;
+
+        uint32_t get_thread_count() const noexcept {
+            return static_cast<uint32_t>( thread_pools.size() );
+        }
+
+        /// <summary>
+        /// Resets every thread's pool for a frame. The frame's fence must have been waited on.
+        /// </summary>
+        void begin_frame( uint32_t frame_index );
+
+        /// <summary>
+        /// Records task_count tasks into secondary command buffers across the threads and waits
+        /// for them. An exception thrown by record_function is rethrown here.
+        /// </summary>
+        /// <param name="inheritance">The render pass, subpass and framebuffer the buffers execute in. Without a render pass, they're recorded outside one.</param>
+        /// <param name="min_tasks_per_buffer">The fewest tasks worth a secondary command buffer of their own.</param>
+        /// <returns>The secondary command buffers in task order, to pass to executeCommands().</returns>
+        std::vector<vk::CommandBuffer> record( const vk::CommandBufferInheritanceInfo& inheritance, uint32_t task_count, const RecordFunction& record_function, uint32_t min_tasks_per_buffer = 64 );
+
+        /// <summary>
+        /// Records in parallel with record() and executes the results in the primary command buffer,
+        /// which must be inside the inherited render pass begun with eSecondaryCommandBuffers.
+        /// </summary>
+        void execute( vk::CommandBuffer primary, const vk::CommandBufferInheritanceInfo& inheritance, uint32_t task_count, const RecordFunction& record_function, uint32_t min_tasks_per_buffer = 64 );
+
+    private:
+        void worker_loop( uint32_t thread_index );
+        void record_ranges( uint32_t thread_index );
+        vk::CommandBuffer acquire_command_buffer( uint32_t thread_index );
+    };
+}
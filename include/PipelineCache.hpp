@@ -0,0 +1,300 @@
+#pragma once
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#ifndef NDEBUG
+#include <iostream>
+#endif // NDEBUG
+
+namespace stlr {
+    /// <summary>
+    /// A VkPipelineCache that's loaded from and saved back to a file. The file is only
+    /// used when it was written for the same vendor, device, driver version and
+    /// pipelineCacheUUID; otherwise the cache starts empty and is overwritten on save.
+    ///
+    /// Pipelines created through create_pipeline() are counted, and when
+    /// VK_EXT_pipeline_creation_feedback is enabled on the device, so are cache hits.
+    /// </summary>
+    class PipelineCache {
+    public:
+        struct Statistics {
+            /// The number of bytes of cache data accepted from the file.
+            size_t loaded_bytes = 0;
+            /// The number of pipelines created through the cache.
+            uint32_t pipeline_count = 0;
+            /// The number of pipelines the driver reported as found in the cache.
+            uint32_t hit_count = 0;
+            /// Whether hit_count was reported by the driver. Without creation feedback it's always 0.
+            bool hits_reported = false;
+            /// The time spent creating pipelines in milliseconds.
+            double creation_time = 0.0;
+
+            double get_hit_rate() const noexcept {
+                return pipeline_count == 0 ? 0.0 : static_cast<double>( hit_count ) / pipeline_count;
+            }
+        };
+
+    private:
+        /// <summary>
+        /// Written in front of the driver's cache data. The driver's own header doesn't
+        /// include the driver version and nothing checks the data for truncation.
+        /// </summary>
+        struct FileHeader {
+            char magic[8];
+            uint32_t version;
+            uint32_t vendor_id;
+            uint32_t device_id;
+            uint32_t driver_version;
+            uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+            uint64_t data_size;
+            uint64_t data_hash;
+        };
+
+        static constexpr char file_magic[8] = { 'S', 'T', 'L', 'R', 'P', 'S', 'O', '\0' };
+        static constexpr uint32_t file_version = 1;
+
+        vk::Device device;
+        vk::PhysicalDeviceProperties properties;
+        std::filesystem::path file_path;
+        vk::PipelineCache cache;
+        bool creation_feedback;
+        Statistics statistics;
+
+    public:
+        /// <summary>
+        /// Creates the cache, seeding it with the file's data if it's valid for the device.
+        /// </summary>
+        /// <param name="physical_device">The physical device the cache data must match.</param>
+        /// <param name="device">The device to create the cache with.</param>
+        /// <param name="file_path">The file to load from and save to. An empty path keeps the cache in memory.</param>
+        /// <param name="creation_feedback">Whether VK_EXT_pipeline_creation_feedback is enabled on the device.</param>
+        PipelineCache( vk::PhysicalDevice physical_device, vk::Device device, std::filesystem::path file_path, bool creation_feedback = false )
+            : device( device )
+            , properties( physical_device.getProperties() )
+            , file_path( std::move( file_path ) )
+            , creation_feedback( creation_feedback ) {
+            std::vector<char> data{ load() };
+            statistics.loaded_bytes = data.size();
+            statistics.hits_reported = creation_feedback;
+
+            vk::PipelineCacheCreateInfo ci {
+                {},
+                data.size(),
+                data.data()
+            };
+            cache = device.createPipelineCache( ci );
+        }
+
+        /// <summary>
+        /// Saves the cache and destroys it. Every pipeline created with it must have finished compiling.
+        /// </summary>
+        ~PipelineCache() {
+            try {
+                save();
+            }
+            catch( const std::exception& e ) {
+#ifndef NDEBUG
+                std::cerr << "Failed to save the pipeline cache: " << e.what() << std::endl;
+#endif // NDEBUG
+            }
+
+            device.destroyPipelineCache( cache );
+        }
+
+        PipelineCache( const PipelineCache& ) = delete;
+        PipelineCache& operator=( const PipelineCache& ) = delete;
+
+        vk::PipelineCache get() const noexcept {
+            return cache;
+        }
+
+        const Statistics& get_statistics() const noexcept {
+            return statistics;
+        }
+
+        /// <summary>
+        /// Creates a graphics or compute pipeline with the cache, recording whether it was a hit.
+        /// </summary>
+        /// <typeparam name="CreateInfo">vk::GraphicsPipelineCreateInfo or vk::ComputePipelineCreateInfo.</typeparam>
+        /// <returns>The pipeline, which the caller destroys.</returns>
+        template <typename CreateInfo>
+        vk::Pipeline create_pipeline( const CreateInfo& ci ) {
+            return create( ci, [this]( const CreateInfo& c ) {
+                if constexpr( std::is_same_v<CreateInfo, vk::GraphicsPipelineCreateInfo> )
+                    return device.createGraphicsPipeline( cache, c ).value;
+                else
+                    return device.createComputePipeline( cache, c ).value;
+            } );
+        }
+
+        /// <summary>
+        /// Creates a graphics or compute pipeline with the cache, recording whether it was a hit.
+        /// </summary>
+        template <typename CreateInfo>
+        vk::UniquePipeline create_pipeline_unique( const CreateInfo& ci ) {
+            return create( ci, [this]( const CreateInfo& c ) {
+                if constexpr( std::is_same_v<CreateInfo, vk::GraphicsPipelineCreateInfo> )
+                    return std::move( device.createGraphicsPipelineUnique( cache, c ).value );
+                else
+                    return std::move( device.createComputePipelineUnique( cache, c ).value );
+            } );
+        }
+
+        /// <summary>
+        /// Writes the cache to its file. The data is written to a temporary file first and then
+        /// renamed over the old one, so a crash mid-write never leaves a truncated cache behind.
+        /// </summary>
+        void save() {
+            if( file_path.empty() )
+                return;
+
+            std::vector<uint8_t> data{ device.getPipelineCacheData( cache ) };
+
+            FileHeader header{};
+            std::memcpy( header.magic, file_magic, sizeof( file_magic ) );
+            header.version = file_version;
+            header.vendor_id = properties.vendorID;
+            header.device_id = properties.deviceID;
+            header.driver_version = properties.driverVersion;
+            std::memcpy( header.pipeline_cache_uuid, properties.pipelineCacheUUID.data(), VK_UUID_SIZE );
+            header.data_size = data.size();
+            header.data_hash = hash( data.data(), data.size() );
+
+            if( file_path.has_parent_path() )
+                std::filesystem::create_directories( file_path.parent_path() );
+
+            std::filesystem::path temp_path{ file_path };
+            temp_path += ".tmp";
+            {
+                std::ofstream file( temp_path, std::ios::binary | std::ios::trunc );
+                file.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+                file.write( reinterpret_cast<const char*>( data.data() ), data.size() );
+                file.flush();
+                if( !file )
+                    throw std::runtime_error( "Failed to write " + temp_path.string() );
+            }
+
+            std::filesystem::rename( temp_path, file_path );
+        }
+
+        /// <summary>
+        /// Prints the number of pipelines created, the hit rate and the time spent creating them.
+        /// Nothing is printed on destruction; call this where the statistics are wanted.
+        /// </summary>
+        void report( std::ostream& out ) const {
+            out << "Pipeline cache: " << statistics.pipeline_count << " pipelines in " << statistics.creation_time << " ms";
+            if( statistics.hits_reported )
+                out << ", " << statistics.hit_count << " hits (" << statistics.get_hit_rate() * 100.0 << "%)";
+            else
+                out << ", hit rate unavailable without " << VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME;
+            out << ", " << statistics.loaded_bytes << " bytes loaded" << std::endl;
+        }
+
+    private:
+        template <typename CreateInfo, typename Create>
+        auto create( const CreateInfo& ci, Create create_function ) {
+            static_assert( std::is_same_v<CreateInfo, vk::GraphicsPipelineCreateInfo> || std::is_same_v<CreateInfo, vk::ComputePipelineCreateInfo>, "Only graphics and compute pipelines can be created." );
+
+            CreateInfo chained{ ci };
+            vk::PipelineCreationFeedbackEXT feedback;
+            vk::PipelineCreationFeedbackCreateInfoEXT feedback_ci {
+                &feedback,
+                0,
+                nullptr
+            };
+            if( creation_feedback ) {
+                feedback_ci.pNext = chained.pNext;
+                chained.pNext = &feedback_ci;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            auto pipeline = create_function( chained );
+            statistics.creation_time += std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+
+            ++statistics.pipeline_count;
+            if( creation_feedback
+                && ( feedback.flags & vk::PipelineCreationFeedbackFlagBitsEXT::eValid )
+                && ( feedback.flags & vk::PipelineCreationFeedbackFlagBitsEXT::eApplicationPipelineCacheHit ) )
+                ++statistics.hit_count;
+
+            return pipeline;
+        }
+
+        /// <summary>
+        /// Reads the cache data from the file, returning nothing if the file is missing, truncated
+        /// or was written for a different device or driver.
+        /// </summary>
+        std::vector<char> load() const {
+            if( file_path.empty() )
+                return {};
+
+            std::ifstream file( file_path, std::ios::binary | std::ios::ate );
+            if( !file.is_open() )
+                return {};
+
+            auto file_size = static_cast<size_t>( file.tellg() );
+            if( file_size < sizeof( FileHeader ) )
+                return {};
+
+            FileHeader header;
+            file.seekg( 0 );
+            file.read( reinterpret_cast<char*>( &header ), sizeof( header ) );
+
+            if( std::memcmp( header.magic, file_magic, sizeof( file_magic ) ) != 0
+                || header.version != file_version
+                || header.vendor_id != properties.vendorID
+                || header.device_id != properties.deviceID
+                || header.driver_version != properties.driverVersion
+                || std::memcmp( header.pipeline_cache_uuid, properties.pipelineCacheUUID.data(), VK_UUID_SIZE ) != 0
+                || header.data_size != file_size - sizeof( FileHeader ) )
+                return {};
+
+            std::vector<char> data( static_cast<size_t>( header.data_size ) );
+            file.read( data.data(), data.size() );
+            if( !file || hash( data.data(), data.size() ) != header.data_hash || !is_valid_cache_header( data ) )
+                return {};
+
+            return data;
+        }
+
+        /// <summary>
+        /// Checks the driver's own header at the start of the data against the device.
+        /// </summary>
+        bool is_valid_cache_header( const std::vector<char>& data ) const {
+            // VkPipelineCacheHeaderVersionOne: size, version, vendor, device, then the UUID.
+            constexpr size_t header_size = 4 * sizeof( uint32_t ) + VK_UUID_SIZE;
+            if( data.size() < header_size )
+                return false;
+
+            uint32_t fields[4];
+            std::memcpy( fields, data.data(), sizeof( fields ) );
+            return fields[0] >= header_size
+                && fields[1] == static_cast<uint32_t>( vk::PipelineCacheHeaderVersion::eOne )
+                && fields[2] == properties.vendorID
+                && fields[3] == properties.deviceID
+                && std::memcmp( data.data() + sizeof( fields ), properties.pipelineCacheUUID.data(), VK_UUID_SIZE ) == 0;
+        }
+
+        /// <summary>
+        /// 64-bit FNV-1a, enough to catch a corrupted or partially written file.
+        /// </summary>
+        static uint64_t hash( const void* data, size_t size ) noexcept {
+            auto bytes = static_cast<const uint8_t*>( data );
+            uint64_t h = 14695981039346656037ull;
+            for( size_t i = 0; i < size; ++i ) {
+                h ^= bytes[i];
+                h *= 1099511628211ull;
+            }
+            return h;
+        }
+    };
+}
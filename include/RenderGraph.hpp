@@ -0,0 +1,336 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+#include "GpuProfiler.hpp"
+#include "MemoryAllocator.hpp"
+
+namespace stlr {
+    /// <summary>
+    /// A frame described as passes that declare which images and buffers they read and write.
+    ///
+    /// compile() culls passes that don't contribute to an output, orders the rest by their
+    /// dependencies, creates the transient images (aliasing the memory of those whose
+    /// lifetimes don't overlap) and works out the barriers between passes. execute() then
+    /// records every pass with only those barriers, beginning a render pass around each
+    /// pass that writes attachments.
+    ///
+    /// Resources are versioned: writing a resource returns a new handle, and reading a
+    /// handle depends on the pass that produced that version.
+    /// </summary>
+    class RenderGraph {
+    public:
+        /// <summary>
+        /// How a pass uses a resource. Each usage implies the stages, access, image layout
+        /// and usage flags of the use.
+        /// </summary>
+        enum class Usage {
+            eColorAttachment,
+            eDepthAttachment,
+            eDepthRead,
+            eSampledFragment,
+            eSampledCompute,
+            eStorageRead,
+            eStorageWrite,
+            eTransferSrc,
+            eTransferDst,
+            eVertexBuffer,
+            eIndexBuffer,
+            eIndirectBuffer,
+            eUniformBuffer
+        };
+
+        struct Handle {
+            uint32_t resource = UINT32_MAX;
+            uint32_t version = 0;
+
+            bool is_valid() const noexcept {
+                return resource != UINT32_MAX;
+            }
+        };
+
+        struct ImageDescription {
+            vk::Extent2D extent;
+            vk::Format format;
+        };
+
+        /// <summary>
+        /// The state an imported resource is in before the graph runs and, for images, the
+        /// layout it's left in afterwards.
+        /// </summary>
+        struct ImportState {
+            vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+            /// For a swapchain image, the stage its acquire semaphore is waited on.
+            vk::PipelineStageFlags stages = vk::PipelineStageFlagBits::eTopOfPipe;
+            vk::AccessFlags access = {};
+            vk::ImageLayout final_layout = vk::ImageLayout::eUndefined;
+        };
+
+        /// <summary>
+        /// Transient images and the memory they alias, replaced while frames in flight may still use
+        /// them. Views and images are destroyed before the memory they're bound to.
+        /// </summary>
+        struct TransientImages {
+            std::vector<MemoryAllocator::UniqueAllocation> memory;
+            std::vector<vk::UniqueImage> images;
+            std::vector<vk::UniqueImageView> views;
+        };
+
+        class PassBuilder;
+        using ExecuteFunction = std::function<void( vk::CommandBuffer, const RenderGraph& )>;
+
+    private:
+        struct UsageInfo {
+            vk::PipelineStageFlags stages;
+            vk::AccessFlags access;
+            vk::ImageLayout layout;
+            vk::ImageUsageFlags image_usage;
+            bool write;
+        };
+
+        struct Use {
+            uint32_t resource;
+            uint32_t version;
+            Usage usage;
+            std::optional<vk::ClearValue> clear;
+        };
+
+        struct Pass {
+            std::string name;
+            std::vector<Use> uses;
+            ExecuteFunction execute;
+            bool side_effects = false;
+            bool secondary_command_buffers = false;
+
+            // Set by compile().
+            std::vector<uint32_t> dependencies;
+            std::vector<vk::ImageMemoryBarrier> image_barriers;
+            std::vector<uint32_t> image_barrier_resources;
+            std::vector<vk::BufferMemoryBarrier> buffer_barriers;
+            std::vector<uint32_t> buffer_barrier_resources;
+            vk::PipelineStageFlags src_stages;
+            vk::PipelineStageFlags dst_stages;
+            vk::UniqueRenderPass render_pass;
+            std::vector<uint32_t> attachments;
+            std::vector<vk::ClearValue> clear_values;
+            vk::Extent2D extent;
+        };
+
+        struct Resource {
+            std::string name;
+            bool image;
+            bool imported;
+            ImageDescription description;
+            ImportState import_state;
+            uint32_t version_count = 1;
+            /// The pass that wrote each version, or UINT32_MAX for the initial contents.
+            std::vector<uint32_t> producers;
+
+            vk::Image image_handle;
+            vk::ImageView image_view;
+            vk::Buffer buffer_handle;
+
+            // Set by compile() for transient images.
+            vk::ImageUsageFlags usage;
+            vk::UniqueImage owned_image;
+            vk::UniqueImageView owned_view;
+            vk::DeviceSize memory_size = 0;
+            uint32_t alias_slot = UINT32_MAX;
+            uint32_t first_use = UINT32_MAX;
+            uint32_t last_use = 0;
+        };
+
+        struct ResourceState {
+            vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+            vk::PipelineStageFlags stages;
+            vk::AccessFlags access;
+            bool written = false;
+        };
+
+        struct AliasSlot {
+            vk::MemoryRequirements requirements;
+            std::vector<uint32_t> resources;
+            MemoryAllocator::UniqueAllocation allocation;
+        };
+
+        vk::Device device;
+        MemoryAllocator& allocator;
+        std::vector<Resource> resources;
+        std::vector<Pass> passes;
+        std::vector<Handle> outputs;
+        std::vector<uint32_t> order;
+        std::vector<AliasSlot> alias_slots;
+        /// Barriers that move imported images into their final layouts.
+        std::vector<vk::ImageMemoryBarrier> final_barriers;
+        std::vector<uint32_t> final_barrier_resources;
+        vk::PipelineStageFlags final_src_stages;
+        std::map<std::pair<VkRenderPass, std::vector<VkImageView>>, vk::UniqueFramebuffer> framebuffers;
+        /// The render pass and framebuffer of the pass being executed.
+        vk::CommandBufferInheritanceInfo current_inheritance;
+        bool compiled;
+        /// Set when a transient image was resized; execute() creates them again.
+        bool transients_outdated;
+
+    public:
+        /// <summary>
+        /// Declares the resources a pass uses.
+        /// </summary>
+        class PassBuilder {
+            friend RenderGraph;
+
+            RenderGraph& graph;
+            uint32_t pass;
+
+            PassBuilder( RenderGraph& graph, uint32_t pass ) : graph( graph ), pass( pass ) {}
+
+        public:
+            /// <summary>
+            /// Reads a version of a resource, making the pass depend on the pass that wrote it.
+            /// </summary>
+            void read( Handle handle, Usage usage );
+
+            /// <summary>
+            /// Writes a resource. Color and depth attachment writes make the pass a render pass.
+            /// </summary>
+            /// <param name="clear">Clears an attachment at the start of the pass instead of loading it.</param>
+            /// <returns>The new version, for later passes to read.</returns>
+            Handle write( Handle handle, Usage usage, std::optional<vk::ClearValue> clear = std::nullopt );
+
+            /// <summary>
+            /// Keeps the pass even if nothing it writes is read, e.g. it writes to a host-visible buffer.
+            /// </summary>
+            void set_side_effects() {
+                graph.passes[pass].side_effects = true;
+            }
+
+            /// <summary>
+            /// Begins the pass's render pass for secondary command buffers, e.g. recorded with
+            /// ParallelRecorder, instead of inline commands. See get_inheritance_info().
+            /// </summary>
+            void set_secondary_command_buffers() {
+                graph.passes[pass].secondary_command_buffers = true;
+            }
+        };
+
+        RenderGraph( vk::Device device, MemoryAllocator& allocator );
+
+        RenderGraph( const RenderGraph& ) = delete;
+        RenderGraph& operator=( const RenderGraph& ) = delete;
+
+        /// <summary>
+        /// Declares an image that only lives during the graph. Its memory may be shared with
+        /// other transient images whose lifetimes don't overlap.
+        /// </summary>
+        Handle create_image( std::string name, const ImageDescription& description );
+
+        /// <summary>
+        /// Declares an image owned outside the graph, e.g. a swapchain image.
+        /// </summary>
+        Handle import_image( std::string name, vk::Image image, vk::ImageView view, const ImageDescription& description, const ImportState& state );
+
+        /// <summary>
+        /// Declares a buffer owned outside the graph.
+        /// </summary>
+        Handle import_buffer( std::string name, vk::Buffer buffer, const ImportState& state );
+
+        /// <summary>
+        /// Replaces an imported image between executions, e.g. with the next swapchain image.
+        /// </summary>
+        void set_imported_image( Handle handle, vk::Image image, vk::ImageView view );
+
+        /// <summary>
+        /// Replaces an imported image with one of another size, e.g. after the swapchain was recreated.
+        /// Retire the framebuffers first if the old views are about to be destroyed.
+        /// </summary>
+        void set_imported_image( Handle handle, vk::Image image, vk::ImageView view, vk::Extent2D extent );
+
+        /// <summary>
+        /// Moves the cached framebuffers into retired and forgets them. Framebuffers are cached by
+        /// their image views, so call this before imported views are destroyed (a new view could
+        /// get the same handle), and keep them until the GPU is done with them.
+        /// </summary>
+        void retire_framebuffers( std::vector<vk::UniqueFramebuffer>& retired );
+
+        /// <summary>
+        /// Resizes a transient image, e.g. along with the swapchain. They share memory, so every
+        /// transient image is created again on the next execute(); the old ones are moved into
+        /// retired, to keep until the GPU is done with them. Retire the framebuffers first too.
+        /// </summary>
+        void set_image_extent( Handle handle, vk::Extent2D extent, TransientImages& retired );
+
+        /// <summary>
+        /// Adds a pass. setup declares its resources immediately; execute records it later.
+        /// </summary>
+        void add_pass( std::string name, const std::function<void( PassBuilder& )>& setup, ExecuteFunction execute );
+
+        /// <summary>
+        /// Marks a resource version as a result of the graph. Passes that don't contribute to
+        /// an output (or have side effects) are culled.
+        /// </summary>
+        void mark_output( Handle handle );
+
+        /// <summary>
+        /// Culls, orders and creates everything needed to execute the graph. Compiling again
+        /// destroys the previous transient images, so the GPU must be done with them.
+        /// </summary>
+        void compile();
+
+        /// <summary>
+        /// Records every pass in order along with its barriers.
+        /// </summary>
+        /// <param name="profiler">If given, times each pass with its barriers in a scope named after the pass.</param>
+        void execute( vk::CommandBuffer command_buffer, GpuProfiler* profiler = nullptr );
+
+        vk::Image get_image( Handle handle ) const {
+            return resources[handle.resource].image_handle;
+        }
+
+        vk::ImageView get_image_view( Handle handle ) const {
+            return resources[handle.resource].image_view;
+        }
+
+        vk::Buffer get_buffer( Handle handle ) const {
+            return resources[handle.resource].buffer_handle;
+        }
+
+        /// <summary>
+        /// The render pass, subpass and framebuffer that the secondary command buffers of the pass
+        /// being executed inherit. Only valid inside an execute function.
+        /// </summary>
+        const vk::CommandBufferInheritanceInfo& get_inheritance_info() const noexcept {
+            return current_inheritance;
+        }
+
+        /// <summary>
+        /// The render pass created for a pass that writes attachments, for creating its pipelines.
+        /// </summary>
+        vk::RenderPass get_render_pass( const std::string& pass_name ) const;
+
+        /// <summary>
+        /// The names of the passes that survived culling, in the order they're recorded.
+        /// </summary>
+        std::vector<std::string> get_pass_order() const;
+
+        /// <summary>
+        /// The bytes of memory used by transient images, and what they'd use without aliasing.
+        /// </summary>
+        std::pair<vk::DeviceSize, vk::DeviceSize> get_transient_memory() const;
+
+    private:
+        static UsageInfo get_usage_info( Usage usage );
+        static bool is_attachment( Usage usage ) noexcept;
+        static vk::ImageAspectFlags get_aspect_mask( vk::Format format ) noexcept;
+
+        void cull_and_order();
+        void create_transient_images();
+        void release_transient_images( TransientImages& released );
+        void set_extent( uint32_t resource, vk::Extent2D extent );
+        void compute_barriers();
+        void create_render_passes();
+        vk::Framebuffer get_framebuffer( const Pass& pass );
+    };
+}
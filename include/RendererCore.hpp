@@ -1,6 +1,12 @@
 #pragma once
 
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <memory>
 #include <optional>
+#include <tuple>
 #include "ExtensionMap.hpp"
 #include "Window.hpp"
 #include "Timer.hpp"
@@ -22,6 +28,22 @@
 #endif // VK_USE_PLATFORM_WIN32_KHR
 
 #include "Utils.hpp"
+#include "BindlessDescriptors.hpp"
+#include "MemoryAllocator.hpp"
+#include "GpuProfiler.hpp"
+#include "RenderGraph.hpp"
+#include "ParallelRecorder.hpp"
+#include "UploadManager.hpp"
+#include "PipelineCache.hpp"
+#include "UniformRing.hpp"
+#include "DescriptorAllocator.hpp"
+#include "DescriptorUpdateTemplate.hpp"
+#include "MipmapGenerator.hpp"
+#include "TextureFile.hpp"
+#include "TextureStreamer.hpp"
+#include "AssetPack.hpp"
+#include "GpuCulling.hpp"
+#include "SwapchainSettings.hpp"
 
 #ifndef NDEBUG
 #include <iostream>
@@ -36,14 +58,23 @@ namespace stlr {
 			std::vector<vk::QueueFamilyProperties2> queue_family_properties;
 			vk::PhysicalDeviceMemoryProperties2 memory_properties;
 			vk::PhysicalDeviceFeatures2 features;
+			vk::PhysicalDeviceVulkan12Features features_12;
 			vk::PhysicalDeviceProperties2 properties;
 			vk::SurfaceCapabilities2KHR capabilities;
 			std::vector<vk::SurfaceFormat2KHR> formats;
+			std::vector<const char*> enabled_extensions;
 			vk::UniqueDevice device;
 			vk::Queue graphics_queue;
 			vk::Queue transfer_queue;
+			/// A queue of a compute-only family if the device has one, otherwise the graphics queue.
+			vk::Queue compute_queue;
 			uint32_t graphics_queue_index;
 			uint32_t transfer_queue_index;
+			uint32_t compute_queue_index;
+
+            bool is_extension_enabled( const char* name ) const {
+                return std::any_of( enabled_extensions.begin(), enabled_extensions.end(), [name]( const char* e ) { return std::strcmp( e, name ) == 0; } );
+            }
 		};
 
 		struct Swapchain {
@@ -54,6 +85,7 @@ namespace stlr {
             vk::ColorSpaceKHR color_space;
             vk::Extent2D extent;
             uint32_t current_image_index;
+            vk::PresentModeKHR present_mode = vk::PresentModeKHR::eFifo;
 		};
 
         struct Subpass {
@@ -61,6 +93,19 @@ namespace stlr {
             vk::AttachmentReference depth_reference;
         };
 
+        struct Frame {
+            vk::UniqueCommandBuffer command_buffer;
+            vk::UniqueSemaphore image_acquired_semaphore;
+            vk::UniqueSemaphore render_finished_semaphore;
+            vk::UniqueFence in_flight_fence;
+            /// Records the frame's culling for the compute queue.
+            vk::UniqueCommandBuffer compute_command_buffer;
+            vk::UniqueSemaphore culling_finished_semaphore;
+            /// Whether the frame's graphics submission waits for culling.
+            bool culled = false;
+            uint32_t profile_scope = GpuProfiler::invalid_scope;
+        };
+
         struct FramebufferReference {
             const vk::UniqueRenderPass& render_pass;
             std::vector<uint32_t> image_view_reference;
@@ -71,16 +116,11 @@ namespace stlr {
 			T _object;
 			vk::DeviceSize _deviceSize;
 			vk::MemoryRequirements _memoryRequirements;
-			vk::UniqueDeviceMemory _deviceMemory;
+			MemoryAllocator::UniqueAllocation _allocation;
 
 		protected:
-<<<<<<< HEAD
-			Resource( T&& obj, vk::DeviceSize devSize, vk::MemoryRequirements memReqs, vk::UniqueDeviceMemory devMem ) : _object( obj ), _deviceSize( devSize ), _memoryRequirements( memReqs ), _deviceMemory( std::move( devMem ) ) {
-				static_assert(std::is_same_v<T, vk::UniqueBuffer> || std::is_same_v<T, vk::UniqueImage>, "Resource must be a buffer or an image.");
-=======
-            Resource( T& obj, vk::DeviceSize devSize, vk::MemoryRequirements memReqs, vk::UniqueDeviceMemory& devMem ) : _object( std::move( obj ) ), _deviceSize( devSize ), _memoryRequirements( memReqs ), _deviceMemory( std::move( devMem ) ) {
+            Resource( T& obj, vk::DeviceSize devSize, vk::MemoryRequirements memReqs, MemoryAllocator::UniqueAllocation& alloc ) : _object( std::move( obj ) ), _deviceSize( devSize ), _memoryRequirements( memReqs ), _allocation( std::move( alloc ) ) {
                 static_assert(std::is_same_v<T, vk::UniqueImage> || std::is_same_v<T, vk::UniqueBuffer>, "Resource must be a buffer or an image.");
->>>>>>> 40ac455a26e24b123555ab53b6a781bda433c843
 			}
 		};
 
@@ -92,9 +132,10 @@ namespace stlr {
 			uint32_t _channels;
 			vk::Format _format;
 			vk::ImageLayout _imageLayout;
+			uint32_t _mipLevels;
 
 		protected:
-            Image( vk::UniqueImage& image, vk::DeviceSize devSize, vk::MemoryRequirements memReqs, vk::UniqueDeviceMemory& devMem, uint32_t width, uint32_t height, uint32_t channels, vk::Format format, vk::ImageLayout layout ) : Resource<vk::UniqueImage>( image, devSize, memReqs, devMem ), _width( width ), _height( height ), _channels( channels ), _format( format ), _imageLayout( layout ) {}
+            Image( vk::UniqueImage& image, vk::DeviceSize devSize, vk::MemoryRequirements memReqs, MemoryAllocator::UniqueAllocation& alloc, uint32_t width, uint32_t height, uint32_t channels, vk::Format format, vk::ImageLayout layout, uint32_t mip_levels = 1 ) : Resource<vk::UniqueImage>( image, devSize, memReqs, alloc ), _width( width ), _height( height ), _channels( channels ), _format( format ), _imageLayout( layout ), _mipLevels( mip_levels ) {}
 		};
 
 		struct Buffer : Resource<vk::UniqueBuffer> {
@@ -103,9 +144,23 @@ namespace stlr {
 			vk::BufferUsageFlags usage;
 
 		protected:
-            Buffer( vk::UniqueBuffer& buffer, vk::DeviceSize devSize, vk::MemoryRequirements memReqs, vk::UniqueDeviceMemory& devMem, vk::BufferUsageFlags usage ) : Resource<vk::UniqueBuffer>( buffer, devSize, memReqs, devMem ), usage( usage ) {}
+            Buffer( vk::UniqueBuffer& buffer, vk::DeviceSize devSize, vk::MemoryRequirements memReqs, MemoryAllocator::UniqueAllocation& alloc, vk::BufferUsageFlags usage ) : Resource<vk::UniqueBuffer>( buffer, devSize, memReqs, alloc ), usage( usage ) {}
 		};
 
+        ///
+        /// \brief A swapchain replaced by a recreation, kept with everything sized to it until the
+        /// frames that may still use it have finished.
+        ///
+        struct RetiredSwapchain {
+            Swapchain swapchain;
+            Image depth_image;
+            vk::UniqueImageView depth_image_view;
+            RenderGraph::TransientImages transient_images;
+            std::vector<vk::UniqueFramebuffer> framebuffers;
+            /// The frame it was replaced in.
+            uint64_t frame;
+        };
+
 
 
 #ifndef NDEBUG
@@ -136,6 +191,9 @@ namespace stlr {
 		};
 #endif // NDEBUG
 
+		/// The format of the images that stand in for the swapchain when rendering without a window.
+		static constexpr vk::Format offscreen_format{ vk::Format::eR8G8B8A8Unorm };
+
 		static constexpr std::array<const char*, 3> required_instance_extensions{
 			VK_KHR_SURFACE_EXTENSION_NAME,
 			VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME,
@@ -146,22 +204,63 @@ namespace stlr {
 			VK_KHR_SWAPCHAIN_EXTENSION_NAME
 		};
 
+        /// Enabled when the device supports them.
+        static constexpr std::array<const char*, 2> optional_device_extensions{
+            VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME,
+            VK_EXT_MEMORY_BUDGET_EXTENSION_NAME
+        };
+
 	protected:
-		Window& window;
+		/// Null when rendering headless.
+		Window* window;
 		vk::UniqueInstance instance;
 		vk::UniqueSurfaceKHR surface;
 		std::vector<RendererCore::Device> devices;
 		std::vector<RendererCore::Device>::iterator selected_device;
+		MemoryAllocator allocator;
 		vk::UniqueCommandPool present_command_pool;
 		vk::UniqueCommandPool transfer_command_pool;
+		vk::UniqueCommandPool compute_command_pool;
 		vk::UniqueCommandBuffer present_command_buffer;
 		vk::UniqueCommandBuffer transfer_command_buffer;
+		GpuProfiler profiler;
+		ParallelRecorder recorder;
+		UploadManager uploader;
+		PipelineCache pipeline_cache;
+		/// Null when the device doesn't support the descriptor indexing features it needs.
+		std::unique_ptr<BindlessDescriptors> bindless;
+		UniformRing uniforms;
+		DescriptorLayoutCache layout_cache;
+		/// Sets that live as long as the renderer.
+		DescriptorAllocator descriptor_allocator;
+		/// Sets that live for one frame; each is reset once its frame's fence has been waited on.
+		std::vector<DescriptorAllocator> frame_descriptor_allocators;
+		MipmapGenerator mipmaps;
+		UploadToken required_upload;
+		std::pair<UploadToken, vk::PipelineStageFlags> frame_upload_wait;
+		SwapchainSettings swapchain_settings;
+		/// The ring of color images rendered to instead of the swapchain's when headless.
+		std::vector<RendererCore::Image> offscreen_images;
 		RendererCore::Swapchain swapchain;
         RendererCore::Image depth_image;
         vk::UniqueImageView depth_image_view;
         vk::UniqueSampler sampler;
+        TextureStreamer streamer;
+        /// Null until init_culling() is called.
+        std::unique_ptr<GpuCulling> culling;
+        std::vector<RendererCore::Frame> frames;
+        uint32_t current_frame;
+        /// The number of frames submitted so far.
+        uint64_t frame_number;
+        /// Set when presenting reports the swapchain no longer matches the surface, or the settings change.
+        bool swapchain_outdated;
+        /// The window's size when the swapchain was last created, to notice resizes the surface doesn't report.
+        vk::Extent2D window_extent;
+        std::vector<RendererCore::RetiredSwapchain> retired_swapchains;
+        bool close_requested;
 
 		Timer timer;
+		/// Milliseconds between the last two frames.
 		double delta_time;
 
 		using pfn_update = void (*)();
@@ -169,31 +268,393 @@ namespace stlr {
 		pfn_update post_update;
 
 	public:
-		RendererCore( Window& window );
-		void run();
+        ///
+        /// \param shader_directory The directory holding the compiled mip-cs.comp.
+        ///
+		RendererCore( Window& window, const std::filesystem::path& shader_directory, uint32_t frames_in_flight = 2, std::filesystem::path pipeline_cache_file = "pipeline_cache.bin", uint32_t recording_threads = 0, const SwapchainSettings& swapchain_settings = {} );
+
+        ///
+        /// \brief Creates a renderer without a window or surface. Frames are rendered into a ring of
+        /// offscreen images instead of a swapchain, so it runs without a display, e.g. on lavapipe in CI.
+        /// \param shader_directory The directory holding the compiled mip-cs.comp.
+        ///
+        explicit RendererCore( vk::Extent2D extent, const std::filesystem::path& shader_directory, uint32_t frames_in_flight = 2, std::filesystem::path pipeline_cache_file = "pipeline_cache.bin", uint32_t recording_threads = 0 );
+
+        ///
+        /// \brief Renders until the window closes, close() is called or frame_limit frames have been rendered.
+        /// \param frame_limit The number of frames to render, or 0 for no limit.
+        ///
+		void run( uint64_t frame_limit = 0 );
+
+        ///
+        /// \brief Stops run() after the current frame.
+        ///
+        void close() noexcept {
+            close_requested = true;
+        }
+
+        constexpr bool is_headless() const noexcept {
+            return window == nullptr;
+        }
+
+        ///
+        /// \brief The pipeline cache, e.g. to report() its statistics before shutting down.
+        ///
+        const PipelineCache& get_pipeline_cache() const noexcept {
+            return pipeline_cache;
+        }
+
+        const SwapchainSettings& get_swapchain_settings() const noexcept {
+            return swapchain_settings;
+        }
+
+        ///
+        /// \brief Changes the present policy, image count or frame latency. The swapchain is recreated
+        /// with them before the next frame.
+        ///
+        void set_swapchain_settings( const SwapchainSettings& settings ) noexcept {
+            swapchain_settings = settings;
+            swapchain_outdated = true;
+        }
 
 	protected:
 		virtual void update() = 0;
+
+        ///
+        /// \brief Records the frame's commands into get_frame_command_buffer(). The command buffer
+        /// has already begun and the swapchain image to render to is swapchain.current_image_index.
+        ///
 		virtual void render() = 0;
 
-<<<<<<< HEAD
-		const uint32_t get_memory_type_index( vk::MemoryRequirements memReq, vk::MemoryPropertyFlags memProps ) {
-=======
-        const uint32_t get_memory_type_index( vk::MemoryRequirements memReq, vk::MemoryPropertyFlags memProps ) {
->>>>>>> 40ac455a26e24b123555ab53b6a781bda433c843
+        ///
+        /// \brief Called after the window was resized or the swapchain went out of date and the
+        /// swapchain, its image views and the depth image were recreated at swapchain.extent. Recreate
+        /// whatever refers to them, such as framebuffers, handing the old ones to retire_framebuffers().
+        ///
+        virtual void on_swapchain_recreated() {}
+
+        ///
+        /// \brief Keeps framebuffers of the replaced swapchain alive until the frames that may still
+        /// use them have finished, so recreation never waits for the GPU. Leaves framebuffers empty.
+        ///
+        void retire_framebuffers( std::vector<vk::UniqueFramebuffer>& framebuffers ) {
+            auto& retired = retired_swapchains.back().framebuffers;
+            std::move( framebuffers.begin(), framebuffers.end(), std::back_inserter( retired ) );
+            framebuffers.clear();
+        }
+
+        ///
+        /// \brief Where a render graph's transient images sized to the replaced swapchain go when
+        /// they're resized with RenderGraph::set_image_extent(), kept alive like retired framebuffers.
+        /// Only valid in on_swapchain_recreated().
+        ///
+        RenderGraph::TransientImages& get_retired_transient_images() {
+            return retired_swapchains.back().transient_images;
+        }
+
+        ///
+        /// \brief The command buffer of the frame currently being recorded.
+        ///
+        vk::CommandBuffer get_frame_command_buffer() const {
+            return frames[current_frame].command_buffer.get();
+        }
+
+        uint32_t get_frames_in_flight() const noexcept {
+            return static_cast<uint32_t>( frames.size() );
+        }
+
+        constexpr uint32_t get_current_frame() const noexcept {
+            return current_frame;
+        }
+
+        ///
+        /// \brief The layout color attachments of swapchain images should end a frame in. Offscreen
+        /// images are left ready to be copied out rather than presented.
+        ///
+        constexpr vk::ImageLayout get_present_layout() const noexcept {
+            return is_headless() ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR;
+        }
+
+        ///
+        /// \brief Times the commands recorded into the frame's command buffer until the returned
+        /// scope is destroyed, e.g. a render pass.
+        ///
+        GpuProfiler::Scope profile_scope( std::string name ) {
+            return GpuProfiler::Scope( profiler, get_frame_command_buffer(), std::move( name ) );
+        }
+
+        ///
+        /// \brief Records task_count tasks into secondary command buffers on the recording threads
+        /// and executes them, in task order, in the frame's command buffer. Begin the render pass
+        /// with vk::SubpassContents::eSecondaryCommandBuffers first.
+        /// \param inheritance The render pass, subpass and framebuffer the tasks are recorded in.
+        /// \param record Records the tasks [first, last) into a secondary command buffer.
+        ///
+        void record_parallel( const vk::CommandBufferInheritanceInfo& inheritance, uint32_t task_count, const ParallelRecorder::RecordFunction& record, uint32_t min_tasks_per_buffer = 64 ) {
+            recorder.execute( get_frame_command_buffer(), inheritance, task_count, record, min_tasks_per_buffer );
+        }
+
+        ///
+        /// \brief Whether textures and buffers can be registered for bindless access.
+        ///
+        bool is_bindless_supported() const noexcept {
+            return bindless != nullptr;
+        }
+
+        ///
+        /// \brief Adds a texture, sampled with the renderer's sampler, to the bindless set.
+        /// \return The texture's index in the shaders' texture array.
+        ///
+        BindlessDescriptors::Handle register_texture( vk::ImageView view, vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal ) {
+            return bindless->add_texture( view, sampler.get(), layout );
+        }
+
+        ///
+        /// \brief Adds a storage buffer to the bindless set.
+        /// \return The buffer's index in the shaders' buffer array.
+        ///
+        BindlessDescriptors::Handle register_buffer( const RendererCore::Buffer& buffer ) {
+            return bindless->add_buffer( buffer._object.get(), 0, buffer._deviceSize );
+        }
+
+        ///
+        /// \brief Binds the bindless set as set 0 of the frame's command buffer. Every pipeline
+        /// layout from create_bindless_pipeline_layout() is compatible with it, so once per frame
+        /// (and bind point) is enough.
+        ///
+        void bind_bindless_descriptors( vk::PipelineLayout layout, vk::PipelineBindPoint bind_point = vk::PipelineBindPoint::eGraphics ) {
+            bind_bindless_descriptors( get_frame_command_buffer(), layout, bind_point );
+        }
+
+        ///
+        /// \brief Binds the bindless set in another of this frame's command buffers. Secondaries,
+        /// such as those of record_parallel(), don't inherit the frame's binding and need their own.
+        ///
+        void bind_bindless_descriptors( vk::CommandBuffer command_buffer, vk::PipelineLayout layout, vk::PipelineBindPoint bind_point = vk::PipelineBindPoint::eGraphics ) {
+            bindless->bind( command_buffer, bind_point, layout );
+        }
+
+        ///
+        /// \brief Creates a pipeline layout for per-draw constants of type T. Constants of up to
+        /// UniformRing::max_push_constant_size bytes are push constants; larger ones are read from
+        /// binding 0 of a dynamic uniform buffer set placed after set_layouts.
+        ///
+        template <typename T>
+        vk::UniquePipelineLayout create_constants_pipeline_layout( vk::ArrayProxy<const vk::DescriptorSetLayout> set_layouts, vk::ShaderStageFlags stages ) {
+            std::vector<vk::DescriptorSetLayout> layouts( set_layouts.begin(), set_layouts.end() );
+            vk::PushConstantRange push_constant_range { stages, 0, sizeof( T ) };
+            constexpr bool push { UniformRing::uses_push_constants<T>() };
+            if( !push )
+                layouts.push_back( uniforms.get_set_layout() );
+
+            vk::PipelineLayoutCreateInfo ci {
+                {},
+                static_cast<uint32_t>( layouts.size() ),
+                layouts.data(),
+                push ? 1u : 0u,
+                push ? &push_constant_range : nullptr
+            };
+
+            return selected_device->device->createPipelineLayoutUnique( ci );
+        }
+
+        ///
+        /// \brief Sets the constants of the following draws in the frame's command buffer, either
+        /// by pushing them or by copying them into this frame's part of the uniform ring.
+        /// \param set_index The index of the ring's set, i.e. the number of set layouts passed to
+        /// create_constants_pipeline_layout(). Unused for pushed constants.
+        ///
+        template <typename T>
+        void bind_constants( vk::PipelineLayout layout, vk::ShaderStageFlags stages, uint32_t set_index, const T& data, vk::PipelineBindPoint bind_point = vk::PipelineBindPoint::eGraphics ) {
+            bind_constants( get_frame_command_buffer(), layout, stages, set_index, data, bind_point );
+        }
+
+        ///
+        /// \brief Sets the constants of the following draws in another of this frame's command
+        /// buffers, such as the secondaries of record_parallel(), whose tasks may call it at once.
+        ///
+        template <typename T>
+        void bind_constants( vk::CommandBuffer command_buffer, vk::PipelineLayout layout, vk::ShaderStageFlags stages, uint32_t set_index, const T& data, vk::PipelineBindPoint bind_point = vk::PipelineBindPoint::eGraphics ) {
+            uniforms.bind_constants( command_buffer, bind_point, layout, stages, set_index, data );
+        }
+
+        ///
+        /// \brief Makes the next frame wait on the GPU for an upload instead of only
+        /// taking uploads that have already completed.
+        ///
+        void require_upload( UploadToken token ) noexcept {
+            required_upload = std::max( required_upload, token );
+        }
+
+        uint32_t get_memory_type_index( vk::MemoryRequirements memReq, vk::MemoryPropertyFlags memProps ) {
 			for( uint32_t i = 0; i < selected_device->memory_properties.memoryProperties.memoryTypeCount; ++i ) {
 				if( (memReq.memoryTypeBits & (1 << i)) &&
                     ( ( selected_device->memory_properties.memoryProperties.memoryTypes[i].propertyFlags & memProps ) == memProps) )
 					return i;
 			}
 
-<<<<<<< HEAD
-			return UINT32_MAX;
-=======
             return UINT32_MAX;
->>>>>>> 40ac455a26e24b123555ab53b6a781bda433c843
 		}
 
+        ///
+        /// \brief Gets the set layout with these bindings from the layout cache, so materials that
+        /// declare the same bindings share one layout. The renderer owns it.
+        ///
+        vk::DescriptorSetLayout get_descriptor_set_layout( vk::ArrayProxy<const vk::DescriptorSetLayoutBinding> bindings ) {
+            return layout_cache.get_set_layout( bindings );
+        }
+
+        ///
+        /// \brief Gets the pipeline layout with these set layouts and push constants from the layout cache.
+        ///
+        vk::PipelineLayout get_pipeline_layout( vk::ArrayProxy<const vk::DescriptorSetLayout> set_layouts, vk::ArrayProxy<const vk::PushConstantRange> push_constants = {} ) {
+            return layout_cache.get_pipeline_layout( set_layouts, push_constants );
+        }
+
+        ///
+        /// \brief Creates a template that writes a whole set with the cached layout for these
+        /// bindings from one packed struct.
+        ///
+        DescriptorUpdateTemplate create_descriptor_update_template( vk::ArrayProxy<const vk::DescriptorSetLayoutBinding> bindings ) {
+            return DescriptorUpdateTemplate( selected_device->device.get(), layout_cache.get_set_layout( bindings ), bindings );
+        }
+
+        ///
+        /// \brief Allocates a set that lives as long as the renderer from a pool chain that grows
+        /// as needed, so no pool has to be sized up front.
+        ///
+        vk::DescriptorSet allocate_descriptor_set( vk::DescriptorSetLayout set_layout ) {
+            return descriptor_allocator.allocate( set_layout );
+        }
+
+        ///
+        /// \brief Allocates a set that is only valid until this frame slot comes round again. Frame
+        /// sets are returned all at once by resetting their pools rather than freed one by one.
+        ///
+        vk::DescriptorSet allocate_frame_descriptor_set( vk::DescriptorSetLayout set_layout ) {
+            return frame_descriptor_allocators[current_frame].allocate( set_layout );
+        }
+
+        ///
+        /// \brief Creates a sampled image with a full mip chain, or a single level if mips can't
+        /// be generated for the format. Fill level 0 and call generate_mipmaps().
+        ///
+        RendererCore::Image create_texture_2d( uint32_t width, uint32_t height, vk::Format format ) {
+            return create_image_2d( width, height, format, vk::ImageUsageFlagBits::eSampled | mipmaps.get_required_usage( format ), mipmaps.get_mip_level_count( format, width, height ) );
+        }
+
+        ///
+        /// \brief Loads a single layer KTX2 or DDS texture with all of its mip levels. Block-compressed
+        /// data is uploaded as is, or decoded to RGBA8 first if the device can't sample its format.
+        /// The next frame waits for the upload, after which the image is in eShaderReadOnlyOptimal.
+        /// \param srgb Whether a DDS file that doesn't record its color space holds sRGB colors.
+        ///
+        RendererCore::Image load_texture( const std::filesystem::path& file, bool srgb = false ) {
+            return load_texture( TextureFile::load( file, srgb ) );
+        }
+
+        ///
+        /// \brief Loads a single layer texture already in memory, e.g. one generated at run time,
+        /// like a texture file.
+        ///
+        RendererCore::Image load_texture( TextureFile texture );
+
+        ///
+        /// \brief Loads a single layer texture cooked into an asset pack. Its texels are copied from
+        /// the pack's mapping straight into the uploader's staging memory, already in their format
+        /// and with every mip level. The next frame waits for the upload.
+        ///
+        RendererCore::Image load_texture( const AssetPack& pack, std::string_view name );
+
+        ///
+        /// \brief Loads a KTX2 or DDS texture like load_texture(), but only keeps the levels it's
+        /// drawn at resident, within the device's memory budget. Report its size on screen each
+        /// frame with request_texture() and read its handle with get_texture_handle().
+        ///
+        TextureStreamer::TextureId stream_texture( const std::filesystem::path& file, bool srgb = false ) {
+            return stream_texture( TextureFile::load( file, srgb ) );
+        }
+
+        ///
+        /// \brief Streams a texture already in memory, e.g. one generated at run time, like a texture file.
+        ///
+        TextureStreamer::TextureId stream_texture( TextureFile texture ) {
+            return streamer.add( std::move( texture ).to_supported( selected_device->physical_device ) );
+        }
+
+        ///
+        /// \brief Reports that a streamed texture is drawn this frame covering about screen_size
+        /// pixels along its longest side.
+        ///
+        void request_texture( TextureStreamer::TextureId texture, float screen_size ) {
+            streamer.request( texture, screen_size );
+        }
+
+        ///
+        /// \brief The streamed texture's index in the bindless set for this frame. It changes as levels
+        /// are streamed in and out, and is invalid_handle until the first ones are resident.
+        ///
+        BindlessDescriptors::Handle get_texture_handle( TextureStreamer::TextureId texture ) const noexcept {
+            return streamer.get_handle( texture );
+        }
+
+        ///
+        /// \brief Creates the compute culling pass for up to max_objects objects a frame. Throws if
+        /// the device doesn't support drawIndirectCount or drawIndirectFirstInstance.
+        /// \param shader_file The compiled cull-cs.comp.
+        ///
+        void init_culling( const std::filesystem::path& shader_file, uint32_t max_objects );
+
+        ///
+        /// \brief Copies this frame's objects into its culling buffer, starting at object first.
+        ///
+        void write_cull_objects( const GpuCulling::Object* objects, uint32_t count, uint32_t first = 0 ) {
+            culling->write_objects( current_frame, objects, count, first );
+        }
+
+        ///
+        /// \brief This frame's objects buffer, indexed by gl_InstanceIndex in the culled draws.
+        ///
+        vk::Buffer get_cull_objects_buffer() const noexcept {
+            return culling->get_objects_buffer( current_frame );
+        }
+
+        ///
+        /// \brief Culls this frame's first object_count objects against the frustum of a column
+        /// major projection times view matrix. The culling is submitted to the compute queue at once,
+        /// so it overlaps with the recording of the rest of the frame, and the frame's graphics
+        /// submission waits for it before reading the draws. Call at most once per frame.
+        ///
+        void cull( uint32_t object_count, const std::array<float, 16>& view_projection );
+
+        ///
+        /// \brief Records the draws of the objects the last cull() left visible into the frame's
+        /// command buffer. Bind the pipeline, index buffer and vertex buffers first.
+        ///
+        void draw_culled() {
+            draw_culled( get_frame_command_buffer() );
+        }
+
+        ///
+        /// \brief Records the culled draws into another of this frame's command buffers, such as a
+        /// secondary of record_parallel().
+        ///
+        void draw_culled( vk::CommandBuffer command_buffer ) {
+            culling->draw( command_buffer, current_frame );
+        }
+
+        ///
+        /// \brief Records the commands filling the image's mip chain from level 0, with blits or,
+        /// for formats blits can't filter, a compute shader. Every level must be in
+        /// eTransferDstOptimal with level 0 written; afterwards all of them are in final_layout.
+        /// \return The compute path's views and descriptors, to keep until the commands complete.
+        ///
+        [[nodiscard]] MipmapGenerator::Resources generate_mipmaps( vk::CommandBuffer command_buffer, RendererCore::Image& image, vk::ImageLayout final_layout = vk::ImageLayout::eShaderReadOnlyOptimal, vk::PipelineStageFlags dst_stage = vk::PipelineStageFlagBits::eFragmentShader, vk::AccessFlags dst_access = vk::AccessFlagBits::eShaderRead ) {
+            MipmapGenerator::Resources r { mipmaps.generate( command_buffer, image._object.get(), image._format, image._width, image._height, image._mipLevels, final_layout, dst_stage, dst_access ) };
+            image._imageLayout = final_layout;
+            return r;
+        }
+
         vk::UniqueDescriptorPool create_descriptor_pool( vk::ArrayProxy<vk::DescriptorPoolSize> pool_sizes, uint32_t sets = 1 );
         vk::UniqueDescriptorSetLayout create_descriptor_set_layout( vk::ArrayProxy<vk::DescriptorSetLayoutBinding> set_layout_bindings );
         vk::UniqueDescriptorSet allocate_descriptor_set( vk::UniqueDescriptorPool& pool, vk::UniqueDescriptorSetLayout& set_layout );
@@ -203,26 +664,40 @@ namespace stlr {
         vk::UniqueShaderModule create_shader_module( std::string spv_file );
         RendererCore::Buffer create_buffer( vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags memory_properties );
         vk::UniquePipelineLayout create_pipeline_layout( vk::ArrayProxy<vk::UniqueDescriptorSetLayout*> layouts, vk::ArrayProxy<vk::PushConstantRange> push_constants = {} );
-        RendererCore::Image create_image_2d( uint32_t width, uint32_t height, vk::Format format = vk::Format::eR32G32B32A32Sfloat );
+        vk::UniquePipelineLayout create_bindless_pipeline_layout( vk::ArrayProxy<vk::PushConstantRange> push_constants = {} );
+        vk::UniquePipeline create_graphics_pipeline( const vk::GraphicsPipelineCreateInfo& ci );
+        RendererCore::Image create_image_2d( uint32_t width, uint32_t height, vk::Format format = vk::Format::eR32G32B32A32Sfloat, vk::ImageUsageFlags additional_usage = {}, uint32_t mip_levels = 1 );
         vk::UniqueImageView create_image_view_2d( RendererCore::Image& image );
 
 
 	private:
+		RendererCore( Window* window, vk::Extent2D extent, const std::filesystem::path& shader_directory, uint32_t frames_in_flight, std::filesystem::path pipeline_cache_file, uint32_t recording_threads, const SwapchainSettings& swapchain_settings );
 		vk::UniqueInstance create_instance();
 		vk::UniqueSurfaceKHR create_surface();
 		std::vector<RendererCore::Device> create_devices();
 		std::optional<RendererCore::Device> create_device( const vk::PhysicalDevice& p );
-		std::pair<uint32_t, uint32_t> get_graphics_and_transfer_queue_indices( const vk::PhysicalDevice& p, const std::vector<vk::QueueFamilyProperties2>& queue_fam_props );
+		std::tuple<uint32_t, uint32_t, uint32_t> get_queue_family_indices( const vk::PhysicalDevice& p, const std::vector<vk::QueueFamilyProperties2>& queue_fam_props );
 		const std::vector<RendererCore::Device>::iterator select_best_device();
 		vk::UniqueCommandPool create_graphics_command_pool();
 		vk::UniqueCommandPool create_transfer_command_pool();
+		vk::UniqueCommandPool create_compute_command_pool();
 		vk::UniqueCommandBuffer allocate_graphics_command_buffer();
 		vk::UniqueCommandBuffer allocate_transfer_command_buffer();
-		RendererCore::Swapchain create_swapchain();
+		RendererCore::Swapchain create_swapchain( vk::SwapchainKHR old_swapchain = nullptr );
+        vk::Extent2D get_window_extent() const;
+        bool recreate_swapchain();
+        void destroy_retired_swapchains();
+        std::vector<RendererCore::Image> create_offscreen_images( vk::Extent2D extent, uint32_t count );
+        RendererCore::Swapchain create_offscreen_swapchain();
         vk::UniqueSampler create_sampler();
+        std::unique_ptr<BindlessDescriptors> create_bindless_descriptors( uint32_t frames_in_flight );
+        std::vector<DescriptorAllocator> create_frame_descriptor_allocators( uint32_t count );
+        std::vector<RendererCore::Frame> create_frames( uint32_t count );
+        bool begin_frame();
+        void end_frame();
         std::vector<char> get_shader_data(std::string spv_file);
 
 
-		void render_loop();
+		void render_loop( uint64_t frame_limit );
 	};
 }
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace stlr {
+    /// <summary>
+    /// How finished frames are handed to the display, from most to least tear-free.
+    /// </summary>
+    enum class PresentPolicy {
+        /// FIFO: every frame is shown for at least one refresh. Tear-free and always supported, but a
+        /// queue of finished frames adds up to a refresh of latency each.
+        eVsync,
+        /// Mailbox, or FIFO without it: a new frame replaces the one waiting for the next refresh, so
+        /// the display always shows the newest frame without tearing.
+        eLowLatency,
+        /// FIFO relaxed, or FIFO without it: like vsync, but a frame that misses its refresh is shown
+        /// at once and tears instead of waiting a whole refresh.
+        eAdaptiveVsync,
+        /// Immediate, then mailbox, then FIFO: frames are shown as soon as they're done and tear.
+        eNoVsync
+    };
+
+    /// <summary>
+    /// What a swapchain is created with. Each choice falls back to what the surface supports, so any
+    /// settings work on any surface.
+    /// </summary>
+    struct SwapchainSettings {
+        PresentPolicy present_policy = PresentPolicy::eLowLatency;
+        /// The number of swapchain images, clamped to the surface's range. 0 picks the fewest that don't
+        /// stall: three for mailbox, so one can be shown, one wait and one be rendered, and the surface's
+        /// minimum otherwise, since every extra FIFO image is another refresh of latency.
+        uint32_t image_count = 0;
+        /// The most frames submitted and not yet finished by the GPU, up to the frames in flight. 0 allows
+        /// every frame in flight. 1 keeps input latency lowest at the cost of the CPU and GPU not overlapping.
+        uint32_t max_frame_latency = 0;
+        /// Used when the surface supports it, then the same format with red and blue swapped, then the first
+        /// supported format that can be rendered to.
+        vk::SurfaceFormatKHR format { vk::Format::eB8G8R8A8Unorm, vk::ColorSpaceKHR::eSrgbNonlinear };
+
+        vk::PresentModeKHR choose_present_mode( const std::vector<vk::PresentModeKHR>& supported ) const {
+            auto is_supported = [&supported]( vk::PresentModeKHR mode ) {
+                return std::find( supported.begin(), supported.end(), mode ) != supported.end();
+            };
+
+            switch( present_policy ) {
+            case PresentPolicy::eLowLatency:
+                if( is_supported( vk::PresentModeKHR::eMailbox ) )
+                    return vk::PresentModeKHR::eMailbox;
+                break;
+            case PresentPolicy::eAdaptiveVsync:
+                if( is_supported( vk::PresentModeKHR::eFifoRelaxed ) )
+                    return vk::PresentModeKHR::eFifoRelaxed;
+                break;
+            case PresentPolicy::eNoVsync:
+                if( is_supported( vk::PresentModeKHR::eImmediate ) )
+                    return vk::PresentModeKHR::eImmediate;
+                if( is_supported( vk::PresentModeKHR::eMailbox ) )
+                    return vk::PresentModeKHR::eMailbox;
+                break;
+            default:
+                break;
+            }
+            // Every surface supports FIFO.
+            return vk::PresentModeKHR::eFifo;
+        }
+
+        uint32_t choose_image_count( vk::PresentModeKHR present_mode, const vk::SurfaceCapabilitiesKHR& capabilities ) const noexcept {
+            uint32_t count { image_count };
+            if( count == 0 )
+                count = present_mode == vk::PresentModeKHR::eMailbox ? 3 : capabilities.minImageCount;
+
+            count = std::max( count, capabilities.minImageCount );
+            // A maximum of 0 means there's no limit.
+            if( capabilities.maxImageCount > 0 )
+                count = std::min( count, capabilities.maxImageCount );
+            return count;
+        }
+
+        vk::SurfaceFormatKHR choose_format( vk::PhysicalDevice physical_device, const std::vector<vk::SurfaceFormatKHR>& supported ) const {
+            // A single undefined format means the surface takes any format.
+            if( supported.size() == 1 && supported.front().format == vk::Format::eUndefined )
+                return format;
+
+            auto find = [&supported]( vk::Format f, vk::ColorSpaceKHR color_space ) {
+                return std::find_if( supported.begin(), supported.end(), [&]( const vk::SurfaceFormatKHR& s ) { return s.format == f && s.colorSpace == color_space; } );
+            };
+
+            auto it = find( format.format, format.colorSpace );
+            if( it != supported.end() )
+                return *it;
+
+            static constexpr std::array<std::array<vk::Format, 2>, 2> swapped { {
+                { vk::Format::eB8G8R8A8Unorm, vk::Format::eR8G8B8A8Unorm },
+                { vk::Format::eB8G8R8A8Srgb, vk::Format::eR8G8B8A8Srgb }
+            } };
+            for( const auto& s : swapped ) {
+                if( format.format == s[0] || format.format == s[1] ) {
+                    it = find( format.format == s[0] ? s[1] : s[0], format.colorSpace );
+                    if( it != supported.end() )
+                        return *it;
+                }
+            }
+
+            for( const auto& s : supported ) {
+                if( physical_device.getFormatProperties( s.format ).optimalTilingFeatures & vk::FormatFeatureFlagBits::eColorAttachment )
+                    return s;
+            }
+            return supported.front();
+        }
+
+        /// <summary>
+        /// The surface's extent, or, where the surface leaves it to the swapchain, the window's framebuffer
+        /// size clamped to what the surface allows. Either is 0 while the window is minimized.
+        /// </summary>
+        static vk::Extent2D choose_extent( const vk::SurfaceCapabilitiesKHR& capabilities, vk::Extent2D framebuffer_size ) noexcept {
+            if( capabilities.currentExtent.width != UINT32_MAX )
+                return capabilities.currentExtent;
+
+            return vk::Extent2D {
+                std::clamp( framebuffer_size.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width ),
+                std::clamp( framebuffer_size.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height )
+            };
+        }
+
+        static vk::CompositeAlphaFlagBitsKHR choose_composite_alpha( const vk::SurfaceCapabilitiesKHR& capabilities ) noexcept {
+            for( const auto a : { vk::CompositeAlphaFlagBitsKHR::eOpaque, vk::CompositeAlphaFlagBitsKHR::eInherit, vk::CompositeAlphaFlagBitsKHR::ePreMultiplied, vk::CompositeAlphaFlagBitsKHR::ePostMultiplied } ) {
+                if( capabilities.supportedCompositeAlpha & a )
+                    return a;
+            }
+            return vk::CompositeAlphaFlagBitsKHR::eOpaque;
+        }
+
+        uint32_t get_frame_latency( uint32_t frames_in_flight ) const noexcept {
+            return max_frame_latency == 0 ? frames_in_flight : std::min( max_frame_latency, frames_in_flight );
+        }
+    };
+}
@@ -0,0 +1,454 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+#include "Utils.hpp"
+
+namespace stlr {
+    /// <summary>
+    /// A texture read from a KTX2 or DDS container with all of its mip levels, array layers and
+    /// cube faces, kept in the container's format. Block-compressed data is copied to the image
+    /// as is, so it takes a quarter to an eighth of the memory and upload bandwidth of RGBA8.
+    ///
+    /// Devices that can't sample the format get an RGBA8 copy from to_supported() instead; the
+    /// CPU can decode BC1 to BC5. Supercompressed (Basis, zstd) KTX2 files aren't supported.
+    /// </summary>
+    class TextureFile {
+    public:
+        /// <summary>
+        /// One mip level of one layer, as a range of data.
+        /// </summary>
+        struct Subresource {
+            uint32_t level;
+            uint32_t layer;
+            size_t offset;
+            size_t size;
+        };
+
+        vk::Format format = vk::Format::eUndefined;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t level_count = 0;
+        /// Array layers times cube faces.
+        uint32_t layer_count = 0;
+        bool cube = false;
+        std::vector<char> data;
+        std::vector<Subresource> subresources;
+
+        /// <summary>
+        /// Reads a .ktx2 or .dds file, recognized by its leading bytes.
+        /// </summary>
+        /// <param name="srgb">Whether DDS files without a DX10 header, which don't say, hold sRGB colors.</param>
+        static TextureFile load( const std::filesystem::path& file, bool srgb = false ) {
+            std::ifstream f( file, std::ios::binary | std::ios::ate );
+            if( !f.is_open() )
+                throw std::runtime_error( "Failed to open texture: " + file.string() );
+
+            std::vector<char> bytes( static_cast<size_t>( f.tellg() ) );
+            f.seekg( 0 );
+            f.read( bytes.data(), bytes.size() );
+
+            static constexpr std::array<char, 12> ktx2_identifier { '\xAB', 'K', 'T', 'X', ' ', '2', '0', '\xBB', '\r', '\n', '\x1A', '\n' };
+            if( bytes.size() >= ktx2_identifier.size() && std::equal( ktx2_identifier.begin(), ktx2_identifier.end(), bytes.begin() ) )
+                return parse_ktx2( std::move( bytes ) );
+            if( bytes.size() >= 4 && std::memcmp( bytes.data(), "DDS ", 4 ) == 0 )
+                return parse_dds( std::move( bytes ), srgb );
+
+            throw std::runtime_error( "Not a KTX2 or DDS texture: " + file.string() );
+        }
+
+        vk::Extent3D get_level_extent( uint32_t level ) const noexcept {
+            return vk::Extent3D { std::max( width >> level, 1u ), std::max( height >> level, 1u ), 1 };
+        }
+
+        vk::ImageSubresourceRange get_subresource_range() const noexcept {
+            return vk::ImageSubresourceRange { vk::ImageAspectFlagBits::eColor, 0, level_count, 0, layer_count };
+        }
+
+        /// <summary>
+        /// The copies of every subresource from a buffer holding data at buffer_offset. Rows are
+        /// tightly packed blocks and each extent is the level's size in texels, which the copy
+        /// rules allow to end partway through a block at the image's edge.
+        /// </summary>
+        std::vector<vk::BufferImageCopy> get_copy_regions( vk::DeviceSize buffer_offset = 0 ) const {
+            std::vector<vk::BufferImageCopy> regions;
+            regions.reserve( subresources.size() );
+            for( const auto& s : subresources ) {
+                regions.push_back( vk::BufferImageCopy {
+                    buffer_offset + s.offset,
+                    0,
+                    0,
+                    vk::ImageSubresourceLayers { vk::ImageAspectFlagBits::eColor, s.level, s.layer, 1 },
+                    vk::Offset3D { 0, 0, 0 },
+                    get_level_extent( s.level )
+                } );
+            }
+            return regions;
+        }
+
+        /// <summary>
+        /// Whether images of the format can be sampled with optimal tiling.
+        /// </summary>
+        static bool is_format_supported( vk::PhysicalDevice physical_device, vk::Format format ) {
+            return static_cast<bool>( physical_device.getFormatProperties( format ).optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage );
+        }
+
+        static bool can_decompress( vk::Format format ) noexcept {
+            switch( format ) {
+            case vk::Format::eBc1RgbUnormBlock:
+            case vk::Format::eBc1RgbSrgbBlock:
+            case vk::Format::eBc1RgbaUnormBlock:
+            case vk::Format::eBc1RgbaSrgbBlock:
+            case vk::Format::eBc2UnormBlock:
+            case vk::Format::eBc2SrgbBlock:
+            case vk::Format::eBc3UnormBlock:
+            case vk::Format::eBc3SrgbBlock:
+            case vk::Format::eBc4UnormBlock:
+            case vk::Format::eBc5UnormBlock:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        /// <summary>
+        /// Returns the texture as is if the device can sample its format, or decoded to RGBA8 if not.
+        /// </summary>
+        TextureFile to_supported( vk::PhysicalDevice physical_device ) && {
+            if( is_format_supported( physical_device, format ) )
+                return std::move( *this );
+            if( !can_decompress( format ) )
+                throw std::runtime_error( "The device can't sample the texture's format and it can't be decoded on the CPU." );
+            return decompress();
+        }
+
+        /// <summary>
+        /// Decodes BC1 to BC5 texels to R8G8B8A8, keeping sRGB formats sRGB.
+        /// </summary>
+        TextureFile decompress() const {
+            if( !can_decompress( format ) )
+                throw std::runtime_error( "The texture's format can't be decoded on the CPU." );
+
+            const bool srgb { format == vk::Format::eBc1RgbSrgbBlock || format == vk::Format::eBc1RgbaSrgbBlock || format == vk::Format::eBc2SrgbBlock || format == vk::Format::eBc3SrgbBlock };
+
+            TextureFile t;
+            t.format = srgb ? vk::Format::eR8G8B8A8Srgb : vk::Format::eR8G8B8A8Unorm;
+            t.width = width;
+            t.height = height;
+            t.level_count = level_count;
+            t.layer_count = layer_count;
+            t.cube = cube;
+            t.subresources.reserve( subresources.size() );
+
+            size_t size { 0 };
+            for( const auto& s : subresources ) {
+                const vk::Extent3D e { get_level_extent( s.level ) };
+                t.subresources.push_back( Subresource { s.level, s.layer, size, static_cast<size_t>( e.width ) * e.height * 4 } );
+                size += t.subresources.back().size;
+            }
+            t.data.resize( size );
+
+            const uint32_t block_size { format_utils::get_format_size( format ) };
+            for( size_t i = 0; i < subresources.size(); ++i ) {
+                const vk::Extent3D e { get_level_extent( subresources[i].level ) };
+                const uint8_t* src { reinterpret_cast<const uint8_t*>( data.data() + subresources[i].offset ) };
+                uint8_t* dst { reinterpret_cast<uint8_t*>( t.data.data() + t.subresources[i].offset ) };
+
+                for( uint32_t by = 0; by < e.height; by += 4 ) {
+                    for( uint32_t bx = 0; bx < e.width; bx += 4 ) {
+                        std::array<uint8_t, 64> texels;
+                        decode_block( src, texels.data() );
+                        src += block_size;
+
+                        // Blocks past the edge of small levels hold padding texels that aren't copied.
+                        for( uint32_t y = 0; y < 4 && by + y < e.height; ++y ) {
+                            for( uint32_t x = 0; x < 4 && bx + x < e.width; ++x ) {
+                                std::memcpy( dst + ( static_cast<size_t>( by + y ) * e.width + bx + x ) * 4, texels.data() + ( y * 4 + x ) * 4, 4 );
+                            }
+                        }
+                    }
+                }
+            }
+
+            return t;
+        }
+
+    private:
+        template <typename T>
+        static T read( const std::vector<char>& bytes, size_t offset ) {
+            if( offset + sizeof( T ) > bytes.size() )
+                throw std::runtime_error( "The texture file is truncated." );
+            T value;
+            std::memcpy( &value, bytes.data() + offset, sizeof( T ) );
+            return value;
+        }
+
+        size_t get_subresource_size( uint32_t level ) const {
+            const vk::Extent3D e { get_level_extent( level ) };
+            const vk::Extent2D block { format_utils::get_block_extent( format ) };
+            return static_cast<size_t>( ( e.width + block.width - 1 ) / block.width ) * ( ( e.height + block.height - 1 ) / block.height ) * format_utils::get_format_size( format );
+        }
+
+        void check_level_count() const {
+            // Levels past the 1x1 one would shift the extents out of range.
+            if( level_count > get_full_mip_level_count( width, height ) )
+                throw std::runtime_error( "The texture file has more levels than its size allows." );
+        }
+
+        void add_subresource( uint32_t level, uint32_t layer, size_t offset ) {
+            const size_t size { get_subresource_size( level ) };
+            // Written so that an offset or size read from the file can't overflow the check.
+            if( offset > data.size() || size > data.size() - offset )
+                throw std::runtime_error( "The texture file is truncated." );
+            subresources.push_back( Subresource { level, layer, offset, size } );
+        }
+
+        static TextureFile parse_ktx2( std::vector<char> bytes ) {
+            TextureFile t;
+            t.format = static_cast<vk::Format>( read<uint32_t>( bytes, 12 ) );
+            t.width = read<uint32_t>( bytes, 20 );
+            t.height = std::max( read<uint32_t>( bytes, 24 ), 1u );
+            const uint32_t depth { read<uint32_t>( bytes, 28 ) };
+            const uint32_t layers { std::max( read<uint32_t>( bytes, 32 ), 1u ) };
+            const uint32_t faces { read<uint32_t>( bytes, 36 ) };
+            // 0 asks the loader to generate the mips; only the base level is stored.
+            t.level_count = std::max( read<uint32_t>( bytes, 40 ), 1u );
+            const uint32_t supercompression { read<uint32_t>( bytes, 44 ) };
+
+            if( t.format == vk::Format::eUndefined || supercompression != 0 )
+                throw std::runtime_error( "Basis and supercompressed KTX2 textures aren't supported." );
+            if( depth > 1 )
+                throw std::runtime_error( "3D KTX2 textures aren't supported." );
+            if( format_utils::format_table.count( static_cast<VkFormat>( t.format ) ) == 0 )
+                throw std::runtime_error( "The KTX2 texture's format is unknown." );
+            t.check_level_count();
+
+            t.cube = faces == 6;
+            t.layer_count = layers * faces;
+            t.data = std::move( bytes );
+
+            // Each level holds its layers in order, and each layer its faces.
+            constexpr size_t level_index { 80 };
+            for( uint32_t level = 0; level < t.level_count; ++level ) {
+                size_t offset { static_cast<size_t>( read<uint64_t>( t.data, level_index + level * 24 ) ) };
+                for( uint32_t layer = 0; layer < t.layer_count; ++layer ) {
+                    t.add_subresource( level, layer, offset );
+                    offset += t.subresources.back().size;
+                }
+            }
+
+            return t;
+        }
+
+        static TextureFile parse_dds( std::vector<char> bytes, bool srgb ) {
+            constexpr uint32_t pf_fourcc { 0x4 };
+            constexpr uint32_t pf_rgb { 0x40 };
+            constexpr uint32_t caps2_cubemap { 0x200 };
+            constexpr uint32_t misc_texturecube { 0x4 };
+
+            TextureFile t;
+            t.height = read<uint32_t>( bytes, 12 );
+            t.width = read<uint32_t>( bytes, 16 );
+            t.level_count = std::max( read<uint32_t>( bytes, 28 ), 1u );
+            const uint32_t pf_flags { read<uint32_t>( bytes, 80 ) };
+            const uint32_t fourcc { read<uint32_t>( bytes, 84 ) };
+            const uint32_t caps2 { read<uint32_t>( bytes, 112 ) };
+
+            size_t offset { 128 };
+            t.layer_count = 1;
+            t.cube = ( caps2 & caps2_cubemap ) != 0;
+
+            if( ( pf_flags & pf_fourcc ) && fourcc == make_fourcc( "DX10" ) ) {
+                t.format = get_dxgi_format( read<uint32_t>( bytes, 128 ) );
+                t.cube = ( read<uint32_t>( bytes, 136 ) & misc_texturecube ) != 0;
+                t.layer_count = std::max( read<uint32_t>( bytes, 140 ), 1u );
+                offset += 20;
+            }
+            else if( pf_flags & pf_fourcc ) {
+                if( fourcc == make_fourcc( "DXT1" ) )
+                    t.format = srgb ? vk::Format::eBc1RgbaSrgbBlock : vk::Format::eBc1RgbaUnormBlock;
+                else if( fourcc == make_fourcc( "DXT2" ) || fourcc == make_fourcc( "DXT3" ) )
+                    t.format = srgb ? vk::Format::eBc2SrgbBlock : vk::Format::eBc2UnormBlock;
+                else if( fourcc == make_fourcc( "DXT4" ) || fourcc == make_fourcc( "DXT5" ) )
+                    t.format = srgb ? vk::Format::eBc3SrgbBlock : vk::Format::eBc3UnormBlock;
+                else if( fourcc == make_fourcc( "ATI1" ) || fourcc == make_fourcc( "BC4U" ) )
+                    t.format = vk::Format::eBc4UnormBlock;
+                else if( fourcc == make_fourcc( "ATI2" ) || fourcc == make_fourcc( "BC5U" ) )
+                    t.format = vk::Format::eBc5UnormBlock;
+            }
+            else if( ( pf_flags & pf_rgb ) && read<uint32_t>( bytes, 88 ) == 32 ) {
+                // 32 bit RGB(A) is either byte order, told apart by where red is.
+                const bool rgba { read<uint32_t>( bytes, 92 ) == 0x000000ff };
+                t.format = rgba ? ( srgb ? vk::Format::eR8G8B8A8Srgb : vk::Format::eR8G8B8A8Unorm ) : ( srgb ? vk::Format::eB8G8R8A8Srgb : vk::Format::eB8G8R8A8Unorm );
+            }
+
+            if( t.format == vk::Format::eUndefined )
+                throw std::runtime_error( "The DDS texture's format isn't supported." );
+            t.check_level_count();
+
+            if( t.cube )
+                t.layer_count *= 6;
+            t.data = std::move( bytes );
+
+            // Unlike KTX2, each layer holds all of its levels.
+            for( uint32_t layer = 0; layer < t.layer_count; ++layer ) {
+                for( uint32_t level = 0; level < t.level_count; ++level ) {
+                    t.add_subresource( level, layer, offset );
+                    offset += t.subresources.back().size;
+                }
+            }
+
+            return t;
+        }
+
+        static constexpr uint32_t make_fourcc( const char ( &c )[5] ) noexcept {
+            return static_cast<uint32_t>( c[0] ) | static_cast<uint32_t>( c[1] ) << 8 | static_cast<uint32_t>( c[2] ) << 16 | static_cast<uint32_t>( c[3] ) << 24;
+        }
+
+        static vk::Format get_dxgi_format( uint32_t dxgi_format ) noexcept {
+            switch( dxgi_format ) {
+            case 28: return vk::Format::eR8G8B8A8Unorm;
+            case 29: return vk::Format::eR8G8B8A8Srgb;
+            case 71: return vk::Format::eBc1RgbaUnormBlock;
+            case 72: return vk::Format::eBc1RgbaSrgbBlock;
+            case 74: return vk::Format::eBc2UnormBlock;
+            case 75: return vk::Format::eBc2SrgbBlock;
+            case 77: return vk::Format::eBc3UnormBlock;
+            case 78: return vk::Format::eBc3SrgbBlock;
+            case 80: return vk::Format::eBc4UnormBlock;
+            case 81: return vk::Format::eBc4SnormBlock;
+            case 83: return vk::Format::eBc5UnormBlock;
+            case 84: return vk::Format::eBc5SnormBlock;
+            case 87: return vk::Format::eB8G8R8A8Unorm;
+            case 91: return vk::Format::eB8G8R8A8Srgb;
+            case 95: return vk::Format::eBc6HUfloatBlock;
+            case 96: return vk::Format::eBc6HSfloatBlock;
+            case 98: return vk::Format::eBc7UnormBlock;
+            case 99: return vk::Format::eBc7SrgbBlock;
+            default: return vk::Format::eUndefined;
+            }
+        }
+
+        /// Decodes one block into 4x4 RGBA8 texels.
+        void decode_block( const uint8_t* block, uint8_t* texels ) const noexcept {
+            switch( format ) {
+            case vk::Format::eBc1RgbUnormBlock:
+            case vk::Format::eBc1RgbSrgbBlock:
+                decode_color( block, texels, false, false );
+                break;
+            case vk::Format::eBc1RgbaUnormBlock:
+            case vk::Format::eBc1RgbaSrgbBlock:
+                decode_color( block, texels, false, true );
+                break;
+            case vk::Format::eBc2UnormBlock:
+            case vk::Format::eBc2SrgbBlock:
+                decode_color( block + 8, texels, true, false );
+                for( uint32_t i = 0; i < 16; ++i ) {
+                    const uint8_t a { static_cast<uint8_t>( ( block[i / 2] >> ( ( i % 2 ) * 4 ) ) & 0xf ) };
+                    texels[i * 4 + 3] = static_cast<uint8_t>( a * 17 );
+                }
+                break;
+            case vk::Format::eBc3UnormBlock:
+            case vk::Format::eBc3SrgbBlock:
+                decode_color( block + 8, texels, true, false );
+                decode_channel( block, texels + 3 );
+                break;
+            case vk::Format::eBc4UnormBlock:
+                decode_channel( block, texels );
+                for( uint32_t i = 0; i < 16; ++i ) {
+                    texels[i * 4 + 1] = 0;
+                    texels[i * 4 + 2] = 0;
+                    texels[i * 4 + 3] = 255;
+                }
+                break;
+            case vk::Format::eBc5UnormBlock:
+                decode_channel( block, texels );
+                decode_channel( block + 8, texels + 1 );
+                for( uint32_t i = 0; i < 16; ++i ) {
+                    texels[i * 4 + 2] = 0;
+                    texels[i * 4 + 3] = 255;
+                }
+                break;
+            default:
+                break;
+            }
+        }
+
+        /// The BC1 color block, also the second half of BC2 and BC3 blocks, which always use four colors.
+        static void decode_color( const uint8_t* block, uint8_t* texels, bool four_colors, bool punch_through_alpha ) noexcept {
+            const uint16_t c0 { static_cast<uint16_t>( block[0] | block[1] << 8 ) };
+            const uint16_t c1 { static_cast<uint16_t>( block[2] | block[3] << 8 ) };
+
+            std::array<std::array<uint8_t, 4>, 4> palette;
+            palette[0] = expand_565( c0 );
+            palette[1] = expand_565( c1 );
+            if( four_colors || c0 > c1 ) {
+                for( uint32_t c = 0; c < 3; ++c ) {
+                    palette[2][c] = static_cast<uint8_t>( ( 2 * palette[0][c] + palette[1][c] + 1 ) / 3 );
+                    palette[3][c] = static_cast<uint8_t>( ( palette[0][c] + 2 * palette[1][c] + 1 ) / 3 );
+                }
+                palette[2][3] = 255;
+                palette[3][3] = 255;
+            }
+            else {
+                for( uint32_t c = 0; c < 3; ++c ) {
+                    palette[2][c] = static_cast<uint8_t>( ( palette[0][c] + palette[1][c] + 1 ) / 2 );
+                    palette[3][c] = 0;
+                }
+                palette[2][3] = 255;
+                palette[3][3] = punch_through_alpha ? 0 : 255;
+            }
+
+            const uint32_t indices { static_cast<uint32_t>( block[4] | block[5] << 8 | block[6] << 16 | static_cast<uint32_t>( block[7] ) << 24 ) };
+            for( uint32_t i = 0; i < 16; ++i ) {
+                std::memcpy( texels + i * 4, palette[( indices >> ( i * 2 ) ) & 0x3].data(), 4 );
+            }
+        }
+
+        /// The BC4 block, also the alpha of BC3 and each channel of BC5. Writes every fourth byte.
+        static void decode_channel( const uint8_t* block, uint8_t* texels ) noexcept {
+            const uint32_t v0 { block[0] };
+            const uint32_t v1 { block[1] };
+
+            std::array<uint8_t, 8> palette { static_cast<uint8_t>( v0 ), static_cast<uint8_t>( v1 ) };
+            if( v0 > v1 ) {
+                for( uint32_t i = 1; i < 7; ++i ) {
+                    palette[i + 1] = static_cast<uint8_t>( ( ( 7 - i ) * v0 + i * v1 + 3 ) / 7 );
+                }
+            }
+            else {
+                for( uint32_t i = 1; i < 5; ++i ) {
+                    palette[i + 1] = static_cast<uint8_t>( ( ( 5 - i ) * v0 + i * v1 + 2 ) / 5 );
+                }
+                palette[6] = 0;
+                palette[7] = 255;
+            }
+
+            uint64_t indices { 0 };
+            for( uint32_t i = 0; i < 6; ++i ) {
+                indices |= static_cast<uint64_t>( block[2 + i] ) << ( i * 8 );
+            }
+            for( uint32_t i = 0; i < 16; ++i ) {
+                texels[i * 4] = palette[( indices >> ( i * 3 ) ) & 0x7];
+            }
+        }
+
+        static std::array<uint8_t, 4> expand_565( uint16_t c ) noexcept {
+            const uint32_t r { static_cast<uint32_t>( c >> 11 ) & 0x1f };
+            const uint32_t g { static_cast<uint32_t>( c >> 5 ) & 0x3f };
+            const uint32_t b { static_cast<uint32_t>( c ) & 0x1f };
+            return {
+                static_cast<uint8_t>( ( r << 3 ) | ( r >> 2 ) ),
+                static_cast<uint8_t>( ( g << 2 ) | ( g >> 4 ) ),
+                static_cast<uint8_t>( ( b << 3 ) | ( b >> 2 ) ),
+                255
+            };
+        }
+    };
+}
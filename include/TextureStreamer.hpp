@@ -0,0 +1,170 @@
+#pragma once
+
+#include <vector>
+#include <vulkan/vulkan.hpp>
+#include "BindlessDescriptors.hpp"
+#include "MemoryAllocator.hpp"
+#include "TextureFile.hpp"
+#include "UploadManager.hpp"
+
+namespace stlr {
+    /// <summary>
+    /// Keeps textures resident at the detail they're seen at while staying within a device memory budget.
+    ///
+    /// Every texture starts with only its mips of at most min_resident_size texels resident. The
+    /// renderer reports each texture's size on screen with request(), and update() streams in one
+    /// more detailed level at a time for textures that need it, up to a number of upload bytes per
+    /// frame. When the textures would use more than their share of the budget, the least recently
+    /// requested ones that weren't drawn in the last frame lose their most detailed level until
+    /// they fit, but never drop below the minimum.
+    ///
+    /// Without sparse residency, changing a texture's levels means creating a new image with them
+    /// and uploading them from the texture's file data, which is kept in host memory. The new image
+    /// replaces the old one once its upload is complete, and the old one is destroyed once the
+    /// frames that may still sample it have finished. get_handle() and get_view() therefore change
+    /// over time; read them when recording each frame.
+    ///
+    /// The budget is what VK_EXT_memory_budget reports for the device local heap, less what the
+    /// rest of the process uses. Without the extension it's a fraction of the heap's size less what
+    /// the allocator has reserved.
+    ///
+    /// Not thread-safe.
+    /// </summary>
+    class TextureStreamer {
+    public:
+        using TextureId = uint32_t;
+        static constexpr TextureId invalid_texture = UINT32_MAX;
+
+        struct Statistics {
+            uint32_t texture_count = 0;
+            uint32_t pending_count = 0;
+            vk::DeviceSize resident_bytes = 0;
+            vk::DeviceSize limit_bytes = 0;
+            uint64_t streamed_levels = 0;
+            uint64_t evicted_levels = 0;
+        };
+
+    private:
+        /// An image holding a texture's levels from top_level down.
+        struct Residency {
+            vk::UniqueImage image;
+            MemoryAllocator::UniqueAllocation allocation;
+            vk::UniqueImageView view;
+            BindlessDescriptors::Handle handle = BindlessDescriptors::invalid_handle;
+            uint32_t top_level = 0;
+            vk::DeviceSize size = 0;
+        };
+
+        struct Texture {
+            TextureFile file;
+            Residency resident;
+            /// The replacement of resident while its upload is in flight.
+            Residency pending;
+            UploadToken pending_token = 0;
+            bool has_pending = false;
+            /// The least detailed top level, which is never evicted.
+            uint32_t base_level = 0;
+            /// The most detailed level requested since the last update.
+            uint32_t wanted_level = 0;
+            uint64_t last_used = 0;
+            bool alive = false;
+        };
+
+        struct Retired {
+            Residency residency;
+            uint64_t frame;
+            /// The upload into the image, if it was abandoned before finishing.
+            UploadToken token;
+        };
+
+        vk::PhysicalDevice physical_device;
+        vk::Device device;
+        MemoryAllocator& allocator;
+        UploadManager& uploader;
+        BindlessDescriptors* bindless;
+        vk::Sampler sampler;
+        uint32_t frame_count;
+        bool memory_budget;
+        uint32_t heap_index;
+        vk::DeviceSize upload_bytes_per_frame;
+        uint32_t min_resident_size;
+        float budget_fraction;
+        std::vector<Texture> textures;
+        std::vector<TextureId> free_ids;
+        std::vector<Retired> retired;
+        uint64_t frame;
+        Statistics statistics;
+
+    public:
+        /// <param name="bindless">The set to register resident images in, or null to only use get_view().</param>
+        /// <param name="frame_count">The number of frames in flight.</param>
+        /// <param name="memory_budget">Whether VK_EXT_memory_budget is enabled on the device.</param>
+        /// <param name="upload_bytes_per_frame">Roughly how much texture data update() streams in each frame.</param>
+        /// <param name="min_resident_size">The width and height of the largest level that always stays resident.</param>
+        /// <param name="budget_fraction">The fraction of the heap budget the process may use before textures are evicted.</param>
+        TextureStreamer( vk::PhysicalDevice physical_device, vk::Device device, MemoryAllocator& allocator, UploadManager& uploader, BindlessDescriptors* bindless, vk::Sampler sampler, uint32_t frame_count, bool memory_budget, vk::DeviceSize upload_bytes_per_frame = 16ull * 1024 * 1024, uint32_t min_resident_size = 64, float budget_fraction = 0.9f );
+
+        TextureStreamer( const TextureStreamer& ) = delete;
+        TextureStreamer& operator=( const TextureStreamer& ) = delete;
+
+        /// <summary>
+        /// Starts streaming a single layer 2D texture. Its minimum levels are queued for upload at
+        /// once, but it has no image until an update() after they've been uploaded.
+        /// </summary>
+        TextureId add( TextureFile file );
+
+        /// <summary>
+        /// Stops streaming a texture. Its images are destroyed once no frame in flight can use them.
+        /// </summary>
+        void remove( TextureId id );
+
+        /// <summary>
+        /// Reports that a texture is drawn this frame covering about screen_size pixels along its longest side.
+        /// </summary>
+        void request( TextureId id, float screen_size );
+
+        /// <summary>
+        /// Swaps in finished uploads, destroys images no frame uses anymore, evicts to stay within the
+        /// budget and queues the next uploads. Call once per frame after its fence has been waited on
+        /// and before the uploader's queued copies are submitted.
+        /// </summary>
+        void update();
+
+        /// <summary>
+        /// The texture's index in the bindless set, or invalid_handle until its first levels are resident.
+        /// </summary>
+        BindlessDescriptors::Handle get_handle( TextureId id ) const noexcept {
+            return textures[id].resident.handle;
+        }
+
+        /// <summary>
+        /// A view of the texture's resident levels, or null until its first levels are resident.
+        /// </summary>
+        vk::ImageView get_view( TextureId id ) const noexcept {
+            return textures[id].resident.view.get();
+        }
+
+        /// <summary>
+        /// The most detailed level that's resident, or the level count if none are yet.
+        /// </summary>
+        uint32_t get_resident_level( TextureId id ) const noexcept {
+            const Texture& t { textures[id] };
+            return t.resident.image ? t.resident.top_level : t.file.level_count;
+        }
+
+        Statistics get_statistics() const noexcept {
+            return statistics;
+        }
+
+    private:
+        uint32_t find_device_local_heap() const;
+        /// The bytes textures may use: what they use now plus what's left of the budget.
+        vk::DeviceSize get_limit() const;
+        /// The size textures will use once every pending upload has replaced its resident image.
+        vk::DeviceSize get_committed_size() const noexcept;
+        /// Creates an image with the file's levels from top_level down and queues their upload.
+        /// Returns the number of bytes uploaded.
+        vk::DeviceSize stream( Texture& texture, uint32_t top_level );
+        void retire( Residency& residency, UploadToken token = 0 );
+    };
+}
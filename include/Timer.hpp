@@ -27,6 +27,20 @@ namespace stlr {
             return elapsed_time;
         }
 
+        ///
+        /// \brief The time the timer was last started.
+        ///
+        std::chrono::steady_clock::time_point get_start_time_point() const noexcept {
+            return start_time_point;
+        }
+
+        ///
+        /// \brief The time the timer was last stopped.
+        ///
+        std::chrono::steady_clock::time_point get_stop_time_point() const noexcept {
+            return stop_time_point;
+        }
+
         ///
         /// \brief Starts the timer.
         ///
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace stlr {
+    /// <summary>
+    /// A hierarchy of transforms stored as one array per field and ordered parents first.
+    ///
+    /// Setting a node's local matrix only marks it dirty. update() then makes one pass over the
+    /// arrays in order, recomputing a node's world matrix if it or its parent changed, so a moved
+    /// node takes its whole subtree with it and nothing else is touched. Because parents always
+    /// come before their children, the pass reads the parent's world matrix from earlier in the
+    /// same array instead of following pointers.
+    ///
+    /// write_world() and write_mvp() copy the results straight into mapped GPU memory, at any
+    /// stride, so they can fill an instance buffer or per-object uniforms in place. The matrix
+    /// products use AVX2 and FMA when the compiler targets them (STELLAR_AVX2 in CMake) and SSE
+    /// otherwise.
+    ///
+    /// Matrices are column major, like glm::mat4, and may be copied from one with memcpy.
+    /// </summary>
+    class TransformHierarchy {
+    public:
+        using NodeId = uint32_t;
+        static constexpr NodeId no_parent = UINT32_MAX;
+
+        struct alignas( 32 ) Matrix {
+            std::array<float, 16> m;
+
+            static constexpr Matrix identity() noexcept {
+                return Matrix { { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f } };
+            }
+        };
+
+    private:
+        std::vector<NodeId> parents;
+        std::vector<Matrix> locals;
+        std::vector<Matrix> worlds;
+        /// Nodes whose local matrix was set since the last update.
+        std::vector<uint8_t> dirty;
+        /// Nodes whose world matrix the last update recomputed.
+        std::vector<uint8_t> changed;
+        bool any_dirty = false;
+        uint32_t changed_count = 0;
+
+    public:
+        /// <summary>
+        /// Adds a node under parent, which must already exist, so the order stays parents first.
+        /// </summary>
+        NodeId add( NodeId parent = no_parent, const Matrix& local = Matrix::identity() );
+
+        /// <summary>
+        /// Removes every node.
+        /// </summary>
+        void clear() noexcept;
+
+        void set_local( NodeId node, const Matrix& local ) noexcept {
+            locals[node] = local;
+            dirty[node] = 1;
+            any_dirty = true;
+        }
+
+        /// <summary>
+        /// Sets the local matrix from a translation, a unit quaternion (x, y, z, w) and a scale.
+        /// </summary>
+        void set_local( NodeId node, const std::array<float, 3>& translation, const std::array<float, 4>& rotation, const std::array<float, 3>& scale ) noexcept {
+            set_local( node, compose( translation, rotation, scale ) );
+        }
+
+        const Matrix& get_local( NodeId node ) const noexcept {
+            return locals[node];
+        }
+
+        /// <summary>
+        /// The node's world matrix as of the last update().
+        /// </summary>
+        const Matrix& get_world( NodeId node ) const noexcept {
+            return worlds[node];
+        }
+
+        NodeId get_parent( NodeId node ) const noexcept {
+            return parents[node];
+        }
+
+        uint32_t get_node_count() const noexcept {
+            return static_cast<uint32_t>( parents.size() );
+        }
+
+        /// <summary>
+        /// Whether the last update() recomputed the node's world matrix.
+        /// </summary>
+        bool is_changed( NodeId node ) const noexcept {
+            return changed[node] != 0;
+        }
+
+        /// <summary>
+        /// Recomputes the world matrices of the nodes set since the last update and of everything under them.
+        /// </summary>
+        /// <returns>The number of world matrices recomputed.</returns>
+        uint32_t update();
+
+        /// <summary>
+        /// Copies every world matrix to destination + node * stride. With changed_only, only the ones
+        /// the last update() changed are copied, which is only right when destination already holds
+        /// the others, so not for buffers that alternate between frames in flight.
+        /// </summary>
+        void write_world( void* destination, size_t stride, bool changed_only = false ) const;
+
+        /// <summary>
+        /// Writes view_projection * world for every node to destination + node * stride.
+        /// </summary>
+        void write_mvp( const Matrix& view_projection, void* destination, size_t stride ) const;
+
+        /// <summary>
+        /// out = a * b.
+        /// </summary>
+        static void multiply( const Matrix& a, const Matrix& b, Matrix& out ) noexcept;
+
+        static Matrix compose( const std::array<float, 3>& translation, const std::array<float, 4>& rotation, const std::array<float, 3>& scale ) noexcept;
+    };
+}
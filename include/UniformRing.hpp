@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <type_traits>
+#include <vulkan/vulkan.hpp>
+#include "MemoryAllocator.hpp"
+
+namespace stlr {
+    /// <summary>
+    /// Per-draw shader constants without descriptor writes.
+    ///
+    /// Constants of up to max_push_constant_size bytes are pushed. Larger ones are copied into a
+    /// persistently mapped uniform buffer split into one region per frame in flight; each frame
+    /// allocates linearly from its region, so an allocation is an atomic pointer bump and a copy,
+    /// which threads recording in parallel can do at once, and the region is reused once the
+    /// frame's fence has been waited on. The whole buffer is bound
+    /// through one eUniformBufferDynamic descriptor written once, and each draw picks its data
+    /// with a dynamic offset.
+    ///
+    /// Whether a type is pushed or read from the buffer is decided by its size, so the pipeline
+    /// layout and the shader's constant block follow uses_push_constants().
+    /// </summary>
+    class UniformRing {
+    public:
+        /// The push constant size every device supports.
+        static constexpr uint32_t max_push_constant_size = 128;
+
+        template <typename T>
+        static constexpr bool uses_push_constants() noexcept {
+            return sizeof( T ) <= max_push_constant_size;
+        }
+
+        /// <summary>
+        /// The push constant range for a constants type, starting at offset 0.
+        /// </summary>
+        template <typename T>
+        static constexpr vk::PushConstantRange get_push_constant_range( vk::ShaderStageFlags stages ) noexcept {
+            static_assert( uses_push_constants<T>(), "The constants are too large to push; use the ring's descriptor set." );
+            return vk::PushConstantRange { stages, 0, sizeof( T ) };
+        }
+
+    private:
+        vk::Device device;
+        MemoryAllocator& allocator;
+        vk::UniqueBuffer buffer;
+        MemoryAllocator::UniqueAllocation allocation;
+        vk::UniqueDescriptorSetLayout set_layout;
+        vk::UniqueDescriptorPool pool;
+        vk::DescriptorSet set;
+        vk::DeviceSize alignment;
+        vk::DeviceSize region_size;
+        vk::DeviceSize binding_range;
+        vk::DeviceSize region_start;
+        std::atomic<vk::DeviceSize> head;
+
+    public:
+        /// <summary>
+        /// Creates the buffer, maps it and writes its descriptor.
+        /// </summary>
+        /// <param name="frame_count">The number of frames in flight; the buffer has a region for each.</param>
+        /// <param name="region_size">The bytes of constants each frame can allocate.</param>
+        /// <param name="binding_range">The largest constants block a shader reads through the descriptor.</param>
+        UniformRing( vk::PhysicalDevice physical_device, vk::Device device, MemoryAllocator& allocator, uint32_t frame_count, vk::DeviceSize region_size = 1 << 20, vk::DeviceSize binding_range = 1 << 14 )
+            : device( device )
+            , allocator( allocator )
+            , region_start( 0 )
+            , head( 0 ) {
+            const vk::PhysicalDeviceLimits limits { physical_device.getProperties().limits };
+            alignment = std::max<vk::DeviceSize>( limits.minUniformBufferOffsetAlignment, 1 );
+            this->binding_range = std::min<vk::DeviceSize>( binding_range, limits.maxUniformBufferRange );
+            this->region_size = align_up( region_size, alignment );
+
+            // The descriptor's range is read from every dynamic offset, so the last region is
+            // followed by a binding range of padding for allocations near its end.
+            vk::BufferCreateInfo ci {
+                {},
+                this->region_size * frame_count + this->binding_range,
+                vk::BufferUsageFlagBits::eUniformBuffer,
+                vk::SharingMode::eExclusive,
+                0,
+                nullptr
+            };
+            buffer = device.createBufferUnique( ci );
+            allocation = allocator.allocate_unique( buffer.get(), vk::MemoryPropertyFlagBits::eHostVisible );
+
+            vk::DescriptorSetLayoutBinding binding { 0, vk::DescriptorType::eUniformBufferDynamic, 1, vk::ShaderStageFlagBits::eAll, nullptr };
+            set_layout = device.createDescriptorSetLayoutUnique( vk::DescriptorSetLayoutCreateInfo { {}, 1, &binding } );
+
+            vk::DescriptorPoolSize pool_size { vk::DescriptorType::eUniformBufferDynamic, 1 };
+            pool = device.createDescriptorPoolUnique( vk::DescriptorPoolCreateInfo { {}, 1, 1, &pool_size } );
+            set = device.allocateDescriptorSets( vk::DescriptorSetAllocateInfo { pool.get(), 1, &set_layout.get() } ).front();
+
+            vk::DescriptorBufferInfo bi { buffer.get(), 0, this->binding_range };
+            device.updateDescriptorSets( vk::WriteDescriptorSet { set, 0, 0, 1, vk::DescriptorType::eUniformBufferDynamic, nullptr, &bi, nullptr }, nullptr );
+        }
+
+        UniformRing( const UniformRing& ) = delete;
+        UniformRing& operator=( const UniformRing& ) = delete;
+
+        /// <summary>
+        /// The layout of the set with the ring's dynamic uniform buffer at binding 0.
+        /// </summary>
+        vk::DescriptorSetLayout get_set_layout() const noexcept {
+            return set_layout.get();
+        }
+
+        vk::DescriptorSet get_set() const noexcept {
+            return set;
+        }
+
+        /// <summary>
+        /// Starts allocating from the frame's region. The frame's fence must have been waited on.
+        /// </summary>
+        void begin_frame( uint32_t frame_index ) noexcept {
+            region_start = region_size * frame_index;
+            head.store( 0, std::memory_order_relaxed );
+        }
+
+        /// <summary>
+        /// Copies data into the current frame's region. Threads may push at once, but not across begin_frame().
+        /// </summary>
+        /// <returns>The dynamic offset to bind the ring's set with.</returns>
+        uint32_t push( const void* data, vk::DeviceSize size ) {
+            if( size > binding_range )
+                throw std::length_error( "The constants are larger than the ring's binding range." );
+            // Each caller claims its own aligned range before copying, so concurrent pushes never overlap.
+            const vk::DeviceSize start { head.fetch_add( align_up( size, alignment ), std::memory_order_relaxed ) };
+            if( start + size > region_size )
+                throw std::length_error( "The uniform ring's frame region is full." );
+
+            const vk::DeviceSize offset { region_start + start };
+            allocator.write( allocation.get(), data, size, offset );
+
+            return static_cast<uint32_t>( offset );
+        }
+
+        template <typename T>
+        uint32_t push( const T& data ) {
+            static_assert( std::is_trivially_copyable_v<T>, "Constants are copied byte for byte." );
+            return push( &data, sizeof( T ) );
+        }
+
+        /// <summary>
+        /// Makes constants available to the next draws or dispatches: pushes them if they're small
+        /// enough, otherwise copies them into the ring and binds its set with their offset.
+        /// </summary>
+        /// <param name="set_index">The index of the ring's set in the pipeline layout. Unused for pushed constants.</param>
+        template <typename T>
+        void bind_constants( vk::CommandBuffer command_buffer, vk::PipelineBindPoint bind_point, vk::PipelineLayout layout, vk::ShaderStageFlags stages, uint32_t set_index, const T& data ) {
+            if constexpr( uses_push_constants<T>() ) {
+                command_buffer.pushConstants( layout, stages, 0, sizeof( T ), &data );
+            }
+            else {
+                const uint32_t offset { push( data ) };
+                command_buffer.bindDescriptorSets( bind_point, layout, set_index, set, offset );
+            }
+        }
+
+        /// <summary>
+        /// The bytes allocated from the current frame's region so far.
+        /// </summary>
+        vk::DeviceSize get_frame_usage() const noexcept {
+            return std::min( head.load( std::memory_order_relaxed ), region_size );
+        }
+
+    private:
+        static constexpr vk::DeviceSize align_up( vk::DeviceSize value, vk::DeviceSize alignment ) noexcept {
+            return ( value + alignment - 1 ) / alignment * alignment;
+        }
+    };
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+#include "MemoryAllocator.hpp"
+#include "GpuProfiler.hpp"
+
+namespace stlr {
+    /// <summary>
+    /// Value of the upload timeline semaphore that is reached once an upload
+    /// has finished on the transfer queue.
+    /// </summary>
+    using UploadToken = uint64_t;
+
+    /// <summary>
+    /// Streams buffer and image data to the GPU through a ring of host-visible
+    /// staging memory. Copies are batched into one transfer queue submission
+    /// per submit() and completion is tracked with a timeline semaphore, so
+    /// neither the CPU nor the graphics queue waits unless a token is needed.
+    ///
+    /// When the transfer and graphics families differ, each upload releases
+    /// ownership on the transfer queue; the matching acquire barriers are
+    /// recorded into a graphics command buffer by record_acquire_barriers().
+    /// </summary>
+    class UploadManager {
+    public:
+        static constexpr vk::DeviceSize default_staging_size = 32ull * 1024 * 1024;
+
+    private:
+        struct Acquire {
+            UploadToken token = 0;
+            std::vector<vk::BufferMemoryBarrier> buffer_barriers;
+            std::vector<vk::ImageMemoryBarrier> image_barriers;
+            vk::PipelineStageFlags stages;
+        };
+
+        struct Batch {
+            vk::UniqueCommandBuffer command_buffer;
+            UploadToken token = 0;
+            vk::DeviceSize ring_bytes = 0;
+            /// Staging buffers for uploads larger than the ring.
+            std::vector<std::pair<vk::UniqueBuffer, MemoryAllocator::UniqueAllocation>> oversized_staging;
+            Acquire acquire;
+            uint32_t profile_scope = GpuProfiler::invalid_scope;
+        };
+
+        vk::Device device;
+        MemoryAllocator& allocator;
+        vk::Queue transfer_queue;
+        uint32_t transfer_family;
+        uint32_t graphics_family;
+        vk::CommandPool command_pool;
+        vk::DeviceSize copy_alignment;
+        GpuProfiler* profiler;
+
+        vk::UniqueBuffer staging_buffer;
+        MemoryAllocator::UniqueAllocation staging_allocation;
+        vk::DeviceSize ring_capacity;
+        vk::DeviceSize ring_head;
+        vk::DeviceSize ring_used;
+
+        vk::UniqueSemaphore timeline;
+        UploadToken next_token;
+        Batch open_batch;
+        bool open_batch_recording;
+        std::deque<Batch> in_flight;
+        /// Acquires of submitted batches that haven't been recorded on the graphics queue yet.
+        std::deque<Acquire> pending_acquires;
+        std::vector<vk::UniqueCommandBuffer> free_command_buffers;
+        std::mutex mutex;
+
+    public:
+        UploadManager( vk::PhysicalDevice physical_device, vk::Device device, MemoryAllocator& allocator, vk::Queue transfer_queue, uint32_t transfer_family, uint32_t graphics_family, vk::CommandPool transfer_command_pool, vk::DeviceSize staging_size = default_staging_size, GpuProfiler* profiler = nullptr );
+        ~UploadManager();
+
+        UploadManager( const UploadManager& ) = delete;
+        UploadManager& operator=( const UploadManager& ) = delete;
+
+        /// <summary>
+        /// Queues a copy of data into a buffer.
+        /// </summary>
+        /// <param name="dst">The buffer to copy to. It needs eTransferDst usage.</param>
+        /// <param name="dst_offset">The offset into the buffer to copy to.</param>
+        /// <param name="data">The data to copy.</param>
+        /// <param name="size">The number of bytes to copy.</param>
+        /// <param name="dst_access">How the graphics queue will access the buffer.</param>
+        /// <param name="dst_stages">The stages the graphics queue will access the buffer in. Empty means every stage.</param>
+        /// <returns>The token that's reached once the copy finishes. It's only valid after submit().</returns>
+        UploadToken upload_buffer( vk::Buffer dst, vk::DeviceSize dst_offset, const void* data, vk::DeviceSize size, vk::AccessFlags dst_access, vk::PipelineStageFlags dst_stages );
+
+        /// <summary>
+        /// Queues a copy of data into an image, transitioning it from undefined to final_layout.
+        /// The regions' buffer offsets are relative to data.
+        /// </summary>
+        UploadToken upload_image( vk::Image dst, const void* data, vk::DeviceSize size, vk::ArrayProxy<const vk::BufferImageCopy> regions, const vk::ImageSubresourceRange& range, vk::ImageLayout final_layout, vk::AccessFlags dst_access, vk::PipelineStageFlags dst_stages );
+
+        /// <summary>
+        /// Queues a copy of tightly packed texels into the first mip level and layer of an image.
+        /// </summary>
+        UploadToken upload_image( vk::Image dst, const void* data, vk::DeviceSize size, vk::Extent3D extent, vk::ImageAspectFlags aspect, vk::ImageLayout final_layout = vk::ImageLayout::eShaderReadOnlyOptimal );
+
+        /// <summary>
+        /// Submits every queued copy to the transfer queue without waiting for it.
+        /// </summary>
+        /// <returns>The token of the submitted batch, or the last token if nothing was queued.</returns>
+        UploadToken submit();
+
+        /// <summary>
+        /// Records the queue family acquire barriers of every submitted upload up to and including
+        /// a token. The command buffer's submission must wait on get_semaphore() at the returned
+        /// value and stages.
+        /// </summary>
+        /// <returns>The value to wait for and the stages to wait in, or 0 if nothing was acquired.</returns>
+        std::pair<UploadToken, vk::PipelineStageFlags> record_acquire_barriers( vk::CommandBuffer command_buffer, UploadToken up_to );
+
+        bool is_complete( UploadToken token );
+        void wait( UploadToken token );
+        UploadToken get_completed_token();
+
+        vk::Semaphore get_semaphore() const noexcept {
+            return timeline.get();
+        }
+
+    private:
+        vk::UniqueSemaphore create_timeline_semaphore();
+        vk::CommandBuffer begin_batch();
+        UploadToken submit_locked();
+        void retire_completed( bool wait_for_oldest );
+        vk::DeviceSize stage( const void* data, vk::DeviceSize size, vk::Buffer& staging );
+
+        bool transfers_ownership() const noexcept {
+            return transfer_family != graphics_family;
+        }
+    };
+}
@@ -1,9 +1,21 @@
 #pragma once
 
 #include <vulkan/vulkan.hpp>
+#include <algorithm>
 #include <map>
 
 namespace stlr {
+    ///
+    /// \brief The number of levels of a full mip chain down to 1x1, floor(log2(max(width, height))) + 1.
+    ///
+    constexpr uint32_t get_full_mip_level_count( uint32_t width, uint32_t height ) noexcept {
+        uint32_t levels { 1 };
+        for( uint32_t s = std::max( width, height ); s > 1; s >>= 1 ) {
+            ++levels;
+        }
+        return levels;
+    }
+
 	namespace format_utils {
 		struct FormatInfo {
             uint32_t size;
@@ -248,21 +260,42 @@ namespace stlr {
             { VK_FORMAT_G16_B16_R16_3PLANE_444_UNORM,                { 6, 3 } }
         };
 
-<<<<<<< HEAD
-        static const inline uint32_t get_format_size( vk::Format format ) {
-            return format_table.at( static_cast<VkFormat>( format ) ).size;
-        }
-
-		static const inline uint32_t get_format_component_count( vk::Format format ) {
-=======
-        static const uint32_t get_format_size( vk::Format format ) {
+        inline uint32_t get_format_size( vk::Format format ) {
             return format_table.at( static_cast<VkFormat>( format ) ).size;
         }
 
-        static const uint32_t get_format_component_count( vk::Format format ) {
->>>>>>> 40ac455a26e24b123555ab53b6a781bda433c843
+        inline uint32_t get_format_component_count( vk::Format format ) {
             return format_table.at( static_cast<VkFormat>( format ) ).component_count;
 			
 		}
+
+        ///
+        /// \brief The texels covered by one block of the format, whose size is get_format_size(); 1x1 for uncompressed formats.
+        ///
+        inline vk::Extent2D get_block_extent( vk::Format format ) {
+            const VkFormat f { static_cast<VkFormat>( format ) };
+            // BC, ETC2 and EAC all use 4x4 blocks.
+            if( f >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && f <= VK_FORMAT_EAC_R11G11_SNORM_BLOCK )
+                return { 4, 4 };
+            if( f >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && f <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK ) {
+                // ASTC formats come in UNORM/SRGB pairs, from the smallest block to the largest.
+                static const vk::Extent2D astc_blocks[] {
+                    { 4, 4 }, { 5, 4 }, { 5, 5 }, { 6, 5 }, { 6, 6 }, { 8, 5 }, { 8, 6 },
+                    { 8, 8 }, { 10, 5 }, { 10, 6 }, { 10, 8 }, { 10, 10 }, { 12, 10 }, { 12, 12 }
+                };
+                return astc_blocks[( f - VK_FORMAT_ASTC_4x4_UNORM_BLOCK ) / 2];
+            }
+            if( f >= VK_FORMAT_PVRTC1_2BPP_UNORM_BLOCK_IMG && f <= VK_FORMAT_PVRTC2_4BPP_SRGB_BLOCK_IMG ) {
+                // The 2 bits per pixel formats have 8x4 blocks, the 4 bits per pixel ones 4x4.
+                const bool two_bpp { f == VK_FORMAT_PVRTC1_2BPP_UNORM_BLOCK_IMG || f == VK_FORMAT_PVRTC2_2BPP_UNORM_BLOCK_IMG || f == VK_FORMAT_PVRTC1_2BPP_SRGB_BLOCK_IMG || f == VK_FORMAT_PVRTC2_2BPP_SRGB_BLOCK_IMG };
+                return two_bpp ? vk::Extent2D { 8, 4 } : vk::Extent2D { 4, 4 };
+            }
+            return { 1, 1 };
+        }
+
+        inline bool is_block_compressed( vk::Format format ) {
+            const vk::Extent2D block { get_block_extent( format ) };
+            return block.width > 1 || block.height > 1;
+        }
 	}
 }
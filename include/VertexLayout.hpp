@@ -0,0 +1,302 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vulkan/vulkan.hpp>
+
+namespace stlr {
+    /// <summary>
+    /// CPU encoders for the packed vertex attribute types, and decoders to check them against.
+    /// </summary>
+    namespace vertex_packing {
+        /// <summary>
+        /// Converts to an IEEE half, rounding to nearest even. Values beyond the half range become infinity.
+        /// </summary>
+        inline uint16_t float_to_half( float f ) noexcept {
+            uint32_t x;
+            std::memcpy( &x, &f, sizeof( x ) );
+            const uint32_t sign { ( x >> 16 ) & 0x8000 };
+            x &= 0x7fffffff;
+
+            // At or above 65536 after rounding: infinity, or a quiet NaN for NaNs.
+            if( x >= 0x47800000 )
+                return static_cast<uint16_t>( sign | ( x > 0x7f800000 ? 0x7e00 : 0x7c00 ) );
+
+            // Below the smallest normal half: adding 0.5 leaves the float with the halves' denormal spacing,
+            // so the FPU does the rounding and the result's low bits are the half's mantissa.
+            if( x < 0x38800000 ) {
+                float a;
+                std::memcpy( &a, &x, sizeof( a ) );
+                a += 0.5f;
+                std::memcpy( &x, &a, sizeof( x ) );
+                return static_cast<uint16_t>( sign | ( x - 0x3f000000 ) );
+            }
+
+            // Rebias the exponent and round the 13 dropped mantissa bits to even; a carry may reach infinity.
+            const uint32_t odd { ( x >> 13 ) & 1 };
+            x += ( static_cast<uint32_t>( 15 - 127 ) << 23 ) + 0xfff + odd;
+            return static_cast<uint16_t>( sign | ( x >> 13 ) );
+        }
+
+        inline float half_to_float( uint16_t h ) noexcept {
+            const uint32_t sign { static_cast<uint32_t>( h & 0x8000 ) << 16 };
+            uint32_t exponent { ( h >> 10 ) & 0x1fu };
+            uint32_t mantissa { h & 0x3ffu };
+            uint32_t x;
+            if( exponent == 0x1f ) {
+                x = sign | 0x7f800000 | ( mantissa << 13 );
+            }
+            else if( exponent != 0 ) {
+                x = sign | ( ( exponent + 127 - 15 ) << 23 ) | ( mantissa << 13 );
+            }
+            else if( mantissa == 0 ) {
+                x = sign;
+            }
+            else {
+                // A denormal half is a normal float: shift the mantissa up to its leading one.
+                exponent = 127 - 14;
+                while( ( mantissa & 0x400 ) == 0 ) {
+                    mantissa <<= 1;
+                    --exponent;
+                }
+                x = sign | ( exponent << 23 ) | ( ( mantissa & 0x3ff ) << 13 );
+            }
+            float f;
+            std::memcpy( &f, &x, sizeof( f ) );
+            return f;
+        }
+
+        inline int8_t encode_snorm8( float f ) noexcept {
+            return static_cast<int8_t>( std::lround( std::clamp( f, -1.0f, 1.0f ) * 127.0f ) );
+        }
+
+        inline int16_t encode_snorm16( float f ) noexcept {
+            return static_cast<int16_t>( std::lround( std::clamp( f, -1.0f, 1.0f ) * 32767.0f ) );
+        }
+
+        inline uint8_t encode_unorm8( float f ) noexcept {
+            return static_cast<uint8_t>( std::lround( std::clamp( f, 0.0f, 1.0f ) * 255.0f ) );
+        }
+
+        /// <summary>
+        /// Maps a unit vector onto the octahedron |x| + |y| + |z| = 1 and unfolds it into the square [-1, 1]^2,
+        /// the lower half folded over the diagonals.
+        /// </summary>
+        inline std::array<float, 2> encode_octahedral( const std::array<float, 3>& n ) noexcept {
+            const float length { std::abs( n[0] ) + std::abs( n[1] ) + std::abs( n[2] ) };
+            if( length == 0.0f )
+                return { 0.0f, 0.0f };
+
+            const float x { n[0] / length };
+            const float y { n[1] / length };
+            if( n[2] >= 0.0f )
+                return { x, y };
+            return { std::copysign( 1.0f - std::abs( y ), x ), std::copysign( 1.0f - std::abs( x ), y ) };
+        }
+
+        inline std::array<float, 3> decode_octahedral( const std::array<float, 2>& e ) noexcept {
+            std::array<float, 3> n { e[0], e[1], 1.0f - std::abs( e[0] ) - std::abs( e[1] ) };
+            const float t { std::max( -n[2], 0.0f ) };
+            n[0] += n[0] >= 0.0f ? -t : t;
+            n[1] += n[1] >= 0.0f ? -t : t;
+            const float length { std::sqrt( n[0] * n[0] + n[1] * n[1] + n[2] * n[2] ) };
+            return { n[0] / length, n[1] / length, n[2] / length };
+        }
+    }
+
+    /// <summary>
+    /// Two half floats, for UVs. 4 bytes instead of 8, exact to 1/2048 up to 1.
+    /// </summary>
+    struct Half2 {
+        static constexpr vk::Format format = vk::Format::eR16G16Sfloat;
+        std::array<uint16_t, 2> v;
+
+        Half2() = default;
+        Half2( float x, float y ) noexcept : v { vertex_packing::float_to_half( x ), vertex_packing::float_to_half( y ) } {}
+    };
+
+    /// <summary>
+    /// Four half floats, for positions with w = 1; three component 16-bit formats are rarely supported for
+    /// vertex input. 8 bytes instead of 12, with 11 bits of precision relative to the coordinate's magnitude,
+    /// so meshes should be modelled around their origin.
+    /// </summary>
+    struct Half4 {
+        static constexpr vk::Format format = vk::Format::eR16G16B16A16Sfloat;
+        std::array<uint16_t, 4> v;
+
+        Half4() = default;
+        Half4( float x, float y, float z, float w = 1.0f ) noexcept
+            : v { vertex_packing::float_to_half( x ), vertex_packing::float_to_half( y ), vertex_packing::float_to_half( z ), vertex_packing::float_to_half( w ) } {}
+        explicit Half4( const std::array<float, 3>& p ) noexcept : Half4( p[0], p[1], p[2] ) {}
+    };
+
+    /// <summary>
+    /// Four signed normalized bytes, for normals and tangents with the handedness in w. Read as floats in [-1, 1].
+    /// </summary>
+    struct Snorm8x4 {
+        static constexpr vk::Format format = vk::Format::eR8G8B8A8Snorm;
+        std::array<int8_t, 4> v;
+
+        Snorm8x4() = default;
+        Snorm8x4( float x, float y, float z, float w = 0.0f ) noexcept
+            : v { vertex_packing::encode_snorm8( x ), vertex_packing::encode_snorm8( y ), vertex_packing::encode_snorm8( z ), vertex_packing::encode_snorm8( w ) } {}
+        explicit Snorm8x4( const std::array<float, 3>& n ) noexcept : Snorm8x4( n[0], n[1], n[2] ) {}
+    };
+
+    /// <summary>
+    /// A unit normal octahedrally encoded in two signed normalized shorts: as precise as three and evenly spread
+    /// over the sphere. The vertex shader reads a vec2 e and decodes it with
+    ///
+    ///     vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    ///     float t = max(-n.z, 0.0);
+    ///     n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+    ///     n = normalize(n);
+    /// </summary>
+    struct OctahedralNormal {
+        static constexpr vk::Format format = vk::Format::eR16G16Snorm;
+        std::array<int16_t, 2> v;
+
+        OctahedralNormal() = default;
+        explicit OctahedralNormal( const std::array<float, 3>& n ) noexcept {
+            const auto e = vertex_packing::encode_octahedral( n );
+            v = { vertex_packing::encode_snorm16( e[0] ), vertex_packing::encode_snorm16( e[1] ) };
+        }
+    };
+
+    /// <summary>
+    /// Four unsigned normalized bytes, for colors. Read as floats in [0, 1].
+    /// </summary>
+    struct Unorm8x4 {
+        static constexpr vk::Format format = vk::Format::eR8G8B8A8Unorm;
+        std::array<uint8_t, 4> v;
+
+        Unorm8x4() = default;
+        Unorm8x4( float r, float g, float b, float a = 1.0f ) noexcept
+            : v { vertex_packing::encode_unorm8( r ), vertex_packing::encode_unorm8( g ), vertex_packing::encode_unorm8( b ), vertex_packing::encode_unorm8( a ) } {}
+    };
+
+    /// <summary>
+    /// The vk::Format a vertex member type is read with. Types with a static format member use it, and
+    /// floats and std::arrays of 2 to 4 floats are 32-bit float formats. Specialize it for other types.
+    /// </summary>
+    template <typename T, typename = void>
+    struct vertex_format;
+
+    template <typename T>
+    struct vertex_format<T, std::void_t<decltype( T::format )>> {
+        static constexpr vk::Format value = T::format;
+    };
+
+    template <>
+    struct vertex_format<float> {
+        static constexpr vk::Format value = vk::Format::eR32Sfloat;
+    };
+
+    template <>
+    struct vertex_format<std::array<float, 2>> {
+        static constexpr vk::Format value = vk::Format::eR32G32Sfloat;
+    };
+
+    template <>
+    struct vertex_format<std::array<float, 3>> {
+        static constexpr vk::Format value = vk::Format::eR32G32B32Sfloat;
+    };
+
+    template <>
+    struct vertex_format<std::array<float, 4>> {
+        static constexpr vk::Format value = vk::Format::eR32G32B32A32Sfloat;
+    };
+
+    namespace detail {
+        template <typename M>
+        struct member_pointer;
+
+        template <typename V, typename T>
+        struct member_pointer<T V::*> {
+            using vertex = V;
+            using type = T;
+        };
+    }
+
+    /// <summary>
+    /// The vertex input description of a vertex struct, derived at compile time from its members:
+    ///
+    ///     struct Vertex { stlr::Half4 position; stlr::Half2 uv; stlr::OctahedralNormal normal; };
+    ///     using Layout = stlr::VertexLayout<Vertex, &Vertex::position, &Vertex::uv, &Vertex::normal>;
+    ///
+    /// Members are listed in declaration order and get consecutive shader locations. The stride, each
+    /// attribute's vk::Format and its offset follow from the member types, so changing the struct can't
+    /// leave the pipeline reading the old layout. Leaving a member out or listing them out of order fails
+    /// to compile where it changes the struct's size, and asserts in debug builds otherwise.
+    /// </summary>
+    template <typename V, auto... Members>
+    class VertexLayout {
+        static_assert( sizeof...( Members ) > 0, "A vertex needs at least one attribute." );
+        static_assert( std::is_standard_layout_v<V> && std::is_trivially_copyable_v<V>, "A vertex must be a plain struct to be copied into a vertex buffer." );
+        static_assert( ( std::is_same_v<typename detail::member_pointer<decltype( Members )>::vertex, V> && ... ), "Every member must belong to the vertex." );
+
+        static constexpr size_t count = sizeof...( Members );
+
+        // A standard layout struct puts each member at the next offset aligned for it and pads its end to its alignment.
+        static constexpr std::array<uint32_t, count> compute_offsets() noexcept {
+            constexpr std::array<size_t, count> sizes { sizeof( typename detail::member_pointer<decltype( Members )>::type )... };
+            constexpr std::array<size_t, count> alignments { alignof( typename detail::member_pointer<decltype( Members )>::type )... };
+            std::array<uint32_t, count> offsets {};
+            size_t end { 0 };
+            for( size_t i = 0; i < count; ++i ) {
+                end = ( end + alignments[i] - 1 ) / alignments[i] * alignments[i];
+                offsets[i] = static_cast<uint32_t>( end );
+                end += sizes[i];
+            }
+            return offsets;
+        }
+
+        static constexpr size_t compute_size() noexcept {
+            constexpr std::array<size_t, count> sizes { sizeof( typename detail::member_pointer<decltype( Members )>::type )... };
+            const size_t end { compute_offsets()[count - 1] + sizes[count - 1] };
+            return ( end + alignof( V ) - 1 ) / alignof( V ) * alignof( V );
+        }
+
+    public:
+        using vertex = V;
+
+        static constexpr uint32_t stride = sizeof( V );
+        static constexpr std::array<vk::Format, count> formats { vertex_format<typename detail::member_pointer<decltype( Members )>::type>::value... };
+        static constexpr std::array<uint32_t, count> offsets = compute_offsets();
+
+        static_assert( compute_size() == sizeof( V ), "The members must be listed in declaration order and none left out." );
+
+        static constexpr uint32_t get_attribute_count() noexcept {
+            return static_cast<uint32_t>( count );
+        }
+
+        static constexpr vk::VertexInputBindingDescription get_binding( uint32_t binding, vk::VertexInputRate rate = vk::VertexInputRate::eVertex ) noexcept {
+            return vk::VertexInputBindingDescription { binding, stride, rate };
+        }
+
+        /// <summary>
+        /// The attributes, read from binding at locations first_location onwards.
+        /// </summary>
+        static std::array<vk::VertexInputAttributeDescription, count> get_attributes( uint32_t binding, uint32_t first_location = 0 ) {
+#ifndef NDEBUG
+            // Same sized members swapped in the list leave the size alone, so check against where they really are.
+            const V v {};
+            const std::array<size_t, count> actual { static_cast<size_t>( reinterpret_cast<const char*>( &( v.*Members ) ) - reinterpret_cast<const char*>( &v ) )... };
+            for( size_t i = 0; i < count; ++i ) {
+                assert( actual[i] == offsets[i] && "The members must be listed in declaration order." );
+            }
+#endif
+            std::array<vk::VertexInputAttributeDescription, count> attributes;
+            for( uint32_t i = 0; i < count; ++i ) {
+                attributes[i] = vk::VertexInputAttributeDescription { first_location + i, binding, formats[i], offsets[i] };
+            }
+            return attributes;
+        }
+    };
+}
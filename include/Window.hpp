@@ -9,6 +9,7 @@
 
 #include <GLFW/glfw3.h>
 #include <GLFW/glfw3native.h>
+#include <utility>
 
 #ifdef GLFW_EXPOSE_NATIVE_X11
 /// Aliasing the X11 platform's native window class
@@ -51,7 +52,12 @@ namespace stlr {
             return title;
         }
 
-        const bool is_set_to_close() const;
+        bool is_set_to_close() const;
+
+        /// <summary>
+        /// The window's current size in pixels, which follows resizes; 0 while it's minimized.
+        /// </summary>
+        std::pair<int, int> get_framebuffer_size() const;
 
         void close();
 
@@ -5,8 +5,9 @@ layout (std140, binding = 0) uniform bufferVals {
     mat4 mvp;
 } myBufferVals;
 layout (location = 0) in vec4 pos;
+layout (location = 1) in vec4 offset;
 layout (location = 0) out vec4 outColor;
 void main() {
-    gl_Position = myBufferVals.mvp * pos;
+    gl_Position = myBufferVals.mvp * (pos + vec4(offset.xyz, 0));
     outColor = vec4(255, 0, 0, 255);
 }
\ No newline at end of file
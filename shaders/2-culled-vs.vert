@@ -0,0 +1,27 @@
+#version 450
+// Draws the cubes GpuCulling left visible: firstInstance is the object's index, so each instance
+// reads its world matrix from the culling's objects buffer.
+struct Object {
+    mat4 world;
+    vec4 sphere;
+    uint firstIndex;
+    uint indexCount;
+    int vertexOffset;
+    uint reserved;
+};
+
+layout (std430, set = 0, binding = 0) readonly buffer Objects {
+    Object objects[];
+};
+
+layout (push_constant) uniform Constants {
+    mat4 viewProjection;
+} constants;
+
+layout (location = 0) in vec4 pos;
+layout (location = 0) out vec4 outColor;
+
+void main() {
+    gl_Position = constants.viewProjection * objects[gl_InstanceIndex].world * pos;
+    outColor = vec4(pos.x, pos.y, pos.z, 255);
+}
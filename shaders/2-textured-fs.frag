@@ -0,0 +1,29 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+// Samples a texture from the bindless set spread over the grid of cubes, a cell per cube on each of
+// its faces, tinted by the cube's color, which a bindless storage buffer holds packed as RGBA8.
+layout (set = 0, binding = 0) uniform sampler2D textures[];
+layout (set = 0, binding = 1) readonly buffer Buffers {
+    uint data[];
+} buffers[];
+
+// The vertex shader's matrix comes first.
+layout (push_constant) uniform Constants {
+    layout (offset = 64) uint textureIndex;
+    uint tintsIndex;
+    uint cubeIndex;
+    uint gridSize;
+} constants;
+
+// 2-vs.vert passes the position on the cube on as its color.
+layout (location = 0) in vec4 pos;
+layout (location = 0) out vec4 outColor;
+
+void main() {
+    // Each face is mapped along the axis it faces.
+    vec3 a = abs(pos.xyz);
+    vec2 uv = a.x >= a.y && a.x >= a.z ? pos.yz : (a.y >= a.z ? pos.xz : pos.xy);
+    vec2 cell = vec2(constants.cubeIndex % constants.gridSize, constants.cubeIndex / constants.gridSize);
+    vec4 tint = unpackUnorm4x8(buffers[constants.tintsIndex].data[constants.cubeIndex]);
+    outColor = texture(textures[constants.textureIndex], (cell + uv * 0.5 + 0.5) / constants.gridSize) * tint;
+}
\ No newline at end of file
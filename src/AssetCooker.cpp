@@ -0,0 +1,458 @@
+// Cooks source images, textures and meshes into an asset pack that loads without decoding.
+//
+//     AssetCooker -o <pack> [--threads <count>] [--linear | --srgb] [--float | --packed] <inputs>...
+//
+// Images stb_image reads (.png, .jpg, .tga, ...) become RGBA8 with a box-filtered mip chain,
+// sRGB unless --linear comes before them. KTX2 and DDS textures keep their format and levels,
+// and OBJ and glTF 2.0 (.gltf, .glb) meshes become indexed position, UV and normal vertices,
+// deduplicated and reordered for the vertex cache and vertex fetch, with 16-bit indices when
+// there are fewer than 65536 vertices. Meshes after --packed get half float positions and UVs and
+// octahedral normals instead, 16 bytes a vertex instead of 32. Each asset is named after its
+// file's stem, and each mesh of a glTF with several after the stem and the mesh's name. Inputs
+// are cooked in parallel and then written out in the order given.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include "AssetPack.hpp"
+#include "MeshImporter.hpp"
+#include "TextureFile.hpp"
+#include "VertexLayout.hpp"
+
+namespace {
+    using namespace stlr;
+
+    struct Input {
+        std::filesystem::path file;
+        bool srgb;
+        bool packed;
+    };
+
+    struct CookedTexture {
+        asset_pack::TextureEntry entry {};
+        /// Offsets relative to data.
+        std::vector<asset_pack::Region> regions;
+        std::vector<char> data;
+    };
+
+    struct CookedMesh {
+        asset_pack::MeshEntry entry {};
+        std::vector<asset_pack::Attribute> attributes;
+        std::vector<char> vertices;
+        std::vector<char> indices;
+    };
+
+    /// One input's asset, or why it couldn't be cooked.
+    struct Cooked {
+        std::vector<CookedTexture> textures;
+        std::vector<CookedMesh> meshes;
+        std::string error;
+    };
+
+    template <size_t N>
+    void set_name( char ( &dst )[N], const std::string& name ) {
+        if( name.size() >= N )
+            throw std::runtime_error( "The name " + name + " is longer than " + std::to_string( N - 1 ) + " bytes." );
+        std::memset( dst, 0, N );
+        std::memcpy( dst, name.data(), name.size() );
+    }
+
+    float srgb_to_linear( uint8_t c ) noexcept {
+        const float f { c / 255.0f };
+        return f <= 0.04045f ? f / 12.92f : std::pow( ( f + 0.055f ) / 1.055f, 2.4f );
+    }
+
+    uint8_t linear_to_srgb( float f ) noexcept {
+        const float c { f <= 0.0031308f ? f * 12.92f : 1.055f * std::pow( f, 1.0f / 2.4f ) - 0.055f };
+        return static_cast<uint8_t>( std::clamp( c * 255.0f + 0.5f, 0.0f, 255.0f ) );
+    }
+
+    /// <summary>
+    /// Averages 2x2 texels of an RGBA8 level into the next one. Odd edges reuse their last texel.
+    /// sRGB colors are averaged as linear light, so mips don't darken; alpha always is linear.
+    /// </summary>
+    void downsample( const uint8_t* src, uint32_t src_width, uint32_t src_height, uint8_t* dst, uint32_t dst_width, uint32_t dst_height, bool srgb, const std::array<float, 256>& to_linear ) {
+        for( uint32_t y = 0; y < dst_height; ++y ) {
+            const uint32_t y0 { std::min( y * 2, src_height - 1 ) };
+            const uint32_t y1 { std::min( y * 2 + 1, src_height - 1 ) };
+            for( uint32_t x = 0; x < dst_width; ++x ) {
+                const uint32_t x0 { std::min( x * 2, src_width - 1 ) };
+                const uint32_t x1 { std::min( x * 2 + 1, src_width - 1 ) };
+                const std::array<const uint8_t*, 4> texels {
+                    src + ( static_cast<size_t>( y0 ) * src_width + x0 ) * 4,
+                    src + ( static_cast<size_t>( y0 ) * src_width + x1 ) * 4,
+                    src + ( static_cast<size_t>( y1 ) * src_width + x0 ) * 4,
+                    src + ( static_cast<size_t>( y1 ) * src_width + x1 ) * 4
+                };
+
+                uint8_t* out { dst + ( static_cast<size_t>( y ) * dst_width + x ) * 4 };
+                for( uint32_t c = 0; c < 4; ++c ) {
+                    if( srgb && c < 3 ) {
+                        float sum { 0.0f };
+                        for( const uint8_t* t : texels ) {
+                            sum += to_linear[t[c]];
+                        }
+                        out[c] = linear_to_srgb( sum * 0.25f );
+                    }
+                    else {
+                        uint32_t sum { 2 };
+                        for( const uint8_t* t : texels ) {
+                            sum += t[c];
+                        }
+                        out[c] = static_cast<uint8_t>( sum / 4 );
+                    }
+                }
+            }
+        }
+    }
+
+    CookedTexture cook_image( const Input& input ) {
+        int width { 0 };
+        int height { 0 };
+        stbi_uc* texels { stbi_load( input.file.string().c_str(), &width, &height, nullptr, STBI_rgb_alpha ) };
+        if( texels == nullptr )
+            throw std::runtime_error( stbi_failure_reason() );
+
+        std::array<float, 256> to_linear;
+        for( uint32_t i = 0; i < 256; ++i ) {
+            to_linear[i] = srgb_to_linear( static_cast<uint8_t>( i ) );
+        }
+
+        CookedTexture t;
+        const uint32_t w { static_cast<uint32_t>( width ) };
+        const uint32_t h { static_cast<uint32_t>( height ) };
+        const uint32_t level_count { get_full_mip_level_count( w, h ) };
+
+        // Every level is a multiple of 4 bytes, so each starts at a valid copy offset for RGBA8.
+        uint64_t size { 0 };
+        for( uint32_t l = 0; l < level_count; ++l ) {
+            const uint64_t level_size { uint64_t { std::max( w >> l, 1u ) } * std::max( h >> l, 1u ) * 4 };
+            t.regions.push_back( asset_pack::Region { l, 0, size, level_size } );
+            size += level_size;
+        }
+        t.data.resize( size );
+        std::memcpy( t.data.data(), texels, t.regions[0].size );
+        stbi_image_free( texels );
+
+        for( uint32_t l = 1; l < level_count; ++l ) {
+            downsample(
+                reinterpret_cast<const uint8_t*>( t.data.data() + t.regions[l - 1].offset ), std::max( w >> ( l - 1 ), 1u ), std::max( h >> ( l - 1 ), 1u ),
+                reinterpret_cast<uint8_t*>( t.data.data() + t.regions[l].offset ), std::max( w >> l, 1u ), std::max( h >> l, 1u ),
+                input.srgb, to_linear );
+        }
+
+        t.entry.format = static_cast<uint32_t>( input.srgb ? vk::Format::eR8G8B8A8Srgb : vk::Format::eR8G8B8A8Unorm );
+        t.entry.width = w;
+        t.entry.height = h;
+        t.entry.level_count = level_count;
+        t.entry.layer_count = 1;
+        return t;
+    }
+
+    CookedTexture cook_texture_file( const Input& input ) {
+        const TextureFile f { TextureFile::load( input.file, input.srgb ) };
+
+        // Only the span of the file holding subresources is kept, with the regions rebased onto it.
+        size_t begin { SIZE_MAX };
+        size_t end { 0 };
+        for( const auto& s : f.subresources ) {
+            begin = std::min( begin, s.offset );
+            end = std::max( end, s.offset + s.size );
+        }
+
+        CookedTexture t;
+        t.data.assign( f.data.begin() + begin, f.data.begin() + end );
+        for( const auto& s : f.subresources ) {
+            t.regions.push_back( asset_pack::Region { s.level, s.layer, s.offset - begin, s.size } );
+        }
+
+        t.entry.format = static_cast<uint32_t>( f.format );
+        t.entry.width = f.width;
+        t.entry.height = f.height;
+        t.entry.level_count = f.level_count;
+        t.entry.layer_count = f.layer_count;
+        return t;
+    }
+
+    using MeshLayout = VertexLayout<MeshVertex, &MeshVertex::position, &MeshVertex::uv, &MeshVertex::normal>;
+
+    struct PackedMeshVertex {
+        Half4 position;
+        Half2 uv;
+        OctahedralNormal normal;
+    };
+    using PackedMeshLayout = VertexLayout<PackedMeshVertex, &PackedMeshVertex::position, &PackedMeshVertex::uv, &PackedMeshVertex::normal>;
+
+    template <typename Layout>
+    std::vector<asset_pack::Attribute> get_attributes() {
+        std::vector<asset_pack::Attribute> attributes;
+        for( const auto& a : Layout::get_attributes( 0 ) ) {
+            attributes.push_back( asset_pack::Attribute { a.location, static_cast<uint32_t>( a.format ), a.offset, 0 } );
+        }
+        return attributes;
+    }
+
+    /// <summary>
+    /// Packs an optimized mesh into position, UV and normal vertices, as floats or packed, and 16-bit
+    /// indices when they fit.
+    /// </summary>
+    CookedMesh cook_mesh( const MeshData& mesh, bool packed ) {
+        CookedMesh m;
+        if( packed ) {
+            std::vector<PackedMeshVertex> vertices;
+            vertices.reserve( mesh.vertices.size() );
+            for( const auto& v : mesh.vertices ) {
+                vertices.push_back( PackedMeshVertex { Half4( v.position ), Half2( v.uv[0], v.uv[1] ), OctahedralNormal( v.normal ) } );
+            }
+            m.vertices.resize( vertices.size() * sizeof( PackedMeshVertex ) );
+            std::memcpy( m.vertices.data(), vertices.data(), m.vertices.size() );
+            m.attributes = get_attributes<PackedMeshLayout>();
+            m.entry.vertex_stride = PackedMeshLayout::stride;
+        }
+        else {
+            m.vertices.resize( mesh.vertices.size() * sizeof( MeshVertex ) );
+            std::memcpy( m.vertices.data(), mesh.vertices.data(), m.vertices.size() );
+            m.attributes = get_attributes<MeshLayout>();
+            m.entry.vertex_stride = MeshLayout::stride;
+        }
+        m.indices = mesh.get_index_data();
+
+        m.entry.vertex_count = static_cast<uint32_t>( mesh.vertices.size() );
+        m.entry.index_count = static_cast<uint32_t>( mesh.indices.size() );
+        m.entry.index_type = static_cast<uint32_t>( mesh.uses_16_bit_indices() ? vk::IndexType::eUint16 : vk::IndexType::eUint32 );
+        return m;
+    }
+
+    Cooked cook( const Input& input ) {
+        Cooked c;
+        try {
+            std::string extension { input.file.extension().string() };
+            std::transform( extension.begin(), extension.end(), extension.begin(), []( unsigned char ch ) { return static_cast<char>( std::tolower( ch ) ); } );
+            const std::string name { input.file.stem().string() };
+
+            if( extension == ".obj" || extension == ".gltf" || extension == ".glb" ) {
+                // A file's only mesh takes its name, several are told apart by their own names.
+                const std::vector<MeshData> meshes { mesh_import::load( input.file ) };
+                for( size_t i = 0; i < meshes.size(); ++i ) {
+                    c.meshes.push_back( cook_mesh( meshes[i], input.packed ) );
+                    std::string mesh_name { name };
+                    if( meshes.size() > 1 )
+                        mesh_name += '.' + ( meshes[i].name.empty() ? std::to_string( i ) : meshes[i].name );
+                    set_name( c.meshes.back().entry.name, mesh_name );
+                }
+            }
+            else if( extension == ".ktx2" || extension == ".dds" ) {
+                c.textures.push_back( cook_texture_file( input ) );
+                set_name( c.textures.back().entry.name, name );
+            }
+            else {
+                c.textures.push_back( cook_image( input ) );
+                set_name( c.textures.back().entry.name, name );
+            }
+        }
+        catch( const std::exception& e ) {
+            c.error = input.file.string() + ": " + e.what();
+        }
+        return c;
+    }
+
+    void write_padding( std::ofstream& f, uint64_t& offset, uint64_t to ) {
+        static const std::array<char, asset_pack::blob_alignment> zeros {};
+        f.write( zeros.data(), static_cast<std::streamsize>( to - offset ) );
+        offset = to;
+    }
+
+    template <typename T>
+    void write_table( std::ofstream& f, uint64_t& offset, const std::vector<T>& table ) {
+        f.write( reinterpret_cast<const char*>( table.data() ), static_cast<std::streamsize>( table.size() * sizeof( T ) ) );
+        offset += table.size() * sizeof( T );
+    }
+
+    void write_blob( std::ofstream& f, uint64_t& offset, const std::vector<char>& blob ) {
+        write_padding( f, offset, asset_pack::align( offset ) );
+        f.write( blob.data(), static_cast<std::streamsize>( blob.size() ) );
+        offset += blob.size();
+    }
+
+    /// <summary>
+    /// Lays out the header, the tables and then the blobs, each blob at the next aligned offset.
+    /// </summary>
+    void write_pack( const std::filesystem::path& path, std::vector<CookedTexture>& textures, std::vector<CookedMesh>& meshes ) {
+        std::vector<asset_pack::TextureEntry> texture_table;
+        std::vector<asset_pack::MeshEntry> mesh_table;
+        std::vector<asset_pack::Region> region_table;
+        std::vector<asset_pack::Attribute> attribute_table;
+
+        asset_pack::Header header {};
+        header.magic = asset_pack::magic;
+        header.version = asset_pack::version;
+        header.texture_count = static_cast<uint32_t>( textures.size() );
+        header.mesh_count = static_cast<uint32_t>( meshes.size() );
+        for( const auto& t : textures ) {
+            header.region_count += static_cast<uint32_t>( t.regions.size() );
+        }
+        for( const auto& m : meshes ) {
+            header.attribute_count += static_cast<uint32_t>( m.attributes.size() );
+        }
+
+        // Every table's entries are multiples of 8 bytes, so they stay aligned back to back.
+        header.textures_offset = sizeof( asset_pack::Header );
+        header.meshes_offset = header.textures_offset + header.texture_count * sizeof( asset_pack::TextureEntry );
+        header.regions_offset = header.meshes_offset + header.mesh_count * sizeof( asset_pack::MeshEntry );
+        header.attributes_offset = header.regions_offset + header.region_count * sizeof( asset_pack::Region );
+        uint64_t blob_offset { header.attributes_offset + header.attribute_count * sizeof( asset_pack::Attribute ) };
+
+        for( auto& t : textures ) {
+            blob_offset = asset_pack::align( blob_offset );
+            t.entry.data_offset = blob_offset;
+            t.entry.data_size = t.data.size();
+            t.entry.first_region = static_cast<uint32_t>( region_table.size() );
+            t.entry.region_count = static_cast<uint32_t>( t.regions.size() );
+            region_table.insert( region_table.end(), t.regions.begin(), t.regions.end() );
+            texture_table.push_back( t.entry );
+            blob_offset += t.data.size();
+        }
+        for( auto& m : meshes ) {
+            blob_offset = asset_pack::align( blob_offset );
+            m.entry.vertex_offset = blob_offset;
+            m.entry.vertex_size = m.vertices.size();
+            blob_offset = asset_pack::align( blob_offset + m.vertices.size() );
+            m.entry.index_offset = blob_offset;
+            m.entry.index_size = m.indices.size();
+            blob_offset += m.indices.size();
+            m.entry.first_attribute = static_cast<uint32_t>( attribute_table.size() );
+            m.entry.attribute_count = static_cast<uint32_t>( m.attributes.size() );
+            attribute_table.insert( attribute_table.end(), m.attributes.begin(), m.attributes.end() );
+            mesh_table.push_back( m.entry );
+        }
+
+        std::ofstream f( path, std::ios::binary | std::ios::trunc );
+        if( !f.is_open() )
+            throw std::runtime_error( "Failed to create " + path.string() );
+
+        uint64_t offset { sizeof( header ) };
+        f.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+        write_table( f, offset, texture_table );
+        write_table( f, offset, mesh_table );
+        write_table( f, offset, region_table );
+        write_table( f, offset, attribute_table );
+        for( const auto& t : textures ) {
+            write_blob( f, offset, t.data );
+        }
+        for( const auto& m : meshes ) {
+            write_blob( f, offset, m.vertices );
+            write_blob( f, offset, m.indices );
+        }
+
+        if( !f )
+            throw std::runtime_error( "Failed to write " + path.string() );
+    }
+
+    int usage() {
+        std::cerr << "Usage: AssetCooker -o <pack> [--threads <count>] [--linear | --srgb] [--float | --packed] <inputs>...\n";
+        return 1;
+    }
+}
+
+int main( int argc, char** argv ) {
+    std::filesystem::path output;
+    std::vector<Input> inputs;
+    uint32_t thread_count { 0 };
+    bool srgb { true };
+    bool packed { false };
+
+    for( int i = 1; i < argc; ++i ) {
+        const std::string arg { argv[i] };
+        if( arg == "-o" && i + 1 < argc )
+            output = argv[++i];
+        else if( arg == "--threads" && i + 1 < argc )
+            thread_count = static_cast<uint32_t>( std::stoul( argv[++i] ) );
+        else if( arg == "--linear" )
+            srgb = false;
+        else if( arg == "--srgb" )
+            srgb = true;
+        else if( arg == "--float" )
+            packed = false;
+        else if( arg == "--packed" )
+            packed = true;
+        else if( !arg.empty() && arg[0] == '-' )
+            return usage();
+        else
+            inputs.push_back( Input { arg, srgb, packed } );
+    }
+    if( output.empty() || inputs.empty() )
+        return usage();
+
+    if( thread_count == 0 )
+        thread_count = std::max( std::thread::hardware_concurrency(), 1u );
+    thread_count = std::min( thread_count, static_cast<uint32_t>( inputs.size() ) );
+
+    // Each thread takes the next input until none are left; results keep the inputs' order.
+    std::vector<Cooked> cooked( inputs.size() );
+    std::atomic<size_t> next { 0 };
+    auto work = [&] {
+        for( size_t i = next++; i < inputs.size(); i = next++ ) {
+            cooked[i] = cook( inputs[i] );
+        }
+    };
+    std::vector<std::thread> threads;
+    for( uint32_t i = 1; i < thread_count; ++i ) {
+        threads.emplace_back( work );
+    }
+    work();
+    for( auto& t : threads ) {
+        t.join();
+    }
+
+    std::vector<CookedTexture> textures;
+    std::vector<CookedMesh> meshes;
+    std::unordered_set<std::string> texture_names;
+    std::unordered_set<std::string> mesh_names;
+    bool failed { false };
+    for( auto& c : cooked ) {
+        if( !c.error.empty() ) {
+            std::cerr << c.error << '\n';
+            failed = true;
+            continue;
+        }
+        for( auto& t : c.textures ) {
+            if( !texture_names.insert( t.entry.name ).second ) {
+                std::cerr << "More than one texture is named " << t.entry.name << '\n';
+                failed = true;
+            }
+            textures.push_back( std::move( t ) );
+        }
+        for( auto& m : c.meshes ) {
+            if( !mesh_names.insert( m.entry.name ).second ) {
+                std::cerr << "More than one mesh is named " << m.entry.name << '\n';
+                failed = true;
+            }
+            meshes.push_back( std::move( m ) );
+        }
+    }
+    if( failed )
+        return 1;
+
+    try {
+        write_pack( output, textures, meshes );
+    }
+    catch( const std::exception& e ) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    std::cout << "Cooked " << textures.size() << " textures and " << meshes.size() << " meshes into " << output.string() << '\n';
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include "BindlessDescriptors.hpp"
+#include <algorithm>
+#include <array>
+
+namespace stlr {
+    BindlessDescriptors::BindlessDescriptors( vk::PhysicalDevice physical_device, vk::Device device, uint32_t frame_count, uint32_t max_textures, uint32_t max_buffers )
+        : device( device )
+        , current_frame( 0 ) {
+        auto property_chain = physical_device.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceVulkan12Properties>();
+        const vk::PhysicalDeviceVulkan12Properties& limits = property_chain.get<vk::PhysicalDeviceVulkan12Properties>();
+
+        // Combined image samplers count against both the sampler and the sampled image limits,
+        // and both arrays against the per-stage resource limit.
+        textures.capacity = std::min( { max_textures,
+            limits.maxDescriptorSetUpdateAfterBindSampledImages,
+            limits.maxDescriptorSetUpdateAfterBindSamplers,
+            limits.maxPerStageDescriptorUpdateAfterBindSampledImages,
+            limits.maxPerStageDescriptorUpdateAfterBindSamplers } );
+        buffers.capacity = std::min( { max_buffers,
+            limits.maxDescriptorSetUpdateAfterBindStorageBuffers,
+            limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers } );
+        if( textures.capacity + buffers.capacity > limits.maxPerStageUpdateAfterBindResources ) {
+            textures.capacity = std::min( textures.capacity, limits.maxPerStageUpdateAfterBindResources / 2 );
+            buffers.capacity = std::min( buffers.capacity, limits.maxPerStageUpdateAfterBindResources - textures.capacity );
+        }
+        textures.retired_handles.resize( frame_count );
+        buffers.retired_handles.resize( frame_count );
+
+        std::array<vk::DescriptorSetLayoutBinding, 2> bindings {
+            vk::DescriptorSetLayoutBinding { texture_binding, vk::DescriptorType::eCombinedImageSampler, textures.capacity, vk::ShaderStageFlagBits::eAll, nullptr },
+            vk::DescriptorSetLayoutBinding { buffer_binding, vk::DescriptorType::eStorageBuffer, buffers.capacity, vk::ShaderStageFlagBits::eAll, nullptr }
+        };
+
+        // Partially bound: unused entries don't need valid descriptors. Update after bind and
+        // unused while pending: adding a resource doesn't wait for the frames using the set.
+        const vk::DescriptorBindingFlags binding_flags {
+            vk::DescriptorBindingFlagBits::ePartiallyBound |
+            vk::DescriptorBindingFlagBits::eUpdateAfterBind |
+            vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending
+        };
+        std::array<vk::DescriptorBindingFlags, 2> flags { binding_flags, binding_flags };
+        vk::DescriptorSetLayoutBindingFlagsCreateInfo flags_ci {
+            static_cast<uint32_t>( flags.size() ),
+            flags.data()
+        };
+
+        vk::DescriptorSetLayoutCreateInfo layout_ci {
+            vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool,
+            static_cast<uint32_t>( bindings.size() ),
+            bindings.data()
+        };
+        layout_ci.setPNext( &flags_ci );
+        layout = device.createDescriptorSetLayoutUnique( layout_ci );
+
+        std::array<vk::DescriptorPoolSize, 2> pool_sizes {
+            vk::DescriptorPoolSize { vk::DescriptorType::eCombinedImageSampler, textures.capacity },
+            vk::DescriptorPoolSize { vk::DescriptorType::eStorageBuffer, buffers.capacity }
+        };
+        vk::DescriptorPoolCreateInfo pool_ci {
+            vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind,
+            1,
+            static_cast<uint32_t>( pool_sizes.size() ),
+            pool_sizes.data()
+        };
+        pool = device.createDescriptorPoolUnique( pool_ci );
+
+        vk::DescriptorSetAllocateInfo ai {
+            pool.get(),
+            1,
+            &layout.get()
+        };
+        set = device.allocateDescriptorSets( ai ).front();
+    }
+
+    void BindlessDescriptors::begin_frame( uint32_t frame_index ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        current_frame = frame_index;
+
+        for( Array* a : { &textures, &buffers } ) {
+            std::vector<Handle>& retired = a->retired_handles[current_frame];
+            a->free_handles.insert( a->free_handles.end(), retired.begin(), retired.end() );
+            retired.clear();
+        }
+    }
+
+    BindlessDescriptors::Handle BindlessDescriptors::add_texture( vk::ImageView view, vk::Sampler sampler, vk::ImageLayout layout ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        const Handle handle { allocate_handle( textures ) };
+        if( handle == invalid_handle )
+            return invalid_handle;
+
+        vk::DescriptorImageInfo ii { sampler, view, layout };
+        device.updateDescriptorSets( vk::WriteDescriptorSet { set, texture_binding, handle, 1, vk::DescriptorType::eCombinedImageSampler, &ii, nullptr, nullptr }, nullptr );
+
+        return handle;
+    }
+
+    BindlessDescriptors::Handle BindlessDescriptors::add_buffer( vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize range ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        const Handle handle { allocate_handle( buffers ) };
+        if( handle == invalid_handle )
+            return invalid_handle;
+
+        vk::DescriptorBufferInfo bi { buffer, offset, range };
+        device.updateDescriptorSets( vk::WriteDescriptorSet { set, buffer_binding, handle, 1, vk::DescriptorType::eStorageBuffer, nullptr, &bi, nullptr }, nullptr );
+
+        return handle;
+    }
+
+    void BindlessDescriptors::remove_texture( Handle handle ) {
+        if( handle == invalid_handle )
+            return;
+
+        std::lock_guard<std::mutex> lock( mutex );
+        textures.retired_handles[current_frame].push_back( handle );
+    }
+
+    void BindlessDescriptors::remove_buffer( Handle handle ) {
+        if( handle == invalid_handle )
+            return;
+
+        std::lock_guard<std::mutex> lock( mutex );
+        buffers.retired_handles[current_frame].push_back( handle );
+    }
+
+    BindlessDescriptors::Handle BindlessDescriptors::allocate_handle( Array& array ) {
+        if( !array.free_handles.empty() ) {
+            const Handle handle { array.free_handles.back() };
+            array.free_handles.pop_back();
+            return handle;
+        }
+
+        if( array.high_water == array.capacity )
+            return invalid_handle;
+
+        return array.high_water++;
+    }
+}
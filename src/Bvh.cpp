@@ -0,0 +1,428 @@
+#include "Bvh.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define STLR_BVH_SSE
+#include <emmintrin.h>
+#endif // SSE2
+
+namespace stlr {
+    namespace {
+        // Deep enough for the median split's depth of log4 of the object count, three siblings
+        // waiting at each level, for any count that fits in an ObjectId.
+        constexpr uint32_t stack_size = 128;
+
+        struct FrustumMasks {
+            /// Lanes whose boxes are entirely outside a plane.
+            uint32_t outside;
+            /// Lanes whose boxes are entirely inside every plane.
+            uint32_t inside;
+        };
+
+        struct RayLanes {
+            std::array<float, 3> origin;
+            std::array<float, 3> inverse_direction;
+        };
+
+#ifdef STLR_BVH_SSE
+        // Tests four boxes at once with the center and half extent form of the plane test: a box is
+        // outside a plane if its center is further behind it than the box's extent along the normal.
+        template <typename Node>
+        FrustumMasks test_frustum( const Node& n, const Bvh::Frustum& frustum ) noexcept {
+            const __m128 half { _mm_set1_ps( 0.5f ) };
+            const __m128 min_x { _mm_load_ps( n.min_x.data() ) };
+            const __m128 min_y { _mm_load_ps( n.min_y.data() ) };
+            const __m128 min_z { _mm_load_ps( n.min_z.data() ) };
+            const __m128 max_x { _mm_load_ps( n.max_x.data() ) };
+            const __m128 max_y { _mm_load_ps( n.max_y.data() ) };
+            const __m128 max_z { _mm_load_ps( n.max_z.data() ) };
+            const __m128 c_x { _mm_mul_ps( _mm_add_ps( min_x, max_x ), half ) };
+            const __m128 c_y { _mm_mul_ps( _mm_add_ps( min_y, max_y ), half ) };
+            const __m128 c_z { _mm_mul_ps( _mm_add_ps( min_z, max_z ), half ) };
+            const __m128 e_x { _mm_mul_ps( _mm_sub_ps( max_x, min_x ), half ) };
+            const __m128 e_y { _mm_mul_ps( _mm_sub_ps( max_y, min_y ), half ) };
+            const __m128 e_z { _mm_mul_ps( _mm_sub_ps( max_z, min_z ), half ) };
+
+            __m128 outside { _mm_setzero_ps() };
+            __m128 crossing { _mm_setzero_ps() };
+            for( const auto& p : frustum ) {
+                const __m128 d { _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( p[0] ), c_x ), _mm_mul_ps( _mm_set1_ps( p[1] ), c_y ) ), _mm_add_ps( _mm_mul_ps( _mm_set1_ps( p[2] ), c_z ), _mm_set1_ps( p[3] ) ) ) };
+                const __m128 r { _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( std::fabs( p[0] ) ), e_x ), _mm_mul_ps( _mm_set1_ps( std::fabs( p[1] ) ), e_y ) ), _mm_mul_ps( _mm_set1_ps( std::fabs( p[2] ) ), e_z ) ) };
+                outside = _mm_or_ps( outside, _mm_cmplt_ps( d, _mm_sub_ps( _mm_setzero_ps(), r ) ) );
+                crossing = _mm_or_ps( crossing, _mm_cmplt_ps( d, r ) );
+            }
+
+            return FrustumMasks {
+                static_cast<uint32_t>( _mm_movemask_ps( outside ) ),
+                static_cast<uint32_t>( ~_mm_movemask_ps( crossing ) & 0xf )
+            };
+        }
+
+        template <typename Node>
+        uint32_t test_box( const Node& n, const Bvh::Aabb& box ) noexcept {
+            __m128 overlap { _mm_and_ps( _mm_cmple_ps( _mm_load_ps( n.min_x.data() ), _mm_set1_ps( box.max[0] ) ), _mm_cmpge_ps( _mm_load_ps( n.max_x.data() ), _mm_set1_ps( box.min[0] ) ) ) };
+            overlap = _mm_and_ps( overlap, _mm_and_ps( _mm_cmple_ps( _mm_load_ps( n.min_y.data() ), _mm_set1_ps( box.max[1] ) ), _mm_cmpge_ps( _mm_load_ps( n.max_y.data() ), _mm_set1_ps( box.min[1] ) ) ) );
+            overlap = _mm_and_ps( overlap, _mm_and_ps( _mm_cmple_ps( _mm_load_ps( n.min_z.data() ), _mm_set1_ps( box.max[2] ) ), _mm_cmpge_ps( _mm_load_ps( n.max_z.data() ), _mm_set1_ps( box.min[2] ) ) ) );
+            return static_cast<uint32_t>( _mm_movemask_ps( overlap ) );
+        }
+
+        // The slab test on four boxes; distances are where the ray enters each box.
+        template <typename Node>
+        uint32_t test_ray( const Node& n, const RayLanes& ray, float max_distance, std::array<float, 4>& distances ) noexcept {
+            __m128 near { _mm_setzero_ps() };
+            __m128 far { _mm_set1_ps( max_distance ) };
+            const std::array<const float*, 3> mins { n.min_x.data(), n.min_y.data(), n.min_z.data() };
+            const std::array<const float*, 3> maxs { n.max_x.data(), n.max_y.data(), n.max_z.data() };
+            for( uint32_t a = 0; a < 3; ++a ) {
+                const __m128 o { _mm_set1_ps( ray.origin[a] ) };
+                const __m128 inv { _mm_set1_ps( ray.inverse_direction[a] ) };
+                const __m128 t0 { _mm_mul_ps( _mm_sub_ps( _mm_load_ps( mins[a] ), o ), inv ) };
+                const __m128 t1 { _mm_mul_ps( _mm_sub_ps( _mm_load_ps( maxs[a] ), o ), inv ) };
+                near = _mm_max_ps( near, _mm_min_ps( t0, t1 ) );
+                far = _mm_min_ps( far, _mm_max_ps( t0, t1 ) );
+            }
+            _mm_storeu_ps( distances.data(), near );
+            return static_cast<uint32_t>( _mm_movemask_ps( _mm_cmple_ps( near, far ) ) );
+        }
+#else
+        template <typename Node>
+        FrustumMasks test_frustum( const Node& n, const Bvh::Frustum& frustum ) noexcept {
+            FrustumMasks masks { 0, 0 };
+            for( uint32_t i = 0; i < 4; ++i ) {
+                const std::array<float, 3> c { ( n.min_x[i] + n.max_x[i] ) * 0.5f, ( n.min_y[i] + n.max_y[i] ) * 0.5f, ( n.min_z[i] + n.max_z[i] ) * 0.5f };
+                const std::array<float, 3> e { ( n.max_x[i] - n.min_x[i] ) * 0.5f, ( n.max_y[i] - n.min_y[i] ) * 0.5f, ( n.max_z[i] - n.min_z[i] ) * 0.5f };
+                bool outside { false };
+                bool crossing { false };
+                for( const auto& p : frustum ) {
+                    const float d { p[0] * c[0] + p[1] * c[1] + p[2] * c[2] + p[3] };
+                    const float r { std::fabs( p[0] ) * e[0] + std::fabs( p[1] ) * e[1] + std::fabs( p[2] ) * e[2] };
+                    outside = outside || d < -r;
+                    crossing = crossing || d < r;
+                }
+                masks.outside |= outside ? 1u << i : 0u;
+                masks.inside |= crossing ? 0u : 1u << i;
+            }
+            return masks;
+        }
+
+        template <typename Node>
+        uint32_t test_box( const Node& n, const Bvh::Aabb& box ) noexcept {
+            uint32_t mask { 0 };
+            for( uint32_t i = 0; i < 4; ++i ) {
+                const bool overlap {
+                    n.min_x[i] <= box.max[0] && n.max_x[i] >= box.min[0] &&
+                    n.min_y[i] <= box.max[1] && n.max_y[i] >= box.min[1] &&
+                    n.min_z[i] <= box.max[2] && n.max_z[i] >= box.min[2]
+                };
+                mask |= overlap ? 1u << i : 0u;
+            }
+            return mask;
+        }
+
+        template <typename Node>
+        uint32_t test_ray( const Node& n, const RayLanes& ray, float max_distance, std::array<float, 4>& distances ) noexcept {
+            uint32_t mask { 0 };
+            for( uint32_t i = 0; i < 4; ++i ) {
+                const std::array<float, 3> mins { n.min_x[i], n.min_y[i], n.min_z[i] };
+                const std::array<float, 3> maxs { n.max_x[i], n.max_y[i], n.max_z[i] };
+                float near { 0.0f };
+                float far { max_distance };
+                for( uint32_t a = 0; a < 3; ++a ) {
+                    const float t0 { ( mins[a] - ray.origin[a] ) * ray.inverse_direction[a] };
+                    const float t1 { ( maxs[a] - ray.origin[a] ) * ray.inverse_direction[a] };
+                    near = std::max( near, std::min( t0, t1 ) );
+                    far = std::min( far, std::max( t0, t1 ) );
+                }
+                distances[i] = near;
+                mask |= near <= far ? 1u << i : 0u;
+            }
+            return mask;
+        }
+#endif // STLR_BVH_SSE
+
+        RayLanes get_ray_lanes( const Bvh::Ray& ray ) noexcept {
+            RayLanes lanes { ray.origin, {} };
+            for( uint32_t a = 0; a < 3; ++a ) {
+                // Infinity for axis-parallel rays keeps the slab test exact without a branch.
+                lanes.inverse_direction[a] = ray.direction[a] != 0.0f ? 1.0f / ray.direction[a] : std::numeric_limits<float>::infinity();
+            }
+            return lanes;
+        }
+    }
+
+    void Bvh::build( std::vector<Aabb> object_boxes ) {
+        boxes = std::move( object_boxes );
+        nodes.clear();
+        locations.assign( boxes.size(), Location { invalid_index, 0 } );
+
+        order.resize( boxes.size() );
+        for( ObjectId i = 0; i < order.size(); ++i ) {
+            order[i] = i;
+        }
+
+        // With median splits there are about a third as many nodes as objects.
+        nodes.reserve( boxes.size() / 3 + 1 );
+        if( !boxes.empty() )
+            build_node( 0, static_cast<uint32_t>( boxes.size() ), invalid_index );
+        dirty.assign( nodes.size(), 0 );
+    }
+
+    void Bvh::update( ObjectId object, const Aabb& box ) {
+        boxes[object] = box;
+        const Location l { locations[object] };
+        set_slot( l.node, l.slot, box );
+        dirty[l.node] = 1;
+    }
+
+    void Bvh::refit() {
+        // Children come after their parents, so walking backwards finishes every child first.
+        for( uint32_t i = static_cast<uint32_t>( nodes.size() ); i-- > 0; ) {
+            if( !dirty[i] )
+                continue;
+            dirty[i] = 0;
+
+            const uint32_t parent { nodes[i].parent };
+            if( parent == invalid_index )
+                continue;
+            const Node& p { nodes[parent] };
+            const uint32_t slot { static_cast<uint32_t>( std::find( p.children.begin(), p.children.begin() + p.child_count, i ) - p.children.begin() ) };
+            set_slot( parent, slot, get_node_bounds( i ) );
+            dirty[parent] = 1;
+        }
+    }
+
+    void Bvh::cull( const Frustum& frustum, std::vector<ObjectId>& visible ) const {
+        if( nodes.empty() )
+            return;
+
+        std::array<uint32_t, stack_size> stack;
+        uint32_t top { 0 };
+        stack[top++] = 0;
+        while( top > 0 ) {
+            const Node& n { nodes[stack[--top]] };
+            const FrustumMasks masks { test_frustum( n, frustum ) };
+
+            for( uint32_t i = 0; i < n.child_count; ++i ) {
+                const uint32_t bit { 1u << i };
+                if( masks.outside & bit )
+                    continue;
+
+                const uint32_t child { n.children[i] };
+                if( child & object_bit )
+                    visible.push_back( child & ~object_bit );
+                // Everything under a box that's entirely inside is visible without testing it.
+                else if( masks.inside & bit )
+                    append_objects( nodes[child], visible );
+                else
+                    stack[top++] = child;
+            }
+        }
+    }
+
+    void Bvh::query( const Aabb& box, std::vector<ObjectId>& result ) const {
+        if( nodes.empty() )
+            return;
+
+        std::array<uint32_t, stack_size> stack;
+        uint32_t top { 0 };
+        stack[top++] = 0;
+        while( top > 0 ) {
+            const Node& n { nodes[stack[--top]] };
+            const uint32_t mask { test_box( n, box ) };
+            for( uint32_t i = 0; i < n.child_count; ++i ) {
+                if( !( mask & ( 1u << i ) ) )
+                    continue;
+
+                const uint32_t child { n.children[i] };
+                if( child & object_bit )
+                    result.push_back( child & ~object_bit );
+                else
+                    stack[top++] = child;
+            }
+        }
+    }
+
+    void Bvh::query( const Ray& ray, std::vector<Hit>& result ) const {
+        if( nodes.empty() )
+            return;
+
+        const RayLanes lanes { get_ray_lanes( ray ) };
+        std::array<uint32_t, stack_size> stack;
+        uint32_t top { 0 };
+        stack[top++] = 0;
+        while( top > 0 ) {
+            const Node& n { nodes[stack[--top]] };
+            std::array<float, 4> distances;
+            const uint32_t mask { test_ray( n, lanes, ray.max_distance, distances ) };
+            for( uint32_t i = 0; i < n.child_count; ++i ) {
+                if( !( mask & ( 1u << i ) ) )
+                    continue;
+
+                const uint32_t child { n.children[i] };
+                if( child & object_bit )
+                    result.push_back( Hit { child & ~object_bit, distances[i] } );
+                else
+                    stack[top++] = child;
+            }
+        }
+    }
+
+    std::optional<Bvh::Hit> Bvh::raycast( const Ray& ray ) const {
+        if( nodes.empty() )
+            return std::nullopt;
+
+        const RayLanes lanes { get_ray_lanes( ray ) };
+        std::optional<Hit> nearest;
+        float max_distance { ray.max_distance };
+
+        std::array<std::pair<uint32_t, float>, stack_size> stack;
+        uint32_t top { 0 };
+        stack[top++] = { 0, 0.0f };
+        while( top > 0 ) {
+            const auto [node, entry] { stack[--top] };
+            // A closer hit may have been found since the node was pushed.
+            if( entry > max_distance )
+                continue;
+
+            const Node& n { nodes[node] };
+            std::array<float, 4> distances;
+            const uint32_t mask { test_ray( n, lanes, max_distance, distances ) };
+
+            const uint32_t first_pushed { top };
+            for( uint32_t i = 0; i < n.child_count; ++i ) {
+                if( !( mask & ( 1u << i ) ) )
+                    continue;
+
+                const uint32_t child { n.children[i] };
+                if( child & object_bit ) {
+                    if( distances[i] <= max_distance ) {
+                        max_distance = distances[i];
+                        nearest = Hit { child & ~object_bit, distances[i] };
+                    }
+                }
+                else {
+                    stack[top++] = { child, distances[i] };
+                }
+            }
+
+            // Nearest on top, so it's visited first and the others are likely pruned.
+            std::sort( stack.begin() + first_pushed, stack.begin() + top, []( const auto& a, const auto& b ) { return a.second > b.second; } );
+        }
+
+        return nearest;
+    }
+
+    Bvh::Aabb Bvh::get_bounds() const noexcept {
+        if( nodes.empty() )
+            return Aabb { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } };
+        return get_node_bounds( 0 );
+    }
+
+    uint32_t Bvh::build_node( uint32_t first, uint32_t count, uint32_t parent ) {
+        const uint32_t index { static_cast<uint32_t>( nodes.size() ) };
+        {
+            Node n {};
+            n.parent = parent;
+            n.first = first;
+            n.count = count;
+            nodes.push_back( n );
+        }
+
+        // Two median splits give up to four children; small ranges make each object a child.
+        std::array<std::pair<uint32_t, uint32_t>, 4> ranges;
+        uint32_t range_count { 0 };
+        if( count <= 4 ) {
+            for( uint32_t i = 0; i < count; ++i ) {
+                ranges[range_count++] = { first + i, 1 };
+            }
+        }
+        else {
+            const uint32_t left { split( first, count ) };
+            const uint32_t right { count - left };
+            const uint32_t left_left { split( first, left ) };
+            const uint32_t right_left { split( first + left, right ) };
+            ranges[range_count++] = { first, left_left };
+            ranges[range_count++] = { first + left_left, left - left_left };
+            ranges[range_count++] = { first + left, right_left };
+            ranges[range_count++] = { first + left + right_left, right - right_left };
+        }
+
+        nodes[index].child_count = range_count;
+        for( uint32_t i = 0; i < range_count; ++i ) {
+            const auto [range_first, range_count_i] { ranges[i] };
+            if( range_count_i == 1 ) {
+                const ObjectId object { order[range_first] };
+                nodes[index].children[i] = object | object_bit;
+                locations[object] = Location { index, i };
+                set_slot( index, i, boxes[object] );
+            }
+            else {
+                const uint32_t child { build_node( range_first, range_count_i, index ) };
+                nodes[index].children[i] = child;
+                set_slot( index, i, get_node_bounds( child ) );
+            }
+        }
+
+        // Unused slots are tested along with the others but never read; empty boxes keep the lanes finite.
+        for( uint32_t i = range_count; i < 4; ++i ) {
+            const float big { std::numeric_limits<float>::max() };
+            set_slot( index, i, Aabb { { big, big, big }, { -big, -big, -big } } );
+            nodes[index].children[i] = invalid_index;
+        }
+
+        return index;
+    }
+
+    uint32_t Bvh::split( uint32_t first, uint32_t count ) {
+        if( count < 2 )
+            return count;
+
+        const auto center = [this]( ObjectId o, uint32_t axis ) { return boxes[o].min[axis] + boxes[o].max[axis]; };
+
+        std::array<float, 3> lo { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+        std::array<float, 3> hi { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+        for( uint32_t i = first; i < first + count; ++i ) {
+            for( uint32_t a = 0; a < 3; ++a ) {
+                const float c { center( order[i], a ) };
+                lo[a] = std::min( lo[a], c );
+                hi[a] = std::max( hi[a], c );
+            }
+        }
+
+        uint32_t axis { 0 };
+        for( uint32_t a = 1; a < 3; ++a ) {
+            if( hi[a] - lo[a] > hi[axis] - lo[axis] )
+                axis = a;
+        }
+
+        const uint32_t half { count / 2 };
+        std::nth_element( order.begin() + first, order.begin() + first + half, order.begin() + first + count, [&]( ObjectId a, ObjectId b ) { return center( a, axis ) < center( b, axis ); } );
+        return half;
+    }
+
+    Bvh::Aabb Bvh::get_node_bounds( uint32_t node ) const noexcept {
+        const Node& n { nodes[node] };
+        Aabb b { { n.min_x[0], n.min_y[0], n.min_z[0] }, { n.max_x[0], n.max_y[0], n.max_z[0] } };
+        for( uint32_t i = 1; i < n.child_count; ++i ) {
+            b.min = { std::min( b.min[0], n.min_x[i] ), std::min( b.min[1], n.min_y[i] ), std::min( b.min[2], n.min_z[i] ) };
+            b.max = { std::max( b.max[0], n.max_x[i] ), std::max( b.max[1], n.max_y[i] ), std::max( b.max[2], n.max_z[i] ) };
+        }
+        return b;
+    }
+
+    void Bvh::set_slot( uint32_t node, uint32_t slot, const Aabb& box ) noexcept {
+        Node& n { nodes[node] };
+        n.min_x[slot] = box.min[0];
+        n.min_y[slot] = box.min[1];
+        n.min_z[slot] = box.min[2];
+        n.max_x[slot] = box.max[0];
+        n.max_y[slot] = box.max[1];
+        n.max_z[slot] = box.max[2];
+    }
+
+    void Bvh::append_objects( const Node& node, std::vector<ObjectId>& result ) const {
+        result.insert( result.end(), order.begin() + node.first, order.begin() + node.first + node.count );
+    }
+}
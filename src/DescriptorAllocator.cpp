@@ -0,0 +1,176 @@
+#include "DescriptorAllocator.hpp"
+#include <algorithm>
+#include <functional>
+
+namespace stlr {
+    namespace {
+        template <typename T>
+        void hash_combine( size_t& seed, const T& value ) noexcept {
+            seed ^= std::hash<T>{}( value ) + 0x9e3779b97f4a7c15ull + ( seed << 6 ) + ( seed >> 2 );
+        }
+    }
+
+    DescriptorAllocator::DescriptorAllocator( vk::Device device, uint32_t sets_per_pool, std::vector<PoolSizeRatio> ratios )
+        : device( device )
+        , ratios( std::move( ratios ) )
+        , sets_per_pool( std::max( sets_per_pool, 1u ) ) {}
+
+    vk::DescriptorSet DescriptorAllocator::allocate( vk::DescriptorSetLayout layout ) {
+        if( used_pools.empty() )
+            used_pools.push_back( get_pool() );
+
+        vk::DescriptorSetAllocateInfo ai {
+            used_pools.back().get(),
+            1,
+            &layout
+        };
+
+        try {
+            return device.allocateDescriptorSets( ai ).front();
+        }
+        catch( const vk::OutOfPoolMemoryError& ) {}
+        catch( const vk::FragmentedPoolError& ) {}
+
+        // The current pool is full; chain a fresh one. If the set doesn't fit an empty pool either,
+        // its layout needs more descriptors than the ratios allow and the error is real.
+        used_pools.push_back( get_pool() );
+        ai.descriptorPool = used_pools.back().get();
+        return device.allocateDescriptorSets( ai ).front();
+    }
+
+    void DescriptorAllocator::reset() {
+        for( auto& p : used_pools ) {
+            device.resetDescriptorPool( p.get() );
+            free_pools.push_back( std::move( p ) );
+        }
+        used_pools.clear();
+    }
+
+    vk::UniqueDescriptorPool DescriptorAllocator::get_pool() {
+        if( !free_pools.empty() ) {
+            vk::UniqueDescriptorPool pool { std::move( free_pools.back() ) };
+            free_pools.pop_back();
+            return pool;
+        }
+
+        std::vector<vk::DescriptorPoolSize> sizes;
+        sizes.reserve( ratios.size() );
+        for( const auto& r : ratios ) {
+            sizes.push_back( vk::DescriptorPoolSize { r.type, std::max( static_cast<uint32_t>( r.ratio * sets_per_pool ), 1u ) } );
+        }
+
+        // No eFreeDescriptorSet: sets are only ever returned by resetting the whole pool.
+        vk::DescriptorPoolCreateInfo ci {
+            {},
+            sets_per_pool,
+            static_cast<uint32_t>( sizes.size() ),
+            sizes.data()
+        };
+        vk::UniqueDescriptorPool pool { device.createDescriptorPoolUnique( ci ) };
+
+        // Needing another pool means the workload is bigger than guessed, so grow the next one.
+        sets_per_pool = std::min( sets_per_pool + sets_per_pool / 2, max_sets_per_pool );
+
+        return pool;
+    }
+
+    bool DescriptorLayoutCache::Binding::operator==( const Binding& other ) const noexcept {
+        return binding == other.binding
+            && type == other.type
+            && count == other.count
+            && stages == other.stages
+            && immutable_samplers == other.immutable_samplers;
+    }
+
+    bool DescriptorLayoutCache::SetLayoutKey::operator==( const SetLayoutKey& other ) const noexcept {
+        return flags == other.flags && bindings == other.bindings;
+    }
+
+    bool DescriptorLayoutCache::PipelineLayoutKey::operator==( const PipelineLayoutKey& other ) const noexcept {
+        return set_layouts == other.set_layouts && push_constants == other.push_constants;
+    }
+
+    size_t DescriptorLayoutCache::Hash::operator()( const SetLayoutKey& key ) const noexcept {
+        size_t h { 0 };
+        hash_combine( h, static_cast<VkDescriptorSetLayoutCreateFlags>( key.flags ) );
+        for( const auto& b : key.bindings ) {
+            hash_combine( h, b.binding );
+            hash_combine( h, static_cast<uint32_t>( b.type ) );
+            hash_combine( h, b.count );
+            hash_combine( h, static_cast<VkShaderStageFlags>( b.stages ) );
+            for( const auto& s : b.immutable_samplers ) {
+                hash_combine( h, static_cast<VkSampler>( s ) );
+            }
+        }
+        return h;
+    }
+
+    size_t DescriptorLayoutCache::Hash::operator()( const PipelineLayoutKey& key ) const noexcept {
+        size_t h { 0 };
+        for( const auto& l : key.set_layouts ) {
+            hash_combine( h, static_cast<VkDescriptorSetLayout>( l ) );
+        }
+        for( const auto& p : key.push_constants ) {
+            hash_combine( h, static_cast<VkShaderStageFlags>( p.stageFlags ) );
+            hash_combine( h, p.offset );
+            hash_combine( h, p.size );
+        }
+        return h;
+    }
+
+    DescriptorLayoutCache::DescriptorLayoutCache( vk::Device device )
+        : device( device ) {}
+
+    vk::DescriptorSetLayout DescriptorLayoutCache::get_set_layout( vk::ArrayProxy<const vk::DescriptorSetLayoutBinding> bindings, vk::DescriptorSetLayoutCreateFlags flags ) {
+        SetLayoutKey key { flags, {} };
+        key.bindings.reserve( bindings.size() );
+        for( const auto& b : bindings ) {
+            std::vector<vk::Sampler> samplers;
+            if( b.pImmutableSamplers != nullptr )
+                samplers.assign( b.pImmutableSamplers, b.pImmutableSamplers + b.descriptorCount );
+            key.bindings.push_back( Binding { b.binding, b.descriptorType, b.descriptorCount, b.stageFlags, std::move( samplers ) } );
+        }
+        std::sort( key.bindings.begin(), key.bindings.end(), []( const Binding& a, const Binding& b ) { return a.binding < b.binding; } );
+
+        std::lock_guard<std::mutex> lock( mutex );
+        auto it = set_layouts.find( key );
+        if( it != set_layouts.end() )
+            return it->second.get();
+
+        vk::DescriptorSetLayoutCreateInfo ci {
+            flags,
+            bindings.size(),
+            bindings.data()
+        };
+        vk::UniqueDescriptorSetLayout layout { device.createDescriptorSetLayoutUnique( ci ) };
+        vk::DescriptorSetLayout handle { layout.get() };
+        set_layouts.emplace( std::move( key ), std::move( layout ) );
+
+        return handle;
+    }
+
+    vk::PipelineLayout DescriptorLayoutCache::get_pipeline_layout( vk::ArrayProxy<const vk::DescriptorSetLayout> layouts, vk::ArrayProxy<const vk::PushConstantRange> push_constants ) {
+        PipelineLayoutKey key {
+            std::vector<vk::DescriptorSetLayout>( layouts.begin(), layouts.end() ),
+            std::vector<vk::PushConstantRange>( push_constants.begin(), push_constants.end() )
+        };
+
+        std::lock_guard<std::mutex> lock( mutex );
+        auto it = pipeline_layouts.find( key );
+        if( it != pipeline_layouts.end() )
+            return it->second.get();
+
+        vk::PipelineLayoutCreateInfo ci {
+            {},
+            layouts.size(),
+            layouts.data(),
+            push_constants.size(),
+            push_constants.data()
+        };
+        vk::UniquePipelineLayout layout { device.createPipelineLayoutUnique( ci ) };
+        vk::PipelineLayout handle { layout.get() };
+        pipeline_layouts.emplace( std::move( key ), std::move( layout ) );
+
+        return handle;
+    }
+}
@@ -0,0 +1,168 @@
+#include "GpuCulling.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+namespace stlr {
+    GpuCulling::GpuCulling( vk::Device device, MemoryAllocator& allocator, const std::filesystem::path& shader_file, uint32_t frame_count, uint32_t max_objects, std::array<uint32_t, 2> queue_family_indices )
+        : device( device )
+        , allocator( allocator )
+        , max_objects( std::max( max_objects, 1u ) ) {
+        create_pipeline( shader_file );
+
+        const uint32_t buffer_count { frame_count * 3 };
+        vk::DescriptorPoolSize pool_size { vk::DescriptorType::eStorageBuffer, buffer_count };
+        pool = device.createDescriptorPoolUnique( vk::DescriptorPoolCreateInfo { {}, frame_count, 1, &pool_size } );
+
+        std::vector<uint32_t> queue_families { queue_family_indices[0] };
+        if( queue_family_indices[1] != queue_family_indices[0] )
+            queue_families.push_back( queue_family_indices[1] );
+
+        frames.reserve( frame_count );
+        for( uint32_t i = 0; i < frame_count; ++i ) {
+            frames.push_back( create_frame_buffers( queue_families ) );
+        }
+    }
+
+    GpuCulling::Frustum GpuCulling::get_frustum( const std::array<float, 16>& view_projection ) noexcept {
+        const auto row = [&view_projection]( uint32_t r ) {
+            return std::array<float, 4> { view_projection[r], view_projection[4 + r], view_projection[8 + r], view_projection[12 + r] };
+        };
+        const auto combine = []( const std::array<float, 4>& a, const std::array<float, 4>& b, float sign ) {
+            return std::array<float, 4> { a[0] + sign * b[0], a[1] + sign * b[1], a[2] + sign * b[2], a[3] + sign * b[3] };
+        };
+
+        const std::array<float, 4> r0 { row( 0 ) };
+        const std::array<float, 4> r1 { row( 1 ) };
+        const std::array<float, 4> r2 { row( 2 ) };
+        const std::array<float, 4> r3 { row( 3 ) };
+
+        // Gribb and Hartmann's extraction; with depth from 0 to 1 the near plane is the third row alone.
+        Frustum planes {
+            combine( r3, r0, 1.0f ),
+            combine( r3, r0, -1.0f ),
+            combine( r3, r1, 1.0f ),
+            combine( r3, r1, -1.0f ),
+            r2,
+            combine( r3, r2, -1.0f )
+        };
+
+        // Unit normals make the plane equation a signed distance, which the sphere's radius is compared with.
+        for( auto& p : planes ) {
+            const float length { std::sqrt( p[0] * p[0] + p[1] * p[1] + p[2] * p[2] ) };
+            if( length > 0.0f ) {
+                for( float& c : p ) {
+                    c /= length;
+                }
+            }
+        }
+
+        return planes;
+    }
+
+    void GpuCulling::write_objects( uint32_t frame, const Object* objects, uint32_t count, uint32_t first ) {
+        if( first + count > max_objects )
+            throw std::out_of_range( "More objects were written than the culling buffers hold." );
+        frames[frame].objects_allocation.write( objects, sizeof( Object ) * count, sizeof( Object ) * first );
+    }
+
+    void GpuCulling::record( vk::CommandBuffer command_buffer, uint32_t frame, uint32_t object_count, const Frustum& frustum ) const {
+        if( object_count > max_objects )
+            throw std::out_of_range( "More objects were culled than the culling buffers hold." );
+
+        const FrameBuffers& f { frames[frame] };
+
+        command_buffer.fillBuffer( f.count.get(), 0, sizeof( uint32_t ), 0 );
+        vk::BufferMemoryBarrier cleared {
+            vk::AccessFlagBits::eTransferWrite,
+            vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+            VK_QUEUE_FAMILY_IGNORED,
+            VK_QUEUE_FAMILY_IGNORED,
+            f.count.get(),
+            0,
+            VK_WHOLE_SIZE
+        };
+        command_buffer.pipelineBarrier( vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, cleared, nullptr );
+
+        if( object_count == 0 )
+            return;
+
+        const PushConstants constants { frustum, object_count };
+        command_buffer.bindPipeline( vk::PipelineBindPoint::eCompute, pipeline.get() );
+        command_buffer.bindDescriptorSets( vk::PipelineBindPoint::eCompute, pipeline_layout.get(), 0, f.set, nullptr );
+        command_buffer.pushConstants( pipeline_layout.get(), vk::ShaderStageFlagBits::eCompute, 0, sizeof( constants ), &constants );
+        command_buffer.dispatch( ( object_count + group_size - 1 ) / group_size, 1, 1 );
+    }
+
+    void GpuCulling::draw( vk::CommandBuffer command_buffer, uint32_t frame ) const {
+        const FrameBuffers& f { frames[frame] };
+        command_buffer.drawIndexedIndirectCount( f.draws.get(), 0, f.count.get(), 0, max_objects, sizeof( vk::DrawIndexedIndirectCommand ) );
+    }
+
+    void GpuCulling::create_pipeline( const std::filesystem::path& shader_file ) {
+        std::ifstream file( shader_file, std::ios::binary | std::ios::ate );
+        if( !file.is_open() )
+            throw std::runtime_error( "Failed to open the culling shader: " + shader_file.string() );
+        std::vector<char> code( static_cast<size_t>( file.tellg() ) );
+        file.seekg( 0 );
+        file.read( code.data(), code.size() );
+
+        shader = device.createShaderModuleUnique( vk::ShaderModuleCreateInfo { {}, code.size(), reinterpret_cast<const uint32_t*>( code.data() ) } );
+
+        std::array<vk::DescriptorSetLayoutBinding, 3> bindings {
+            vk::DescriptorSetLayoutBinding { 0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute, nullptr },
+            vk::DescriptorSetLayoutBinding { 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute, nullptr },
+            vk::DescriptorSetLayoutBinding { 2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute, nullptr }
+        };
+        set_layout = device.createDescriptorSetLayoutUnique( vk::DescriptorSetLayoutCreateInfo { {}, static_cast<uint32_t>( bindings.size() ), bindings.data() } );
+
+        vk::PushConstantRange push_constants { vk::ShaderStageFlagBits::eCompute, 0, sizeof( PushConstants ) };
+        pipeline_layout = device.createPipelineLayoutUnique( vk::PipelineLayoutCreateInfo { {}, 1, &set_layout.get(), 1, &push_constants } );
+
+        vk::ComputePipelineCreateInfo ci {
+            {},
+            vk::PipelineShaderStageCreateInfo { {}, vk::ShaderStageFlagBits::eCompute, shader.get(), "main" },
+            pipeline_layout.get()
+        };
+        pipeline = std::move( device.createComputePipelineUnique( nullptr, ci ).value );
+    }
+
+    GpuCulling::FrameBuffers GpuCulling::create_frame_buffers( const std::vector<uint32_t>& queue_families ) {
+        // Written by one queue and read by the other, so both families access them concurrently.
+        const bool shared { queue_families.size() > 1 };
+        const auto create = [&]( vk::DeviceSize size, vk::BufferUsageFlags usage ) {
+            vk::BufferCreateInfo ci {
+                {},
+                size,
+                usage,
+                shared ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive,
+                shared ? static_cast<uint32_t>( queue_families.size() ) : 0u,
+                shared ? queue_families.data() : nullptr
+            };
+            return device.createBufferUnique( ci );
+        };
+
+        FrameBuffers f;
+        f.objects = create( sizeof( Object ) * max_objects, vk::BufferUsageFlagBits::eStorageBuffer );
+        f.objects_allocation = allocator.allocate_unique( f.objects.get(), vk::MemoryPropertyFlagBits::eHostVisible );
+        f.draws = create( sizeof( vk::DrawIndexedIndirectCommand ) * max_objects, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer );
+        f.draws_allocation = allocator.allocate_unique( f.draws.get(), vk::MemoryPropertyFlagBits::eDeviceLocal );
+        f.count = create( sizeof( uint32_t ), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst );
+        f.count_allocation = allocator.allocate_unique( f.count.get(), vk::MemoryPropertyFlagBits::eDeviceLocal );
+
+        f.set = device.allocateDescriptorSets( vk::DescriptorSetAllocateInfo { pool.get(), 1, &set_layout.get() } ).front();
+        std::array<vk::DescriptorBufferInfo, 3> infos {
+            vk::DescriptorBufferInfo { f.objects.get(), 0, VK_WHOLE_SIZE },
+            vk::DescriptorBufferInfo { f.draws.get(), 0, VK_WHOLE_SIZE },
+            vk::DescriptorBufferInfo { f.count.get(), 0, VK_WHOLE_SIZE }
+        };
+        std::array<vk::WriteDescriptorSet, 3> writes;
+        for( uint32_t i = 0; i < writes.size(); ++i ) {
+            writes[i] = vk::WriteDescriptorSet { f.set, i, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &infos[i], nullptr };
+        }
+        device.updateDescriptorSets( writes, nullptr );
+
+        return f;
+    }
+}
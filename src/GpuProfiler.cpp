@@ -0,0 +1,287 @@
+#include "GpuProfiler.hpp"
+#include <array>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+namespace stlr {
+    namespace {
+        constexpr uint32_t transfer_scope_capacity = 64;
+
+        uint64_t get_timestamp_mask( uint32_t valid_bits ) {
+            return valid_bits >= 64 ? UINT64_MAX : ( uint64_t( 1 ) << valid_bits ) - 1;
+        }
+
+        void write_json_string( std::ostream& out, const std::string& s ) {
+            out << '"';
+            for( char c : s ) {
+                if( c == '"' || c == '\\' )
+                    out << '\\' << c;
+                else if( static_cast<unsigned char>( c ) < 0x20 )
+                    out << ' ';
+                else
+                    out << c;
+            }
+            out << '"';
+        }
+    }
+
+    GpuProfiler::GpuProfiler( vk::PhysicalDevice physical_device, vk::Device device, vk::Queue graphics_queue, uint32_t graphics_family, vk::Queue transfer_queue, uint32_t transfer_family, uint32_t frame_count, bool host_query_reset, uint32_t max_scopes_per_frame )
+        : device( device )
+        , shared_family( graphics_family == transfer_family )
+        , timestamp_period( physical_device.getProperties().limits.timestampPeriod )
+        , graphics_mask( 0 )
+        , transfer_mask( 0 )
+        , host_query_reset( host_query_reset )
+        , queries_per_frame( max_scopes_per_frame * 2 )
+        , current_pool( 0 )
+        , graphics_calibration()
+        , transfer_calibration()
+        , origin( std::chrono::steady_clock::now() )
+        , capturing( false )
+        , dropped_scopes( 0 ) {
+        std::vector<vk::QueueFamilyProperties> families { physical_device.getQueueFamilyProperties() };
+        const uint32_t graphics_bits { families[graphics_family].timestampValidBits };
+        const uint32_t transfer_bits { families[transfer_family].timestampValidBits };
+
+        // Without timestamps on the graphics queue there's nothing to measure.
+        if( graphics_bits == 0 )
+            return;
+
+        graphics_mask = get_timestamp_mask( graphics_bits );
+        frame_pools.resize( frame_count );
+        for( auto& f : frame_pools ) {
+            f.pool = device.createQueryPoolUnique( vk::QueryPoolCreateInfo { {}, vk::QueryType::eTimestamp, queries_per_frame } );
+        }
+
+        // Transfer scopes are read whenever their batch retires, independent of the frames, so their
+        // queries are reset from the host rather than from a command buffer on another queue.
+        if( transfer_bits != 0 && host_query_reset ) {
+            transfer_mask = get_timestamp_mask( transfer_bits );
+            transfer_pool = device.createQueryPoolUnique( vk::QueryPoolCreateInfo { {}, vk::QueryType::eTimestamp, transfer_scope_capacity * 2 } );
+            device.resetQueryPool( transfer_pool.get(), 0, transfer_scope_capacity * 2 );
+            free_transfer_scopes.reserve( transfer_scope_capacity );
+            for( uint32_t i = transfer_scope_capacity; i > 0; --i ) {
+                free_transfer_scopes.push_back( i - 1 );
+            }
+        }
+
+        graphics_calibration.queue = graphics_queue;
+        graphics_calibration.command_pool = device.createCommandPoolUnique( vk::CommandPoolCreateInfo { vk::CommandPoolCreateFlagBits::eTransient, graphics_family } );
+        if( transfer_pool && !shared_family ) {
+            transfer_calibration.queue = transfer_queue;
+            transfer_calibration.command_pool = device.createCommandPoolUnique( vk::CommandPoolCreateInfo { vk::CommandPoolCreateFlagBits::eTransient, transfer_family } );
+        }
+        calibrate();
+    }
+
+    void GpuProfiler::begin_frame( uint32_t frame_index, vk::CommandBuffer command_buffer ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        if( !is_enabled() )
+            return;
+
+        current_pool = frame_index;
+        FramePool& f = frame_pools[current_pool];
+
+        if( !f.scopes.empty() ) {
+            // Each query's value followed by its availability.
+            std::vector<uint64_t> results( f.query_count * 2 );
+            [[maybe_unused]] vk::Result res = device.getQueryPoolResults( f.pool.get(), 0, f.query_count, results.size() * sizeof( uint64_t ), results.data(), sizeof( uint64_t ) * 2, vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability );
+
+            last_frame.clear();
+            for( const auto& s : f.scopes ) {
+                const uint64_t* begin { &results[s.query * 2] };
+                const uint64_t* end { &results[( s.query + 1 ) * 2] };
+
+                // Scopes that were never ended have no end timestamp.
+                if( begin[1] == 0 || end[1] == 0 )
+                    continue;
+
+                const double start { to_microseconds( begin[0], graphics_mask, graphics_calibration ) };
+                Event e { s.name, Track::eGraphics, start, to_microseconds( end[0], graphics_mask, graphics_calibration ) - start };
+                last_frame.push_back( e );
+                record( std::move( e ) );
+            }
+        }
+
+        if( host_query_reset ) {
+            device.resetQueryPool( f.pool.get(), 0, queries_per_frame );
+        }
+        else {
+            command_buffer.resetQueryPool( f.pool.get(), 0, queries_per_frame );
+        }
+        f.query_count = 0;
+        f.scopes.clear();
+    }
+
+    uint32_t GpuProfiler::begin_scope( vk::CommandBuffer command_buffer, std::string name ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        if( !is_enabled() )
+            return invalid_scope;
+
+        FramePool& f = frame_pools[current_pool];
+        if( f.query_count + 2 > queries_per_frame ) {
+            ++dropped_scopes;
+            return invalid_scope;
+        }
+
+        const uint32_t query { f.query_count };
+        f.query_count += 2;
+        f.scopes.push_back( PendingScope { std::move( name ), query } );
+        command_buffer.writeTimestamp( vk::PipelineStageFlagBits::eTopOfPipe, f.pool.get(), query );
+
+        return query;
+    }
+
+    void GpuProfiler::end_scope( vk::CommandBuffer command_buffer, uint32_t scope ) {
+        if( scope == invalid_scope )
+            return;
+
+        std::lock_guard<std::mutex> lock( mutex );
+        command_buffer.writeTimestamp( vk::PipelineStageFlagBits::eBottomOfPipe, frame_pools[current_pool].pool.get(), scope + 1 );
+    }
+
+    uint32_t GpuProfiler::begin_transfer_scope( vk::CommandBuffer command_buffer ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        if( !transfer_pool )
+            return invalid_scope;
+
+        if( free_transfer_scopes.empty() ) {
+            ++dropped_scopes;
+            return invalid_scope;
+        }
+
+        const uint32_t scope { free_transfer_scopes.back() };
+        free_transfer_scopes.pop_back();
+        command_buffer.writeTimestamp( vk::PipelineStageFlagBits::eTopOfPipe, transfer_pool.get(), scope * 2 );
+
+        return scope;
+    }
+
+    void GpuProfiler::end_transfer_scope( vk::CommandBuffer command_buffer, uint32_t scope ) {
+        if( scope == invalid_scope )
+            return;
+
+        command_buffer.writeTimestamp( vk::PipelineStageFlagBits::eBottomOfPipe, transfer_pool.get(), scope * 2 + 1 );
+    }
+
+    void GpuProfiler::resolve_transfer_scope( uint32_t scope, std::string name ) {
+        if( scope == invalid_scope )
+            return;
+
+        std::lock_guard<std::mutex> lock( mutex );
+        std::array<uint64_t, 4> results {};
+        [[maybe_unused]] vk::Result res = device.getQueryPoolResults( transfer_pool.get(), scope * 2, 2, sizeof( results ), results.data(), sizeof( uint64_t ) * 2, vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability );
+
+        if( results[1] != 0 && results[3] != 0 ) {
+            const Calibration& calibration { shared_family ? graphics_calibration : transfer_calibration };
+            const double start { to_microseconds( results[0], transfer_mask, calibration ) };
+            record( Event { std::move( name ), Track::eTransfer, start, to_microseconds( results[2], transfer_mask, calibration ) - start } );
+        }
+
+        device.resetQueryPool( transfer_pool.get(), scope * 2, 2 );
+        free_transfer_scopes.push_back( scope );
+    }
+
+    void GpuProfiler::add_cpu_scope( std::string name, const Timer& timer ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        record( Event { std::move( name ), Track::eCpu, to_microseconds( timer.get_start_time_point() ), timer.get_elapsed_time() * 1000.0 } );
+    }
+
+    void GpuProfiler::begin_capture() {
+        std::lock_guard<std::mutex> lock( mutex );
+        calibrate();
+        capture.clear();
+        capturing = true;
+    }
+
+    void GpuProfiler::end_capture( const std::filesystem::path& file_path ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        capturing = false;
+
+        std::ofstream file( file_path, std::ios::trunc );
+        if( !file.is_open() )
+            throw std::runtime_error( "Failed to open " + file_path.string() );
+
+        static constexpr std::array<const char*, 3> track_names { "CPU", "GPU graphics", "GPU transfer" };
+
+        file << std::fixed << std::setprecision( 3 );
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        for( uint32_t i = 0; i < track_names.size(); ++i ) {
+            file << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":" << i << ",\"args\":{\"name\":\"" << track_names[i] << "\"}},\n";
+        }
+        for( size_t i = 0; i < capture.size(); ++i ) {
+            const Event& e = capture[i];
+            file << "{\"ph\":\"X\",\"name\":";
+            write_json_string( file, e.name );
+            file << ",\"pid\":0,\"tid\":" << static_cast<uint32_t>( e.track ) << ",\"ts\":" << e.start << ",\"dur\":" << e.duration << "}";
+            file << ( i + 1 < capture.size() ? ",\n" : "\n" );
+        }
+        file << "]}\n";
+
+        capture.clear();
+    }
+
+    std::vector<GpuProfiler::Event> GpuProfiler::get_last_frame_events() {
+        std::lock_guard<std::mutex> lock( mutex );
+        return last_frame;
+    }
+
+    void GpuProfiler::calibrate() {
+        if( !is_enabled() )
+            return;
+
+        calibrate( graphics_calibration, false );
+        // Transfer families can't reset queries in a command buffer, which is why transfer
+        // profiling needs hostQueryReset in the first place.
+        if( transfer_calibration.command_pool )
+            calibrate( transfer_calibration, true );
+    }
+
+    void GpuProfiler::calibrate( Calibration& calibration, bool reset_on_host ) {
+        // Write one timestamp and take the middle of the CPU time around the submission as the
+        // moment it was written. The timebase is only shared by queues of the same family.
+        vk::UniqueQueryPool pool { device.createQueryPoolUnique( vk::QueryPoolCreateInfo { {}, vk::QueryType::eTimestamp, 1 } ) };
+        vk::UniqueCommandBuffer cmd { std::move( device.allocateCommandBuffersUnique( vk::CommandBufferAllocateInfo { calibration.command_pool.get(), vk::CommandBufferLevel::ePrimary, 1 } ).front() ) };
+        vk::UniqueFence fence { device.createFenceUnique( {} ) };
+
+        if( reset_on_host )
+            device.resetQueryPool( pool.get(), 0, 1 );
+
+        cmd->begin( vk::CommandBufferBeginInfo { vk::CommandBufferUsageFlagBits::eOneTimeSubmit } );
+        if( !reset_on_host )
+            cmd->resetQueryPool( pool.get(), 0, 1 );
+        cmd->writeTimestamp( vk::PipelineStageFlagBits::eBottomOfPipe, pool.get(), 0 );
+        cmd->end();
+
+        vk::SubmitInfo si { 0, nullptr, nullptr, 1, &cmd.get() };
+        const auto before { std::chrono::steady_clock::now() };
+        calibration.queue.submit( si, fence.get() );
+        [[maybe_unused]] auto res = device.waitForFences( fence.get(), true, UINT64_MAX );
+        const auto after { std::chrono::steady_clock::now() };
+
+        uint64_t ticks { 0 };
+        res = device.getQueryPoolResults( pool.get(), 0, 1, sizeof( ticks ), &ticks, sizeof( ticks ), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait );
+
+        calibration.ticks = ticks;
+        calibration.time = before + ( after - before ) / 2;
+    }
+
+    double GpuProfiler::to_microseconds( uint64_t ticks, uint64_t mask, const Calibration& calibration ) const noexcept {
+        // Timestamps with fewer than 64 valid bits wrap, so take the shortest distance to the calibration.
+        int64_t delta { static_cast<int64_t>( ( ticks - calibration.ticks ) & mask ) };
+        if( mask != UINT64_MAX && static_cast<uint64_t>( delta ) > mask / 2 )
+            delta -= static_cast<int64_t>( mask ) + 1;
+
+        return to_microseconds( calibration.time ) + static_cast<double>( delta ) * timestamp_period / 1000.0;
+    }
+
+    double GpuProfiler::to_microseconds( std::chrono::steady_clock::time_point time ) const noexcept {
+        return std::chrono::duration<double, std::micro>( time - origin ).count();
+    }
+
+    void GpuProfiler::record( Event event ) {
+        if( capturing )
+            capture.push_back( std::move( event ) );
+    }
+}
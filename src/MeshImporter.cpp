@@ -0,0 +1,791 @@
+#include "MeshImporter.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+
+namespace stlr {
+    namespace {
+        /// <summary>
+        /// The subset of JSON a glTF file needs: objects, arrays, strings, numbers, booleans and null.
+        /// </summary>
+        struct Json {
+            enum class Type {
+                eNull,
+                eBool,
+                eNumber,
+                eString,
+                eArray,
+                eObject
+            };
+
+            Type type = Type::eNull;
+            bool boolean = false;
+            double number = 0.0;
+            std::string string;
+            std::vector<Json> array;
+            std::map<std::string, Json, std::less<>> object;
+
+            const Json* find( std::string_view key ) const {
+                if( type != Type::eObject )
+                    return nullptr;
+                auto it = object.find( key );
+                return it != object.end() ? &it->second : nullptr;
+            }
+
+            const Json& at( std::string_view key ) const {
+                const Json* j { find( key ) };
+                if( j == nullptr )
+                    throw std::runtime_error( "The glTF is missing " + std::string( key ) + "." );
+                return *j;
+            }
+
+            const Json& at( size_t index ) const {
+                if( type != Type::eArray || index >= array.size() )
+                    throw std::runtime_error( "A glTF index is out of range." );
+                return array[index];
+            }
+
+            uint64_t get_uint( std::string_view key, uint64_t fallback ) const {
+                const Json* j { find( key ) };
+                return j != nullptr && j->type == Type::eNumber ? static_cast<uint64_t>( j->number ) : fallback;
+            }
+        };
+
+        class JsonParser {
+            std::string_view text;
+            size_t p;
+
+        public:
+            explicit JsonParser( std::string_view text ) : text( text ), p( 0 ) {}
+
+            Json parse() {
+                Json j { value() };
+                skip_space();
+                if( p != text.size() )
+                    fail();
+                return j;
+            }
+
+        private:
+            [[noreturn]] void fail() const {
+                throw std::runtime_error( "The glTF's JSON is malformed at byte " + std::to_string( p ) + "." );
+            }
+
+            void skip_space() noexcept {
+                while( p < text.size() && std::isspace( static_cast<unsigned char>( text[p] ) ) ) {
+                    ++p;
+                }
+            }
+
+            bool consume( char c ) {
+                skip_space();
+                if( p < text.size() && text[p] == c ) {
+                    ++p;
+                    return true;
+                }
+                return false;
+            }
+
+            void expect( char c ) {
+                if( !consume( c ) )
+                    fail();
+            }
+
+            bool consume_word( std::string_view word ) {
+                if( text.substr( p, word.size() ) != word )
+                    return false;
+                p += word.size();
+                return true;
+            }
+
+            Json value() {
+                skip_space();
+                if( p >= text.size() )
+                    fail();
+
+                Json j;
+                const char c { text[p] };
+                if( c == '{' ) {
+                    ++p;
+                    j.type = Json::Type::eObject;
+                    if( consume( '}' ) )
+                        return j;
+                    do {
+                        skip_space();
+                        std::string key { string() };
+                        expect( ':' );
+                        j.object.insert_or_assign( std::move( key ), value() );
+                    } while( consume( ',' ) );
+                    expect( '}' );
+                }
+                else if( c == '[' ) {
+                    ++p;
+                    j.type = Json::Type::eArray;
+                    if( consume( ']' ) )
+                        return j;
+                    do {
+                        j.array.push_back( value() );
+                    } while( consume( ',' ) );
+                    expect( ']' );
+                }
+                else if( c == '"' ) {
+                    j.type = Json::Type::eString;
+                    j.string = string();
+                }
+                else if( consume_word( "true" ) || consume_word( "false" ) ) {
+                    j.type = Json::Type::eBool;
+                    j.boolean = text[p - 1] == 'e' && text[p - 2] == 'u';
+                }
+                else if( consume_word( "null" ) ) {
+                    j.type = Json::Type::eNull;
+                }
+                else {
+                    j.type = Json::Type::eNumber;
+                    j.number = number();
+                }
+                return j;
+            }
+
+            double number() {
+                const size_t start { p };
+                while( p < text.size() && ( std::isdigit( static_cast<unsigned char>( text[p] ) ) || text[p] == '-' || text[p] == '+' || text[p] == '.' || text[p] == 'e' || text[p] == 'E' ) ) {
+                    ++p;
+                }
+                if( p == start )
+                    fail();
+                // strtod is locale dependent, a stream imbued with the classic locale isn't.
+                std::istringstream s( std::string( text.substr( start, p - start ) ) );
+                s.imbue( std::locale::classic() );
+                double d;
+                if( !( s >> d ) )
+                    fail();
+                return d;
+            }
+
+            std::string string() {
+                if( p >= text.size() || text[p] != '"' )
+                    fail();
+                ++p;
+
+                std::string s;
+                while( p < text.size() && text[p] != '"' ) {
+                    char c { text[p++] };
+                    if( c != '\\' ) {
+                        s.push_back( c );
+                        continue;
+                    }
+                    if( p >= text.size() )
+                        fail();
+                    c = text[p++];
+                    switch( c ) {
+                    case 'b': s.push_back( '\b' ); break;
+                    case 'f': s.push_back( '\f' ); break;
+                    case 'n': s.push_back( '\n' ); break;
+                    case 'r': s.push_back( '\r' ); break;
+                    case 't': s.push_back( '\t' ); break;
+                    case 'u': append_utf8( s ); break;
+                    default: s.push_back( c ); break;
+                    }
+                }
+                if( p >= text.size() )
+                    fail();
+                ++p;
+                return s;
+            }
+
+            uint32_t hex4() {
+                if( p + 4 > text.size() )
+                    fail();
+                uint32_t v { 0 };
+                for( uint32_t i = 0; i < 4; ++i ) {
+                    const char c { text[p++] };
+                    v <<= 4;
+                    if( c >= '0' && c <= '9' )
+                        v |= c - '0';
+                    else if( c >= 'a' && c <= 'f' )
+                        v |= c - 'a' + 10;
+                    else if( c >= 'A' && c <= 'F' )
+                        v |= c - 'A' + 10;
+                    else
+                        fail();
+                }
+                return v;
+            }
+
+            void append_utf8( std::string& s ) {
+                uint32_t cp { hex4() };
+                // A surrogate pair encodes a code point above the basic plane.
+                if( cp >= 0xd800 && cp < 0xdc00 && text.substr( p, 2 ) == "\\u" ) {
+                    p += 2;
+                    cp = 0x10000 + ( ( cp - 0xd800 ) << 10 ) + ( hex4() - 0xdc00 );
+                }
+                if( cp < 0x80 ) {
+                    s.push_back( static_cast<char>( cp ) );
+                }
+                else if( cp < 0x800 ) {
+                    s.push_back( static_cast<char>( 0xc0 | ( cp >> 6 ) ) );
+                    s.push_back( static_cast<char>( 0x80 | ( cp & 0x3f ) ) );
+                }
+                else if( cp < 0x10000 ) {
+                    s.push_back( static_cast<char>( 0xe0 | ( cp >> 12 ) ) );
+                    s.push_back( static_cast<char>( 0x80 | ( ( cp >> 6 ) & 0x3f ) ) );
+                    s.push_back( static_cast<char>( 0x80 | ( cp & 0x3f ) ) );
+                }
+                else {
+                    s.push_back( static_cast<char>( 0xf0 | ( cp >> 18 ) ) );
+                    s.push_back( static_cast<char>( 0x80 | ( ( cp >> 12 ) & 0x3f ) ) );
+                    s.push_back( static_cast<char>( 0x80 | ( ( cp >> 6 ) & 0x3f ) ) );
+                    s.push_back( static_cast<char>( 0x80 | ( cp & 0x3f ) ) );
+                }
+            }
+        };
+
+        std::vector<char> read_file( const std::filesystem::path& file ) {
+            std::ifstream f( file, std::ios::binary | std::ios::ate );
+            if( !f.is_open() )
+                throw std::runtime_error( "Failed to open " + file.string() + "." );
+            std::vector<char> data( static_cast<size_t>( f.tellg() ) );
+            f.seekg( 0 );
+            f.read( data.data(), static_cast<std::streamsize>( data.size() ) );
+            return data;
+        }
+
+        std::vector<char> decode_base64( std::string_view text ) {
+            std::vector<char> out;
+            out.reserve( text.size() / 4 * 3 );
+            uint32_t bits { 0 };
+            uint32_t bit_count { 0 };
+            for( const char c : text ) {
+                uint32_t v;
+                if( c >= 'A' && c <= 'Z' )
+                    v = c - 'A';
+                else if( c >= 'a' && c <= 'z' )
+                    v = c - 'a' + 26;
+                else if( c >= '0' && c <= '9' )
+                    v = c - '0' + 52;
+                else if( c == '+' )
+                    v = 62;
+                else if( c == '/' )
+                    v = 63;
+                else
+                    break;
+
+                bits = ( bits << 6 ) | v;
+                bit_count += 6;
+                if( bit_count >= 8 ) {
+                    bit_count -= 8;
+                    out.push_back( static_cast<char>( ( bits >> bit_count ) & 0xff ) );
+                }
+            }
+            return out;
+        }
+
+        std::string decode_uri( std::string_view uri ) {
+            std::string s;
+            for( size_t i = 0; i < uri.size(); ++i ) {
+                if( uri[i] == '%' && i + 2 < uri.size() ) {
+                    s.push_back( static_cast<char>( std::stoi( std::string( uri.substr( i + 1, 2 ) ), nullptr, 16 ) ) );
+                    i += 2;
+                }
+                else {
+                    s.push_back( uri[i] );
+                }
+            }
+            return s;
+        }
+
+        /// <summary>
+        /// Reads the elements of a glTF accessor as floats, applying its normalization.
+        /// </summary>
+        class Accessor {
+            const char* data;
+            size_t size;
+            size_t stride;
+            uint32_t component_type;
+            uint32_t component_size;
+            bool normalized;
+
+        public:
+            uint32_t count;
+            uint32_t component_count;
+
+            Accessor( const Json& gltf, const std::vector<std::vector<char>>& buffers, uint64_t index ) {
+                const Json& a { gltf.at( "accessors" ).at( index ) };
+                if( a.find( "sparse" ) != nullptr )
+                    throw std::runtime_error( "Sparse accessors aren't supported." );
+
+                static const std::map<std::string, uint32_t, std::less<>> component_counts {
+                    { "SCALAR", 1 }, { "VEC2", 2 }, { "VEC3", 3 }, { "VEC4", 4 }, { "MAT2", 4 }, { "MAT3", 9 }, { "MAT4", 16 }
+                };
+                auto type = component_counts.find( a.at( "type" ).string );
+                if( type == component_counts.end() )
+                    throw std::runtime_error( "An accessor has an unknown type." );
+                component_count = type->second;
+                component_type = static_cast<uint32_t>( a.at( "componentType" ).number );
+                switch( component_type ) {
+                case 5120: case 5121: component_size = 1; break;
+                case 5122: case 5123: component_size = 2; break;
+                case 5125: case 5126: component_size = 4; break;
+                default: throw std::runtime_error( "An accessor has an unknown component type." );
+                }
+                count = static_cast<uint32_t>( a.at( "count" ).number );
+                const Json* n { a.find( "normalized" ) };
+                normalized = n != nullptr && n->boolean;
+
+                const Json& view { gltf.at( "bufferViews" ).at( a.at( "bufferView" ).number ) };
+                const std::vector<char>& buffer { buffers.at( static_cast<size_t>( view.at( "buffer" ).number ) ) };
+                const uint64_t offset { view.get_uint( "byteOffset", 0 ) + a.get_uint( "byteOffset", 0 ) };
+                stride = view.get_uint( "byteStride", component_size * component_count );
+                const uint64_t length { view.get_uint( "byteLength", 0 ) };
+                const uint64_t needed { count == 0 ? 0 : ( count - 1 ) * stride + component_size * component_count };
+                if( view.get_uint( "byteOffset", 0 ) + length > buffer.size() || offset + needed > view.get_uint( "byteOffset", 0 ) + length )
+                    throw std::runtime_error( "An accessor reads past the end of its buffer." );
+                data = buffer.data() + offset;
+                size = static_cast<size_t>( needed );
+            }
+
+            float get( uint32_t element, uint32_t component ) const {
+                const char* c { data + element * stride + component * component_size };
+                switch( component_type ) {
+                case 5126: { float v; std::memcpy( &v, c, 4 ); return v; }
+                case 5125: { uint32_t v; std::memcpy( &v, c, 4 ); return static_cast<float>( v ); }
+                case 5123: { uint16_t v; std::memcpy( &v, c, 2 ); return normalized ? v / 65535.0f : v; }
+                case 5122: { int16_t v; std::memcpy( &v, c, 2 ); return normalized ? std::max( v / 32767.0f, -1.0f ) : v; }
+                case 5121: { uint8_t v; std::memcpy( &v, c, 1 ); return normalized ? v / 255.0f : v; }
+                default: { int8_t v; std::memcpy( &v, c, 1 ); return normalized ? std::max( v / 127.0f, -1.0f ) : v; }
+                }
+            }
+
+            uint32_t get_index( uint32_t element ) const {
+                const char* c { data + element * stride };
+                switch( component_type ) {
+                case 5125: { uint32_t v; std::memcpy( &v, c, 4 ); return v; }
+                case 5123: { uint16_t v; std::memcpy( &v, c, 2 ); return v; }
+                case 5121: { uint8_t v; std::memcpy( &v, c, 1 ); return v; }
+                default: throw std::runtime_error( "Indices must be unsigned integers." );
+                }
+            }
+        };
+
+        constexpr uint32_t cache_size = 32;
+
+        // Forsyth's scores: the last triangle's vertices a flat 0.75 so it doesn't matter which of
+        // them comes next, older cache entries less and less, and vertices with few triangles left
+        // a boost so they're finished off instead of leaving stragglers.
+        float get_vertex_score( int32_t cache_position, uint32_t remaining ) noexcept {
+            if( remaining == 0 )
+                return -1.0f;
+
+            float score { 0.0f };
+            if( cache_position >= 0 ) {
+                if( cache_position < 3 )
+                    score = 0.75f;
+                else
+                    score = std::pow( 1.0f - static_cast<float>( cache_position - 3 ) / ( cache_size - 3 ), 1.5f );
+            }
+            return score + 2.0f / std::sqrt( static_cast<float>( remaining ) );
+        }
+    }
+
+    namespace mesh_import {
+        std::vector<MeshData> load( const std::filesystem::path& file ) {
+            std::string extension { file.extension().string() };
+            std::transform( extension.begin(), extension.end(), extension.begin(), []( unsigned char c ) { return static_cast<char>( std::tolower( c ) ); } );
+
+            std::vector<MeshData> meshes;
+            if( extension == ".obj" )
+                meshes.push_back( load_obj( file ) );
+            else if( extension == ".gltf" || extension == ".glb" )
+                meshes = load_gltf( file );
+            else
+                throw std::runtime_error( "Meshes can only be imported from .obj, .gltf and .glb files." );
+
+            for( auto& m : meshes ) {
+                optimize( m );
+            }
+            return meshes;
+        }
+
+        MeshData load_obj( const std::filesystem::path& file ) {
+            std::ifstream f( file );
+            if( !f.is_open() )
+                throw std::runtime_error( "Failed to open " + file.string() + "." );
+
+            std::vector<std::array<float, 3>> positions;
+            std::vector<std::array<float, 2>> uvs;
+            std::vector<std::array<float, 3>> normals;
+            std::unordered_map<std::string, uint32_t> corners;
+            MeshData mesh;
+            mesh.name = file.stem().string();
+
+            // OBJ indices start at 1 and negative ones count back from the latest element.
+            auto resolve = []( long i, size_t count ) -> long {
+                return i < 0 ? static_cast<long>( count ) + i : i - 1;
+            };
+
+            // Corners that share a position, UV and normal become one vertex.
+            auto add_corner = [&]( const std::string& corner ) -> uint32_t {
+                auto it = corners.find( corner );
+                if( it != corners.end() )
+                    return it->second;
+
+                long p { 0 };
+                long t { 0 };
+                long n { 0 };
+                const size_t first_slash { corner.find( '/' ) };
+                p = std::stol( corner.substr( 0, first_slash ) );
+                if( first_slash != std::string::npos ) {
+                    const size_t second_slash { corner.find( '/', first_slash + 1 ) };
+                    const std::string uv { corner.substr( first_slash + 1, second_slash - first_slash - 1 ) };
+                    if( !uv.empty() )
+                        t = std::stol( uv );
+                    if( second_slash != std::string::npos )
+                        n = std::stol( corner.substr( second_slash + 1 ) );
+                }
+
+                MeshVertex v {};
+                p = resolve( p, positions.size() );
+                if( p < 0 || static_cast<size_t>( p ) >= positions.size() )
+                    throw std::runtime_error( "A face refers to a missing position." );
+                v.position = positions[p];
+                if( t != 0 ) {
+                    t = resolve( t, uvs.size() );
+                    if( t < 0 || static_cast<size_t>( t ) >= uvs.size() )
+                        throw std::runtime_error( "A face refers to a missing UV." );
+                    // OBJ's V goes up from the bottom of the image, Vulkan's down from the top.
+                    v.uv = { uvs[t][0], 1.0f - uvs[t][1] };
+                }
+                if( n != 0 ) {
+                    n = resolve( n, normals.size() );
+                    if( n < 0 || static_cast<size_t>( n ) >= normals.size() )
+                        throw std::runtime_error( "A face refers to a missing normal." );
+                    v.normal = normals[n];
+                }
+
+                const uint32_t index { static_cast<uint32_t>( mesh.vertices.size() ) };
+                mesh.vertices.push_back( v );
+                corners.emplace( corner, index );
+                return index;
+            };
+
+            std::string line;
+            while( std::getline( f, line ) ) {
+                std::istringstream l( line );
+                std::string type;
+                l >> type;
+                if( type == "v" ) {
+                    std::array<float, 3> p {};
+                    l >> p[0] >> p[1] >> p[2];
+                    positions.push_back( p );
+                }
+                else if( type == "vt" ) {
+                    std::array<float, 2> t {};
+                    l >> t[0] >> t[1];
+                    uvs.push_back( t );
+                }
+                else if( type == "vn" ) {
+                    std::array<float, 3> n {};
+                    l >> n[0] >> n[1] >> n[2];
+                    normals.push_back( n );
+                }
+                else if( type == "f" ) {
+                    std::vector<uint32_t> face;
+                    std::string corner;
+                    while( l >> corner ) {
+                        face.push_back( add_corner( corner ) );
+                    }
+                    for( size_t i = 2; i < face.size(); ++i ) {
+                        mesh.indices.insert( mesh.indices.end(), { face[0], face[i - 1], face[i] } );
+                    }
+                }
+            }
+
+            if( mesh.indices.empty() )
+                throw std::runtime_error( "The mesh has no faces." );
+            return mesh;
+        }
+
+        std::vector<MeshData> load_gltf( const std::filesystem::path& file ) {
+            const std::vector<char> contents { read_file( file ) };
+
+            // A .glb is a header and then a JSON chunk, optionally followed by a binary chunk.
+            std::string_view json_text;
+            std::vector<char> glb_binary;
+            constexpr uint32_t glb_magic { 0x46546c67 };
+            uint32_t magic { 0 };
+            if( contents.size() >= 4 )
+                std::memcpy( &magic, contents.data(), 4 );
+            if( magic == glb_magic ) {
+                size_t offset { 12 };
+                while( offset + 8 <= contents.size() ) {
+                    uint32_t length;
+                    uint32_t type;
+                    std::memcpy( &length, contents.data() + offset, 4 );
+                    std::memcpy( &type, contents.data() + offset + 4, 4 );
+                    offset += 8;
+                    if( offset + length > contents.size() )
+                        throw std::runtime_error( "The .glb is truncated." );
+                    if( type == 0x4e4f534a )
+                        json_text = std::string_view( contents.data() + offset, length );
+                    else if( type == 0x004e4942 )
+                        glb_binary.assign( contents.data() + offset, contents.data() + offset + length );
+                    offset += ( length + 3 ) & ~3u;
+                }
+                if( json_text.empty() )
+                    throw std::runtime_error( "The .glb has no JSON chunk." );
+            }
+            else {
+                json_text = std::string_view( contents.data(), contents.size() );
+            }
+
+            const Json gltf { JsonParser( json_text ).parse() };
+
+            std::vector<std::vector<char>> buffers;
+            if( const Json* b = gltf.find( "buffers" ) ) {
+                for( const Json& buffer : b->array ) {
+                    const Json* uri { buffer.find( "uri" ) };
+                    if( uri == nullptr ) {
+                        buffers.push_back( glb_binary );
+                    }
+                    else if( uri->string.compare( 0, 5, "data:" ) == 0 ) {
+                        const size_t comma { uri->string.find( ";base64," ) };
+                        if( comma == std::string::npos )
+                            throw std::runtime_error( "Only base64 data URIs are supported." );
+                        buffers.push_back( decode_base64( std::string_view( uri->string ).substr( comma + 8 ) ) );
+                    }
+                    else {
+                        buffers.push_back( read_file( file.parent_path() / std::filesystem::u8path( decode_uri( uri->string ) ) ) );
+                    }
+                }
+            }
+
+            std::vector<MeshData> meshes;
+            const Json* gltf_meshes { gltf.find( "meshes" ) };
+            if( gltf_meshes == nullptr || gltf_meshes->array.empty() )
+                throw std::runtime_error( "The glTF has no meshes." );
+
+            for( const Json& m : gltf_meshes->array ) {
+                MeshData mesh;
+                if( const Json* name = m.find( "name" ) )
+                    mesh.name = name->string;
+
+                for( const Json& primitive : m.at( "primitives" ).array ) {
+                    // Points, lines and strips have no place in a triangle list.
+                    if( primitive.get_uint( "mode", 4 ) != 4 )
+                        continue;
+
+                    const Json& attributes { primitive.at( "attributes" ) };
+                    const Accessor positions( gltf, buffers, static_cast<uint64_t>( attributes.at( "POSITION" ).number ) );
+                    std::unique_ptr<Accessor> uvs;
+                    std::unique_ptr<Accessor> normals;
+                    if( const Json* a = attributes.find( "TEXCOORD_0" ) )
+                        uvs = std::make_unique<Accessor>( gltf, buffers, static_cast<uint64_t>( a->number ) );
+                    if( const Json* a = attributes.find( "NORMAL" ) )
+                        normals = std::make_unique<Accessor>( gltf, buffers, static_cast<uint64_t>( a->number ) );
+
+                    const uint32_t base { static_cast<uint32_t>( mesh.vertices.size() ) };
+                    for( uint32_t i = 0; i < positions.count; ++i ) {
+                        MeshVertex v {};
+                        v.position = { positions.get( i, 0 ), positions.get( i, 1 ), positions.get( i, 2 ) };
+                        // glTF's UV origin is the top left, like Vulkan's.
+                        if( uvs && i < uvs->count )
+                            v.uv = { uvs->get( i, 0 ), uvs->get( i, 1 ) };
+                        if( normals && i < normals->count )
+                            v.normal = { normals->get( i, 0 ), normals->get( i, 1 ), normals->get( i, 2 ) };
+                        mesh.vertices.push_back( v );
+                    }
+
+                    if( const Json* i = primitive.find( "indices" ) ) {
+                        const Accessor indices( gltf, buffers, static_cast<uint64_t>( i->number ) );
+                        for( uint32_t j = 0; j + 2 < indices.count; j += 3 ) {
+                            for( uint32_t k = 0; k < 3; ++k ) {
+                                const uint32_t index { indices.get_index( j + k ) };
+                                if( index >= positions.count )
+                                    throw std::runtime_error( "An index refers to a missing vertex." );
+                                mesh.indices.push_back( base + index );
+                            }
+                        }
+                    }
+                    else {
+                        for( uint32_t j = 0; j + 2 < positions.count; j += 3 ) {
+                            mesh.indices.insert( mesh.indices.end(), { base + j, base + j + 1, base + j + 2 } );
+                        }
+                    }
+                }
+
+                if( !mesh.indices.empty() )
+                    meshes.push_back( std::move( mesh ) );
+            }
+
+            if( meshes.empty() )
+                throw std::runtime_error( "The glTF has no triangles." );
+            return meshes;
+        }
+
+        void deduplicate( MeshData& mesh ) {
+            // Keyed by the vertices' bytes, which stay put while the unique ones are copied out.
+            std::unordered_map<std::string_view, uint32_t> unique;
+            unique.reserve( mesh.vertices.size() );
+            std::vector<uint32_t> remap( mesh.vertices.size() );
+            std::vector<MeshVertex> vertices;
+            vertices.reserve( mesh.vertices.size() );
+
+            for( size_t i = 0; i < mesh.vertices.size(); ++i ) {
+                const std::string_view key( reinterpret_cast<const char*>( &mesh.vertices[i] ), sizeof( MeshVertex ) );
+                auto [it, inserted] = unique.emplace( key, static_cast<uint32_t>( vertices.size() ) );
+                if( inserted )
+                    vertices.push_back( mesh.vertices[i] );
+                remap[i] = it->second;
+            }
+
+            for( auto& index : mesh.indices ) {
+                index = remap[index];
+            }
+            mesh.vertices = std::move( vertices );
+        }
+
+        void optimize_vertex_cache( std::vector<uint32_t>& indices, uint32_t vertex_count ) {
+            const size_t triangle_count { indices.size() / 3 };
+            if( triangle_count == 0 )
+                return;
+
+            // Each vertex's triangles, with the ones not yet emitted kept at the front of its list.
+            std::vector<uint32_t> remaining( vertex_count, 0 );
+            for( size_t i = 0; i < triangle_count * 3; ++i ) {
+                ++remaining[indices[i]];
+            }
+            std::vector<uint32_t> first( vertex_count + 1, 0 );
+            for( uint32_t v = 0; v < vertex_count; ++v ) {
+                first[v + 1] = first[v] + remaining[v];
+            }
+            std::vector<uint32_t> adjacency( triangle_count * 3 );
+            {
+                std::vector<uint32_t> cursor( first.begin(), first.end() - 1 );
+                for( size_t i = 0; i < triangle_count * 3; ++i ) {
+                    adjacency[cursor[indices[i]]++] = static_cast<uint32_t>( i / 3 );
+                }
+            }
+
+            std::vector<int32_t> cache_position( vertex_count, -1 );
+            std::vector<float> vertex_score( vertex_count );
+            for( uint32_t v = 0; v < vertex_count; ++v ) {
+                vertex_score[v] = get_vertex_score( -1, remaining[v] );
+            }
+
+            std::vector<float> triangle_score( triangle_count );
+            std::vector<uint8_t> emitted( triangle_count, 0 );
+            size_t best { 0 };
+            for( size_t t = 0; t < triangle_count; ++t ) {
+                triangle_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+                if( triangle_score[t] > triangle_score[best] )
+                    best = t;
+            }
+
+            std::vector<uint32_t> output;
+            output.reserve( triangle_count * 3 );
+            std::vector<uint32_t> cache;
+            std::vector<uint32_t> next_cache;
+            cache.reserve( cache_size + 3 );
+            next_cache.reserve( cache_size + 3 );
+            size_t scan { 0 };
+
+            for( size_t n = 0; n < triangle_count; ++n ) {
+                // Nothing in the cache has triangles left; start again from the first one that's left.
+                if( best == SIZE_MAX ) {
+                    while( emitted[scan] ) {
+                        ++scan;
+                    }
+                    best = scan;
+                }
+
+                const size_t t { best };
+                emitted[t] = 1;
+                const std::array<uint32_t, 3> tri { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] };
+                output.insert( output.end(), tri.begin(), tri.end() );
+
+                for( const uint32_t v : tri ) {
+                    uint32_t* list { adjacency.data() + first[v] };
+                    uint32_t* end { list + remaining[v] };
+                    std::iter_swap( std::find( list, end, static_cast<uint32_t>( t ) ), end - 1 );
+                    --remaining[v];
+                }
+
+                // The triangle's vertices move to the front of the cache and push the rest back.
+                next_cache.assign( tri.begin(), tri.end() );
+                for( const uint32_t v : cache ) {
+                    if( v != tri[0] && v != tri[1] && v != tri[2] )
+                        next_cache.push_back( v );
+                }
+                for( size_t i = 0; i < next_cache.size(); ++i ) {
+                    const uint32_t v { next_cache[i] };
+                    cache_position[v] = i < cache_size ? static_cast<int32_t>( i ) : -1;
+                    vertex_score[v] = get_vertex_score( cache_position[v], remaining[v] );
+                }
+
+                // Only triangles touching the cache changed score, so the next one is among them.
+                best = SIZE_MAX;
+                float best_score { -1.0f };
+                for( const uint32_t v : next_cache ) {
+                    for( uint32_t i = first[v]; i < first[v] + remaining[v]; ++i ) {
+                        const uint32_t a { adjacency[i] };
+                        const float score { vertex_score[indices[a * 3]] + vertex_score[indices[a * 3 + 1]] + vertex_score[indices[a * 3 + 2]] };
+                        triangle_score[a] = score;
+                        if( score > best_score ) {
+                            best_score = score;
+                            best = a;
+                        }
+                    }
+                }
+
+                next_cache.resize( std::min<size_t>( next_cache.size(), cache_size ) );
+                std::swap( cache, next_cache );
+            }
+
+            std::copy( output.begin(), output.end(), indices.begin() );
+        }
+
+        void optimize_vertex_fetch( MeshData& mesh ) {
+            std::vector<uint32_t> remap( mesh.vertices.size(), UINT32_MAX );
+            std::vector<MeshVertex> vertices;
+            vertices.reserve( mesh.vertices.size() );
+
+            for( auto& index : mesh.indices ) {
+                if( remap[index] == UINT32_MAX ) {
+                    remap[index] = static_cast<uint32_t>( vertices.size() );
+                    vertices.push_back( mesh.vertices[index] );
+                }
+                index = remap[index];
+            }
+            mesh.vertices = std::move( vertices );
+        }
+
+        void optimize( MeshData& mesh ) {
+            deduplicate( mesh );
+            optimize_vertex_cache( mesh.indices, static_cast<uint32_t>( mesh.vertices.size() ) );
+            optimize_vertex_fetch( mesh );
+        }
+
+        float get_acmr( const std::vector<uint32_t>& indices, uint32_t vertex_count, uint32_t cache_size ) {
+            if( indices.size() < 3 )
+                return 0.0f;
+
+            // When each vertex entered the cache; it's still there if fewer than cache_size misses have happened since.
+            std::vector<uint64_t> entered( vertex_count, 0 );
+            uint64_t misses { 0 };
+            for( const uint32_t index : indices ) {
+                if( entered[index] == 0 || misses - entered[index] >= cache_size ) {
+                    ++misses;
+                    entered[index] = misses;
+                }
+            }
+            return static_cast<float>( misses ) / static_cast<float>( indices.size() / 3 );
+        }
+    }
+}
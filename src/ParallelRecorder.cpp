@@ -0,0 +1,163 @@
+#include "ParallelRecorder.hpp"
+#include <algorithm>
+
+namespace stlr {
+    ParallelRecorder::ParallelRecorder( vk::Device device, uint32_t queue_family, uint32_t frame_count, uint32_t thread_count )
+        : device( device )
+        , current_frame( 0 )
+        , job_generation( 0 )
+        , stopping( false )
+        , job_function( nullptr )
+        , job_task_count( 0 )
+        , job_range_count( 0 )
+        , next_range( 0 )
+        , busy_workers( 0 ) {
+        if( thread_count == 0 )
+            thread_count = std::max( std::thread::hardware_concurrency(), 1u );
+
+        thread_pools.resize( thread_count );
+        for( auto& t : thread_pools ) {
+            t.frames.resize( frame_count );
+            for( auto& f : t.frames ) {
+                // Transient: the buffers are re-recorded every time the frame comes around.
+                f.pool = device.createCommandPoolUnique( vk::CommandPoolCreateInfo { vk::CommandPoolCreateFlagBits::eTransient, queue_family } );
+            }
+        }
+
+        workers.reserve( thread_count - 1 );
+        for( uint32_t i = 1; i < thread_count; ++i ) {
+            workers.emplace_back( &ParallelRecorder::worker_loop, this, i );
+        }
+    }
+
+    ParallelRecorder::~ParallelRecorder() {
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            stopping = true;
+        }
+        job_ready.notify_all();
+
+        for( auto& w : workers ) {
+            w.join();
+        }
+    }
+
+    void ParallelRecorder::begin_frame( uint32_t frame_index ) {
+        current_frame = frame_index;
+
+        for( auto& t : thread_pools ) {
+            FramePool& f = t.frames[current_frame];
+            device.resetCommandPool( f.pool.get(), {} );
+            f.used = 0;
+        }
+    }
+
+    std::vector<vk::CommandBuffer> ParallelRecorder::record( const vk::CommandBufferInheritanceInfo& inheritance, uint32_t task_count, const RecordFunction& record_function, uint32_t min_tasks_per_buffer ) {
+        if( task_count == 0 )
+            return {};
+
+        // A few ranges per thread lets threads that finish early pick up the slack.
+        const uint32_t tasks_per_buffer { std::max( min_tasks_per_buffer, 1u ) };
+        const uint32_t range_count { std::clamp( ( task_count + tasks_per_buffer - 1 ) / tasks_per_buffer, 1u, get_thread_count() * 4 ) };
+
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            job_function = &record_function;
+            job_inheritance = inheritance;
+            job_task_count = task_count;
+            job_range_count = range_count;
+            job_results.assign( range_count, nullptr );
+            job_exception = nullptr;
+            next_range = 0;
+
+            // A single range isn't worth waking anyone for.
+            if( range_count > 1 && !workers.empty() ) {
+                busy_workers = static_cast<uint32_t>( workers.size() );
+                ++job_generation;
+            }
+        }
+        job_ready.notify_all();
+
+        record_ranges( 0 );
+
+        std::unique_lock<std::mutex> lock( mutex );
+        job_done.wait( lock, [this] { return busy_workers == 0; } );
+        job_function = nullptr;
+
+        if( job_exception )
+            std::rethrow_exception( job_exception );
+
+        return std::move( job_results );
+    }
+
+    void ParallelRecorder::execute( vk::CommandBuffer primary, const vk::CommandBufferInheritanceInfo& inheritance, uint32_t task_count, const RecordFunction& record_function, uint32_t min_tasks_per_buffer ) {
+        std::vector<vk::CommandBuffer> secondaries { record( inheritance, task_count, record_function, min_tasks_per_buffer ) };
+        if( !secondaries.empty() )
+            primary.executeCommands( secondaries );
+    }
+
+    void ParallelRecorder::worker_loop( uint32_t thread_index ) {
+        uint64_t seen_generation { 0 };
+
+        while( true ) {
+            {
+                std::unique_lock<std::mutex> lock( mutex );
+                job_ready.wait( lock, [&] { return stopping || job_generation != seen_generation; } );
+                if( stopping )
+                    return;
+                seen_generation = job_generation;
+            }
+
+            record_ranges( thread_index );
+
+            {
+                std::lock_guard<std::mutex> lock( mutex );
+                --busy_workers;
+            }
+            job_done.notify_one();
+        }
+    }
+
+    void ParallelRecorder::record_ranges( uint32_t thread_index ) {
+        const vk::CommandBufferUsageFlags usage {
+            job_inheritance.renderPass
+                ? vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue
+                : vk::CommandBufferUsageFlagBits::eOneTimeSubmit
+        };
+
+        for( uint32_t r = next_range++; r < job_range_count; r = next_range++ ) {
+            const uint32_t first { static_cast<uint32_t>( static_cast<uint64_t>( job_task_count ) * r / job_range_count ) };
+            const uint32_t last { static_cast<uint32_t>( static_cast<uint64_t>( job_task_count ) * ( r + 1 ) / job_range_count ) };
+
+            try {
+                vk::CommandBuffer cmd { acquire_command_buffer( thread_index ) };
+                cmd.begin( vk::CommandBufferBeginInfo { usage, &job_inheritance } );
+                ( *job_function )( cmd, first, last );
+                cmd.end();
+
+                // Each range has its own slot, so no lock is needed.
+                job_results[r] = cmd;
+            }
+            catch( ... ) {
+                std::lock_guard<std::mutex> lock( mutex );
+                if( !job_exception )
+                    job_exception = std::current_exception();
+            }
+        }
+    }
+
+    vk::CommandBuffer ParallelRecorder::acquire_command_buffer( uint32_t thread_index ) {
+        FramePool& f = thread_pools[thread_index].frames[current_frame];
+
+        if( f.used == f.command_buffers.size() ) {
+            vk::CommandBufferAllocateInfo ai {
+                f.pool.get(),
+                vk::CommandBufferLevel::eSecondary,
+                1
+            };
+            f.command_buffers.push_back( device.allocateCommandBuffers( ai ).front() );
+        }
+
+        return f.command_buffers[f.used++];
+    }
+}
@@ -0,0 +1,758 @@
+#include "RenderGraph.hpp"
+#include <algorithm>
+#include <queue>
+#include <stdexcept>
+
+namespace stlr {
+    void RenderGraph::PassBuilder::read( Handle handle, Usage usage ) {
+        if( !handle.is_valid() || handle.version >= graph.resources[handle.resource].version_count )
+            throw std::invalid_argument( "Pass " + graph.passes[pass].name + " reads an invalid resource handle." );
+
+        graph.passes[pass].uses.push_back( Use { handle.resource, handle.version, usage, std::nullopt } );
+    }
+
+    RenderGraph::Handle RenderGraph::PassBuilder::write( Handle handle, Usage usage, std::optional<vk::ClearValue> clear ) {
+        if( !handle.is_valid() )
+            throw std::invalid_argument( "Pass " + graph.passes[pass].name + " writes an invalid resource handle." );
+
+        Resource& r = graph.resources[handle.resource];
+        // Writing an older version would fork the resource's history.
+        if( handle.version + 1 != r.version_count )
+            throw std::invalid_argument( "Pass " + graph.passes[pass].name + " writes " + r.name + " from a version that has already been written." );
+
+        graph.passes[pass].uses.push_back( Use { handle.resource, handle.version, usage, clear } );
+        r.producers.push_back( pass );
+        return Handle { handle.resource, r.version_count++ };
+    }
+
+    RenderGraph::RenderGraph( vk::Device device, MemoryAllocator& allocator )
+        : device( device )
+        , allocator( allocator )
+        , current_inheritance()
+        , compiled( false )
+        , transients_outdated( false ) {}
+
+    RenderGraph::Handle RenderGraph::create_image( std::string name, const ImageDescription& description ) {
+        Resource r;
+        r.name = std::move( name );
+        r.image = true;
+        r.imported = false;
+        r.description = description;
+        r.producers.push_back( UINT32_MAX );
+        resources.push_back( std::move( r ) );
+        compiled = false;
+
+        return Handle { static_cast<uint32_t>( resources.size() - 1 ), 0 };
+    }
+
+    RenderGraph::Handle RenderGraph::import_image( std::string name, vk::Image image, vk::ImageView view, const ImageDescription& description, const ImportState& state ) {
+        Resource r;
+        r.name = std::move( name );
+        r.image = true;
+        r.imported = true;
+        r.description = description;
+        r.import_state = state;
+        r.producers.push_back( UINT32_MAX );
+        r.image_handle = image;
+        r.image_view = view;
+        resources.push_back( std::move( r ) );
+        compiled = false;
+
+        return Handle { static_cast<uint32_t>( resources.size() - 1 ), 0 };
+    }
+
+    RenderGraph::Handle RenderGraph::import_buffer( std::string name, vk::Buffer buffer, const ImportState& state ) {
+        Resource r;
+        r.name = std::move( name );
+        r.image = false;
+        r.imported = true;
+        r.import_state = state;
+        r.producers.push_back( UINT32_MAX );
+        r.buffer_handle = buffer;
+        resources.push_back( std::move( r ) );
+        compiled = false;
+
+        return Handle { static_cast<uint32_t>( resources.size() - 1 ), 0 };
+    }
+
+    void RenderGraph::set_imported_image( Handle handle, vk::Image image, vk::ImageView view ) {
+        Resource& r = resources[handle.resource];
+        r.image_handle = image;
+        r.image_view = view;
+    }
+
+    void RenderGraph::set_imported_image( Handle handle, vk::Image image, vk::ImageView view, vk::Extent2D extent ) {
+        set_imported_image( handle, image, view );
+        set_extent( handle.resource, extent );
+    }
+
+    void RenderGraph::set_image_extent( Handle handle, vk::Extent2D extent, TransientImages& retired ) {
+        if( resources[handle.resource].imported )
+            throw std::invalid_argument( "Imported images are resized with set_imported_image()." );
+
+        set_extent( handle.resource, extent );
+        release_transient_images( retired );
+        transients_outdated = true;
+    }
+
+    void RenderGraph::set_extent( uint32_t resource, vk::Extent2D extent ) {
+        resources[resource].description.extent = extent;
+
+        // The render passes don't depend on the extent, so only the render areas change.
+        for( auto& p : passes ) {
+            if( std::find( p.attachments.begin(), p.attachments.end(), resource ) != p.attachments.end() )
+                p.extent = extent;
+        }
+    }
+
+    void RenderGraph::retire_framebuffers( std::vector<vk::UniqueFramebuffer>& retired ) {
+        for( auto& f : framebuffers ) {
+            retired.push_back( std::move( f.second ) );
+        }
+        framebuffers.clear();
+    }
+
+    void RenderGraph::add_pass( std::string name, const std::function<void( PassBuilder& )>& setup, ExecuteFunction execute ) {
+        Pass p;
+        p.name = std::move( name );
+        p.execute = std::move( execute );
+        passes.push_back( std::move( p ) );
+        compiled = false;
+
+        PassBuilder builder( *this, static_cast<uint32_t>( passes.size() - 1 ) );
+        setup( builder );
+    }
+
+    void RenderGraph::mark_output( Handle handle ) {
+        outputs.push_back( handle );
+        compiled = false;
+    }
+
+    void RenderGraph::compile() {
+        framebuffers.clear();
+        {
+            TransientImages previous;
+            release_transient_images( previous );
+        }
+        for( auto& r : resources ) {
+            r.usage = {};
+            r.first_use = UINT32_MAX;
+            r.last_use = 0;
+        }
+
+        cull_and_order();
+        create_transient_images();
+        compute_barriers();
+        create_render_passes();
+        compiled = true;
+        transients_outdated = false;
+    }
+
+    void RenderGraph::execute( vk::CommandBuffer command_buffer, GpuProfiler* profiler ) {
+        if( !compiled ) {
+            compile();
+        }
+        else if( transients_outdated ) {
+            // The order and usages are unchanged, but images of new sizes may share memory differently.
+            create_transient_images();
+            compute_barriers();
+            transients_outdated = false;
+        }
+
+        for( uint32_t p : order ) {
+            Pass& pass = passes[p];
+            std::optional<GpuProfiler::Scope> scope;
+            if( profiler != nullptr )
+                scope.emplace( *profiler, command_buffer, pass.name );
+
+            // Imported resources may have been swapped since the barriers were built.
+            for( size_t i = 0; i < pass.image_barriers.size(); ++i ) {
+                pass.image_barriers[i].image = resources[pass.image_barrier_resources[i]].image_handle;
+            }
+            for( size_t i = 0; i < pass.buffer_barriers.size(); ++i ) {
+                pass.buffer_barriers[i].buffer = resources[pass.buffer_barrier_resources[i]].buffer_handle;
+            }
+            if( !pass.image_barriers.empty() || !pass.buffer_barriers.empty() ) {
+                command_buffer.pipelineBarrier( pass.src_stages, pass.dst_stages, {}, nullptr, pass.buffer_barriers, pass.image_barriers );
+            }
+
+            if( pass.render_pass ) {
+                const vk::Framebuffer framebuffer { get_framebuffer( pass ) };
+                current_inheritance = vk::CommandBufferInheritanceInfo { pass.render_pass.get(), 0, framebuffer };
+
+                vk::RenderPassBeginInfo bi {
+                    pass.render_pass.get(),
+                    framebuffer,
+                    vk::Rect2D { { 0, 0 }, pass.extent },
+                    static_cast<uint32_t>( pass.clear_values.size() ),
+                    pass.clear_values.data()
+                };
+                command_buffer.beginRenderPass( bi, pass.secondary_command_buffers ? vk::SubpassContents::eSecondaryCommandBuffers : vk::SubpassContents::eInline );
+                pass.execute( command_buffer, *this );
+                command_buffer.endRenderPass();
+            }
+            else {
+                // Secondary command buffers recorded outside a render pass inherit none.
+                current_inheritance = vk::CommandBufferInheritanceInfo {};
+                pass.execute( command_buffer, *this );
+            }
+        }
+
+        if( !final_barriers.empty() ) {
+            for( size_t i = 0; i < final_barriers.size(); ++i ) {
+                final_barriers[i].image = resources[final_barrier_resources[i]].image_handle;
+            }
+            command_buffer.pipelineBarrier( final_src_stages, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, nullptr, final_barriers );
+        }
+    }
+
+    vk::RenderPass RenderGraph::get_render_pass( const std::string& pass_name ) const {
+        auto it = std::find_if( passes.begin(), passes.end(), [&]( const Pass& p ) { return p.name == pass_name; } );
+        if( it == passes.end() || !it->render_pass )
+            throw std::invalid_argument( "No render pass named " + pass_name + " has been compiled." );
+
+        return it->render_pass.get();
+    }
+
+    std::vector<std::string> RenderGraph::get_pass_order() const {
+        std::vector<std::string> names;
+        names.reserve( order.size() );
+        for( uint32_t p : order ) {
+            names.push_back( passes[p].name );
+        }
+        return names;
+    }
+
+    std::pair<vk::DeviceSize, vk::DeviceSize> RenderGraph::get_transient_memory() const {
+        vk::DeviceSize aliased { 0 };
+        for( const auto& s : alias_slots ) {
+            aliased += s.requirements.size;
+        }
+
+        vk::DeviceSize unaliased { 0 };
+        for( const auto& r : resources ) {
+            unaliased += r.memory_size;
+        }
+
+        return { aliased, unaliased };
+    }
+
+    RenderGraph::UsageInfo RenderGraph::get_usage_info( Usage usage ) {
+        using Stage = vk::PipelineStageFlagBits;
+        using Access = vk::AccessFlagBits;
+        using Layout = vk::ImageLayout;
+        using ImageUsage = vk::ImageUsageFlagBits;
+
+        switch( usage ) {
+        case Usage::eColorAttachment:
+            return { Stage::eColorAttachmentOutput, Access::eColorAttachmentRead | Access::eColorAttachmentWrite, Layout::eColorAttachmentOptimal, ImageUsage::eColorAttachment, true };
+        case Usage::eDepthAttachment:
+            return { Stage::eEarlyFragmentTests | Stage::eLateFragmentTests, Access::eDepthStencilAttachmentRead | Access::eDepthStencilAttachmentWrite, Layout::eDepthStencilAttachmentOptimal, ImageUsage::eDepthStencilAttachment, true };
+        case Usage::eDepthRead:
+            return { Stage::eEarlyFragmentTests | Stage::eLateFragmentTests, Access::eDepthStencilAttachmentRead, Layout::eDepthStencilReadOnlyOptimal, ImageUsage::eDepthStencilAttachment, false };
+        case Usage::eSampledFragment:
+            return { Stage::eFragmentShader, Access::eShaderRead, Layout::eShaderReadOnlyOptimal, ImageUsage::eSampled, false };
+        case Usage::eSampledCompute:
+            return { Stage::eComputeShader, Access::eShaderRead, Layout::eShaderReadOnlyOptimal, ImageUsage::eSampled, false };
+        case Usage::eStorageRead:
+            return { Stage::eComputeShader, Access::eShaderRead, Layout::eGeneral, ImageUsage::eStorage, false };
+        case Usage::eStorageWrite:
+            return { Stage::eComputeShader, Access::eShaderRead | Access::eShaderWrite, Layout::eGeneral, ImageUsage::eStorage, true };
+        case Usage::eTransferSrc:
+            return { Stage::eTransfer, Access::eTransferRead, Layout::eTransferSrcOptimal, ImageUsage::eTransferSrc, false };
+        case Usage::eTransferDst:
+            return { Stage::eTransfer, Access::eTransferWrite, Layout::eTransferDstOptimal, ImageUsage::eTransferDst, true };
+        case Usage::eVertexBuffer:
+            return { Stage::eVertexInput, Access::eVertexAttributeRead, Layout::eUndefined, {}, false };
+        case Usage::eIndexBuffer:
+            return { Stage::eVertexInput, Access::eIndexRead, Layout::eUndefined, {}, false };
+        case Usage::eIndirectBuffer:
+            return { Stage::eDrawIndirect, Access::eIndirectCommandRead, Layout::eUndefined, {}, false };
+        case Usage::eUniformBuffer:
+            return { Stage::eVertexShader | Stage::eFragmentShader | Stage::eComputeShader, Access::eUniformRead, Layout::eUndefined, {}, false };
+        }
+
+        throw std::invalid_argument( "Unknown render graph usage." );
+    }
+
+    bool RenderGraph::is_attachment( Usage usage ) noexcept {
+        return usage == Usage::eColorAttachment || usage == Usage::eDepthAttachment || usage == Usage::eDepthRead;
+    }
+
+    vk::ImageAspectFlags RenderGraph::get_aspect_mask( vk::Format format ) noexcept {
+        switch( format ) {
+        case vk::Format::eD16Unorm:
+        case vk::Format::eX8D24UnormPack32:
+        case vk::Format::eD32Sfloat:
+            return vk::ImageAspectFlagBits::eDepth;
+        // The graph only uses the combined depth/stencil layouts, which transition both aspects
+        // together; only separateDepthStencilLayouts would allow one of them on its own.
+        case vk::Format::eD16UnormS8Uint:
+        case vk::Format::eD24UnormS8Uint:
+        case vk::Format::eD32SfloatS8Uint:
+            return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+        default:
+            return vk::ImageAspectFlagBits::eColor;
+        }
+    }
+
+    void RenderGraph::cull_and_order() {
+        const uint32_t pass_count { static_cast<uint32_t>( passes.size() ) };
+
+        // Passes that read each version of each resource.
+        std::vector<std::vector<std::vector<uint32_t>>> readers( resources.size() );
+        for( uint32_t r = 0; r < resources.size(); ++r ) {
+            readers[r].resize( resources[r].version_count );
+        }
+        for( uint32_t p = 0; p < pass_count; ++p ) {
+            for( const auto& u : passes[p].uses ) {
+                if( !get_usage_info( u.usage ).write )
+                    readers[u.resource][u.version].push_back( p );
+            }
+        }
+
+        // Data dependencies: reads depend on the version's writer, and so do writes that keep
+        // the previous contents (anything but a cleared attachment).
+        std::vector<std::vector<uint32_t>> data_dependencies( pass_count );
+        for( uint32_t p = 0; p < pass_count; ++p ) {
+            for( const auto& u : passes[p].uses ) {
+                const uint32_t producer { resources[u.resource].producers[u.version] };
+                const bool keeps_contents { !get_usage_info( u.usage ).write || !u.clear.has_value() };
+                if( producer != UINT32_MAX && producer != p && keeps_contents )
+                    data_dependencies[p].push_back( producer );
+            }
+        }
+
+        // Walk back from the outputs; whatever isn't reached doesn't contribute.
+        std::vector<bool> kept( pass_count, false );
+        std::vector<uint32_t> stack;
+        for( const auto& o : outputs ) {
+            const uint32_t producer { resources[o.resource].producers[o.version] };
+            if( producer != UINT32_MAX )
+                stack.push_back( producer );
+        }
+        for( uint32_t p = 0; p < pass_count; ++p ) {
+            if( passes[p].side_effects )
+                stack.push_back( p );
+        }
+        while( !stack.empty() ) {
+            const uint32_t p { stack.back() };
+            stack.pop_back();
+            if( kept[p] )
+                continue;
+            kept[p] = true;
+            stack.insert( stack.end(), data_dependencies[p].begin(), data_dependencies[p].end() );
+        }
+
+        // Order dependencies also include write-after-read: a write of a version waits for its readers.
+        for( uint32_t p = 0; p < pass_count; ++p ) {
+            Pass& pass = passes[p];
+            pass.dependencies.clear();
+            if( !kept[p] )
+                continue;
+
+            for( const auto& u : pass.uses ) {
+                const uint32_t producer { resources[u.resource].producers[u.version] };
+                if( producer != UINT32_MAX && producer != p )
+                    pass.dependencies.push_back( producer );
+                if( get_usage_info( u.usage ).write ) {
+                    for( uint32_t reader : readers[u.resource][u.version] ) {
+                        if( reader != p && kept[reader] )
+                            pass.dependencies.push_back( reader );
+                    }
+                }
+            }
+            std::sort( pass.dependencies.begin(), pass.dependencies.end() );
+            pass.dependencies.erase( std::unique( pass.dependencies.begin(), pass.dependencies.end() ), pass.dependencies.end() );
+        }
+
+        // Kahn's algorithm, taking the earliest declared ready pass first so the order is stable.
+        std::vector<uint32_t> remaining( pass_count, 0 );
+        std::vector<std::vector<uint32_t>> dependents( pass_count );
+        for( uint32_t p = 0; p < pass_count; ++p ) {
+            if( !kept[p] )
+                continue;
+            remaining[p] = static_cast<uint32_t>( passes[p].dependencies.size() );
+            for( uint32_t d : passes[p].dependencies ) {
+                dependents[d].push_back( p );
+            }
+        }
+
+        std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> ready;
+        for( uint32_t p = 0; p < pass_count; ++p ) {
+            if( kept[p] && remaining[p] == 0 )
+                ready.push( p );
+        }
+
+        order.clear();
+        while( !ready.empty() ) {
+            const uint32_t p { ready.top() };
+            ready.pop();
+            order.push_back( p );
+            for( uint32_t d : dependents[p] ) {
+                if( --remaining[d] == 0 )
+                    ready.push( d );
+            }
+        }
+
+        if( order.size() != static_cast<size_t>( std::count( kept.begin(), kept.end(), true ) ) )
+            throw std::logic_error( "The render graph has a dependency cycle." );
+
+        for( uint32_t i = 0; i < order.size(); ++i ) {
+            for( const auto& u : passes[order[i]].uses ) {
+                Resource& r = resources[u.resource];
+                r.first_use = std::min( r.first_use, i );
+                r.last_use = std::max( r.last_use, i );
+                r.usage |= get_usage_info( u.usage ).image_usage;
+            }
+        }
+    }
+
+    void RenderGraph::release_transient_images( TransientImages& released ) {
+        for( auto& r : resources ) {
+            if( !r.imported ) {
+                if( r.owned_view )
+                    released.views.push_back( std::move( r.owned_view ) );
+                if( r.owned_image )
+                    released.images.push_back( std::move( r.owned_image ) );
+                r.image_handle = nullptr;
+                r.image_view = nullptr;
+            }
+            r.alias_slot = UINT32_MAX;
+            r.memory_size = 0;
+        }
+        for( auto& s : alias_slots ) {
+            released.memory.push_back( std::move( s.allocation ) );
+        }
+        alias_slots.clear();
+    }
+
+    void RenderGraph::create_transient_images() {
+        std::vector<uint32_t> transients;
+        for( uint32_t r = 0; r < resources.size(); ++r ) {
+            Resource& res = resources[r];
+            if( res.imported || !res.image || res.first_use == UINT32_MAX )
+                continue;
+
+            vk::ImageCreateInfo ci {
+                {},
+                vk::ImageType::e2D,
+                res.description.format,
+                vk::Extent3D { res.description.extent.width, res.description.extent.height, 1 },
+                1,
+                1,
+                vk::SampleCountFlagBits::e1,
+                vk::ImageTiling::eOptimal,
+                res.usage,
+                vk::SharingMode::eExclusive,
+                0,
+                nullptr,
+                vk::ImageLayout::eUndefined
+            };
+            res.owned_image = device.createImageUnique( ci );
+            res.image_handle = res.owned_image.get();
+            transients.push_back( r );
+        }
+
+        // Place the largest images first, each in the first slot it fits into without overlapping
+        // the lifetime of anything already there.
+        std::vector<vk::MemoryRequirements> requirements( resources.size() );
+        for( uint32_t r : transients ) {
+            requirements[r] = device.getImageMemoryRequirements( resources[r].image_handle );
+            resources[r].memory_size = requirements[r].size;
+        }
+        std::stable_sort( transients.begin(), transients.end(), [&]( uint32_t a, uint32_t b ) { return requirements[a].size > requirements[b].size; } );
+
+        for( uint32_t r : transients ) {
+            Resource& res = resources[r];
+            const vk::MemoryRequirements& reqs = requirements[r];
+
+            auto fits = [&]( const AliasSlot& slot ) {
+                if( !( slot.requirements.memoryTypeBits & reqs.memoryTypeBits ) )
+                    return false;
+                return std::none_of( slot.resources.begin(), slot.resources.end(), [&]( uint32_t other ) {
+                    return resources[other].first_use <= res.last_use && res.first_use <= resources[other].last_use;
+                } );
+            };
+
+            auto slot = std::find_if( alias_slots.begin(), alias_slots.end(), fits );
+            if( slot == alias_slots.end() ) {
+                alias_slots.push_back( AliasSlot { reqs, {}, {} } );
+                slot = alias_slots.end() - 1;
+            }
+
+            slot->requirements.size = std::max( slot->requirements.size, reqs.size );
+            slot->requirements.alignment = std::max( slot->requirements.alignment, reqs.alignment );
+            slot->requirements.memoryTypeBits &= reqs.memoryTypeBits;
+            slot->resources.push_back( r );
+            res.alias_slot = static_cast<uint32_t>( slot - alias_slots.begin() );
+        }
+
+        for( auto& slot : alias_slots ) {
+            slot.allocation = MemoryAllocator::UniqueAllocation( allocator, allocator.allocate( slot.requirements, vk::MemoryPropertyFlagBits::eDeviceLocal, false ) );
+            for( uint32_t r : slot.resources ) {
+                device.bindImageMemory( resources[r].image_handle, slot.allocation->memory, slot.allocation->offset );
+            }
+
+            // Later occupants overwrite earlier ones, so keep them in the order they're used.
+            std::sort( slot.resources.begin(), slot.resources.end(), [&]( uint32_t a, uint32_t b ) { return resources[a].first_use < resources[b].first_use; } );
+        }
+
+        for( uint32_t r : transients ) {
+            Resource& res = resources[r];
+            vk::ImageViewCreateInfo ci {
+                {},
+                res.image_handle,
+                vk::ImageViewType::e2D,
+                res.description.format,
+                {},
+                vk::ImageSubresourceRange { get_aspect_mask( res.description.format ), 0, 1, 0, 1 }
+            };
+            res.owned_view = device.createImageViewUnique( ci );
+            res.image_view = res.owned_view.get();
+        }
+    }
+
+    void RenderGraph::compute_barriers() {
+        // The state each resource is left in by its last use.
+        auto last_state = [&]( uint32_t r ) {
+            ResourceState s;
+            for( auto it = order.rbegin(); it != order.rend(); ++it ) {
+                for( const auto& u : passes[*it].uses ) {
+                    if( u.resource != r )
+                        continue;
+                    const UsageInfo info { get_usage_info( u.usage ) };
+                    s.stages |= info.stages;
+                    s.access |= info.access;
+                    s.written = s.written || info.write;
+                }
+                if( s.stages )
+                    return s;
+            }
+            return s;
+        };
+
+        std::vector<ResourceState> states( resources.size() );
+        for( uint32_t r = 0; r < resources.size(); ++r ) {
+            const Resource& res = resources[r];
+            if( res.imported ) {
+                states[r] = ResourceState { res.import_state.layout, res.import_state.stages, res.import_state.access, static_cast<bool>( res.import_state.access ) };
+            }
+            else if( res.alias_slot != UINT32_MAX ) {
+                // A transient image starts out undefined, but the memory it's in was last used by the
+                // previous occupant of its slot - this execution's, or the previous execution's
+                // last occupant for the first one.
+                const auto& occupants = alias_slots[res.alias_slot].resources;
+                auto it = std::find( occupants.begin(), occupants.end(), r );
+                const uint32_t previous { it == occupants.begin() ? occupants.back() : *( it - 1 ) };
+                states[r] = last_state( previous );
+                states[r].layout = vk::ImageLayout::eUndefined;
+                states[r].written = true;
+            }
+        }
+
+        for( uint32_t p : order ) {
+            Pass& pass = passes[p];
+            pass.image_barriers.clear();
+            pass.image_barrier_resources.clear();
+            pass.buffer_barriers.clear();
+            pass.buffer_barrier_resources.clear();
+            pass.src_stages = {};
+            pass.dst_stages = {};
+
+            // Merge the uses of each resource within the pass.
+            std::map<uint32_t, UsageInfo> needs;
+            for( const auto& u : pass.uses ) {
+                const UsageInfo info { get_usage_info( u.usage ) };
+                auto [it, inserted] = needs.try_emplace( u.resource, info );
+                if( !inserted ) {
+                    it->second.stages |= info.stages;
+                    it->second.access |= info.access;
+                    it->second.write = it->second.write || info.write;
+                    if( it->second.layout != info.layout )
+                        it->second.layout = vk::ImageLayout::eGeneral;
+                }
+            }
+
+            for( const auto& [r, need] : needs ) {
+                ResourceState& state = states[r];
+                const Resource& res = resources[r];
+                const bool layout_change { res.image && state.layout != need.layout };
+
+                // Read after read in the same layout needs nothing; remember the reader so a later
+                // write waits for it.
+                if( !layout_change && !state.written && !need.write ) {
+                    state.stages |= need.stages;
+                    state.access |= need.access;
+                    continue;
+                }
+
+                const vk::PipelineStageFlags src_stages { state.stages ? state.stages : vk::PipelineStageFlags( vk::PipelineStageFlagBits::eTopOfPipe ) };
+                // Only writes need to be made available; write-after-read is an execution dependency.
+                const vk::AccessFlags src_access { state.written ? state.access : vk::AccessFlags() };
+                pass.src_stages |= src_stages;
+                pass.dst_stages |= need.stages;
+
+                if( res.image ) {
+                    pass.image_barriers.push_back( vk::ImageMemoryBarrier {
+                        src_access,
+                        need.access,
+                        state.layout,
+                        need.layout,
+                        VK_QUEUE_FAMILY_IGNORED,
+                        VK_QUEUE_FAMILY_IGNORED,
+                        nullptr,
+                        vk::ImageSubresourceRange { get_aspect_mask( res.description.format ), 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS }
+                    } );
+                    pass.image_barrier_resources.push_back( r );
+                }
+                else {
+                    pass.buffer_barriers.push_back( vk::BufferMemoryBarrier {
+                        src_access,
+                        need.access,
+                        VK_QUEUE_FAMILY_IGNORED,
+                        VK_QUEUE_FAMILY_IGNORED,
+                        nullptr,
+                        0,
+                        VK_WHOLE_SIZE
+                    } );
+                    pass.buffer_barrier_resources.push_back( r );
+                }
+
+                state = ResourceState { res.image ? need.layout : vk::ImageLayout::eUndefined, need.stages, need.access, need.write };
+            }
+        }
+
+        final_barriers.clear();
+        final_barrier_resources.clear();
+        final_src_stages = {};
+        for( uint32_t r = 0; r < resources.size(); ++r ) {
+            const Resource& res = resources[r];
+            const ResourceState& state = states[r];
+            if( !res.imported || !res.image || res.import_state.final_layout == vk::ImageLayout::eUndefined || res.import_state.final_layout == state.layout )
+                continue;
+
+            final_src_stages |= state.stages ? state.stages : vk::PipelineStageFlags( vk::PipelineStageFlagBits::eTopOfPipe );
+            final_barriers.push_back( vk::ImageMemoryBarrier {
+                state.written ? state.access : vk::AccessFlags(),
+                {},
+                state.layout,
+                res.import_state.final_layout,
+                VK_QUEUE_FAMILY_IGNORED,
+                VK_QUEUE_FAMILY_IGNORED,
+                nullptr,
+                vk::ImageSubresourceRange { get_aspect_mask( res.description.format ), 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS }
+            } );
+            final_barrier_resources.push_back( r );
+        }
+    }
+
+    void RenderGraph::create_render_passes() {
+        // Whether a resource is used again after a position in the order, or must outlive the graph.
+        auto is_needed_after = [&]( uint32_t r, uint32_t position ) {
+            const Resource& res = resources[r];
+            return res.imported || res.last_use > position || std::any_of( outputs.begin(), outputs.end(), [r]( const Handle& h ) { return h.resource == r; } );
+        };
+
+        for( uint32_t i = 0; i < order.size(); ++i ) {
+            Pass& pass = passes[order[i]];
+            pass.render_pass.reset();
+            pass.attachments.clear();
+            pass.clear_values.clear();
+
+            std::vector<vk::AttachmentDescription> descriptions;
+            std::vector<vk::AttachmentReference> color_references;
+            std::optional<vk::AttachmentReference> depth_reference;
+
+            for( const auto& u : pass.uses ) {
+                if( !is_attachment( u.usage ) )
+                    continue;
+
+                const Resource& res = resources[u.resource];
+                const UsageInfo info { get_usage_info( u.usage ) };
+                const bool has_contents { res.producers[u.version] != UINT32_MAX || ( res.imported && res.import_state.layout != vk::ImageLayout::eUndefined ) };
+
+                vk::AttachmentLoadOp load { has_contents ? vk::AttachmentLoadOp::eLoad : vk::AttachmentLoadOp::eDontCare };
+                if( u.clear.has_value() )
+                    load = vk::AttachmentLoadOp::eClear;
+                const vk::AttachmentStoreOp store { !info.write || is_needed_after( u.resource, i ) ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare };
+
+                // The graph's barriers do every transition, so the render pass keeps the layout.
+                const vk::AttachmentReference reference { static_cast<uint32_t>( descriptions.size() ), info.layout };
+                descriptions.push_back( vk::AttachmentDescription {
+                    {},
+                    res.description.format,
+                    vk::SampleCountFlagBits::e1,
+                    load,
+                    store,
+                    vk::AttachmentLoadOp::eDontCare,
+                    vk::AttachmentStoreOp::eDontCare,
+                    info.layout,
+                    info.layout
+                } );
+
+                if( u.usage == Usage::eColorAttachment )
+                    color_references.push_back( reference );
+                else
+                    depth_reference = reference;
+
+                pass.attachments.push_back( u.resource );
+                pass.clear_values.push_back( u.clear.value_or( vk::ClearValue {} ) );
+                pass.extent = res.description.extent;
+            }
+
+            if( descriptions.empty() )
+                continue;
+
+            vk::SubpassDescription subpass {
+                {},
+                vk::PipelineBindPoint::eGraphics,
+                0,
+                nullptr,
+                static_cast<uint32_t>( color_references.size() ),
+                color_references.data(),
+                nullptr,
+                depth_reference.has_value() ? &depth_reference.value() : nullptr,
+                0,
+                nullptr
+            };
+
+            vk::RenderPassCreateInfo ci {
+                {},
+                static_cast<uint32_t>( descriptions.size() ),
+                descriptions.data(),
+                1,
+                &subpass,
+                0,
+                nullptr
+            };
+            pass.render_pass = device.createRenderPassUnique( ci );
+        }
+    }
+
+    vk::Framebuffer RenderGraph::get_framebuffer( const Pass& pass ) {
+        std::vector<VkImageView> views;
+        views.reserve( pass.attachments.size() );
+        for( uint32_t r : pass.attachments ) {
+            views.push_back( static_cast<VkImageView>( resources[r].image_view ) );
+        }
+
+        auto key { std::make_pair( static_cast<VkRenderPass>( pass.render_pass.get() ), views ) };
+        auto it = framebuffers.find( key );
+        if( it == framebuffers.end() ) {
+            std::vector<vk::ImageView> attachments( views.begin(), views.end() );
+            vk::FramebufferCreateInfo ci {
+                {},
+                pass.render_pass.get(),
+                static_cast<uint32_t>( attachments.size() ),
+                attachments.data(),
+                pass.extent.width,
+                pass.extent.height,
+                1
+            };
+            it = framebuffers.emplace( std::move( key ), device.createFramebufferUnique( ci ) ).first;
+        }
+
+        return it->second.get();
+    }
+}
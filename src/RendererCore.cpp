@@ -2,25 +2,59 @@
 #include <fstream>
 
 namespace stlr {
-	RendererCore::RendererCore( Window& window )
+	RendererCore::RendererCore( Window& window, const std::filesystem::path& shader_directory, uint32_t frames_in_flight, std::filesystem::path pipeline_cache_file, uint32_t recording_threads, const SwapchainSettings& swapchain_settings )
+		: RendererCore( &window, vk::Extent2D{ static_cast<uint32_t>( window.get_width() ), static_cast<uint32_t>( window.get_height() ) }, shader_directory, frames_in_flight, std::move( pipeline_cache_file ), recording_threads, swapchain_settings ) {}
+
+	RendererCore::RendererCore( vk::Extent2D extent, const std::filesystem::path& shader_directory, uint32_t frames_in_flight, std::filesystem::path pipeline_cache_file, uint32_t recording_threads )
+		: RendererCore( nullptr, extent, shader_directory, frames_in_flight, std::move( pipeline_cache_file ), recording_threads, {} ) {}
+
+	RendererCore::RendererCore( Window* window, vk::Extent2D extent, const std::filesystem::path& shader_directory, uint32_t frames_in_flight, std::filesystem::path pipeline_cache_file, uint32_t recording_threads, const SwapchainSettings& swapchain_settings )
 		: window( window )
 		, instance( create_instance() )
 		, surface( create_surface() )
 		, devices( create_devices() )
 		, selected_device( select_best_device() )
+		, allocator( selected_device->physical_device, selected_device->device.get() )
 		, present_command_pool( create_graphics_command_pool() )
 		, transfer_command_pool( create_transfer_command_pool() )
+		, compute_command_pool( create_compute_command_pool() )
 		, present_command_buffer( allocate_graphics_command_buffer() )
 		, transfer_command_buffer( allocate_transfer_command_buffer() )
-		, swapchain( create_swapchain() )
-        , depth_image( create_image_2d( window.get_width(), window.get_height(), vk::Format::eD32Sfloat ) )
+		, profiler( selected_device->physical_device, selected_device->device.get(), selected_device->graphics_queue, selected_device->graphics_queue_index, selected_device->transfer_queue, selected_device->transfer_queue_index, frames_in_flight, selected_device->features_12.hostQueryReset )
+		, recorder( selected_device->device.get(), selected_device->graphics_queue_index, frames_in_flight, recording_threads )
+		, uploader( selected_device->physical_device, selected_device->device.get(), allocator, selected_device->transfer_queue, selected_device->transfer_queue_index, selected_device->graphics_queue_index, transfer_command_pool.get(), UploadManager::default_staging_size, &profiler )
+		, pipeline_cache( selected_device->physical_device, selected_device->device.get(), std::move( pipeline_cache_file ), selected_device->is_extension_enabled( VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME ) )
+		, bindless( create_bindless_descriptors( frames_in_flight ) )
+		, uniforms( selected_device->physical_device, selected_device->device.get(), allocator, frames_in_flight )
+		, layout_cache( selected_device->device.get() )
+		, descriptor_allocator( selected_device->device.get() )
+		, frame_descriptor_allocators( create_frame_descriptor_allocators( frames_in_flight ) )
+		, mipmaps( selected_device->physical_device, selected_device->device.get(), shader_directory / "mip-cs.spv" )
+		, required_upload( 0 )
+		, frame_upload_wait( 0, {} )
+		, swapchain_settings( swapchain_settings )
+		, offscreen_images( is_headless() ? create_offscreen_images( extent, frames_in_flight ) : std::vector<Image>{} )
+		, swapchain( is_headless() ? create_offscreen_swapchain() : create_swapchain() )
+        , depth_image( create_image_2d( swapchain.extent.width, swapchain.extent.height, vk::Format::eD32Sfloat ) )
         , depth_image_view( create_image_view_2d( depth_image ) )
         , sampler( create_sampler() )
+        , streamer( selected_device->physical_device, selected_device->device.get(), allocator, uploader, bindless.get(), sampler.get(), frames_in_flight, selected_device->is_extension_enabled( VK_EXT_MEMORY_BUDGET_EXTENSION_NAME ) )
+        , frames( create_frames( frames_in_flight ) )
+        , current_frame( 0 )
+        , frame_number( 0 )
+        , swapchain_outdated( false )
+        , window_extent( is_headless() ? extent : get_window_extent() )
+        , close_requested( false )
 		, timer()
 		, delta_time( 0.0f )
         , pre_update( nullptr )
         , post_update( nullptr ) {}
 
+    void RendererCore::run( uint64_t frame_limit ) {
+        timer.start();
+        render_loop( frame_limit );
+    }
+
     vk::UniqueDescriptorPool RendererCore::create_descriptor_pool( vk::ArrayProxy<vk::DescriptorPoolSize> pool_sizes, uint32_t sets ) {
         vk::DescriptorPoolCreateInfo ci {
             vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
@@ -143,12 +177,9 @@ namespace stlr {
         };
         auto buffer = selected_device->device->createBufferUnique( ci );
         auto bufferMR = selected_device->device->getBufferMemoryRequirements( buffer.get() );
-        auto bufferMemoryAI = vk::MemoryAllocateInfo(bufferMR.size, get_memory_type_index( bufferMR, memory_properties ) );
-        auto bufferDM = selected_device->device->allocateMemoryUnique(bufferMemoryAI);
-
-        selected_device->device->bindBufferMemory( buffer.get(), bufferDM.get(), 0 );
+        auto allocation = allocator.allocate_unique( buffer.get(), memory_properties );
 
-        return Buffer( buffer, size, bufferMR, bufferDM, usage );
+        return Buffer( buffer, size, bufferMR, allocation, usage );
 
     }
 
@@ -171,19 +202,38 @@ namespace stlr {
         return selected_device->device->createPipelineLayoutUnique( ci );
     }
 
-	RendererCore::Image RendererCore::create_image_2d( uint32_t width, uint32_t height, vk::Format format ) {
+    vk::UniquePipelineLayout RendererCore::create_bindless_pipeline_layout( vk::ArrayProxy<vk::PushConstantRange> push_constants ) {
+        vk::DescriptorSetLayout set_layout { bindless->get_layout() };
+        vk::PipelineLayoutCreateInfo ci {
+            {},
+            1,
+            &set_layout,
+            push_constants.size(),
+            push_constants.data()
+        };
+
+        return selected_device->device->createPipelineLayoutUnique( ci );
+    }
+
+    vk::UniquePipeline RendererCore::create_graphics_pipeline( const vk::GraphicsPipelineCreateInfo& ci ) {
+        return pipeline_cache.create_pipeline_unique( ci );
+    }
+
+	RendererCore::Image RendererCore::create_image_2d( uint32_t width, uint32_t height, vk::Format format, vk::ImageUsageFlags additional_usage, uint32_t mip_levels ) {
 		vk::ImageCreateInfo ci {
 			{},
 			vk::ImageType::e2D,
 			format,
 			vk::Extent3D{ width, height, 1 },
-			1,
+			mip_levels,
 			1,
 			vk::SampleCountFlagBits::e1,
 			vk::ImageTiling::eOptimal,
 			{
-                format == vk::Format::eD32Sfloat ? vk::ImageUsageFlagBits::eDepthStencilAttachment : vk::ImageUsageFlagBits::eColorAttachment |
-				vk::ImageUsageFlagBits::eTransferDst
+                ( format == vk::Format::eD32Sfloat ? vk::ImageUsageFlagBits::eDepthStencilAttachment :
+                // Block-compressed formats can't be rendered to, only copied into.
+                format_utils::is_block_compressed( format ) ? vk::ImageUsageFlagBits::eTransferDst : vk::ImageUsageFlagBits::eColorAttachment |
+				vk::ImageUsageFlagBits::eTransferDst ) | additional_usage
 			},
 			vk::SharingMode::eExclusive,
 			0,
@@ -193,12 +243,34 @@ namespace stlr {
 
 		vk::UniqueImage image { selected_device->device->createImageUnique( ci ) };
 		vk::MemoryRequirements mem_reqs { selected_device->device->getImageMemoryRequirements( image.get() ) };
-		vk::MemoryAllocateInfo mem_ai {mem_reqs.size, get_memory_type_index(mem_reqs, vk::MemoryPropertyFlagBits::eDeviceLocal) };
-		vk::UniqueDeviceMemory dev_mem{ selected_device->device->allocateMemoryUnique( mem_ai ) };
-		
-		selected_device->device->bindImageMemory( image.get(), dev_mem.get(), 0 );
+		MemoryAllocator::UniqueAllocation allocation { allocator.allocate_unique( image.get(), vk::MemoryPropertyFlagBits::eDeviceLocal ) };
+
 		vk::DeviceSize size { static_cast<vk::DeviceSize>( width ) * height * format_utils::get_format_component_count( format ) };
-        return RendererCore::Image( image, size, mem_reqs, dev_mem, width, height, format_utils::get_format_component_count(format), format, vk::ImageLayout::ePreinitialized );
+        return RendererCore::Image( image, size, mem_reqs, allocation, width, height, format_utils::get_format_component_count(format), format, vk::ImageLayout::ePreinitialized, mip_levels );
+    }
+
+    RendererCore::Image RendererCore::load_texture( TextureFile file ) {
+        TextureFile texture { std::move( file ).to_supported( selected_device->physical_device ) };
+        if( texture.layer_count != 1 )
+            throw std::runtime_error( "Only textures with a single layer can be loaded." );
+
+        RendererCore::Image image { create_image_2d( texture.width, texture.height, texture.format, vk::ImageUsageFlagBits::eSampled, texture.level_count ) };
+        require_upload( uploader.upload_image( image._object.get(), texture.data.data(), texture.data.size(), texture.get_copy_regions(), texture.get_subresource_range(), vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eFragmentShader ) );
+        image._imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+
+        return image;
+    }
+
+    RendererCore::Image RendererCore::load_texture( const AssetPack& pack, std::string_view name ) {
+        const asset_pack::TextureEntry& texture { pack.get_texture( name ) };
+        if( texture.layer_count != 1 )
+            throw std::runtime_error( "Only textures with a single layer can be loaded." );
+
+        RendererCore::Image image { create_image_2d( texture.width, texture.height, AssetPack::get_format( texture ), vk::ImageUsageFlagBits::eSampled, texture.level_count ) };
+        require_upload( uploader.upload_image( image._object.get(), pack.get_texture_data( texture ), texture.data_size, pack.get_copy_regions( texture ), pack.get_subresource_range( texture ), vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eFragmentShader ) );
+        image._imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+
+        return image;
     }
 
     vk::UniqueImageView RendererCore::create_image_view_2d(Image &image) {
@@ -211,7 +283,7 @@ namespace stlr {
             vk::ImageSubresourceRange {
                 image._format == vk::Format::eD32Sfloat ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor,
                 0,
-                1,
+                image._mipLevels,
                 0,
                 1
             }
@@ -221,17 +293,22 @@ namespace stlr {
     }
 
 	vk::UniqueInstance RendererCore::create_instance() {
-		std::vector<const char*> layers{
+		std::vector<const char*> layers;
 #ifndef NDEBUG
-			DebugInfo::instance_debug_layers.begin(),
-			DebugInfo::instance_debug_layers.end()
+		// Only request the debug layers that are installed; CI machines usually have none.
+		std::vector<vk::LayerProperties> available_layers{ vk::enumerateInstanceLayerProperties() };
+		for( const char* l : DebugInfo::instance_debug_layers ) {
+			auto available = std::find_if( available_layers.begin(), available_layers.end(), [l]( const vk::LayerProperties& a ) { return std::strcmp( a.layerName, l ) == 0; } );
+			if( available != available_layers.end() )
+				layers.push_back( l );
+		}
 #endif // NDEBUG
-		};
 
-		std::vector<const char*> extensions{
-			required_instance_extensions.begin(),
-			required_instance_extensions.end()
-		};
+		// Without a window there's no surface, so none of the surface extensions are needed.
+		std::vector<const char*> extensions;
+		if( !is_headless() ) {
+			extensions.assign( required_instance_extensions.begin(), required_instance_extensions.end() );
+		}
 #ifndef NDEBUG
 		//extensions.insert( extensions.end(), DebugInfo::instance_debug_extensions.begin(), DebugInfo::instance_debug_extensions.end() );
 #endif // NDEBUG
@@ -259,11 +336,14 @@ namespace stlr {
 	}
 
 	vk::UniqueSurfaceKHR RendererCore::create_surface() {
+		if( is_headless() )
+			return {};
+
 #ifdef VK_USE_PLATFORM_XLIB_KHR
 		vk::XlibSurfaceCreateInfoKHR ci{
 			{},
-			window.get_x11_info().display,
-			window.get_x11_info().window
+			window->get_x11_info().display,
+			window->get_x11_info().window
 		};
 
 		return instance->createXlibSurfaceKHRUnique( ci );
@@ -274,7 +354,7 @@ namespace stlr {
 		vk::Win32SurfaceCreateInfoKHR ci{
 			{},
 			{},
-			window.get_hwnd()
+			window->get_hwnd()
 		};
 
 		return instance->createWin32SurfaceKHRUnique( ci );
@@ -303,89 +383,102 @@ namespace stlr {
 		std::vector<vk::QueueFamilyProperties2> queue_fam_props{ p.getQueueFamilyProperties2() };
 		uint32_t gfx_queue_index = UINT32_MAX;
 		uint32_t trfr_queue_index = UINT32_MAX;
-		std::tie( gfx_queue_index, trfr_queue_index ) = get_graphics_and_transfer_queue_indices( p, queue_fam_props );
+		uint32_t comp_queue_index = UINT32_MAX;
+		std::tie( gfx_queue_index, trfr_queue_index, comp_queue_index ) = get_queue_family_indices( p, queue_fam_props );
 
 		// If there's no graphics queue, don't continue.
 		if( gfx_queue_index == UINT32_MAX )
 			return std::nullopt;
 
 		vk::PhysicalDeviceMemoryProperties2 memProps{ p.getMemoryProperties2() };
-		vk::PhysicalDeviceFeatures2 feats{ p.getFeatures2() };
-		vk::PhysicalDeviceProperties2 props{ p.getProperties2() };
-		vk::SurfaceCapabilities2KHR surf_cap{ p.getSurfaceCapabilities2KHR( surface.get() ) };
-		std::vector<vk::SurfaceFormat2KHR> surf_forms{ p.getSurfaceFormats2KHR( surface.get() ) };
+		auto feature_chain = p.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+		vk::PhysicalDeviceFeatures2 feats{ feature_chain.get<vk::PhysicalDeviceFeatures2>() };
+		vk::PhysicalDeviceVulkan12Features feats_12{ feature_chain.get<vk::PhysicalDeviceVulkan12Features>() };
+		feats_12.pNext = nullptr;
 
-		bool same_queue_family{ gfx_queue_index == trfr_queue_index };
-		bool more_than_one_gfx_queue{ queue_fam_props[gfx_queue_index].queueFamilyProperties.queueCount > 1 };
-		bool same_multiple_queue_family = same_queue_family && more_than_one_gfx_queue;
-
-		std::vector<float> priority{
-			same_multiple_queue_family ? std::vector<float>{ 1.0f, 0.0f } : std::vector<float>{ 1.0f }
-		};
+		// Timeline semaphores are core in 1.2 and the upload manager depends on them.
+		if( !feats_12.timelineSemaphore )
+			return std::nullopt;
 
-		std::vector<vk::DeviceQueueCreateInfo> queue_ci;
+		vk::PhysicalDeviceProperties2 props{ p.getProperties2() };
+		vk::SurfaceCapabilities2KHR surf_cap;
+		std::vector<vk::SurfaceFormat2KHR> surf_forms;
+		std::vector<const char*> extensions;
+		if( surface ) {
+			surf_cap = p.getSurfaceCapabilities2KHR( surface.get() );
+			surf_forms = p.getSurfaceFormats2KHR( surface.get() );
+			extensions.assign( required_device_extension.begin(), required_device_extension.end() );
+		}
 
-		// If the transfer queue is exclusive from the graphics family, create a queue
-		// for each family. If it shares the same family as graphics and has more than
-		// one queue available, create 2 queues of the graphics family - one for
-		// graphics and one for transfer. Otherwise, they both share the same queue.
-		if( !same_queue_family ) {
-			queue_ci = std::vector<vk::DeviceQueueCreateInfo>{
-				vk::DeviceQueueCreateInfo( {}, gfx_queue_index, 1, priority.data() ),
-				vk::DeviceQueueCreateInfo( {}, trfr_queue_index, 1, priority.data() )
-			};
+		std::vector<vk::ExtensionProperties> supported_extensions{ p.enumerateDeviceExtensionProperties() };
+		for( const char* e : optional_device_extensions ) {
+			auto supported = std::find_if( supported_extensions.begin(), supported_extensions.end(), [e]( const vk::ExtensionProperties& s ) { return std::strcmp( s.extensionName, e ) == 0; } );
+			if( supported != supported_extensions.end() )
+				extensions.push_back( e );
 		}
-		else if( same_multiple_queue_family ) {
-			queue_ci = std::vector<vk::DeviceQueueCreateInfo>{
-				vk::DeviceQueueCreateInfo( {}, gfx_queue_index, 2, priority.data() ),
-			};
+
+		// Graphics, transfer and compute each get their own queue while their family has queues
+		// left, in that order; the ones that don't share the last queue of their family.
+		const std::array<uint32_t, 3> families{ gfx_queue_index, trfr_queue_index, comp_queue_index };
+		const std::array<float, 3> role_priorities{ 1.0f, 0.0f, 0.5f };
+		std::array<uint32_t, 3> queue_indices{};
+		std::vector<std::pair<uint32_t, std::vector<float>>> family_priorities;
+
+		for( uint32_t i = 0; i < families.size(); ++i ) {
+			auto family = std::find_if( family_priorities.begin(), family_priorities.end(), [&]( const auto& f ) { return f.first == families[i]; } );
+			if( family == family_priorities.end() ) {
+				family_priorities.emplace_back( families[i], std::vector<float>{} );
+				family = family_priorities.end() - 1;
+			}
+
+			const uint32_t queue_count{ queue_fam_props[families[i]].queueFamilyProperties.queueCount };
+			if( family->second.size() < queue_count )
+				family->second.push_back( role_priorities[i] );
+			queue_indices[i] = static_cast<uint32_t>( family->second.size() ) - 1;
 		}
-		else {
-			queue_ci = std::vector<vk::DeviceQueueCreateInfo>{
-				vk::DeviceQueueCreateInfo( {}, gfx_queue_index, 1, priority.data() ),
-			};
+
+		std::vector<vk::DeviceQueueCreateInfo> queue_ci;
+		for( const auto& f : family_priorities ) {
+			queue_ci.push_back( vk::DeviceQueueCreateInfo( {}, f.first, static_cast<uint32_t>( f.second.size() ), f.second.data() ) );
 		}
 
 		vk::DeviceCreateInfo dev_ci{
 			{},
 			queue_ci,
 			nullptr,
-			required_device_extension
+			extensions
 		};
 
+		feats.pNext = &feats_12;
 		dev_ci.setPNext( &feats );
 		vk::UniqueDevice dev{ p.createDeviceUnique( dev_ci ) };
+		feats.pNext = nullptr;
 
-		vk::Queue gfx_queue{ dev->getQueue( gfx_queue_index, 0 ) };
-
-		vk::Queue trfr_queue;
-		if( same_multiple_queue_family ) {
-			trfr_queue = dev->getQueue( gfx_queue_index, 1 );
-		}
-		else if( same_queue_family && !more_than_one_gfx_queue ) {
-			trfr_queue = dev->getQueue( gfx_queue_index, 0 );
-		}
-		else {
-			trfr_queue = dev->getQueue( trfr_queue_index, 0 );
-		}
+		vk::Queue gfx_queue{ dev->getQueue( gfx_queue_index, queue_indices[0] ) };
+		vk::Queue trfr_queue{ dev->getQueue( trfr_queue_index, queue_indices[1] ) };
+		vk::Queue comp_queue{ dev->getQueue( comp_queue_index, queue_indices[2] ) };
 
 		return stlr::RendererCore::Device {
 			p,
 			queue_fam_props,
 			memProps,
 			feats,
+			feats_12,
 			props,
 			surf_cap,
 			surf_forms,
+			extensions,
 			std::move( dev ),
 			gfx_queue,
 			trfr_queue,
+			comp_queue,
 			gfx_queue_index,
-			trfr_queue_index
+			trfr_queue_index,
+			comp_queue_index
 		};
 	}
 
-	std::pair<uint32_t, uint32_t> RendererCore::get_graphics_and_transfer_queue_indices( const vk::PhysicalDevice& p, const std::vector<vk::QueueFamilyProperties2>& queue_fam_props ) {
+	std::tuple<uint32_t, uint32_t, uint32_t> RendererCore::get_queue_family_indices( const vk::PhysicalDevice& p, const std::vector<vk::QueueFamilyProperties2>& queue_fam_props ) {
 		uint32_t gfx_queue_index { UINT32_MAX };
 		uint32_t trfr_queue_index { UINT32_MAX };
 		uint32_t comp_queue_index { UINT32_MAX };
@@ -396,8 +489,8 @@ namespace stlr {
 		for( uint32_t i = 0; i < queue_fam_props.size(); i++ ) {
 			vk::QueueFamilyProperties q{ queue_fam_props[i].queueFamilyProperties };
 
-			// If the family supports presentation and graphics, use it exclusively.
-			if( !gfx_queue_found && p.getSurfaceSupportKHR( i, surface.get() ) && q.queueFlags & vk::QueueFlagBits::eGraphics ) {
+			// If the family supports presentation (when there's a surface) and graphics, use it exclusively.
+			if( !gfx_queue_found && q.queueFlags & vk::QueueFlagBits::eGraphics && ( !surface || p.getSurfaceSupportKHR( i, surface.get() ) ) ) {
 				gfx_queue_index = i;
 				gfx_queue_found = true;
 			}
@@ -425,7 +518,7 @@ namespace stlr {
 				comp_queue_found = true;
 			}
 
-			if( gfx_queue_found && trfr_queue_found )
+			if( gfx_queue_found && trfr_queue_found && comp_queue_found )
 				break;
 		}
 
@@ -438,7 +531,12 @@ namespace stlr {
 			trfr_queue_index = comp_queue_index;
 		}
 
-		return std::pair( gfx_queue_index, trfr_queue_index );
+		// Without a compute-only family, culling runs on the graphics queue.
+		if( !comp_queue_found ) {
+			comp_queue_index = gfx_queue_index;
+		}
+
+		return std::tuple( gfx_queue_index, trfr_queue_index, comp_queue_index );
 	}
 
 	const std::vector<RendererCore::Device>::iterator RendererCore::select_best_device() {
@@ -486,6 +584,15 @@ namespace stlr {
 		return selected_device->device->createCommandPoolUnique( trfr_ci );
 	}
 
+	vk::UniqueCommandPool RendererCore::create_compute_command_pool() {
+		vk::CommandPoolCreateInfo comp_ci {
+			vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+			selected_device->compute_queue_index
+		};
+
+		return selected_device->device->createCommandPoolUnique( comp_ci );
+	}
+
 	vk::UniqueCommandBuffer RendererCore::allocate_graphics_command_buffer() {
 		vk::CommandBufferAllocateInfo ai {
 			present_command_pool.get(),
@@ -506,26 +613,36 @@ namespace stlr {
 		return std::move( selected_device->device->allocateCommandBuffersUnique( ai ).front() );
 	}
 
-	RendererCore::Swapchain RendererCore::create_swapchain() {
+	RendererCore::Swapchain RendererCore::create_swapchain( vk::SwapchainKHR old_swapchain ) {
+		const vk::PhysicalDevice physical_device { selected_device->physical_device };
 		const vk::SurfaceCapabilitiesKHR& surface_capabilities { selected_device->capabilities.surfaceCapabilities };
-		const vk::SurfaceFormatKHR& surface_format { selected_device->formats.front().surfaceFormat };
+		std::vector<vk::SurfaceFormatKHR> surface_formats;
+		surface_formats.reserve( selected_device->formats.size() );
+		for( const auto& f : selected_device->formats ) {
+			surface_formats.push_back( f.surfaceFormat );
+		}
+		const vk::SurfaceFormatKHR surface_format { swapchain_settings.choose_format( physical_device, surface_formats ) };
+		const vk::PresentModeKHR present_mode { swapchain_settings.choose_present_mode( physical_device.getSurfacePresentModesKHR( surface.get() ) ) };
+
+		// Passing the old swapchain lets the presentation engine hand its resources over and keep
+		// showing its last image until the new one presents.
 		vk::SwapchainCreateInfoKHR ci{
 			{},
 			surface.get(),
-			surface_capabilities.minImageCount,
+			swapchain_settings.choose_image_count( present_mode, surface_capabilities ),
 			surface_format.format,
 			surface_format.colorSpace,
-			surface_capabilities.currentExtent,
+			SwapchainSettings::choose_extent( surface_capabilities, get_window_extent() ),
 			1,
             vk::ImageUsageFlagBits::eColorAttachment,
 			vk::SharingMode::eExclusive,
 			0,
 			nullptr,
 			surface_capabilities.currentTransform,
-			vk::CompositeAlphaFlagBitsKHR::eOpaque,
-			vk::PresentModeKHR::eImmediate,
+			SwapchainSettings::choose_composite_alpha( surface_capabilities ),
+			present_mode,
 			true,
-			nullptr
+			old_swapchain
 		};
 
 		vk::UniqueSwapchainKHR swapchain { selected_device->device->createSwapchainKHRUnique( ci ) };
@@ -554,10 +671,75 @@ namespace stlr {
 		}
 
 
-        return Swapchain{ std::move( swapchain ), swapchain_images, std::move( swapchain_image_views ), ci.imageFormat, ci.imageColorSpace, ci.imageExtent, 0 };
+        return Swapchain{ std::move( swapchain ), swapchain_images, std::move( swapchain_image_views ), ci.imageFormat, ci.imageColorSpace, ci.imageExtent, 0, present_mode };
+    }
+
+    vk::Extent2D RendererCore::get_window_extent() const {
+        const auto [width, height] = window->get_framebuffer_size();
+        return vk::Extent2D { static_cast<uint32_t>( std::max( width, 0 ) ), static_cast<uint32_t>( std::max( height, 0 ) ) };
+    }
+
+    bool RendererCore::recreate_swapchain() {
+        // The capabilities were queried when the device was created; the extent has changed since.
+        selected_device->capabilities.surfaceCapabilities = selected_device->physical_device.getSurfaceCapabilitiesKHR( surface.get() );
+        window_extent = get_window_extent();
+        const vk::Extent2D extent { SwapchainSettings::choose_extent( selected_device->capabilities.surfaceCapabilities, window_extent ) };
+        // A minimized window has nothing to present to until it's restored.
+        if( extent.width == 0 || extent.height == 0 )
+            return false;
+
+        // Only what's sized to the swapchain is replaced; the device, pipelines and resources stay.
+        // The old ones are retired rather than destroyed, so there's no wait for the frames in flight.
+        Swapchain new_swapchain { create_swapchain( swapchain.swapchain.get() ) };
+        const vk::Format depth_format { depth_image._format };
+        retired_swapchains.push_back( RetiredSwapchain { std::move( swapchain ), std::move( depth_image ), std::move( depth_image_view ), {}, {}, frame_number } );
+        swapchain = std::move( new_swapchain );
+        depth_image = create_image_2d( swapchain.extent.width, swapchain.extent.height, depth_format );
+        depth_image_view = create_image_view_2d( depth_image );
+        swapchain_outdated = false;
+
+        on_swapchain_recreated();
+        return true;
+    }
+
+    void RendererCore::destroy_retired_swapchains() {
+        // Frames finish in submission order, so once this frame's fence has been waited on, every
+        // frame up to frames_in_flight ago is done with the swapchain it used.
+        while( !retired_swapchains.empty() && frame_number >= retired_swapchains.front().frame + frames.size() ) {
+            retired_swapchains.erase( retired_swapchains.begin() );
+        }
+    }
+
+    std::vector<RendererCore::Image> RendererCore::create_offscreen_images( vk::Extent2D extent, uint32_t count ) {
+        std::vector<Image> images;
+        images.reserve( count );
+
+        // One image per frame in flight, so the frame's fence also guards its image.
+        for( uint32_t i = 0; i < count; ++i ) {
+            images.push_back( create_image_2d( extent.width, extent.height, offscreen_format, vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eSampled ) );
+        }
+
+        return images;
+    }
+
+    RendererCore::Swapchain RendererCore::create_offscreen_swapchain() {
+        std::vector<vk::Image> images;
+        std::vector<vk::UniqueImageView> image_views;
+        images.reserve( offscreen_images.size() );
+        image_views.reserve( offscreen_images.size() );
+
+        for( auto& i : offscreen_images ) {
+            images.push_back( i._object.get() );
+            image_views.push_back( create_image_view_2d( i ) );
+        }
+
+        const vk::Extent2D extent { offscreen_images.front()._width, offscreen_images.front()._height };
+        return Swapchain{ {}, images, std::move( image_views ), offscreen_format, vk::ColorSpaceKHR::eSrgbNonlinear, extent, 0 };
     }
 
     vk::UniqueSampler RendererCore::create_sampler() {
+        // The device was created with every supported feature, so anisotropy is enabled when it's supported.
+        const bool anisotropy { selected_device->features.features.samplerAnisotropy == VK_TRUE };
         vk::SamplerCreateInfo ci {
             {},
             vk::Filter::eLinear,
@@ -567,12 +749,12 @@ namespace stlr {
             vk::SamplerAddressMode::eRepeat,
             vk::SamplerAddressMode::eRepeat,
             0.0f,
-            false,
-            0.0f,
+            anisotropy,
+            anisotropy ? selected_device->properties.properties.limits.maxSamplerAnisotropy : 1.0f,
             false,
             vk::CompareOp::eNever,
             0.0f,
-            0.0f,
+            VK_LOD_CLAMP_NONE,
             vk::BorderColor::eIntOpaqueBlack,
             false
         };
@@ -580,6 +762,255 @@ namespace stlr {
         return selected_device->device->createSamplerUnique( ci );
     }
 
+    std::unique_ptr<BindlessDescriptors> RendererCore::create_bindless_descriptors( uint32_t frames_in_flight ) {
+        // The device was created with every supported 1.2 feature, so support means enabled.
+        if( !BindlessDescriptors::is_supported( selected_device->features_12 ) )
+            return nullptr;
+
+        return std::make_unique<BindlessDescriptors>( selected_device->physical_device, selected_device->device.get(), frames_in_flight );
+    }
+
+    std::vector<RendererCore::Frame> RendererCore::create_frames( uint32_t count ) {
+        vk::CommandBufferAllocateInfo ai {
+            present_command_pool.get(),
+            vk::CommandBufferLevel::ePrimary,
+            count
+        };
+        std::vector<vk::UniqueCommandBuffer> command_buffers { selected_device->device->allocateCommandBuffersUnique( ai ) };
+        ai.commandPool = compute_command_pool.get();
+        std::vector<vk::UniqueCommandBuffer> compute_command_buffers { selected_device->device->allocateCommandBuffersUnique( ai ) };
+
+        std::vector<Frame> f;
+        f.reserve( count );
+        for( uint32_t i = 0; i < count; ++i ) {
+            // Fences start signaled so the first wait on each frame returns immediately.
+            f.push_back( Frame {
+                std::move( command_buffers[i] ),
+                selected_device->device->createSemaphoreUnique( {} ),
+                selected_device->device->createSemaphoreUnique( {} ),
+                selected_device->device->createFenceUnique( { vk::FenceCreateFlagBits::eSignaled } ),
+                std::move( compute_command_buffers[i] ),
+                selected_device->device->createSemaphoreUnique( {} )
+            } );
+        }
+
+        return f;
+    }
+
+    std::vector<DescriptorAllocator> RendererCore::create_frame_descriptor_allocators( uint32_t count ) {
+        std::vector<DescriptorAllocator> a;
+        a.reserve( count );
+        for( uint32_t i = 0; i < count; ++i ) {
+            a.emplace_back( selected_device->device.get() );
+        }
+
+        return a;
+    }
+
+    void RendererCore::init_culling( const std::filesystem::path& shader_file, uint32_t max_objects ) {
+        if( !selected_device->features_12.drawIndirectCount )
+            throw std::runtime_error( "GPU culling needs drawIndirectCount, which the device doesn't support." );
+        // Each draw's firstInstance is its object's index.
+        if( !selected_device->features.features.drawIndirectFirstInstance )
+            throw std::runtime_error( "GPU culling needs drawIndirectFirstInstance, which the device doesn't support." );
+
+        culling = std::make_unique<GpuCulling>( selected_device->device.get(), allocator, shader_file, get_frames_in_flight(), max_objects, std::array<uint32_t, 2> { selected_device->compute_queue_index, selected_device->graphics_queue_index } );
+    }
+
+    void RendererCore::cull( uint32_t object_count, const std::array<float, 16>& view_projection ) {
+        Frame& f = frames[current_frame];
+
+        // The frame's fence covers the last culling in this slot too, since its graphics submission waited for it.
+        f.compute_command_buffer->begin( vk::CommandBufferBeginInfo { vk::CommandBufferUsageFlagBits::eOneTimeSubmit } );
+        culling->record( f.compute_command_buffer.get(), current_frame, object_count, GpuCulling::get_frustum( view_projection ) );
+        f.compute_command_buffer->end();
+
+        // The objects were written through mapped memory, which must be visible before the compute queue reads it.
+        allocator.flush();
+
+        vk::SubmitInfo si {
+            0,
+            nullptr,
+            nullptr,
+            1,
+            &f.compute_command_buffer.get(),
+            1,
+            &f.culling_finished_semaphore.get()
+        };
+        selected_device->compute_queue.submit( si, nullptr );
+        f.culled = true;
+    }
+
+    bool RendererCore::begin_frame() {
+        Frame& f = frames[current_frame];
+
+        // Only wait for the GPU to release this frame's objects; the other frames keep running.
+        auto res = selected_device->device->waitForFences( f.in_flight_fence.get(), true, UINT64_MAX );
+        // With a lower latency limit, also wait for the frame submitted that many frames ago.
+        const uint32_t latency { swapchain_settings.get_frame_latency( get_frames_in_flight() ) };
+        if( latency < get_frames_in_flight() ) {
+            const uint32_t previous { ( current_frame + get_frames_in_flight() - latency ) % get_frames_in_flight() };
+            res = selected_device->device->waitForFences( frames[previous].in_flight_fence.get(), true, UINT64_MAX );
+        }
+        destroy_retired_swapchains();
+
+        if( is_headless() ) {
+            swapchain.current_image_index = current_frame;
+        }
+        else {
+            // Not every platform reports a resize as out of date, so the window's size is checked too.
+            if( get_window_extent() != window_extent )
+                swapchain_outdated = true;
+            if( swapchain_outdated && !recreate_swapchain() )
+                return false;
+
+            res = selected_device->device->acquireNextImageKHR( swapchain.swapchain.get(), UINT64_MAX, f.image_acquired_semaphore.get(), nullptr, &swapchain.current_image_index );
+            // Nothing was acquired and the semaphore won't be signaled, so the frame can retry on a new swapchain.
+            if( res == vk::Result::eErrorOutOfDateKHR ) {
+                if( !recreate_swapchain() )
+                    return false;
+                res = selected_device->device->acquireNextImageKHR( swapchain.swapchain.get(), UINT64_MAX, f.image_acquired_semaphore.get(), nullptr, &swapchain.current_image_index );
+            }
+            // A suboptimal image was still acquired; it's rendered and presented, then the swapchain is recreated.
+            if( res == vk::Result::eSuboptimalKHR ) {
+                swapchain_outdated = true;
+            }
+            else if( res == vk::Result::eErrorOutOfDateKHR ) {
+                swapchain_outdated = true;
+                return false;
+            }
+            else if( res != vk::Result::eSuccess ) {
+                throw std::runtime_error( "Failed to acquire a swapchain image: " + vk::to_string( res ) );
+            }
+        }
+        // Only reset once the frame is certain to be submitted, or the next wait on it would never return.
+        selected_device->device->resetFences( f.in_flight_fence.get() );
+
+        // The fence also means the GPU is done with the secondary command buffers recorded for this frame.
+        recorder.begin_frame( current_frame );
+        if( bindless )
+            bindless->begin_frame( current_frame );
+        uniforms.begin_frame( current_frame );
+        frame_descriptor_allocators[current_frame].reset();
+        // Queues this frame's texture uploads and evictions before they're submitted below.
+        streamer.update();
+
+        f.command_buffer->begin( vk::CommandBufferBeginInfo { vk::CommandBufferUsageFlagBits::eOneTimeSubmit } );
+
+        // Send off the uploads queued since the last frame, then take ownership of the ones
+        // that are finished (or required) so this frame can use them.
+        uploader.submit();
+        frame_upload_wait = uploader.record_acquire_barriers( f.command_buffer.get(), std::max( uploader.get_completed_token(), required_upload ) );
+
+        // The fence wait above guarantees this frame's previous timestamps are available.
+        profiler.begin_frame( current_frame, f.command_buffer.get() );
+        f.profile_scope = profiler.begin_scope( f.command_buffer.get(), "Frame" );
+        return true;
+    }
+
+    void RendererCore::end_frame() {
+        Frame& f = frames[current_frame];
+        profiler.end_scope( f.command_buffer.get(), f.profile_scope );
+        f.command_buffer->end();
+
+        // Make this frame's writes to persistently mapped, non-coherent memory visible to the GPU.
+        allocator.flush();
+
+        std::array<vk::Semaphore, 3> wait_semaphores { f.image_acquired_semaphore.get(), uploader.get_semaphore(), f.culling_finished_semaphore.get() };
+        std::array<vk::PipelineStageFlags, 3> wait_stages { vk::PipelineStageFlagBits::eColorAttachmentOutput, frame_upload_wait.second, vk::PipelineStageFlagBits::eDrawIndirect };
+        // The binary semaphores' values are ignored.
+        std::array<uint64_t, 3> wait_values { 0, frame_upload_wait.first, 0 };
+        // Without an upload to wait on, the culling wait takes its place.
+        uint32_t wait_end { frame_upload_wait.first > 0 ? 2u : 1u };
+        if( f.culled ) {
+            wait_semaphores[wait_end] = wait_semaphores[2];
+            wait_stages[wait_end] = wait_stages[2];
+            wait_values[wait_end] = wait_values[2];
+            ++wait_end;
+            f.culled = false;
+        }
+        // Headless frames have no acquire to wait on and nothing to present.
+        const uint32_t first_wait { is_headless() ? 1u : 0u };
+        const uint32_t wait_count { wait_end - first_wait };
+
+        vk::TimelineSemaphoreSubmitInfo ti { wait_count, wait_values.data() + first_wait, 0, nullptr };
+        vk::SubmitInfo si {
+            wait_count,
+            wait_semaphores.data() + first_wait,
+            wait_stages.data() + first_wait,
+            1,
+            &f.command_buffer.get(),
+            is_headless() ? 0u : 1u,
+            &f.render_finished_semaphore.get()
+        };
+        si.setPNext( &ti );
+        selected_device->graphics_queue.submit( si, f.in_flight_fence.get() );
+
+        if( is_headless() ) {
+            current_frame = ( current_frame + 1 ) % frames.size();
+            ++frame_number;
+            return;
+        }
+
+        vk::PresentInfoKHR pi {
+            f.render_finished_semaphore.get(),
+            swapchain.swapchain.get(),
+            swapchain.current_image_index
+        };
+        // The pointer overload returns out of date instead of throwing it.
+        const vk::Result res { selected_device->graphics_queue.presentKHR( &pi ) };
+        if( res == vk::Result::eErrorOutOfDateKHR || res == vk::Result::eSuboptimalKHR )
+            swapchain_outdated = true;
+        else if( res != vk::Result::eSuccess )
+            throw std::runtime_error( "Failed to present: " + vk::to_string( res ) );
+
+        current_frame = ( current_frame + 1 ) % frames.size();
+        ++frame_number;
+    }
+
+    void RendererCore::render_loop( uint64_t frame_limit ) {
+        Timer update_timer;
+        Timer record_timer;
+
+        for( uint64_t frame = 0; frame_limit == 0 || frame < frame_limit; ++frame ) {
+            if( !is_headless() ) {
+                glfwPollEvents();
+                if( window->is_set_to_close() )
+                    break;
+            }
+            if( close_requested )
+                break;
+
+            timer.stop();
+            delta_time = timer.get_elapsed_time();
+            timer.start();
+
+            update_timer.start();
+            if( pre_update != nullptr )
+                pre_update();
+            update();
+            if( post_update != nullptr )
+                post_update();
+            update_timer.stop();
+            profiler.add_cpu_scope( "Update", update_timer );
+
+            // Includes waiting for the frame's fence, so a GPU-bound frame shows up here.
+            record_timer.start();
+            // A minimized window skips frames until it's restored.
+            if( !begin_frame() ) {
+                record_timer.stop();
+                glfwWaitEventsTimeout( 0.1 );
+                continue;
+            }
+            render();
+            end_frame();
+            record_timer.stop();
+            profiler.add_cpu_scope( "Frame", record_timer );
+        }
+
+        selected_device->device->waitIdle();
+    }
+
     std::vector<char> RendererCore::get_shader_data(std::string spv_file) {
         auto f = std::ifstream(spv_file, std::ios::ate | std::ios::binary);
         if(!f.is_open()) {
@@ -1,95 +1,518 @@
 #include "RendererCore.hpp"
+#include "RenderGraph.hpp"
+#include "TransformHierarchy.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+#include <iostream>
+#include <string>
 
 class MyRenderer : public stlr::RendererCore {
-protected:
-    std::array<vk::DescriptorPoolSize, 1> descriptor_pool_sizes =
-    {
-        vk::DescriptorPoolSize( vk::DescriptorType::eUniformBuffer, 1 )
+public:
+    enum class DrawMode {
+        /// One draw per cube, its matrix pushed as a constant.
+        eEveryCube,
+        /// Culled on the compute queue and drawn indirectly.
+        eCulled,
+        /// One draw per cube sampling a texture from the bindless set.
+        eTextured
     };
 
-    std::array<vk::DescriptorSetLayoutBinding, 1> descriptor_set_layout_bindings =
-    {
-        vk::DescriptorSetLayoutBinding( 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex, nullptr )
-    };
+protected:
+    using Usage = stlr::RenderGraph::Usage;
 
-    std::array<vk::AttachmentDescription, 2> attachment_descriptions {
-        vk::AttachmentDescription(
-            {},
-            swapchain.format,
-            vk::SampleCountFlagBits::e1,
-            vk::AttachmentLoadOp::eClear,
-            vk::AttachmentStoreOp::eStore,
-            vk::AttachmentLoadOp::eDontCare,
-            vk::AttachmentStoreOp::eDontCare,
-            vk::ImageLayout::ePreinitialized,
-            vk::ImageLayout::ePresentSrcKHR
-        ),
-        vk::AttachmentDescription(
-            {},
-            depth_image._format,
-            vk::SampleCountFlagBits::e1,
-            vk::AttachmentLoadOp::eClear,
-            vk::AttachmentStoreOp::eStore,
-            vk::AttachmentLoadOp::eDontCare,
-            vk::AttachmentStoreOp::eDontCare,
-            vk::ImageLayout::ePreinitialized,
-            vk::ImageLayout::eDepthStencilAttachmentOptimal
-        )
+    static constexpr std::array<std::array<float, 4>, 8> cube_vertices {{
+        { -1.0f, -1.0f, -1.0f, 1.0f },
+        {  1.0f, -1.0f, -1.0f, 1.0f },
+        {  1.0f,  1.0f, -1.0f, 1.0f },
+        { -1.0f,  1.0f, -1.0f, 1.0f },
+        { -1.0f, -1.0f,  1.0f, 1.0f },
+        {  1.0f, -1.0f,  1.0f, 1.0f },
+        {  1.0f,  1.0f,  1.0f, 1.0f },
+        { -1.0f,  1.0f,  1.0f, 1.0f }
+    }};
+
+    static constexpr std::array<uint16_t, 36> cube_indices {
+        0, 2, 1, 0, 3, 2,
+        4, 5, 6, 4, 6, 7,
+        0, 1, 5, 0, 5, 4,
+        3, 6, 2, 3, 7, 6,
+        0, 4, 7, 0, 7, 3,
+        1, 2, 6, 1, 6, 5
     };
 
-    Subpass subpass {
-        {
-            vk::AttachmentReference( 0, vk::ImageLayout::eColorAttachmentOptimal )
-        },
-        vk::AttachmentReference( 1, vk::ImageLayout::eDepthStencilAttachmentOptimal )
+    /// The cubes are laid out in a square grid, each drawn by its own task.
+    static constexpr uint32_t grid_size = 8;
+    static constexpr uint32_t cube_count = grid_size * grid_size;
+
+    /// The textured draws' constants: the cube's matrix, then what the fragment shader reads.
+    struct TexturedConstants {
+        glm::mat4 mvp;
+        stlr::BindlessDescriptors::Handle texture;
+        stlr::BindlessDescriptors::Handle tints;
+        uint32_t cube;
+        uint32_t grid_size;
     };
 
-    vk::UniqueDescriptorPool descriptor_pool;
-    vk::UniqueDescriptorSetLayout descriptor_set_layout;
-    vk::UniqueDescriptorSet descriptor_set;
-    vk::UniqueRenderPass render_pass;
-    std::vector<vk::UniqueFramebuffer> framebuffers;
+    stlr::RenderGraph graph;
+    stlr::RenderGraph::Handle color_target;
+    stlr::RenderGraph::Handle depth_target;
     vk::UniqueShaderModule vertex_shader_module;
     vk::UniqueShaderModule fragment_shader_module;
     RendererCore::Buffer vertex_buffer;
     RendererCore::Buffer index_buffer;
+    /// One root node per cube.
+    stlr::TransformHierarchy cubes;
+    /// This frame's matrix of each cube, pushed as a constant before its draw.
+    std::vector<glm::mat4> mvps;
+    /// Headless only: the color image of a frame is copied here when a readback is requested.
+    std::optional<RendererCore::Buffer> readback_buffer;
     vk::UniquePipelineLayout pipeline_layout;
     vk::UniquePipeline pipeline;
-    vk::UniqueSemaphore image_acquired_semaphore;
-    vk::UniqueSemaphore image_ready_semaphore;
-    vk::UniqueFence fence;
-    vk::Viewport viewport;
-    vk::Rect2D scissor;
+    glm::mat4 view_projection;
+    /// Headless only, when the device supports it: the cubes can instead be culled on the compute
+    /// queue and drawn indirectly, reading their world matrices from the culling's objects buffer.
+    bool culling_supported;
+    vk::DescriptorSetLayout objects_set_layout;
+    vk::DescriptorSet objects_set;
+    vk::UniqueShaderModule culled_vertex_shader_module;
+    vk::UniquePipelineLayout culled_pipeline_layout;
+    vk::UniquePipeline culled_pipeline;
+    /// Headless only, when the device supports bindless descriptors: the cubes can instead sample a
+    /// checker texture spread over the grid, tinted by each cube's color in a storage buffer, both
+    /// from the bindless set. The checker is streamed; a small one stands in until it's resident.
+    bool textured_supported;
+    std::optional<RendererCore::Image> checker_image;
+    vk::UniqueImageView checker_view;
+    stlr::BindlessDescriptors::Handle checker_texture;
+    stlr::TextureStreamer::TextureId streamed_checker;
+    /// This frame's handle of the streamed checker, or of the small one while it isn't resident.
+    stlr::BindlessDescriptors::Handle texture;
+    std::optional<RendererCore::Buffer> tints_buffer;
+    stlr::BindlessDescriptors::Handle tints;
+    vk::UniqueShaderModule textured_fragment_shader_module;
+    vk::UniquePipelineLayout textured_pipeline_layout;
+    vk::UniquePipeline textured_pipeline;
+    DrawMode draw_mode;
+    float angle;
+    bool animating;
+    /// Whether the draws are spread over the recording threads or recorded by one thread.
+    bool parallel_recording;
+    bool readback_requested;
 
 public:
-    MyRenderer( stlr::Window& w )
-        : stlr::RendererCore( w )
-        , descriptor_pool( create_descriptor_pool( descriptor_pool_sizes ) )
-        , descriptor_set_layout( create_descriptor_set_layout( descriptor_set_layout_bindings ) )
-        , descriptor_set( allocate_descriptor_set( descriptor_pool, descriptor_set_layout ) )
-        , render_pass( create_render_pass( attachment_descriptions, subpass ) )
-        , framebuffers( )
+    /// Target is a stlr::Window, or a vk::Extent2D to render headless.
+    template <typename Target>
+    MyRenderer( Target& target )
+        : stlr::RendererCore( target, "../shaders" )
+        , graph( selected_device->device.get(), allocator )
+        , color_target()
+        , depth_target()
         , vertex_shader_module( create_shader_module( "../shaders/2-vs.spv" ) )
         , fragment_shader_module( create_shader_module( "../shaders/2-fs.spv" ) )
-        , vertex_buffer( create_buffer( 1024, vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent ) )
-        , index_buffer( create_buffer( 1024, vk::BufferUsageFlagBits::eIndexBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent ) )
-        , pipeline_layout( create_pipeline_layout( { &descriptor_set_layout } ) )
+        , vertex_buffer( create_buffer( sizeof( cube_vertices ), vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent ) )
+        , index_buffer( create_buffer( sizeof( cube_indices ), vk::BufferUsageFlagBits::eIndexBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent ) )
+        , mvps( cube_count )
+        , readback_buffer()
+        , pipeline_layout( create_constants_pipeline_layout<glm::mat4>( nullptr, vk::ShaderStageFlagBits::eVertex ) )
+        , view_projection( 1.0f )
+        , culling_supported( false )
+        , textured_supported( false )
+        , checker_texture( stlr::BindlessDescriptors::invalid_handle )
+        , streamed_checker( stlr::TextureStreamer::invalid_texture )
+        , texture( stlr::BindlessDescriptors::invalid_handle )
+        , tints( stlr::BindlessDescriptors::invalid_handle )
+        , draw_mode( DrawMode::eEveryCube )
+        , angle( 0.0f )
+        , animating( true )
+        , parallel_recording( true )
+        , readback_requested( false )
     {
-        std::array<vk::UniqueImageView*, 2> image_view_attachments;
-        image_view_attachments[1] = &depth_image_view;
-        for(  auto& i : swapchain.image_views ) {
-            image_view_attachments[0] = &i;
-            framebuffers.push_back( create_framebuffer( render_pass, image_view_attachments ) );
+        vertex_buffer._allocation.write( cube_vertices.data(), sizeof( cube_vertices ) );
+        index_buffer._allocation.write( cube_indices.data(), sizeof( cube_indices ) );
+        for( uint32_t c = 0; c < cube_count; ++c ) {
+            cubes.add();
         }
+
+        if( is_headless() )
+            readback_buffer.emplace( create_buffer( vk::DeviceSize( swapchain.extent.width ) * swapchain.extent.height * 4, vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent ) );
+
+        create_graph();
+        pipeline = create_pipeline( vertex_shader_module.get(), fragment_shader_module.get(), pipeline_layout.get() );
+
+        if( is_headless() ) {
+            try {
+                init_culling( "../shaders/cull-cs.spv", cube_count );
+                culling_supported = true;
+            }
+            catch( const std::runtime_error& e ) {
+                std::cout << "Not testing GPU culling: " << e.what() << std::endl;
+            }
+        }
+        if( culling_supported ) {
+            objects_set_layout = get_descriptor_set_layout( vk::DescriptorSetLayoutBinding( 0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex, nullptr ) );
+            culled_vertex_shader_module = create_shader_module( "../shaders/2-culled-vs.spv" );
+            culled_pipeline_layout = create_constants_pipeline_layout<glm::mat4>( objects_set_layout, vk::ShaderStageFlagBits::eVertex );
+            culled_pipeline = create_pipeline( culled_vertex_shader_module.get(), fragment_shader_module.get(), culled_pipeline_layout.get() );
+        }
+
+        if( is_headless() && !is_bindless_supported() )
+            std::cout << "Not testing bindless textures: the device doesn't support descriptor indexing." << std::endl;
+        textured_supported = is_headless() && is_bindless_supported();
+        if( textured_supported ) {
+            checker_image.emplace( load_texture( create_checker_texture( 16 ) ) );
+            checker_view = create_image_view_2d( *checker_image );
+            checker_texture = register_texture( checker_view.get() );
+            streamed_checker = stream_texture( create_checker_texture( 256 ) );
+
+            // Each cube's tint is packed as RGBA8, redder along the grid's rows and greener along its columns.
+            std::array<uint32_t, cube_count> colors;
+            for( uint32_t c = 0; c < cube_count; ++c ) {
+                colors[c] = ( 0x3fu + c % grid_size * 0x20u ) | ( 0x3fu + c / grid_size * 0x20u ) << 8 | 0xffu << 16 | 0xffu << 24;
+            }
+            tints_buffer.emplace( create_buffer( sizeof( colors ), vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent ) );
+            tints_buffer->_allocation.write( colors.data(), sizeof( colors ) );
+            tints = register_buffer( *tints_buffer );
+
+            textured_fragment_shader_module = create_shader_module( "../shaders/2-textured-fs.spv" );
+            vk::PushConstantRange constants_range { vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, sizeof( TexturedConstants ) };
+            textured_pipeline_layout = create_bindless_pipeline_layout( constants_range );
+            textured_pipeline = create_pipeline( vertex_shader_module.get(), textured_fragment_shader_module.get(), textured_pipeline_layout.get() );
+        }
+    }
+
+    bool is_culling_supported() const noexcept {
+        return culling_supported;
+    }
+
+    bool is_textured_supported() const noexcept {
+        return textured_supported;
+    }
+
+    /// The most detailed level of the streamed checker that's resident.
+    uint32_t get_streamed_level() const noexcept {
+        return streamer.get_resident_level( streamed_checker );
+    }
+
+    ///
+    /// \brief Renders frames of the cubes at a fixed angle, headless, and returns the last one's pixels.
+    /// \param parallel Whether the draws are recorded on the recording threads or on one thread.
+    /// \param mode eCulled and eTextured need is_culling_supported() and is_textured_supported().
+    /// \param frame_count More than one gives streamed textures time to become resident.
+    ///
+    std::vector<uint8_t> render_still( bool parallel, DrawMode mode = DrawMode::eEveryCube, uint32_t frame_count = 1 ) {
+        animating = false;
+        angle = 0.5f;
+        parallel_recording = parallel;
+        draw_mode = mode;
+        readback_requested = true;
+        // run() waits for the GPU before returning.
+        run( frame_count );
+        readback_requested = false;
+        draw_mode = DrawMode::eEveryCube;
+
+        const uint8_t* pixels { static_cast<const uint8_t*>( readback_buffer->_allocation->mapped ) };
+        return std::vector<uint8_t>( pixels, pixels + readback_buffer->_deviceSize );
     }
 
 protected:
-    void update() {}
-    void render() {}
+    /// A size x size RGBA8 texture of 16 x 16 grey and white squares, with every mip level. Size is a power of two of at least 16.
+    static stlr::TextureFile create_checker_texture( uint32_t size ) {
+        stlr::TextureFile t;
+        t.format = vk::Format::eR8G8B8A8Unorm;
+        t.width = size;
+        t.height = size;
+        t.layer_count = 1;
+
+        std::vector<uint8_t> level( size_t( size ) * size * 4 );
+        for( uint32_t y = 0; y < size; ++y ) {
+            for( uint32_t x = 0; x < size; ++x ) {
+                const uint8_t value { static_cast<uint8_t>( ( x * 16 / size + y * 16 / size ) % 2 ? 255 : 64 ) };
+                std::memset( level.data() + ( size_t( y ) * size + x ) * 4, value, 3 );
+                level[( size_t( y ) * size + x ) * 4 + 3] = 255;
+            }
+        }
+        for( uint32_t l = 0, s = size; ; ++l, s /= 2 ) {
+            t.subresources.push_back( stlr::TextureFile::Subresource { l, 0, t.data.size(), level.size() } );
+            t.data.insert( t.data.end(), level.begin(), level.end() );
+            if( s == 1 )
+                break;
+
+            // Each texel of the next level averages 2 x 2 of this one.
+            const uint32_t n { s / 2 };
+            std::vector<uint8_t> next( size_t( n ) * n * 4 );
+            for( uint32_t y = 0; y < n; ++y ) {
+                for( uint32_t x = 0; x < n; ++x ) {
+                    for( uint32_t c = 0; c < 4; ++c ) {
+                        const size_t top { ( size_t( y ) * 2 * s + x * 2 ) * 4 + c };
+                        const size_t bottom { top + size_t( s ) * 4 };
+                        next[( size_t( y ) * n + x ) * 4 + c] = static_cast<uint8_t>( ( level[top] + level[top + 4] + level[bottom] + level[bottom + 4] + 2 ) / 4 );
+                    }
+                }
+            }
+            level = std::move( next );
+        }
+        t.level_count = static_cast<uint32_t>( t.subresources.size() );
+        return t;
+    }
+
+    void create_graph() {
+        // The swapchain image is swapped in every frame. The depth image only lives during the scene
+        // pass, so it's left to the graph, which resizes it along with the swapchain.
+        color_target = graph.import_image(
+            "Swapchain",
+            swapchain.images.front(),
+            swapchain.image_views.front().get(),
+            stlr::RenderGraph::ImageDescription { swapchain.extent, swapchain.format },
+            stlr::RenderGraph::ImportState { vk::ImageLayout::eUndefined, vk::PipelineStageFlagBits::eColorAttachmentOutput, {}, get_present_layout() }
+        );
+        depth_target = graph.create_image( "Depth", stlr::RenderGraph::ImageDescription { swapchain.extent, vk::Format::eD32Sfloat } );
+
+        stlr::RenderGraph::Handle output;
+        graph.add_pass(
+            "Scene",
+            [&]( stlr::RenderGraph::PassBuilder& b ) {
+                output = b.write( color_target, Usage::eColorAttachment, vk::ClearColorValue( std::array<float, 4> { 0.1f, 0.1f, 0.1f, 1.0f } ) );
+                b.write( depth_target, Usage::eDepthAttachment, vk::ClearDepthStencilValue( 1.0f, 0 ) );
+                b.set_secondary_command_buffers();
+            },
+            [this]( vk::CommandBuffer, const stlr::RenderGraph& g ) {
+                if( draw_mode == DrawMode::eCulled ) {
+                    record_parallel( g.get_inheritance_info(), 1, [this]( vk::CommandBuffer command_buffer, uint32_t, uint32_t ) {
+                        draw_visible( command_buffer );
+                    } );
+                    return;
+                }
+                // One thread records every draw into a single buffer when recording isn't parallel.
+                record_parallel( g.get_inheritance_info(), cube_count, [this]( vk::CommandBuffer command_buffer, uint32_t first, uint32_t last ) {
+                    if( draw_mode == DrawMode::eTextured )
+                        draw_textured( command_buffer, first, last );
+                    else
+                        draw( command_buffer, first, last );
+                }, parallel_recording ? grid_size : cube_count );
+            }
+        );
+        graph.mark_output( output );
+
+        // Offscreen frames are left in eTransferSrcOptimal, so copying one out needs no extra transition.
+        if( is_headless() ) {
+            graph.add_pass(
+                "Readback",
+                [&]( stlr::RenderGraph::PassBuilder& b ) {
+                    b.read( output, Usage::eTransferSrc );
+                    b.set_side_effects();
+                },
+                [this, output]( vk::CommandBuffer command_buffer, const stlr::RenderGraph& g ) {
+                    if( !readback_requested )
+                        return;
+
+                    vk::BufferImageCopy region { 0, 0, 0, vk::ImageSubresourceLayers { vk::ImageAspectFlagBits::eColor, 0, 0, 1 }, vk::Offset3D { 0, 0, 0 }, vk::Extent3D { swapchain.extent.width, swapchain.extent.height, 1 } };
+                    command_buffer.copyImageToBuffer( g.get_image( output ), vk::ImageLayout::eTransferSrcOptimal, readback_buffer->_object.get(), region );
+                    vk::MemoryBarrier to_host { vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead };
+                    command_buffer.pipelineBarrier( vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, to_host, nullptr, nullptr );
+                }
+            );
+        }
+
+        graph.compile();
+    }
+
+    vk::UniquePipeline create_pipeline( vk::ShaderModule vertex_shader, vk::ShaderModule fragment_shader, vk::PipelineLayout layout ) {
+        std::array<vk::PipelineShaderStageCreateInfo, 2> stages {
+            vk::PipelineShaderStageCreateInfo( {}, vk::ShaderStageFlagBits::eVertex, vertex_shader, "main" ),
+            vk::PipelineShaderStageCreateInfo( {}, vk::ShaderStageFlagBits::eFragment, fragment_shader, "main" )
+        };
+
+        vk::VertexInputBindingDescription binding( 0, sizeof( cube_vertices[0] ), vk::VertexInputRate::eVertex );
+        vk::VertexInputAttributeDescription attribute( 0, 0, vk::Format::eR32G32B32A32Sfloat, 0 );
+        vk::PipelineVertexInputStateCreateInfo vertex_input( {}, 1, &binding, 1, &attribute );
+        vk::PipelineInputAssemblyStateCreateInfo input_assembly( {}, vk::PrimitiveTopology::eTriangleList, false );
+        // The viewport and scissor are dynamic, so the pipeline outlives swapchain recreation.
+        vk::PipelineViewportStateCreateInfo viewport_state( {}, 1, nullptr, 1, nullptr );
+        vk::PipelineRasterizationStateCreateInfo rasterization( {}, false, false, vk::PolygonMode::eFill, vk::CullModeFlagBits::eNone, vk::FrontFace::eCounterClockwise, false, 0.0f, 0.0f, 0.0f, 1.0f );
+        vk::PipelineMultisampleStateCreateInfo multisample( {}, vk::SampleCountFlagBits::e1 );
+        vk::PipelineDepthStencilStateCreateInfo depth_stencil( {}, true, true, vk::CompareOp::eLessOrEqual );
+        vk::PipelineColorBlendAttachmentState blend_attachment;
+        blend_attachment.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
+        vk::PipelineColorBlendStateCreateInfo blend( {}, false, vk::LogicOp::eCopy, 1, &blend_attachment );
+        std::array<vk::DynamicState, 2> dynamic_states { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+        vk::PipelineDynamicStateCreateInfo dynamic( {}, static_cast<uint32_t>( dynamic_states.size() ), dynamic_states.data() );
+
+        vk::GraphicsPipelineCreateInfo ci(
+            {},
+            static_cast<uint32_t>( stages.size() ),
+            stages.data(),
+            &vertex_input,
+            &input_assembly,
+            nullptr,
+            &viewport_state,
+            &rasterization,
+            &multisample,
+            &depth_stencil,
+            &blend,
+            &dynamic,
+            layout,
+            graph.get_render_pass( "Scene" ),
+            0
+        );
+
+        return create_graphics_pipeline( ci );
+    }
+
+    /// Sets a secondary command buffer's state, since it inherits none, and binds the cube.
+    void bind_cube( vk::CommandBuffer command_buffer, vk::Pipeline cube_pipeline ) {
+        command_buffer.setViewport( 0, vk::Viewport( 0.0f, 0.0f, static_cast<float>( swapchain.extent.width ), static_cast<float>( swapchain.extent.height ), 0.0f, 1.0f ) );
+        command_buffer.setScissor( 0, vk::Rect2D( { 0, 0 }, swapchain.extent ) );
+        command_buffer.bindPipeline( vk::PipelineBindPoint::eGraphics, cube_pipeline );
+        command_buffer.bindVertexBuffers( 0, vertex_buffer._object.get(), vk::DeviceSize( 0 ) );
+        command_buffer.bindIndexBuffer( index_buffer._object.get(), 0, vk::IndexType::eUint16 );
+    }
+
+    /// Records the cubes [first, last) into a secondary command buffer.
+    void draw( vk::CommandBuffer command_buffer, uint32_t first, uint32_t last ) {
+        bind_cube( command_buffer, pipeline.get() );
+        for( uint32_t c = first; c < last; ++c ) {
+            bind_constants( command_buffer, pipeline_layout.get(), vk::ShaderStageFlagBits::eVertex, 0, mvps[c] );
+            command_buffer.drawIndexed( static_cast<uint32_t>( cube_indices.size() ), 1, 0, 0, 0 );
+        }
+    }
+
+    /// Records the cubes [first, last) into a secondary command buffer, each sampling its part of the checker.
+    void draw_textured( vk::CommandBuffer command_buffer, uint32_t first, uint32_t last ) {
+        bind_cube( command_buffer, textured_pipeline.get() );
+        // The frame's command buffer binds the set for its own draws only.
+        bind_bindless_descriptors( command_buffer, textured_pipeline_layout.get() );
+        for( uint32_t c = first; c < last; ++c ) {
+            bind_constants( command_buffer, textured_pipeline_layout.get(), vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, TexturedConstants { mvps[c], texture, tints, c, grid_size } );
+            command_buffer.drawIndexed( static_cast<uint32_t>( cube_indices.size() ), 1, 0, 0, 0 );
+        }
+    }
+
+    /// Records the draws of the cubes this frame's culling left visible into a secondary command buffer.
+    void draw_visible( vk::CommandBuffer command_buffer ) {
+        bind_cube( command_buffer, culled_pipeline.get() );
+        command_buffer.bindDescriptorSets( vk::PipelineBindPoint::eGraphics, culled_pipeline_layout.get(), 0, objects_set, nullptr );
+        bind_constants( command_buffer, culled_pipeline_layout.get(), vk::ShaderStageFlagBits::eVertex, 1, view_projection );
+        draw_culled( command_buffer );
+    }
+
+    void on_swapchain_recreated() override {
+        // The old views are destroyed with the retired swapchain, so its framebuffers go with it.
+        std::vector<vk::UniqueFramebuffer> old_framebuffers;
+        graph.retire_framebuffers( old_framebuffers );
+        retire_framebuffers( old_framebuffers );
+
+        graph.set_imported_image( color_target, swapchain.images.front(), swapchain.image_views.front().get(), swapchain.extent );
+        graph.set_image_extent( depth_target, swapchain.extent, get_retired_transient_images() );
+    }
+
+    void update() override {
+        if( animating )
+            angle += static_cast<float>( delta_time ) * 0.001f;
+    }
+
+    void render() override {
+        const float aspect_ratio { static_cast<float>( swapchain.extent.width ) / static_cast<float>( swapchain.extent.height ) };
+        const glm::mat4 projection { glm::perspective( glm::radians( 45.0f ), aspect_ratio, 0.1f, 100.0f ) };
+        const glm::mat4 view { glm::lookAt( glm::vec3( 0, 0, -24 ), glm::vec3( 0, 0, 0 ), glm::vec3( 0, -1, 0 ) ) };
+        // Every cube turns about (1, 1, 0) in place.
+        const float s { std::sin( angle * 0.5f ) / std::sqrt( 2.0f ) };
+        const std::array<float, 4> rotation { s, s, 0.0f, std::cos( angle * 0.5f ) };
+        for( uint32_t c = 0; c < cube_count; ++c ) {
+            const float x { ( static_cast<float>( c % grid_size ) - ( grid_size - 1 ) * 0.5f ) * 2.5f };
+            const float y { ( static_cast<float>( c / grid_size ) - ( grid_size - 1 ) * 0.5f ) * 2.5f };
+            cubes.set_local( c, { x, y, 0.0f }, rotation, { 1.0f, 1.0f, 1.0f } );
+        }
+        cubes.update();
+
+        view_projection = projection * view;
+        stlr::TransformHierarchy::Matrix vp;
+        std::memcpy( vp.m.data(), &view_projection, sizeof( vp.m ) );
+        cubes.write_mvp( vp, mvps.data(), sizeof( glm::mat4 ) );
+
+        if( draw_mode == DrawMode::eTextured ) {
+            // The checker spans the grid, whose width on screen is about the distance's share of the view's height.
+            const float grid_width { grid_size * 2.5f };
+            request_texture( streamed_checker, grid_width / ( 2.0f * 24.0f * std::tan( glm::radians( 22.5f ) ) ) * static_cast<float>( swapchain.extent.height ) );
+            const stlr::BindlessDescriptors::Handle streamed { get_texture_handle( streamed_checker ) };
+            texture = streamed != stlr::BindlessDescriptors::invalid_handle ? streamed : checker_texture;
+        }
+
+        if( draw_mode == DrawMode::eCulled ) {
+            // The cube's corners are sqrt( 3 ) from its center.
+            std::array<stlr::GpuCulling::Object, cube_count> objects;
+            for( uint32_t c = 0; c < cube_count; ++c ) {
+                objects[c] = stlr::GpuCulling::Object { cubes.get_world( c ).m, { 0.0f, 0.0f, 0.0f, std::sqrt( 3.0f ) }, 0, static_cast<uint32_t>( cube_indices.size() ), 0, 0 };
+            }
+            write_cull_objects( objects.data(), cube_count );
+            // Submitted to the compute queue now; the frame's graphics submission waits for it.
+            cull( cube_count, vp.m );
+
+            objects_set = allocate_frame_descriptor_set( objects_set_layout );
+            vk::DescriptorBufferInfo objects_info { get_cull_objects_buffer(), 0, VK_WHOLE_SIZE };
+            selected_device->device->updateDescriptorSets( vk::WriteDescriptorSet( objects_set, 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &objects_info ), nullptr );
+        }
+
+        const uint32_t i { swapchain.current_image_index };
+        graph.set_imported_image( color_target, swapchain.images[i], swapchain.image_views[i].get() );
+        graph.execute( get_frame_command_buffer(), &profiler );
+    }
 };
 
+/// The number of pixels where two RGBA images differ by more than rounding.
+size_t count_different_pixels( const std::vector<uint8_t>& a, const std::vector<uint8_t>& b ) {
+    size_t count { 0 };
+    for( size_t p = 0; p + 3 < a.size(); p += 4 ) {
+        bool different { false };
+        for( size_t c = p; c < p + 4; ++c ) {
+            different = different || std::abs( a[c] - b[c] ) > 2;
+        }
+        count += different;
+    }
+    return count;
+}
+
 int main(int argc, char** argv) {
+    // --headless renders a fixed number of frames offscreen, e.g. on lavapipe in CI.
+    if( argc > 1 && std::string( argv[1] ) == "--headless" ) {
+        vk::Extent2D extent { 500, 500 };
+        MyRenderer r( extent );
+        r.run( 100 );
+
+        // Recording the draws on the worker threads has to produce the same image as one thread.
+        const std::vector<uint8_t> still { r.render_still( true ) };
+        if( still != r.render_still( false ) ) {
+            std::cerr << "Parallel recording rendered a different image than single-threaded recording." << std::endl;
+            return 1;
+        }
+
+        // The culled draws multiply the matrices on the GPU, so a few pixels on the cubes' edges may differ.
+        if( r.is_culling_supported() && count_different_pixels( still, r.render_still( true, MyRenderer::DrawMode::eCulled ) ) > still.size() / 4 / 200 ) {
+            std::cerr << "Culling on the GPU rendered a different image than drawing every cube." << std::endl;
+            return 1;
+        }
+
+        // The textured cubes cover the same pixels, but in the checker's and their tints' colors. The
+        // grid is large enough on screen to stream the checker in up to its most detailed level.
+        if( r.is_textured_supported() ) {
+            if( count_different_pixels( still, r.render_still( true, MyRenderer::DrawMode::eTextured, 60 ) ) < still.size() / 4 / 10 ) {
+                std::cerr << "Sampling the bindless texture rendered the same image as the untextured cubes." << std::endl;
+                return 1;
+            }
+            if( r.get_streamed_level() != 0 ) {
+                std::cerr << "The streamed texture's most detailed level wasn't resident after 60 frames." << std::endl;
+                return 1;
+            }
+        }
+        r.get_pipeline_cache().report( std::cout );
+        return 0;
+    }
+
     stlr::Window w;
     MyRenderer r(w);
+    r.run();
+    r.get_pipeline_cache().report( std::cout );
     return 0;
 }
@@ -1,8 +1,11 @@
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb/stb_image.h>
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 #include <DGVulkan.hpp>
+#include <filesystem>
+#include <iostream>
+// DGVulkan.hpp declares stb_image for its image loader; this is where it's compiled.
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
 
 float _windowWidth = 1920.0f, _windowHeight = 1080.0f;
 float _windowAspectRatio = static_cast<float>(_windowWidth) / _windowHeight;
@@ -12,6 +15,18 @@ glm::vec3 upDirection = glm::vec3(0, -1, 0);
 std::string shaderDirectory = "../shaders/";
 std::string textureDirectory = "../textures/";
 
+// The descriptor set's contents in binding order, written with a single templated update.
+struct TextureDescriptors {
+	vk::DescriptorImageInfo texture;
+};
+
+// Half float positions and UVs: 12 bytes a vertex instead of 20. The shader still reads a vec3 and a vec2.
+struct Vertex {
+	stlr::Half4 position;
+	stlr::Half2 uv;
+};
+using VertexLayout = stlr::VertexLayout<Vertex, &Vertex::position, &Vertex::uv>;
+
 int main() {
     auto b = new DG::DGVulkan( _windowWidth, _windowHeight );
     b->init_surface_and_swapchain();
@@ -21,6 +36,8 @@ int main() {
 	b->init_depth_image_and_view(&depthImage);
 
 	b->init_sampler();
+	b->init_mipmap_generator(shaderDirectory + "mip-cs.spv");
+	b->init_image_loader();
 
 	DG::RenderPassAttachments renderPassAttachments;
 	renderPassAttachments.add_attachment(b->get_surface_format(), vk::ImageLayout::ePresentSrcKHR, false);
@@ -30,22 +47,21 @@ int main() {
 	b->init_framebuffers();
 
 	DG::DescriptorPools descriptorPools;
-	descriptorPools.add_descriptor_size(vk::DescriptorType::eUniformBuffer, 1);
 	descriptorPools.add_descriptor_size(vk::DescriptorType::eCombinedImageSampler, 1);
 	b->init_descriptor_pool(descriptorPools);
 	DG::DescriptorSetLayoutBindings descriptorSetLayoutBindings;
-	descriptorSetLayoutBindings.add_binding(0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex);
 	descriptorSetLayoutBindings.add_binding(1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment);
 	b->init_descriptor_set_layout(descriptorSetLayoutBindings);
 	b->init_descriptor_set();
+	b->init_descriptor_update_template();
 
 	b->init_vertex_shader(shaderDirectory + "3-vs.spv");
 	b->init_fragment_shader(shaderDirectory + "3-fs.spv");
-	b->init_pipeline_layout();
+	// The MVP is small enough to be a push constant, so drawing with a new one writes no descriptors.
+	b->init_pipeline_layout_with_constants<glm::mat4>(vk::ShaderStageFlagBits::eVertex);
+	b->init_pipeline_cache("texture_pipeline_cache.bin");
 	DG::Pipeline pipeline;
-	pipeline.add_vertex_input_binding(0, sizeof(float) * 5);	// Input is 5 floats - xyz & uv
-	pipeline.add_vertex_input_attribute(0, 0, vk::Format::eR32G32B32Sfloat, 0); // No offset for position
-	pipeline.add_vertex_input_attribute(0, 1, vk::Format::eR32G32Sfloat, sizeof(float) * 3); // The offset from position
+	pipeline.add_vertex_layout<VertexLayout>(0);
 	b->init_pipeline(pipeline);
 	b->init_sync_objects();
 	b->init_viewport(0, 0, _windowWidth, _windowHeight);
@@ -59,28 +75,19 @@ int main() {
 	glm::mat4 model = glm::mat4(1);
 	glm::mat4 mvp = projection * view * model;
 
-	auto uniformBuffer = b->create_buffer(sizeof(mvp), vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible);
-
-	b->copy_to_resource_memory(&uniformBuffer, &mvp);
-
-	b->write_buffer_to_descriptor_set(uniformBuffer, 0, vk::DescriptorType::eUniformBuffer);
+	b->set_constants(mvp);
 
-	float vertices[] = {
-		-1.0f, -1.0f, -1.0f, // left-bottom-front
-		0.0f, 0.0f,
-		-1.0f, 1.0f, -1.0f,  // left-top-front
-		0.0f, 1.0f,
-
-		1.0f, -1.0f, -1.0f, // right-bottom-front
-		1.0f, 0.0f,
-		1.0f, 1.0f, -1.0f,  // right-top-front
-		1.0f, 1.0f,
+	Vertex vertices[] = {
+		{ { -1.0f, -1.0f, -1.0f }, { 0.0f, 0.0f } }, // left-bottom-front
+		{ { -1.0f, 1.0f, -1.0f }, { 0.0f, 1.0f } },  // left-top-front
+		{ { 1.0f, -1.0f, -1.0f }, { 1.0f, 0.0f } },  // right-bottom-front
+		{ { 1.0f, 1.0f, -1.0f }, { 1.0f, 1.0f } },   // right-top-front
 	};
 	auto vertexBuffer = b->create_buffer(sizeof(vertices), vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible);
 
 	b->copy_to_resource_memory(&vertexBuffer, &vertices);
 
-	int indices[] = {
+	uint16_t indices[] = {
 		0, 1, 2, 
 		2, 1, 3,
 	};
@@ -88,43 +95,29 @@ int main() {
 
 	b->copy_to_resource_memory(&indexBuffer, &indices);
 
-	int textureWidth = 0, textureHeight = 0;
-	auto textureData = stbi_load((textureDirectory + "Red Stare.jpg").data(), &textureWidth, &textureHeight, nullptr, STBI_rgb_alpha);
-	auto textureBufferSize = textureWidth * textureHeight * STBI_rgb_alpha;
-
-	auto textureStagingBuffer = b->create_buffer(static_cast<vk::DeviceSize>(textureBufferSize), vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible);
-	b->copy_to_resource_memory(&textureStagingBuffer, textureData);
-
-	auto textureImage = b->create_image_2D(textureWidth, textureHeight, 4, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled, vk::Format::eR8G8B8A8Srgb, vk::MemoryPropertyFlagBits::eDeviceLocal);
-
-	b->cmd_start_recording();
-	b->cmd_change_image_layout(
-		&textureImage, 
-		vk::AccessFlags(),
-		vk::AccessFlagBits::eTransferWrite, 
-		vk::ImageLayout::eTransferDstOptimal, 
-		vk::ImageAspectFlagBits::eColor, 
-		vk::PipelineStageFlagBits::eTopOfPipe, 
-		vk::PipelineStageFlagBits::eTransfer
-	);
-	b->cmd_copy_buffer_to_image(&textureStagingBuffer, &textureImage, vk::ImageAspectFlagBits::eColor);
-	b->cmd_change_image_layout(
-		&textureImage, 
-		vk::AccessFlagBits::eTransferWrite,
-		vk::AccessFlagBits::eShaderRead, 
-		vk::ImageLayout::eShaderReadOnlyOptimal, 
-		vk::ImageAspectFlagBits::eColor, 
-		vk::PipelineStageFlagBits::eTransfer, 
-		vk::PipelineStageFlagBits::eFragmentShader
-	);
-	b->cmd_end_recording();
-	b->submit_commands();
+	// A pack cooked with AssetCooker is mapped and the texture copied from it as is, with its own mips.
+	// Next best is a block-compressed KTX2 copy of the texture. Otherwise the JPEG is decoded on the
+	// image loader's threads and the placeholder is drawn until it's uploaded.
+	auto assetPack = textureDirectory + "assets.pak";
+	auto compressedTexture = textureDirectory + "Red Stare.ktx2";
+	auto textureLoading = false;
+	stlr::ImageLoader::Handle textureHandle = 0;
+	auto textureImage = [&] {
+		if (std::filesystem::exists(assetPack))
+			return b->load_texture(stlr::AssetPack(assetPack), "Red Stare");
+		if (std::filesystem::exists(compressedTexture))
+			return b->load_texture(compressedTexture);
+
+		textureLoading = true;
+		textureHandle = b->load_image_async(textureDirectory + "Red Stare.jpg");
+		return *b->get_loaded_image(textureHandle);
+	}();
 
 	auto textureImageView = b->create_image_view_2D(&textureImage, vk::ImageAspectFlagBits::eColor);
-	b->write_image_view_to_descriptor_set(textureImageView, vk::ImageLayout::eShaderReadOnlyOptimal, 1, vk::DescriptorType::eCombinedImageSampler);
+	b->update_descriptor_set(TextureDescriptors{ vk::DescriptorImageInfo(b->get_sampler(), textureImageView._view, vk::ImageLayout::eShaderReadOnlyOptimal) });
 
 	b->set_vertex_buffer(&vertexBuffer);
-	b->set_index_buffer(&indexBuffer);
+	b->set_index_buffer(&indexBuffer, vk::IndexType::eUint16);
 	b->set_index_count(sizeof(indices) / sizeof(indices[0]));
 
 	double lastTime = 0.0f;
@@ -137,12 +130,25 @@ int main() {
 		model = glm::rotate(model, glm::radians(45.0f) * static_cast<float>(deltaTime), { 0, 1, 0 });
 		mvp = projection * view * model;
 
-		b->copy_to_resource_memory(&uniformBuffer, &mvp);
-		b->write_buffer_to_descriptor_set(uniformBuffer, 0, vk::DescriptorType::eUniformBuffer);
+		b->set_constants(mvp);
+
+		if (textureLoading) {
+			for (auto handle : b->upload_loaded_images()) {
+				if (handle != textureHandle)
+					continue;
+
+				// The upload's fence has signalled and the frames in flight have finished, so nothing reads the descriptor set or the old view.
+				b->destroy_image_view(&textureImageView);
+				textureImageView = b->create_image_view_2D(b->get_loaded_image(textureHandle), vk::ImageAspectFlagBits::eColor);
+				b->update_descriptor_set(TextureDescriptors{ vk::DescriptorImageInfo(b->get_sampler(), textureImageView._view, vk::ImageLayout::eShaderReadOnlyOptimal) });
+				textureLoading = false;
+			}
+		}
 
 		b->render();
 	}
 
+	b->report_pipeline_cache(std::cout);
 	delete(b);
 	return 0;
 }
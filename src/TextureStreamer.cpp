@@ -0,0 +1,297 @@
+#include "TextureStreamer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace stlr {
+    TextureStreamer::TextureStreamer( vk::PhysicalDevice physical_device, vk::Device device, MemoryAllocator& allocator, UploadManager& uploader, BindlessDescriptors* bindless, vk::Sampler sampler, uint32_t frame_count, bool memory_budget, vk::DeviceSize upload_bytes_per_frame, uint32_t min_resident_size, float budget_fraction )
+        : physical_device( physical_device )
+        , device( device )
+        , allocator( allocator )
+        , uploader( uploader )
+        , bindless( bindless )
+        , sampler( sampler )
+        , frame_count( std::max( frame_count, 1u ) )
+        , memory_budget( memory_budget )
+        , heap_index( 0 )
+        , upload_bytes_per_frame( upload_bytes_per_frame )
+        , min_resident_size( std::max( min_resident_size, 1u ) )
+        , budget_fraction( budget_fraction )
+        , frame( 0 ) {
+        heap_index = find_device_local_heap();
+    }
+
+    TextureStreamer::TextureId TextureStreamer::add( TextureFile file ) {
+        if( file.layer_count != 1 || file.cube )
+            throw std::runtime_error( "Only textures with a single layer can be streamed." );
+        if( file.level_count == 0 )
+            throw std::runtime_error( "The texture has no levels." );
+
+        TextureId id;
+        if( !free_ids.empty() ) {
+            id = free_ids.back();
+            free_ids.pop_back();
+        }
+        else {
+            id = static_cast<TextureId>( textures.size() );
+            textures.emplace_back();
+        }
+
+        Texture& t { textures[id] };
+        t.file = std::move( file );
+        t.alive = true;
+        t.last_used = frame;
+
+        // The first level that fits the minimum size, or the smallest one the file has.
+        t.base_level = 0;
+        while( t.base_level + 1 < t.file.level_count && std::max( t.file.width >> t.base_level, t.file.height >> t.base_level ) > min_resident_size ) {
+            ++t.base_level;
+        }
+        t.wanted_level = t.base_level;
+
+        stream( t, t.base_level );
+        ++statistics.texture_count;
+
+        return id;
+    }
+
+    void TextureStreamer::remove( TextureId id ) {
+        Texture& t { textures[id] };
+        if( !t.alive )
+            return;
+
+        statistics.resident_bytes -= t.resident.size;
+        retire( t.resident );
+        if( t.has_pending ) {
+            // The upload may still be writing to it, and retiring outlasts any upload the frames wait on.
+            retire( t.pending, t.pending_token );
+            t.has_pending = false;
+            --statistics.pending_count;
+        }
+        t.file = TextureFile {};
+        t.alive = false;
+        free_ids.push_back( id );
+        --statistics.texture_count;
+    }
+
+    void TextureStreamer::request( TextureId id, float screen_size ) {
+        Texture& t { textures[id] };
+        if( t.last_used != frame ) {
+            t.last_used = frame;
+            t.wanted_level = t.base_level;
+        }
+
+        // The level whose texels are about the size of a pixel.
+        const float size { static_cast<float>( std::max( t.file.width, t.file.height ) ) };
+        uint32_t level { t.base_level };
+        if( screen_size > 0.0f ) {
+            const float l { std::floor( std::log2( size / screen_size ) ) };
+            level = static_cast<uint32_t>( std::clamp( l, 0.0f, static_cast<float>( t.base_level ) ) );
+        }
+        t.wanted_level = std::min( t.wanted_level, level );
+    }
+
+    void TextureStreamer::update() {
+        ++frame;
+
+        // Images retired frame_count updates ago aren't used by any frame still in flight, and
+        // ones whose upload was abandoned must also wait for the copy into them to finish.
+        retired.erase( std::remove_if( retired.begin(), retired.end(), [this]( const Retired& r ) { return frame - r.frame > frame_count && uploader.is_complete( r.token ); } ), retired.end() );
+
+        // Finished uploads replace what's resident. The frame recorded after this update acquires
+        // them before sampling, so it's the first to see the new handle.
+        for( auto& t : textures ) {
+            if( !t.alive || !t.has_pending || !uploader.is_complete( t.pending_token ) )
+                continue;
+
+            if( bindless != nullptr )
+                t.pending.handle = bindless->add_texture( t.pending.view.get(), sampler );
+            statistics.resident_bytes = statistics.resident_bytes - t.resident.size + t.pending.size;
+            retire( t.resident );
+            t.resident = std::move( t.pending );
+            t.has_pending = false;
+            --statistics.pending_count;
+        }
+
+        std::vector<TextureId> order;
+        order.reserve( textures.size() );
+        for( TextureId i = 0; i < textures.size(); ++i ) {
+            if( textures[i].alive && !textures[i].has_pending )
+                order.push_back( i );
+        }
+
+        const vk::DeviceSize limit { get_limit() };
+        vk::DeviceSize committed { get_committed_size() };
+        statistics.limit_bytes = limit;
+
+        // Over the limit, the least recently used textures give up their most detailed level until
+        // it fits. The smaller image takes the place of the larger one like any other upload.
+        if( committed > limit ) {
+            std::sort( order.begin(), order.end(), [this]( TextureId a, TextureId b ) { return textures[a].last_used < textures[b].last_used; } );
+            for( TextureId i : order ) {
+                if( committed <= limit )
+                    break;
+
+                Texture& t { textures[i] };
+                // Textures drawn in the last frame keep their detail; evicting them would only stream it back.
+                if( !t.resident.image || t.resident.top_level >= t.base_level || t.last_used == frame - 1 )
+                    continue;
+
+                const vk::DeviceSize before { t.resident.size };
+                stream( t, t.resident.top_level + 1 );
+                committed = committed - before + t.pending.size;
+                ++statistics.evicted_levels;
+            }
+            return;
+        }
+
+        // Otherwise the most recently requested textures get one more level each, as long as the
+        // frame's upload allowance and the limit last.
+        std::sort( order.begin(), order.end(), [this]( TextureId a, TextureId b ) { return textures[a].last_used > textures[b].last_used; } );
+        vk::DeviceSize uploaded { 0 };
+        for( TextureId i : order ) {
+            Texture& t { textures[i] };
+            // Requests made since the previous update are the ones for the frame being recorded.
+            if( t.last_used != frame - 1 )
+                break;
+            if( uploaded >= upload_bytes_per_frame )
+                break;
+            if( !t.resident.image || t.wanted_level >= t.resident.top_level )
+                continue;
+
+            // A level is about three times the size of all the smaller ones together.
+            const vk::DeviceSize estimate { t.resident.size * 4 };
+            if( committed - t.resident.size + estimate > limit )
+                continue;
+
+            uploaded += stream( t, t.resident.top_level - 1 );
+            committed = committed - t.resident.size + t.pending.size;
+            ++statistics.streamed_levels;
+        }
+    }
+
+    uint32_t TextureStreamer::find_device_local_heap() const {
+        const vk::PhysicalDeviceMemoryProperties& props { allocator.get_memory_properties() };
+        for( uint32_t i = 0; i < props.memoryHeapCount; ++i ) {
+            if( props.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal )
+                return i;
+        }
+        return 0;
+    }
+
+    vk::DeviceSize TextureStreamer::get_limit() const {
+        vk::DeviceSize budget;
+        vk::DeviceSize usage;
+        if( memory_budget ) {
+            // The budget accounts for other processes and the driver, and both numbers change as they allocate.
+            auto chain { physical_device.getMemoryProperties2<vk::PhysicalDeviceMemoryProperties2, vk::PhysicalDeviceMemoryBudgetPropertiesEXT>() };
+            const auto& b { chain.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>() };
+            budget = b.heapBudget[heap_index];
+            usage = b.heapUsage[heap_index];
+        }
+        else {
+            budget = allocator.get_memory_properties().memoryHeaps[heap_index].size;
+            usage = allocator.get_statistics().reserved_bytes;
+        }
+
+        const vk::DeviceSize allowed { static_cast<vk::DeviceSize>( budget * static_cast<double>( budget_fraction ) ) };
+        const vk::DeviceSize own { get_committed_size() };
+        // What textures use is part of the usage; what's left is free for them to grow into.
+        return allowed > usage ? own + ( allowed - usage ) : ( own > usage - allowed ? own - ( usage - allowed ) : 0 );
+    }
+
+    vk::DeviceSize TextureStreamer::get_committed_size() const noexcept {
+        vk::DeviceSize size { 0 };
+        for( const auto& t : textures ) {
+            if( t.alive )
+                size += t.has_pending ? t.pending.size : t.resident.size;
+        }
+        return size;
+    }
+
+    vk::DeviceSize TextureStreamer::stream( Texture& texture, uint32_t top_level ) {
+        const TextureFile& f { texture.file };
+        const vk::Extent3D extent { f.get_level_extent( top_level ) };
+        const uint32_t level_count { f.level_count - top_level };
+
+        vk::ImageCreateInfo ci {
+            {},
+            vk::ImageType::e2D,
+            f.format,
+            extent,
+            level_count,
+            1,
+            vk::SampleCountFlagBits::e1,
+            vk::ImageTiling::eOptimal,
+            vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+            vk::SharingMode::eExclusive,
+            0,
+            nullptr,
+            vk::ImageLayout::eUndefined
+        };
+
+        Residency r;
+        r.image = device.createImageUnique( ci );
+        r.size = device.getImageMemoryRequirements( r.image.get() ).size;
+        r.allocation = allocator.allocate_unique( r.image.get(), vk::MemoryPropertyFlagBits::eDeviceLocal );
+        r.top_level = top_level;
+
+        const vk::ImageSubresourceRange range { vk::ImageAspectFlagBits::eColor, 0, level_count, 0, 1 };
+        vk::ImageViewCreateInfo vci {
+            {},
+            r.image.get(),
+            vk::ImageViewType::e2D,
+            f.format,
+            {},
+            range
+        };
+        r.view = device.createImageViewUnique( vci );
+
+        // The levels from top_level down are one span of the file in both KTX2 and DDS order, so
+        // only that span is staged, with the regions moved to the image's own level numbers.
+        size_t begin { SIZE_MAX };
+        size_t end { 0 };
+        for( const auto& s : f.subresources ) {
+            if( s.level >= top_level ) {
+                begin = std::min( begin, s.offset );
+                end = std::max( end, s.offset + s.size );
+            }
+        }
+
+        std::vector<vk::BufferImageCopy> regions;
+        regions.reserve( level_count );
+        for( const auto& s : f.subresources ) {
+            if( s.level < top_level )
+                continue;
+            regions.push_back( vk::BufferImageCopy {
+                s.offset - begin,
+                0,
+                0,
+                vk::ImageSubresourceLayers { vk::ImageAspectFlagBits::eColor, s.level - top_level, 0, 1 },
+                vk::Offset3D { 0, 0, 0 },
+                f.get_level_extent( s.level )
+            } );
+        }
+
+        if( texture.has_pending )
+            retire( texture.pending, texture.pending_token );
+        texture.pending_token = uploader.upload_image( r.image.get(), f.data.data() + begin, end - begin, regions, range, vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eFragmentShader );
+        texture.pending = std::move( r );
+        if( !texture.has_pending )
+            ++statistics.pending_count;
+        texture.has_pending = true;
+
+        return end - begin;
+    }
+
+    void TextureStreamer::retire( Residency& residency, UploadToken token ) {
+        if( !residency.image )
+            return;
+
+        if( bindless != nullptr && residency.handle != BindlessDescriptors::invalid_handle )
+            bindless->remove_texture( residency.handle );
+        residency.handle = BindlessDescriptors::invalid_handle;
+        retired.push_back( Retired { std::move( residency ), frame, token } );
+        residency = Residency {};
+    }
+}
@@ -13,7 +13,7 @@ namespace stlr {
     }
 
     void Timer::calculate_elapsed_time() noexcept {
-        auto diff = stop_time_point - start_time_point;
-        elapsed_time = diff.count();
+        // The difference is in steady_clock ticks, which aren't necessarily milliseconds.
+        elapsed_time = std::chrono::duration<double, std::milli>( stop_time_point - start_time_point ).count();
     }
 }
@@ -0,0 +1,171 @@
+#include "TransformHierarchy.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if defined( __AVX2__ ) && defined( __FMA__ )
+#define STLR_TRANSFORM_AVX2
+#include <immintrin.h>
+#elif defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define STLR_TRANSFORM_SSE
+#include <emmintrin.h>
+#endif
+
+namespace stlr {
+    namespace {
+        // The columns of the left hand matrix, loaded once for a batch of products with it.
+#if defined( STLR_TRANSFORM_AVX2 )
+        // Each register holds a column twice, so one instruction works on two result columns.
+        struct Columns {
+            __m256 c[4];
+
+            explicit Columns( const TransformHierarchy::Matrix& a ) noexcept {
+                for( uint32_t k = 0; k < 4; ++k ) {
+                    c[k] = _mm256_broadcast_ps( reinterpret_cast<const __m128*>( a.m.data() + k * 4 ) );
+                }
+            }
+
+            // out may alias b: each pair of b's columns is read before the same pair of out's is written.
+            void multiply( const TransformHierarchy::Matrix& b, float* out ) const noexcept {
+                for( uint32_t j = 0; j < 4; j += 2 ) {
+                    const __m256 pair { _mm256_load_ps( b.m.data() + j * 4 ) };
+                    __m256 r { _mm256_mul_ps( c[0], _mm256_permute_ps( pair, 0x00 ) ) };
+                    r = _mm256_fmadd_ps( c[1], _mm256_permute_ps( pair, 0x55 ), r );
+                    r = _mm256_fmadd_ps( c[2], _mm256_permute_ps( pair, 0xaa ), r );
+                    r = _mm256_fmadd_ps( c[3], _mm256_permute_ps( pair, 0xff ), r );
+                    _mm256_storeu_ps( out + j * 4, r );
+                }
+            }
+        };
+#elif defined( STLR_TRANSFORM_SSE )
+        struct Columns {
+            __m128 c[4];
+
+            explicit Columns( const TransformHierarchy::Matrix& a ) noexcept {
+                for( uint32_t k = 0; k < 4; ++k ) {
+                    c[k] = _mm_load_ps( a.m.data() + k * 4 );
+                }
+            }
+
+            void multiply( const TransformHierarchy::Matrix& b, float* out ) const noexcept {
+                for( uint32_t j = 0; j < 4; ++j ) {
+                    const __m128 column { _mm_load_ps( b.m.data() + j * 4 ) };
+                    __m128 r { _mm_mul_ps( c[0], _mm_shuffle_ps( column, column, 0x00 ) ) };
+                    r = _mm_add_ps( r, _mm_mul_ps( c[1], _mm_shuffle_ps( column, column, 0x55 ) ) );
+                    r = _mm_add_ps( r, _mm_mul_ps( c[2], _mm_shuffle_ps( column, column, 0xaa ) ) );
+                    r = _mm_add_ps( r, _mm_mul_ps( c[3], _mm_shuffle_ps( column, column, 0xff ) ) );
+                    _mm_storeu_ps( out + j * 4, r );
+                }
+            }
+        };
+#else
+        struct Columns {
+            TransformHierarchy::Matrix a;
+
+            explicit Columns( const TransformHierarchy::Matrix& a ) noexcept : a( a ) {}
+
+            void multiply( const TransformHierarchy::Matrix& b, float* out ) const noexcept {
+                std::array<float, 16> r;
+                for( uint32_t j = 0; j < 4; ++j ) {
+                    for( uint32_t i = 0; i < 4; ++i ) {
+                        r[j * 4 + i] = a.m[i] * b.m[j * 4] + a.m[4 + i] * b.m[j * 4 + 1] + a.m[8 + i] * b.m[j * 4 + 2] + a.m[12 + i] * b.m[j * 4 + 3];
+                    }
+                }
+                std::memcpy( out, r.data(), sizeof( r ) );
+            }
+        };
+#endif
+    }
+
+    TransformHierarchy::NodeId TransformHierarchy::add( NodeId parent, const Matrix& local ) {
+        const NodeId node { static_cast<NodeId>( parents.size() ) };
+        if( parent != no_parent && parent >= node )
+            throw std::out_of_range( "A node's parent must be added before it." );
+
+        parents.push_back( parent );
+        locals.push_back( local );
+        worlds.push_back( Matrix::identity() );
+        dirty.push_back( 1 );
+        changed.push_back( 0 );
+        any_dirty = true;
+        return node;
+    }
+
+    void TransformHierarchy::clear() noexcept {
+        parents.clear();
+        locals.clear();
+        worlds.clear();
+        dirty.clear();
+        changed.clear();
+        any_dirty = false;
+        changed_count = 0;
+    }
+
+    uint32_t TransformHierarchy::update() {
+        if( !any_dirty ) {
+            if( changed_count > 0 )
+                std::fill( changed.begin(), changed.end(), uint8_t { 0 } );
+            changed_count = 0;
+            return 0;
+        }
+
+        // One pass in parents first order: a parent's changed flag is final before its children read it.
+        uint32_t count { 0 };
+        const size_t node_count { parents.size() };
+        for( size_t i = 0; i < node_count; ++i ) {
+            const NodeId p { parents[i] };
+            const bool c { dirty[i] != 0 || ( p != no_parent && changed[p] != 0 ) };
+            changed[i] = c ? 1 : 0;
+            if( !c )
+                continue;
+
+            dirty[i] = 0;
+            if( p == no_parent )
+                worlds[i] = locals[i];
+            else
+                Columns( worlds[p] ).multiply( locals[i], worlds[i].m.data() );
+            ++count;
+        }
+
+        any_dirty = false;
+        changed_count = count;
+        return count;
+    }
+
+    void TransformHierarchy::write_world( void* destination, size_t stride, bool changed_only ) const {
+        char* d { static_cast<char*>( destination ) };
+        const size_t node_count { worlds.size() };
+        for( size_t i = 0; i < node_count; ++i ) {
+            if( !changed_only || changed[i] )
+                std::memcpy( d + i * stride, worlds[i].m.data(), sizeof( worlds[i].m ) );
+        }
+    }
+
+    void TransformHierarchy::write_mvp( const Matrix& view_projection, void* destination, size_t stride ) const {
+        // The camera usually moves every frame, so every product is written; view_projection stays in registers.
+        const Columns columns( view_projection );
+        char* d { static_cast<char*>( destination ) };
+        const size_t node_count { worlds.size() };
+        for( size_t i = 0; i < node_count; ++i ) {
+            columns.multiply( worlds[i], reinterpret_cast<float*>( d + i * stride ) );
+        }
+    }
+
+    void TransformHierarchy::multiply( const Matrix& a, const Matrix& b, Matrix& out ) noexcept {
+        Columns( a ).multiply( b, out.m.data() );
+    }
+
+    TransformHierarchy::Matrix TransformHierarchy::compose( const std::array<float, 3>& translation, const std::array<float, 4>& rotation, const std::array<float, 3>& scale ) noexcept {
+        const float x { rotation[0] };
+        const float y { rotation[1] };
+        const float z { rotation[2] };
+        const float w { rotation[3] };
+
+        return Matrix { {
+            ( 1.0f - 2.0f * ( y * y + z * z ) ) * scale[0], 2.0f * ( x * y + w * z ) * scale[0], 2.0f * ( x * z - w * y ) * scale[0], 0.0f,
+            2.0f * ( x * y - w * z ) * scale[1], ( 1.0f - 2.0f * ( x * x + z * z ) ) * scale[1], 2.0f * ( y * z + w * x ) * scale[1], 0.0f,
+            2.0f * ( x * z + w * y ) * scale[2], 2.0f * ( y * z - w * x ) * scale[2], ( 1.0f - 2.0f * ( x * x + y * y ) ) * scale[2], 0.0f,
+            translation[0], translation[1], translation[2], 1.0f
+        } };
+    }
+}
@@ -1,6 +1,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 #include "DGVulkan.hpp"
+#include <iostream>
 
 
 uint32_t _windowWidth = 1920.0f, _windowHeight = 1080.0f;
@@ -10,6 +11,16 @@ glm::vec3 lookAtPosition = glm::vec3(0, 0, 0);
 glm::vec3 upDirection = glm::vec3(0, -1, 0);
 std::string shaderDirectory = "../shaders/";
 
+struct Vertex {
+    stlr::Half4 position;
+};
+using VertexLayout = stlr::VertexLayout<Vertex, &Vertex::position>;
+
+struct Instance {
+    stlr::Half4 offset;
+};
+using InstanceLayout = stlr::VertexLayout<Instance, &Instance::offset>;
+
 int main(int argc, char** argv) {
 
     DG::DGVulkan b{_windowWidth, _windowHeight};
@@ -37,9 +48,10 @@ int main(int argc, char** argv) {
     b.init_vertex_shader(shaderDirectory + "1-vs.spv");
     b.init_fragment_shader(shaderDirectory + "1-fs.spv");
     b.init_pipeline_layout();
+    b.init_pipeline_cache("triangle_pipeline_cache.bin");
     DG::Pipeline pipeline;
-    pipeline.add_vertex_input_binding(0, sizeof(float) * 3);
-    pipeline.add_vertex_input_attribute(0, 0, vk::Format::eR32G32B32Sfloat, 0);
+    pipeline.add_vertex_layout<VertexLayout>(0);
+    pipeline.add_vertex_layout<InstanceLayout>(1, vk::VertexInputRate::eInstance, 1);
     b.init_pipeline(pipeline);
     b.init_sync_objects();
     b.init_viewport(0, 0, b.get_surface_width(), b.get_surface_height());
@@ -66,28 +78,51 @@ int main(int argc, char** argv) {
 
     b.write_buffer_to_descriptor_set(uniformBuffer, 0, vk::DescriptorType::eUniformBuffer);
 
-    float vertices[9] = {
-        -1.0f, 0.0f, 0.0f,
-        0.0f, 1.0f, 0.0f,
-        1.0f, 0.0f, 0.0f,
+    Vertex vertices[3] = {
+        { { -1.0f, 0.0f, 0.0f } },
+        { { 0.0f, 1.0f, 0.0f } },
+        { { 1.0f, 0.0f, 0.0f } },
     };
     auto vertexBuffer = b.create_buffer(sizeof(vertices), vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible);
 	
     b.copy_to_resource_memory(&vertexBuffer, &vertices);
 
-    int indices[3] = { 0, 1, 2 };
+    uint16_t indices[3] = { 0, 1, 2 };
     auto indexBuffer = b.create_buffer(sizeof(indices), vk::BufferUsageFlagBits::eIndexBuffer, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible);
 
     b.copy_to_resource_memory(&indexBuffer, &indices);
 
     b.set_vertex_buffer(&vertexBuffer);
-    b.set_index_buffer(&indexBuffer);
-    b.set_index_count(sizeof(indices) / sizeof(float));
+    b.set_index_buffer(&indexBuffer, vk::IndexType::eUint16);
+    b.set_index_count(sizeof(indices) / sizeof(indices[0]));
+
+    // The triangle is drawn three times side by side, as instances with their own offsets.
+    Instance instances[3] = {
+        { { -2.5f, 0.0f, 0.0f } },
+        { { 0.0f, 0.0f, 0.0f } },
+        { { 2.5f, 0.0f, 0.0f } },
+    };
+    auto instanceBuffer = b.create_buffer(sizeof(instances), vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible);
+
+    b.copy_to_resource_memory(&instanceBuffer, &instances);
+
+    b.set_instance_buffer(&instanceBuffer);
+    b.set_instance_count(sizeof(instances) / sizeof(instances[0]));
+
+    // --indirect draws the same instances from a command in a buffer, as a culling shader would write it.
+    vk::DrawIndexedIndirectCommand command(sizeof(indices) / sizeof(indices[0]), sizeof(instances) / sizeof(instances[0]), 0, 0, 0);
+    auto indirectBuffer = b.create_buffer(sizeof(command), vk::BufferUsageFlagBits::eIndirectBuffer, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible);
+
+    b.copy_to_resource_memory(&indirectBuffer, &command);
+
+    if (argc > 1 && std::string(argv[1]) == "--indirect")
+        b.set_indirect_buffer(&indirectBuffer, 1);
 
     b.render();
     while (!b.is_window_close()) {
         glfwPollEvents();
     }
+    b.report_pipeline_cache(std::cout);
 
 
     return 0;
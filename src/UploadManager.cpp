@@ -0,0 +1,310 @@
+#include "UploadManager.hpp"
+#include <string>
+
+namespace stlr {
+    UploadManager::UploadManager( vk::PhysicalDevice physical_device, vk::Device device, MemoryAllocator& allocator, vk::Queue transfer_queue, uint32_t transfer_family, uint32_t graphics_family, vk::CommandPool transfer_command_pool, vk::DeviceSize staging_size, GpuProfiler* profiler )
+        : device( device )
+        , allocator( allocator )
+        , transfer_queue( transfer_queue )
+        , transfer_family( transfer_family )
+        , graphics_family( graphics_family )
+        , command_pool( transfer_command_pool )
+        // Every texel size we upload is a power of two no larger than 16 bytes.
+        , copy_alignment( std::max<vk::DeviceSize>( physical_device.getProperties().limits.optimalBufferCopyOffsetAlignment, 16 ) )
+        , profiler( profiler )
+        , staging_buffer( device.createBufferUnique( vk::BufferCreateInfo { {}, staging_size, vk::BufferUsageFlagBits::eTransferSrc, vk::SharingMode::eExclusive } ) )
+        , staging_allocation( allocator.allocate_unique( staging_buffer.get(), vk::MemoryPropertyFlagBits::eHostVisible ) )
+        , ring_capacity( staging_size )
+        , ring_head( 0 )
+        , ring_used( 0 )
+        , timeline( create_timeline_semaphore() )
+        , next_token( 1 )
+        , open_batch()
+        , open_batch_recording( false ) {}
+
+    UploadManager::~UploadManager() {
+        if( next_token > 1 ) {
+            wait( next_token - 1 );
+        }
+    }
+
+    UploadToken UploadManager::upload_buffer( vk::Buffer dst, vk::DeviceSize dst_offset, const void* data, vk::DeviceSize size, vk::AccessFlags dst_access, vk::PipelineStageFlags dst_stages ) {
+        std::lock_guard<std::mutex> lock( mutex );
+
+        vk::Buffer staging;
+        vk::DeviceSize staging_offset { stage( data, size, staging ) };
+        vk::CommandBuffer cmd { begin_batch() };
+
+        cmd.copyBuffer( staging, dst, vk::BufferCopy { staging_offset, dst_offset, size } );
+
+        if( transfers_ownership() ) {
+            vk::BufferMemoryBarrier release {
+                vk::AccessFlagBits::eTransferWrite,
+                {},
+                transfer_family,
+                graphics_family,
+                dst,
+                dst_offset,
+                size
+            };
+            cmd.pipelineBarrier( vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, release, nullptr );
+
+            vk::BufferMemoryBarrier acquire { release };
+            acquire.srcAccessMask = {};
+            acquire.dstAccessMask = dst_access;
+            open_batch.acquire.buffer_barriers.push_back( acquire );
+        }
+        // Otherwise the timeline semaphore wait alone makes the copy visible to dst_stages.
+        // An empty mask would become a zero semaphore wait stage mask, which isn't allowed.
+        open_batch.acquire.stages |= dst_stages ? dst_stages : vk::PipelineStageFlagBits::eAllCommands;
+
+        return next_token;
+    }
+
+    UploadToken UploadManager::upload_image( vk::Image dst, const void* data, vk::DeviceSize size, vk::ArrayProxy<const vk::BufferImageCopy> regions, const vk::ImageSubresourceRange& range, vk::ImageLayout final_layout, vk::AccessFlags dst_access, vk::PipelineStageFlags dst_stages ) {
+        std::lock_guard<std::mutex> lock( mutex );
+
+        vk::Buffer staging;
+        vk::DeviceSize staging_offset { stage( data, size, staging ) };
+        vk::CommandBuffer cmd { begin_batch() };
+
+        std::vector<vk::BufferImageCopy> copies { regions.begin(), regions.end() };
+        for( auto& c : copies ) {
+            c.bufferOffset += staging_offset;
+        }
+
+        vk::ImageMemoryBarrier to_transfer_dst {
+            {},
+            vk::AccessFlagBits::eTransferWrite,
+            vk::ImageLayout::eUndefined,
+            vk::ImageLayout::eTransferDstOptimal,
+            VK_QUEUE_FAMILY_IGNORED,
+            VK_QUEUE_FAMILY_IGNORED,
+            dst,
+            range
+        };
+        cmd.pipelineBarrier( vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, to_transfer_dst );
+
+        cmd.copyBufferToImage( staging, dst, vk::ImageLayout::eTransferDstOptimal, copies );
+
+        // The layout transition to final_layout is part of the release (and must be repeated
+        // identically by the acquire) when ownership moves to the graphics family.
+        vk::ImageMemoryBarrier release {
+            vk::AccessFlagBits::eTransferWrite,
+            {},
+            vk::ImageLayout::eTransferDstOptimal,
+            final_layout,
+            transfers_ownership() ? transfer_family : VK_QUEUE_FAMILY_IGNORED,
+            transfers_ownership() ? graphics_family : VK_QUEUE_FAMILY_IGNORED,
+            dst,
+            range
+        };
+        cmd.pipelineBarrier( vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, nullptr, release );
+
+        if( transfers_ownership() ) {
+            vk::ImageMemoryBarrier acquire { release };
+            acquire.srcAccessMask = {};
+            acquire.dstAccessMask = dst_access;
+            open_batch.acquire.image_barriers.push_back( acquire );
+        }
+        open_batch.acquire.stages |= dst_stages ? dst_stages : vk::PipelineStageFlagBits::eAllCommands;
+
+        return next_token;
+    }
+
+    UploadToken UploadManager::upload_image( vk::Image dst, const void* data, vk::DeviceSize size, vk::Extent3D extent, vk::ImageAspectFlags aspect, vk::ImageLayout final_layout ) {
+        vk::BufferImageCopy region {
+            0,
+            0,
+            0,
+            vk::ImageSubresourceLayers { aspect, 0, 0, 1 },
+            vk::Offset3D { 0, 0, 0 },
+            extent
+        };
+
+        return upload_image( dst, data, size, region, vk::ImageSubresourceRange { aspect, 0, 1, 0, 1 }, final_layout, vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eFragmentShader );
+    }
+
+    UploadToken UploadManager::submit() {
+        std::lock_guard<std::mutex> lock( mutex );
+        // Retiring here as well as when staging keeps ring space and profiler scopes from
+        // waiting for the next upload.
+        retire_completed( false );
+        return submit_locked();
+    }
+
+    std::pair<UploadToken, vk::PipelineStageFlags> UploadManager::record_acquire_barriers( vk::CommandBuffer command_buffer, UploadToken up_to ) {
+        std::lock_guard<std::mutex> lock( mutex );
+
+        UploadToken wait_value { 0 };
+        vk::PipelineStageFlags stages;
+        std::vector<vk::BufferMemoryBarrier> buffer_barriers;
+        std::vector<vk::ImageMemoryBarrier> image_barriers;
+
+        while( !pending_acquires.empty() && pending_acquires.front().token <= up_to ) {
+            Acquire& a = pending_acquires.front();
+            buffer_barriers.insert( buffer_barriers.end(), a.buffer_barriers.begin(), a.buffer_barriers.end() );
+            image_barriers.insert( image_barriers.end(), a.image_barriers.begin(), a.image_barriers.end() );
+            stages |= a.stages;
+            wait_value = a.token;
+            pending_acquires.pop_front();
+        }
+
+        // The acquire's first scope has to match the semaphore wait's stages to chain with it.
+        if( !buffer_barriers.empty() || !image_barriers.empty() ) {
+            command_buffer.pipelineBarrier( stages, stages, {}, nullptr, buffer_barriers, image_barriers );
+        }
+
+        return { wait_value, stages };
+    }
+
+    bool UploadManager::is_complete( UploadToken token ) {
+        return device.getSemaphoreCounterValue( timeline.get() ) >= token;
+    }
+
+    void UploadManager::wait( UploadToken token ) {
+        vk::Semaphore s { timeline.get() };
+        vk::SemaphoreWaitInfo wi { {}, 1, &s, &token };
+        [[maybe_unused]] auto res = device.waitSemaphores( wi, UINT64_MAX );
+    }
+
+    UploadToken UploadManager::get_completed_token() {
+        return device.getSemaphoreCounterValue( timeline.get() );
+    }
+
+    vk::UniqueSemaphore UploadManager::create_timeline_semaphore() {
+        vk::StructureChain<vk::SemaphoreCreateInfo, vk::SemaphoreTypeCreateInfo> ci {
+            vk::SemaphoreCreateInfo {},
+            vk::SemaphoreTypeCreateInfo { vk::SemaphoreType::eTimeline, 0 }
+        };
+
+        return device.createSemaphoreUnique( ci.get<vk::SemaphoreCreateInfo>() );
+    }
+
+    vk::CommandBuffer UploadManager::begin_batch() {
+        if( !open_batch_recording ) {
+            if( free_command_buffers.empty() ) {
+                vk::CommandBufferAllocateInfo ai {
+                    command_pool,
+                    vk::CommandBufferLevel::ePrimary,
+                    1
+                };
+                open_batch.command_buffer = std::move( device.allocateCommandBuffersUnique( ai ).front() );
+            }
+            else {
+                open_batch.command_buffer = std::move( free_command_buffers.back() );
+                free_command_buffers.pop_back();
+            }
+
+            open_batch.command_buffer->begin( vk::CommandBufferBeginInfo { vk::CommandBufferUsageFlagBits::eOneTimeSubmit } );
+            open_batch_recording = true;
+
+            if( profiler != nullptr )
+                open_batch.profile_scope = profiler->begin_transfer_scope( open_batch.command_buffer.get() );
+        }
+
+        return open_batch.command_buffer.get();
+    }
+
+    UploadToken UploadManager::submit_locked() {
+        if( !open_batch_recording ) {
+            return next_token - 1;
+        }
+
+        if( profiler != nullptr )
+            profiler->end_transfer_scope( open_batch.command_buffer.get(), open_batch.profile_scope );
+        open_batch.command_buffer->end();
+
+        // Staging writes may be in non-coherent memory.
+        allocator.flush();
+
+        UploadToken token { next_token++ };
+        open_batch.token = token;
+        open_batch.acquire.token = token;
+
+        vk::TimelineSemaphoreSubmitInfo ti { 0, nullptr, 1, &token };
+        vk::SubmitInfo si {
+            0,
+            nullptr,
+            nullptr,
+            1,
+            &open_batch.command_buffer.get(),
+            1,
+            &timeline.get()
+        };
+        si.setPNext( &ti );
+        transfer_queue.submit( si, nullptr );
+
+        pending_acquires.push_back( std::move( open_batch.acquire ) );
+        in_flight.push_back( std::move( open_batch ) );
+        open_batch = Batch();
+        open_batch_recording = false;
+
+        return token;
+    }
+
+    void UploadManager::retire_completed( bool wait_for_oldest ) {
+        if( wait_for_oldest && !in_flight.empty() ) {
+            vk::Semaphore s { timeline.get() };
+            UploadToken t { in_flight.front().token };
+            vk::SemaphoreWaitInfo wi { {}, 1, &s, &t };
+            [[maybe_unused]] auto res = device.waitSemaphores( wi, UINT64_MAX );
+        }
+
+        const UploadToken completed { device.getSemaphoreCounterValue( timeline.get() ) };
+        while( !in_flight.empty() && in_flight.front().token <= completed ) {
+            Batch& b = in_flight.front();
+            ring_used -= b.ring_bytes;
+            if( profiler != nullptr )
+                profiler->resolve_transfer_scope( b.profile_scope, "Upload batch " + std::to_string( b.token ) );
+            b.command_buffer->reset();
+            free_command_buffers.push_back( std::move( b.command_buffer ) );
+            in_flight.pop_front();
+        }
+    }
+
+    vk::DeviceSize UploadManager::stage( const void* data, vk::DeviceSize size, vk::Buffer& staging ) {
+        // Uploads that can never fit the ring get a staging buffer of their own for the batch's lifetime.
+        if( size > ring_capacity ) {
+            vk::UniqueBuffer b { device.createBufferUnique( vk::BufferCreateInfo { {}, size, vk::BufferUsageFlagBits::eTransferSrc, vk::SharingMode::eExclusive } ) };
+            MemoryAllocator::UniqueAllocation a { allocator.allocate_unique( b.get(), vk::MemoryPropertyFlagBits::eHostVisible ) };
+            a.write( data, size );
+            staging = b.get();
+            open_batch.oversized_staging.emplace_back( std::move( b ), std::move( a ) );
+            return 0;
+        }
+
+        retire_completed( false );
+
+        vk::DeviceSize offset { 0 };
+        vk::DeviceSize consumed { 0 };
+        for( ;; ) {
+            if( ring_used == 0 ) {
+                ring_head = 0;
+            }
+
+            const vk::DeviceSize aligned { ( ring_head + copy_alignment - 1 ) / copy_alignment * copy_alignment };
+            const bool wrap { aligned + size > ring_capacity };
+            offset = wrap ? 0 : aligned;
+            consumed = ( wrap ? ring_capacity - ring_head : aligned - ring_head ) + size;
+
+            if( ring_used + consumed <= ring_capacity ) {
+                break;
+            }
+
+            // Out of space: make sure the open batch can retire, then wait for the oldest batch.
+            if( in_flight.empty() ) {
+                submit_locked();
+            }
+            retire_completed( true );
+        }
+
+        ring_head = offset + size;
+        ring_used += consumed;
+        open_batch.ring_bytes += consumed;
+
+        staging_allocation.write( data, size, offset );
+        staging = staging_buffer.get();
+        return offset;
+    }
+}
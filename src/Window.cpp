@@ -15,10 +15,17 @@ namespace stlr {
         window = glfwCreateWindow( width, height, title, nullptr, nullptr );
     }
 
-    const bool Window::is_set_to_close() const {
+    bool Window::is_set_to_close() const {
         return glfwWindowShouldClose( window );
     }
 
+    std::pair<int, int> Window::get_framebuffer_size() const {
+        int w { 0 };
+        int h { 0 };
+        glfwGetFramebufferSize( window, &w, &h );
+        return { w, h };
+    }
+
     void Window::close() {
         glfwDestroyWindow( window );
     }
@@ -0,0 +1,141 @@
+// Checks that a pack written by hand to a temporary directory opens and reads back, and that
+// packs with a broken table or range are rejected when opened rather than read out of bounds.
+#include "AssetPack.hpp"
+#include "TestUtils.hpp"
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+    using namespace stlr::test;
+    namespace asset_pack = stlr::asset_pack;
+
+    /// The tables of a pack with one 4x4 RGBA8 texture with every level, and one triangle.
+    struct Pack {
+        asset_pack::Header header;
+        asset_pack::TextureEntry texture;
+        asset_pack::MeshEntry mesh;
+        std::array<asset_pack::Region, 3> regions;
+        std::array<asset_pack::Attribute, 2> attributes;
+    };
+
+    constexpr uint64_t texture_offset { 512 };
+    constexpr uint64_t vertex_offset { 768 };
+    constexpr uint64_t index_offset { 1024 };
+    constexpr uint64_t file_size { 1280 };
+
+    Pack get_pack() {
+        Pack p {};
+        p.header = asset_pack::Header { asset_pack::magic, asset_pack::version, 1, 1, 3, 2, 0, 64, 176, 296, 368 };
+
+        std::strcpy( p.texture.name, "checker" );
+        p.texture.format = static_cast<uint32_t>( vk::Format::eR8G8B8A8Unorm );
+        p.texture.width = 4;
+        p.texture.height = 4;
+        p.texture.level_count = 3;
+        p.texture.layer_count = 1;
+        p.texture.first_region = 0;
+        p.texture.region_count = 3;
+        p.texture.data_offset = texture_offset;
+        p.texture.data_size = 64 + 16 + 4;
+        p.regions = { asset_pack::Region { 0, 0, 0, 64 }, asset_pack::Region { 1, 0, 64, 16 }, asset_pack::Region { 2, 0, 80, 4 } };
+
+        // A float3 position and a packed color in each 16 byte vertex.
+        std::strcpy( p.mesh.name, "triangle" );
+        p.mesh.vertex_stride = 16;
+        p.mesh.vertex_count = 3;
+        p.mesh.index_count = 3;
+        p.mesh.index_type = static_cast<uint32_t>( vk::IndexType::eUint16 );
+        p.mesh.first_attribute = 0;
+        p.mesh.attribute_count = 2;
+        p.mesh.vertex_offset = vertex_offset;
+        p.mesh.vertex_size = 3 * 16;
+        p.mesh.index_offset = index_offset;
+        p.mesh.index_size = 3 * 2;
+        p.attributes = { asset_pack::Attribute { 0, static_cast<uint32_t>( vk::Format::eR32G32B32Sfloat ), 0, 0 }, asset_pack::Attribute { 1, static_cast<uint32_t>( vk::Format::eR8G8B8A8Unorm ), 12, 0 } };
+        return p;
+    }
+
+    void write_pack( const std::filesystem::path& file, const Pack& p ) {
+        std::vector<char> bytes( file_size );
+        std::memcpy( bytes.data(), &p.header, sizeof( p.header ) );
+        std::memcpy( bytes.data() + p.header.textures_offset, &p.texture, sizeof( p.texture ) );
+        std::memcpy( bytes.data() + p.header.meshes_offset, &p.mesh, sizeof( p.mesh ) );
+        std::memcpy( bytes.data() + p.header.regions_offset, p.regions.data(), sizeof( p.regions ) );
+        std::memcpy( bytes.data() + p.header.attributes_offset, p.attributes.data(), sizeof( p.attributes ) );
+        for( uint64_t i = 0; i < p.texture.data_size; ++i ) {
+            bytes[texture_offset + i] = static_cast<char>( i );
+        }
+        const std::array<uint16_t, 3> indices { 0, 1, 2 };
+        std::memcpy( bytes.data() + index_offset, indices.data(), sizeof( indices ) );
+
+        std::ofstream f( file, std::ios::binary );
+        f.write( bytes.data(), bytes.size() );
+    }
+
+    /// Writes the valid pack after breaking it with change, and checks opening it throws.
+    template <typename F>
+    void check_rejects( const std::filesystem::path& file, F&& change, const std::string& what ) {
+        Pack p { get_pack() };
+        change( p );
+        write_pack( file, p );
+        check_throws( [&] { stlr::AssetPack pack( file ); }, what );
+    }
+
+    void check_valid( const std::filesystem::path& file ) {
+        write_pack( file, get_pack() );
+        const stlr::AssetPack pack( file );
+        check( pack.get_textures().size() == 1 && pack.get_meshes().size() == 1, "the pack's tables are read" );
+        check( pack.find_texture( "checker" ) != nullptr && pack.find_mesh( "checker" ) == nullptr, "find_texture() and find_mesh() look up names" );
+
+        const asset_pack::TextureEntry& texture { pack.get_texture( "checker" ) };
+        check( pack.get_texture_data( texture )[81] == 81, "get_texture_data() points at the texture's blob" );
+        const auto copies { pack.get_copy_regions( texture, 1000 ) };
+        check( copies.size() == 3 && copies[2].bufferOffset == 1080 && copies[2].imageSubresource.mipLevel == 2 && copies[2].imageExtent.width == 1, "get_copy_regions() copies each level at its offset and size" );
+
+        const asset_pack::MeshEntry& mesh { pack.get_mesh( "triangle" ) };
+        check( stlr::AssetPack::get_index_type( mesh ) == vk::IndexType::eUint16 && reinterpret_cast<const uint16_t*>( pack.get_index_data( mesh ) )[2] == 2, "get_index_data() points at the mesh's indices" );
+        const auto attributes { pack.get_vertex_attributes( mesh, 1 ) };
+        check( attributes.size() == 2 && attributes[1].location == 1 && attributes[1].binding == 1 && attributes[1].format == vk::Format::eR8G8B8A8Unorm && attributes[1].offset == 12, "get_vertex_attributes() reads the mesh's attributes" );
+        check_throws( [&] { pack.get_mesh( "square" ); }, "get_mesh() rejects unknown names" );
+    }
+}
+
+int main() {
+    const std::filesystem::path directory { std::filesystem::temp_directory_path() / "stellar_asset_pack_test" };
+    std::filesystem::create_directories( directory );
+    const std::filesystem::path file { directory / "test.pack" };
+
+    try {
+        check_valid( file );
+
+        check_rejects( file, []( Pack& p ) { p.header.magic[0] = 'X'; }, "a wrong magic is rejected" );
+        check_rejects( file, []( Pack& p ) { p.header.version = asset_pack::version + 1; }, "other versions are rejected" );
+        check_rejects( file, []( Pack& p ) { p.header.attribute_count = 100; }, "tables past the end of the file are rejected" );
+        check_rejects( file, []( Pack& p ) { p.texture.data_offset = file_size - 64; }, "blobs past the end of the file are rejected" );
+        check_rejects( file, []( Pack& p ) { std::memset( p.texture.name, 'x', asset_pack::name_size ); }, "unterminated names are rejected" );
+        check_rejects( file, []( Pack& p ) { p.texture.level_count = 4; p.regions[2].level = 3; }, "textures with more levels than their size allows are rejected" );
+        check_rejects( file, []( Pack& p ) { p.texture.region_count = 4; }, "texture regions outside the region table are rejected" );
+        check_rejects( file, []( Pack& p ) { p.regions[2].offset = 81; }, "texture regions outside the texture's data are rejected" );
+        check_rejects( file, []( Pack& p ) { p.regions[1].layer = 1; }, "texture regions outside the texture's layers are rejected" );
+        check_rejects( file, []( Pack& p ) { p.mesh.index_type = static_cast<uint32_t>( vk::IndexType::eUint8EXT ); }, "index types other than 16 and 32 bit are rejected" );
+        check_rejects( file, []( Pack& p ) { p.mesh.index_type = static_cast<uint32_t>( vk::IndexType::eUint32 ); }, "more index data than the mesh has is rejected" );
+        check_rejects( file, []( Pack& p ) { p.mesh.vertex_count = 4; }, "more vertices than the mesh has are rejected" );
+        check_rejects( file, []( Pack& p ) { p.attributes[1].offset = 14; }, "attributes overrunning the vertex stride are rejected" );
+        check_rejects( file, []( Pack& p ) { p.attributes[1].format = 0x7fffffff; }, "attributes of an unknown format are rejected" );
+        check_rejects( file, []( Pack& p ) { p.mesh.first_attribute = 1; }, "mesh attributes outside the attribute table are rejected" );
+    }
+    catch( const std::exception& e ) {
+        check( false, e.what() );
+    }
+    std::filesystem::remove_all( directory );
+
+    if( failed )
+        return EXIT_FAILURE;
+    std::cout << "AssetPack reads valid packs and rejects broken ones." << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,167 @@
+// Checks the BVH's frustum, box and ray queries against testing every object's box, before and
+// after objects move and the tree is refitted.
+#include "Bvh.hpp"
+#include "TestUtils.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <random>
+#include <string>
+
+namespace {
+    using stlr::Bvh;
+    using namespace stlr::test;
+
+    Bvh::Aabb random_box( std::mt19937& rng ) {
+        std::uniform_real_distribution<float> xy { -30.0f, 30.0f };
+        std::uniform_real_distribution<float> z { -10.0f, 60.0f };
+        std::uniform_real_distribution<float> size { 0.0f, 3.0f };
+        const std::array<float, 3> min { xy( rng ), xy( rng ), z( rng ) };
+        return Bvh::Aabb { min, { min[0] + size( rng ), min[1] + size( rng ), min[2] + size( rng ) } };
+    }
+
+    bool is_outside( const Bvh::Aabb& box, const Bvh::Frustum& frustum ) {
+        for( const auto& p : frustum ) {
+            float d { p[3] };
+            float r { 0.0f };
+            for( uint32_t a = 0; a < 3; ++a ) {
+                d += p[a] * ( box.min[a] + box.max[a] ) * 0.5f;
+                r += std::fabs( p[a] ) * ( box.max[a] - box.min[a] ) * 0.5f;
+            }
+            if( d < -r )
+                return true;
+        }
+        return false;
+    }
+
+    bool overlaps( const Bvh::Aabb& a, const Bvh::Aabb& b ) {
+        for( uint32_t i = 0; i < 3; ++i ) {
+            if( a.min[i] > b.max[i] || a.max[i] < b.min[i] )
+                return false;
+        }
+        return true;
+    }
+
+    /// Where the ray enters the box, if it does before max_distance.
+    std::optional<float> intersect( const Bvh::Aabb& box, const Bvh::Ray& ray ) {
+        float near { 0.0f };
+        float far { ray.max_distance };
+        for( uint32_t a = 0; a < 3; ++a ) {
+            const float inverse { ray.direction[a] != 0.0f ? 1.0f / ray.direction[a] : std::numeric_limits<float>::infinity() };
+            const float t0 { ( box.min[a] - ray.origin[a] ) * inverse };
+            const float t1 { ( box.max[a] - ray.origin[a] ) * inverse };
+            near = std::max( near, std::min( t0, t1 ) );
+            far = std::min( far, std::max( t0, t1 ) );
+        }
+        if( near > far )
+            return std::nullopt;
+        return near;
+    }
+
+    void check_queries( const Bvh& bvh, std::mt19937& rng, const std::string& when ) {
+        const float s { 1.0f / std::sqrt( 2.0f ) };
+        const Bvh::Frustum frustum { {
+            { s, 0.0f, s, 0.0f },
+            { -s, 0.0f, s, 0.0f },
+            { 0.0f, s, s, 0.0f },
+            { 0.0f, -s, s, 0.0f },
+            { 0.0f, 0.0f, 1.0f, -1.0f },
+            { 0.0f, 0.0f, -1.0f, 40.0f }
+        } };
+        std::vector<Bvh::ObjectId> visible;
+        bvh.cull( frustum, visible );
+        std::sort( visible.begin(), visible.end() );
+        std::vector<Bvh::ObjectId> expected;
+        for( Bvh::ObjectId o = 0; o < bvh.get_object_count(); ++o ) {
+            if( !is_outside( bvh.get_box( o ), frustum ) )
+                expected.push_back( o );
+        }
+        check( visible == expected, when + ": cull() matches testing every box" );
+        check( !expected.empty() && expected.size() < bvh.get_object_count(), when + ": the frustum cuts through the scene" );
+
+        for( uint32_t i = 0; i < 20; ++i ) {
+            const Bvh::Aabb box { random_box( rng ) };
+            std::vector<Bvh::ObjectId> result;
+            bvh.query( box, result );
+            std::sort( result.begin(), result.end() );
+            expected.clear();
+            for( Bvh::ObjectId o = 0; o < bvh.get_object_count(); ++o ) {
+                if( overlaps( bvh.get_box( o ), box ) )
+                    expected.push_back( o );
+            }
+            check( result == expected, when + ": query( box ) matches testing every box" );
+        }
+
+        std::uniform_real_distribution<float> position { -20.0f, 20.0f };
+        std::uniform_real_distribution<float> direction { -1.0f, 1.0f };
+        for( uint32_t i = 0; i < 200; ++i ) {
+            Bvh::Ray ray { { position( rng ), position( rng ), position( rng ) }, { direction( rng ), direction( rng ), direction( rng ) }, 100.0f };
+            // Axis-parallel rays take the infinite inverse direction path.
+            if( i % 4 == 0 ) {
+                ray.direction[i / 4 % 3] = 0.0f;
+                ray.direction[( i / 4 + 1 ) % 3] = 0.0f;
+            }
+
+            std::vector<Bvh::Hit> hits;
+            bvh.query( ray, hits );
+            std::sort( hits.begin(), hits.end(), []( const Bvh::Hit& a, const Bvh::Hit& b ) { return a.object < b.object; } );
+
+            std::vector<Bvh::Hit> expected_hits;
+            std::optional<float> nearest;
+            for( Bvh::ObjectId o = 0; o < bvh.get_object_count(); ++o ) {
+                if( const auto distance { intersect( bvh.get_box( o ), ray ) } ) {
+                    expected_hits.push_back( Bvh::Hit { o, *distance } );
+                    nearest = std::min( nearest.value_or( *distance ), *distance );
+                }
+            }
+
+            bool same { hits.size() == expected_hits.size() };
+            for( size_t h = 0; same && h < hits.size(); ++h ) {
+                same = hits[h].object == expected_hits[h].object && hits[h].distance == expected_hits[h].distance;
+            }
+            check( same, when + ": query( ray ) matches testing every box" );
+
+            const auto hit { bvh.raycast( ray ) };
+            check( hit.has_value() == nearest.has_value(), when + ": raycast() hits when some box is hit" );
+            if( hit && nearest ) {
+                check( hit->distance == *nearest, when + ": raycast() returns the nearest distance" );
+                check( intersect( bvh.get_box( hit->object ), ray ) == *nearest, when + ": raycast() returns an object at the nearest distance" );
+            }
+        }
+    }
+}
+
+int main() {
+    std::mt19937 rng { 1234 };
+
+    std::vector<Bvh::Aabb> boxes( 1000 );
+    for( auto& b : boxes ) {
+        b = random_box( rng );
+    }
+
+    Bvh bvh;
+    bvh.build( boxes );
+    check( bvh.get_object_count() == boxes.size(), "build() keeps every object" );
+    check_queries( bvh, rng, "built" );
+
+    // Move a third of the objects, some far from where they were.
+    for( Bvh::ObjectId o = 0; o < bvh.get_object_count(); o += 3 ) {
+        bvh.update( o, random_box( rng ) );
+    }
+    bvh.refit();
+    check_queries( bvh, rng, "refitted" );
+
+    Bvh empty;
+    empty.build( {} );
+    std::vector<Bvh::ObjectId> none;
+    empty.cull( Bvh::Frustum {}, none );
+    check( none.empty() && !empty.raycast( Bvh::Ray { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, 1.0f } ), "an empty tree finds nothing" );
+
+    if( failed )
+        return EXIT_FAILURE;
+    std::cout << "Bvh queries match brute force." << std::endl;
+    return EXIT_SUCCESS;
+}
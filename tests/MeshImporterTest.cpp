@@ -0,0 +1,176 @@
+// Checks the mesh importer on OBJ and glTF files written to a temporary directory, and that
+// optimizing a mesh keeps its triangles while improving its vertex cache and fetch order.
+#include "MeshImporter.hpp"
+#include "TestUtils.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+    using stlr::MeshData;
+    using stlr::MeshVertex;
+    namespace mesh_import = stlr::mesh_import;
+    using namespace stlr::test;
+
+    void write_file( const std::filesystem::path& file, const std::string& contents ) {
+        std::ofstream f( file, std::ios::binary );
+        f << contents;
+    }
+
+    std::string encode_base64( const std::vector<char>& data ) {
+        static const char digits[] { "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/" };
+        std::string result;
+        for( size_t i = 0; i < data.size(); i += 3 ) {
+            uint32_t group { static_cast<uint32_t>( static_cast<uint8_t>( data[i] ) ) << 16 };
+            if( i + 1 < data.size() )
+                group |= static_cast<uint32_t>( static_cast<uint8_t>( data[i + 1] ) ) << 8;
+            if( i + 2 < data.size() )
+                group |= static_cast<uint8_t>( data[i + 2] );
+            result += digits[group >> 18 & 63];
+            result += digits[group >> 12 & 63];
+            result += i + 1 < data.size() ? digits[group >> 6 & 63] : '=';
+            result += i + 2 < data.size() ? digits[group & 63] : '=';
+        }
+        return result;
+    }
+
+    /// A grid of size by size quads in the XZ plane, whose neighbours share corners.
+    std::string get_grid_obj( uint32_t size ) {
+        std::ostringstream obj;
+        for( uint32_t z = 0; z <= size; ++z ) {
+            for( uint32_t x = 0; x <= size; ++x ) {
+                obj << "v " << x << " 0 " << z << "\n";
+                obj << "vt " << static_cast<float>( x ) / size << " " << static_cast<float>( z ) / size << "\n";
+            }
+        }
+        obj << "vn 0 1 0\n";
+        for( uint32_t z = 0; z < size; ++z ) {
+            for( uint32_t x = 0; x < size; ++x ) {
+                const uint32_t a { z * ( size + 1 ) + x + 1 };
+                const uint32_t b { a + 1 };
+                const uint32_t c { b + size + 1 };
+                const uint32_t d { a + size + 1 };
+                obj << "f " << a << "/" << a << "/1 " << d << "/" << d << "/1 " << c << "/" << c << "/1 " << b << "/" << b << "/1\n";
+            }
+        }
+        return obj.str();
+    }
+
+    /// Every triangle as its vertices' bytes, starting from the smallest corner so the winding is kept.
+    std::vector<std::string> get_triangles( const MeshData& mesh ) {
+        std::vector<std::string> triangles;
+        for( size_t t = 0; t + 2 < mesh.indices.size(); t += 3 ) {
+            std::array<std::string, 3> corners;
+            for( uint32_t k = 0; k < 3; ++k ) {
+                corners[k].assign( reinterpret_cast<const char*>( &mesh.vertices[mesh.indices[t + k]] ), sizeof( MeshVertex ) );
+            }
+            std::rotate( corners.begin(), std::min_element( corners.begin(), corners.end() ), corners.end() );
+            triangles.push_back( corners[0] + corners[1] + corners[2] );
+        }
+        std::sort( triangles.begin(), triangles.end() );
+        return triangles;
+    }
+
+    void check_obj( const std::filesystem::path& directory ) {
+        const uint32_t size { 32 };
+        const std::filesystem::path file { directory / "grid.obj" };
+        write_file( file, get_grid_obj( size ) );
+
+        MeshData mesh { mesh_import::load_obj( file ) };
+        check( mesh.name == "grid", "load_obj() names the mesh after the file" );
+        check( mesh.indices.size() == size * size * 6, "load_obj() fans each quad into two triangles" );
+        check( mesh.vertices.size() == ( size + 1 ) * ( size + 1 ), "load_obj() shares corners with the same position, UV and normal" );
+        check( mesh.vertices[0].position == std::array<float, 3> { 0.0f, 0.0f, 0.0f } && mesh.vertices[0].uv == std::array<float, 2> { 0.0f, 1.0f } && mesh.vertices[0].normal == std::array<float, 3> { 0.0f, 1.0f, 0.0f }, "load_obj() reads the first corner, with V flipped" );
+        check( mesh.uses_16_bit_indices() && mesh.get_index_data().size() == mesh.indices.size() * 2, "small meshes pack their indices into 16 bits" );
+
+        // Shuffling the triangles ruins the cache hits the grid's order had, for optimize() to restore.
+        std::mt19937 rng { 1234 };
+        std::vector<std::array<uint32_t, 3>> triangles( mesh.indices.size() / 3 );
+        std::memcpy( triangles.data(), mesh.indices.data(), mesh.indices.size() * sizeof( uint32_t ) );
+        std::shuffle( triangles.begin(), triangles.end(), rng );
+        std::memcpy( mesh.indices.data(), triangles.data(), mesh.indices.size() * sizeof( uint32_t ) );
+        // A copy of every vertex, used by half the triangles, for deduplicate() to merge.
+        const size_t original_count { mesh.vertices.size() };
+        mesh.vertices.insert( mesh.vertices.end(), mesh.vertices.begin(), mesh.vertices.end() );
+        for( size_t i = 0; i < mesh.indices.size(); i += 6 ) {
+            mesh.indices[i] += static_cast<uint32_t>( original_count );
+        }
+
+        const std::vector<std::string> before { get_triangles( mesh ) };
+        const float shuffled_acmr { mesh_import::get_acmr( mesh.indices, static_cast<uint32_t>( mesh.vertices.size() ) ) };
+        mesh_import::optimize( mesh );
+        const float acmr { mesh_import::get_acmr( mesh.indices, static_cast<uint32_t>( mesh.vertices.size() ) ) };
+
+        check( get_triangles( mesh ) == before, "optimize() keeps every triangle and its winding" );
+        check( mesh.vertices.size() == original_count, "optimize() merges identical vertices" );
+        check( acmr < 0.8f && acmr < shuffled_acmr / 2.0f, "optimize() reorders the triangles for the vertex cache (ACMR " + std::to_string( shuffled_acmr ) + " to " + std::to_string( acmr ) + ")" );
+
+        uint32_t next { 0 };
+        bool in_order { true };
+        for( const uint32_t index : mesh.indices ) {
+            in_order = in_order && index <= next;
+            next = std::max( next, index + 1 );
+        }
+        check( in_order && next == mesh.vertices.size(), "optimize() numbers the vertices in the order the triangles use them" );
+
+        write_file( directory / "broken.obj", "v 0 0 0\nv 1 0 0\nf 1 2 3\n" );
+        check_throws( [&] { mesh_import::load_obj( directory / "broken.obj" ); }, "load_obj() rejects a face with a missing position" );
+    }
+
+    void check_gltf( const std::filesystem::path& directory ) {
+        // A quad's four positions, then its six 16-bit indices.
+        const std::array<float, 12> positions { 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f };
+        const std::array<uint16_t, 6> indices { 0, 1, 2, 0, 2, 3 };
+        std::vector<char> buffer( sizeof( positions ) + sizeof( indices ) );
+        std::memcpy( buffer.data(), positions.data(), sizeof( positions ) );
+        std::memcpy( buffer.data() + sizeof( positions ), indices.data(), sizeof( indices ) );
+
+        std::ostringstream gltf;
+        gltf << R"({"asset":{"version":"2.0"},)"
+             << R"("buffers":[{"byteLength":)" << buffer.size() << R"(,"uri":"data:application/octet-stream;base64,)" << encode_base64( buffer ) << R"("}],)"
+             << R"("bufferViews":[{"buffer":0,"byteLength":48},{"buffer":0,"byteOffset":48,"byteLength":12}],)"
+             << R"("accessors":[{"bufferView":0,"componentType":5126,"count":4,"type":"VEC3"},{"bufferView":1,"componentType":5123,"count":6,"type":"SCALAR"}],)"
+             << R"("meshes":[{"name":"Quad","primitives":[{"attributes":{"POSITION":0},"indices":1},{"attributes":{"POSITION":0},"mode":1}]}]})";
+        const std::filesystem::path file { directory / "quad.gltf" };
+        write_file( file, gltf.str() );
+
+        const std::vector<MeshData> meshes { mesh_import::load( file ) };
+        check( meshes.size() == 1 && meshes[0].name == "Quad", "load() reads the glTF's mesh" );
+        if( meshes.size() != 1 )
+            return;
+        check( meshes[0].indices.size() == 6 && meshes[0].vertices.size() == 4, "load_gltf() reads only the triangle primitive" );
+
+        MeshData expected;
+        for( uint32_t i = 0; i < 4; ++i ) {
+            expected.vertices.push_back( MeshVertex { { positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2] }, {}, {} } );
+        }
+        expected.indices.assign( indices.begin(), indices.end() );
+        check( get_triangles( meshes[0] ) == get_triangles( expected ), "load_gltf() reads the positions and indices" );
+
+        check_throws( [&] { mesh_import::load( directory / "quad.txt" ); }, "load() rejects other extensions" );
+    }
+}
+
+int main() {
+    const std::filesystem::path directory { std::filesystem::temp_directory_path() / "stellar_mesh_importer_test" };
+    std::filesystem::create_directories( directory );
+
+    try {
+        check_obj( directory );
+        check_gltf( directory );
+    }
+    catch( const std::exception& e ) {
+        check( false, e.what() );
+    }
+    std::filesystem::remove_all( directory );
+
+    if( failed )
+        return EXIT_FAILURE;
+    std::cout << "MeshImporter loads and optimizes meshes." << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,111 @@
+// Checks that each swapchain choice takes what the settings ask for when the surface supports it,
+// and otherwise falls back in the documented order to something the surface does support.
+#include "SwapchainSettings.hpp"
+#include "TestUtils.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace {
+    using stlr::PresentPolicy;
+    using stlr::SwapchainSettings;
+    using namespace stlr::test;
+
+    SwapchainSettings with_policy( PresentPolicy policy ) {
+        SwapchainSettings s;
+        s.present_policy = policy;
+        return s;
+    }
+
+    void check_present_modes() {
+        using Mode = vk::PresentModeKHR;
+        const std::vector<Mode> all { Mode::eImmediate, Mode::eMailbox, Mode::eFifo, Mode::eFifoRelaxed };
+        const std::vector<Mode> fifo { Mode::eFifo };
+        const std::vector<Mode> mailbox { Mode::eFifo, Mode::eMailbox };
+
+        check( with_policy( PresentPolicy::eVsync ).choose_present_mode( all ) == Mode::eFifo, "vsync uses FIFO" );
+        check( with_policy( PresentPolicy::eLowLatency ).choose_present_mode( all ) == Mode::eMailbox, "low latency uses mailbox" );
+        check( with_policy( PresentPolicy::eLowLatency ).choose_present_mode( fifo ) == Mode::eFifo, "low latency falls back to FIFO" );
+        check( with_policy( PresentPolicy::eAdaptiveVsync ).choose_present_mode( all ) == Mode::eFifoRelaxed, "adaptive vsync uses FIFO relaxed" );
+        check( with_policy( PresentPolicy::eAdaptiveVsync ).choose_present_mode( mailbox ) == Mode::eFifo, "adaptive vsync falls back to FIFO" );
+        check( with_policy( PresentPolicy::eNoVsync ).choose_present_mode( all ) == Mode::eImmediate, "no vsync uses immediate" );
+        check( with_policy( PresentPolicy::eNoVsync ).choose_present_mode( mailbox ) == Mode::eMailbox, "no vsync falls back to mailbox" );
+        check( with_policy( PresentPolicy::eNoVsync ).choose_present_mode( fifo ) == Mode::eFifo, "no vsync falls back to FIFO last" );
+    }
+
+    void check_image_counts() {
+        vk::SurfaceCapabilitiesKHR capabilities;
+        capabilities.minImageCount = 2;
+        capabilities.maxImageCount = 4;
+        SwapchainSettings s;
+        check( s.choose_image_count( vk::PresentModeKHR::eMailbox, capabilities ) == 3, "mailbox takes three images by default" );
+        check( s.choose_image_count( vk::PresentModeKHR::eFifo, capabilities ) == 2, "FIFO takes the surface's minimum by default" );
+
+        s.image_count = 8;
+        check( s.choose_image_count( vk::PresentModeKHR::eFifo, capabilities ) == 4, "image counts are clamped to the surface's maximum" );
+        s.image_count = 1;
+        check( s.choose_image_count( vk::PresentModeKHR::eFifo, capabilities ) == 2, "image counts are clamped to the surface's minimum" );
+        s.image_count = 8;
+        capabilities.maxImageCount = 0;
+        check( s.choose_image_count( vk::PresentModeKHR::eFifo, capabilities ) == 8, "a maximum of 0 is no limit" );
+
+        s.image_count = 0;
+        capabilities.minImageCount = 4;
+        check( s.choose_image_count( vk::PresentModeKHR::eMailbox, capabilities ) == 4, "mailbox's three images respect the surface's minimum" );
+    }
+
+    void check_extents() {
+        vk::SurfaceCapabilitiesKHR capabilities;
+        capabilities.currentExtent = vk::Extent2D { 800, 600 };
+        capabilities.minImageExtent = vk::Extent2D { 100, 100 };
+        capabilities.maxImageExtent = vk::Extent2D { 1000, 1000 };
+        check( SwapchainSettings::choose_extent( capabilities, { 640, 480 } ) == vk::Extent2D { 800, 600 }, "the surface's extent wins when it has one" );
+
+        capabilities.currentExtent = vk::Extent2D { UINT32_MAX, UINT32_MAX };
+        check( SwapchainSettings::choose_extent( capabilities, { 640, 480 } ) == vk::Extent2D { 640, 480 }, "otherwise the framebuffer size is used" );
+        check( SwapchainSettings::choose_extent( capabilities, { 2000, 50 } ) == vk::Extent2D { 1000, 100 }, "the framebuffer size is clamped to the surface's range" );
+    }
+
+    void check_composite_alpha() {
+        vk::SurfaceCapabilitiesKHR capabilities;
+        capabilities.supportedCompositeAlpha = vk::CompositeAlphaFlagBitsKHR::eOpaque | vk::CompositeAlphaFlagBitsKHR::eInherit;
+        check( SwapchainSettings::choose_composite_alpha( capabilities ) == vk::CompositeAlphaFlagBitsKHR::eOpaque, "opaque is preferred" );
+        capabilities.supportedCompositeAlpha = vk::CompositeAlphaFlagBitsKHR::ePostMultiplied | vk::CompositeAlphaFlagBitsKHR::eInherit;
+        check( SwapchainSettings::choose_composite_alpha( capabilities ) == vk::CompositeAlphaFlagBitsKHR::eInherit, "inherit comes next" );
+        capabilities.supportedCompositeAlpha = vk::CompositeAlphaFlagBitsKHR::ePostMultiplied | vk::CompositeAlphaFlagBitsKHR::ePreMultiplied;
+        check( SwapchainSettings::choose_composite_alpha( capabilities ) == vk::CompositeAlphaFlagBitsKHR::ePreMultiplied, "pre-multiplied comes before post-multiplied" );
+    }
+
+    void check_formats() {
+        // None of these reach the fallback that asks the physical device, so none is needed.
+        const vk::PhysicalDevice no_device;
+        const SwapchainSettings s;
+        const vk::SurfaceFormatKHR bgra { vk::Format::eB8G8R8A8Unorm, vk::ColorSpaceKHR::eSrgbNonlinear };
+        const vk::SurfaceFormatKHR rgba { vk::Format::eR8G8B8A8Unorm, vk::ColorSpaceKHR::eSrgbNonlinear };
+        const vk::SurfaceFormatKHR rgba_srgb { vk::Format::eR8G8B8A8Srgb, vk::ColorSpaceKHR::eSrgbNonlinear };
+
+        check( s.choose_format( no_device, { { vk::Format::eUndefined, vk::ColorSpaceKHR::eSrgbNonlinear } } ) == s.format, "a surface that takes any format gets the settings' format" );
+        check( s.choose_format( no_device, { rgba, bgra } ) == bgra, "the settings' format is used when supported" );
+        check( s.choose_format( no_device, { rgba_srgb, rgba } ) == rgba, "the format with red and blue swapped comes next" );
+    }
+}
+
+int main() {
+    check_present_modes();
+    check_image_counts();
+    check_extents();
+    check_composite_alpha();
+    check_formats();
+
+    SwapchainSettings s;
+    check( s.get_frame_latency( 3 ) == 3, "a frame latency of 0 allows every frame in flight" );
+    s.max_frame_latency = 1;
+    check( s.get_frame_latency( 3 ) == 1, "the frame latency limits the frames in flight" );
+    s.max_frame_latency = 5;
+    check( s.get_frame_latency( 3 ) == 3, "the frame latency can't exceed the frames in flight" );
+
+    if( failed )
+        return EXIT_FAILURE;
+    std::cout << "SwapchainSettings choose what the surface supports." << std::endl;
+    return EXIT_SUCCESS;
+}
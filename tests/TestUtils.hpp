@@ -0,0 +1,34 @@
+#pragma once
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+namespace stlr::test {
+    /// Set by the first failed check; main() returns EXIT_FAILURE if it is.
+    inline bool failed { false };
+
+    /// <summary>
+    /// Reports a failed condition and carries on, so a run lists every failure.
+    /// </summary>
+    inline void check( bool condition, const std::string& what ) {
+        if( condition )
+            return;
+        std::cerr << "FAILED: " << what << std::endl;
+        failed = true;
+    }
+
+    /// <summary>
+    /// Checks that f throws a std::runtime_error.
+    /// </summary>
+    template <typename F>
+    void check_throws( F&& f, const std::string& what ) {
+        try {
+            f();
+        }
+        catch( const std::runtime_error& ) {
+            return;
+        }
+        check( false, what );
+    }
+}
@@ -0,0 +1,212 @@
+// Checks the BC1 to BC5 decoders against blocks decoded by hand, and that the KTX2 and DDS parsers
+// find every level and layer of files written to a temporary directory and reject broken ones.
+#include "TextureFile.hpp"
+#include "TestUtils.hpp"
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+    using stlr::TextureFile;
+    using namespace stlr::test;
+    using Texel = std::array<uint8_t, 4>;
+
+    /// A one level, one layer texture holding a single block.
+    TextureFile make_block_texture( vk::Format format, const std::vector<uint8_t>& block, uint32_t width = 4, uint32_t height = 4 ) {
+        TextureFile t;
+        t.format = format;
+        t.width = width;
+        t.height = height;
+        t.level_count = 1;
+        t.layer_count = 1;
+        t.data.assign( block.begin(), block.end() );
+        t.subresources.push_back( TextureFile::Subresource { 0, 0, 0, block.size() } );
+        return t;
+    }
+
+    Texel get_texel( const TextureFile& t, uint32_t i ) {
+        Texel texel;
+        std::memcpy( texel.data(), t.data.data() + i * 4, 4 );
+        return texel;
+    }
+
+    void check_bc1() {
+        // Red and blue, with texels 0 to 3 using palette entries 0 to 3 and the rest entry 0.
+        const std::vector<uint8_t> block { 0x00, 0xf8, 0x1f, 0x00, 0xe4, 0x00, 0x00, 0x00 };
+        const TextureFile four { make_block_texture( vk::Format::eBc1RgbaUnormBlock, block ).decompress() };
+        check( four.format == vk::Format::eR8G8B8A8Unorm && four.data.size() == 64, "BC1 decodes to 4x4 RGBA8" );
+        check( get_texel( four, 0 ) == Texel { 255, 0, 0, 255 } && get_texel( four, 1 ) == Texel { 0, 0, 255, 255 }, "BC1 expands the 565 end points" );
+        check( get_texel( four, 2 ) == Texel { 170, 0, 85, 255 } && get_texel( four, 3 ) == Texel { 85, 0, 170, 255 }, "BC1 interpolates thirds when c0 > c1" );
+
+        // With the end points swapped, c0 <= c1 selects the half point and transparent black.
+        const std::vector<uint8_t> swapped { 0x1f, 0x00, 0x00, 0xf8, 0xe4, 0x00, 0x00, 0x00 };
+        const TextureFile three { make_block_texture( vk::Format::eBc1RgbaSrgbBlock, swapped ).decompress() };
+        check( three.format == vk::Format::eR8G8B8A8Srgb, "sRGB BC1 decodes to sRGB RGBA8" );
+        check( get_texel( three, 2 ) == Texel { 128, 0, 128, 255 } && get_texel( three, 3 ) == Texel { 0, 0, 0, 0 }, "BC1 with c0 <= c1 has a half point and punch-through alpha" );
+        const TextureFile opaque { make_block_texture( vk::Format::eBc1RgbUnormBlock, swapped ).decompress() };
+        check( get_texel( opaque, 3 ) == Texel { 0, 0, 0, 255 }, "RGB BC1 keeps its black opaque" );
+
+        // A 2x2 level still takes a whole block, of which only the top left texels are kept.
+        const TextureFile small { make_block_texture( vk::Format::eBc1RgbaUnormBlock, block, 2, 2 ).decompress() };
+        check( small.data.size() == 16 && get_texel( small, 1 ) == Texel { 0, 0, 255, 255 } && get_texel( small, 2 ) == Texel { 255, 0, 0, 255 }, "partial blocks keep only the level's texels" );
+    }
+
+    void check_bc2_to_bc5() {
+        // The color half uses four colors even though c0 <= c1.
+        const std::vector<uint8_t> color { 0x1f, 0x00, 0x00, 0xf8, 0xe4, 0x00, 0x00, 0x00 };
+
+        // Explicit alpha: 0xf for texel 0, 0x8 for texel 1, 0 for the rest.
+        std::vector<uint8_t> bc2 { 0x8f, 0, 0, 0, 0, 0, 0, 0 };
+        bc2.insert( bc2.end(), color.begin(), color.end() );
+        const TextureFile t2 { make_block_texture( vk::Format::eBc2UnormBlock, bc2 ).decompress() };
+        check( get_texel( t2, 0 ) == Texel { 0, 0, 255, 255 } && get_texel( t2, 1 ) == Texel { 255, 0, 0, 136 } && get_texel( t2, 2 )[3] == 0, "BC2 reads 4 bit alpha" );
+        check( get_texel( t2, 3 ) == Texel { 170, 0, 85, 0 }, "BC2's colors never have a transparent entry" );
+
+        // Interpolated alpha between 255 and 0: texels 0 to 7 use entries 0 to 7.
+        const std::vector<uint8_t> alpha { 255, 0, 0x88, 0xc6, 0xfa, 0, 0, 0 };
+        std::vector<uint8_t> bc3 { alpha };
+        bc3.insert( bc3.end(), color.begin(), color.end() );
+        const TextureFile t3 { make_block_texture( vk::Format::eBc3UnormBlock, bc3 ).decompress() };
+        const std::array<uint8_t, 8> eighths { 255, 0, 219, 182, 146, 109, 73, 36 };
+        bool interpolated { true };
+        for( uint32_t i = 0; i < 8; ++i ) {
+            interpolated = interpolated && get_texel( t3, i )[3] == eighths[i];
+        }
+        check( interpolated, "BC3 interpolates sevenths when a0 > a1" );
+
+        // BC4 with the end points swapped: fifths, then 0 and 255.
+        const std::vector<uint8_t> bc4 { 0, 255, 0x88, 0xc6, 0xfa, 0, 0, 0 };
+        const TextureFile t4 { make_block_texture( vk::Format::eBc4UnormBlock, bc4 ).decompress() };
+        const std::array<uint8_t, 8> fifths { 0, 255, 51, 102, 153, 204, 0, 255 };
+        bool fifths_match { true };
+        for( uint32_t i = 0; i < 8; ++i ) {
+            fifths_match = fifths_match && get_texel( t4, i ) == Texel { fifths[i], 0, 0, 255 };
+        }
+        check( fifths_match, "BC4 interpolates fifths and adds 0 and 255 when r0 <= r1, into red only" );
+
+        std::vector<uint8_t> bc5 { alpha };
+        bc5.insert( bc5.end(), bc4.begin(), bc4.end() );
+        const TextureFile t5 { make_block_texture( vk::Format::eBc5UnormBlock, bc5 ).decompress() };
+        check( get_texel( t5, 2 ) == Texel { 219, 51, 0, 255 } && get_texel( t5, 7 ) == Texel { 36, 255, 0, 255 }, "BC5 decodes red and green separately" );
+
+        check_throws( [] { make_block_texture( vk::Format::eBc7UnormBlock, std::vector<uint8_t>( 16 ) ).decompress(); }, "decompress() rejects formats it can't decode" );
+    }
+
+    void write_file( const std::filesystem::path& file, const std::vector<char>& contents ) {
+        std::ofstream f( file, std::ios::binary );
+        f.write( contents.data(), contents.size() );
+    }
+
+    template <typename T>
+    void put( std::vector<char>& bytes, size_t offset, T value ) {
+        std::memcpy( bytes.data() + offset, &value, sizeof( T ) );
+    }
+
+    /// An 8x4 RGBA8 KTX2 file with two levels of two layers, whose bytes number the texels.
+    std::vector<char> get_ktx2( uint32_t level_count, uint32_t supercompression = 0 ) {
+        // Level 1 is stored first, as KTX2 writers do, to check the offsets come from the level index.
+        const size_t level1 { 128 };
+        const size_t level0 { level1 + 2 * 4 * 2 * 4 };
+        std::vector<char> bytes( level0 + 2 * 8 * 4 * 4 );
+        const std::array<char, 12> identifier { '\xAB', 'K', 'T', 'X', ' ', '2', '0', '\xBB', '\r', '\n', '\x1A', '\n' };
+        std::memcpy( bytes.data(), identifier.data(), identifier.size() );
+        put<uint32_t>( bytes, 12, static_cast<uint32_t>( vk::Format::eR8G8B8A8Unorm ) );
+        put<uint32_t>( bytes, 16, 1 );
+        put<uint32_t>( bytes, 20, 8 );
+        put<uint32_t>( bytes, 24, 4 );
+        put<uint32_t>( bytes, 32, 2 );
+        put<uint32_t>( bytes, 36, 1 );
+        put<uint32_t>( bytes, 40, level_count );
+        put<uint32_t>( bytes, 44, supercompression );
+        put<uint64_t>( bytes, 80, level0 );
+        put<uint64_t>( bytes, 88, bytes.size() - level0 );
+        put<uint64_t>( bytes, 104, level1 );
+        put<uint64_t>( bytes, 112, level0 - level1 );
+        return bytes;
+    }
+
+    /// A DXT5 DDS file of size 8x8 with level_count levels.
+    std::vector<char> get_dds( uint32_t level_count, const char* fourcc = "DXT5" ) {
+        // 8x8, 4x4, 2x2 and 1x1 levels take 4, 1, 1 and 1 blocks of 16 bytes.
+        std::vector<char> bytes( 128 + 7 * 16 );
+        std::memcpy( bytes.data(), "DDS ", 4 );
+        put<uint32_t>( bytes, 4, 124 );
+        put<uint32_t>( bytes, 12, 8 );
+        put<uint32_t>( bytes, 16, 8 );
+        put<uint32_t>( bytes, 28, level_count );
+        put<uint32_t>( bytes, 76, 32 );
+        put<uint32_t>( bytes, 80, 0x4 );
+        std::memcpy( bytes.data() + 84, fourcc, 4 );
+        return bytes;
+    }
+
+    void check_parsers( const std::filesystem::path& directory ) {
+        const std::filesystem::path ktx2 { directory / "texture.ktx2" };
+        write_file( ktx2, get_ktx2( 2 ) );
+        const TextureFile k { TextureFile::load( ktx2 ) };
+        check( k.format == vk::Format::eR8G8B8A8Unorm && k.width == 8 && k.height == 4 && k.level_count == 2 && k.layer_count == 2 && !k.cube, "load() reads the KTX2 header" );
+        const std::vector<TextureFile::Subresource> expected_ktx2 { { 0, 0, 192, 128 }, { 0, 1, 320, 128 }, { 1, 0, 128, 32 }, { 1, 1, 160, 32 } };
+        bool ktx2_match { k.subresources.size() == expected_ktx2.size() };
+        for( size_t i = 0; ktx2_match && i < expected_ktx2.size(); ++i ) {
+            const auto& s { k.subresources[i] };
+            ktx2_match = s.level == expected_ktx2[i].level && s.layer == expected_ktx2[i].layer && s.offset == expected_ktx2[i].offset && s.size == expected_ktx2[i].size;
+        }
+        check( ktx2_match, "KTX2 levels start at the level index's offsets, with their layers in order" );
+        const auto regions { k.get_copy_regions( 1000 ) };
+        check( regions.size() == 4 && regions[3].bufferOffset == 1160 && regions[3].imageExtent.width == 4 && regions[3].imageExtent.height == 2, "get_copy_regions() offsets the data and halves each level" );
+
+        const std::filesystem::path dds { directory / "texture.dds" };
+        write_file( dds, get_dds( 4 ) );
+        const TextureFile d { TextureFile::load( dds, true ) };
+        check( d.format == vk::Format::eBc3SrgbBlock && d.width == 8 && d.height == 8 && d.level_count == 4 && d.layer_count == 1, "load() reads the DDS header, sRGB when asked" );
+        bool dds_match { d.subresources.size() == 4 };
+        size_t offset { 128 };
+        const std::array<size_t, 4> sizes { 64, 16, 16, 16 };
+        for( uint32_t l = 0; dds_match && l < 4; ++l ) {
+            dds_match = d.subresources[l].level == l && d.subresources[l].offset == offset && d.subresources[l].size == sizes[l];
+            offset += sizes[l];
+        }
+        check( dds_match, "DDS levels follow each other after the header, rounded up to whole blocks" );
+
+        std::vector<char> truncated { get_dds( 4 ) };
+        truncated.resize( truncated.size() - 1 );
+        write_file( dds, truncated );
+        check_throws( [&] { TextureFile::load( dds ); }, "load() rejects a truncated DDS file" );
+        write_file( dds, get_dds( 5 ) );
+        check_throws( [&] { TextureFile::load( dds ); }, "load() rejects more levels than the size allows" );
+        write_file( dds, get_dds( 1, "ABCD" ) );
+        check_throws( [&] { TextureFile::load( dds ); }, "load() rejects unknown DDS formats" );
+        write_file( ktx2, get_ktx2( 2, 2 ) );
+        check_throws( [&] { TextureFile::load( ktx2 ); }, "load() rejects supercompressed KTX2 files" );
+        std::vector<char> short_ktx2 { get_ktx2( 2 ) };
+        put<uint64_t>( short_ktx2, 80, short_ktx2.size() - 64 );
+        write_file( ktx2, short_ktx2 );
+        check_throws( [&] { TextureFile::load( ktx2 ); }, "load() rejects KTX2 levels past the end of the file" );
+        write_file( directory / "texture.png", std::vector<char>( 64 ) );
+        check_throws( [&] { TextureFile::load( directory / "texture.png" ); }, "load() rejects files that are neither KTX2 nor DDS" );
+    }
+}
+
+int main() {
+    check_bc1();
+    check_bc2_to_bc5();
+
+    const std::filesystem::path directory { std::filesystem::temp_directory_path() / "stellar_texture_file_test" };
+    std::filesystem::create_directories( directory );
+    try {
+        check_parsers( directory );
+    }
+    catch( const std::exception& e ) {
+        check( false, e.what() );
+    }
+    std::filesystem::remove_all( directory );
+
+    if( failed )
+        return EXIT_FAILURE;
+    std::cout << "TextureFile decodes BC1 to BC5 and parses KTX2 and DDS." << std::endl;
+    return EXIT_SUCCESS;
+}
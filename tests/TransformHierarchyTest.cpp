@@ -0,0 +1,156 @@
+// Checks the hierarchy's world matrices against multiplying each node's ancestors' local matrices
+// in plain scalar code, after building it and after moving nodes in the middle of the tree.
+#include "TransformHierarchy.hpp"
+#include "TestUtils.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace {
+    using stlr::TransformHierarchy;
+    using Matrix = TransformHierarchy::Matrix;
+    using namespace stlr::test;
+
+    bool is_near( const Matrix& a, const Matrix& b ) {
+        for( uint32_t i = 0; i < 16; ++i ) {
+            if( std::fabs( a.m[i] - b.m[i] ) > 1e-4f * std::max( 1.0f, std::fabs( b.m[i] ) ) )
+                return false;
+        }
+        return true;
+    }
+
+    Matrix multiply( const Matrix& a, const Matrix& b ) {
+        Matrix out {};
+        for( uint32_t column = 0; column < 4; ++column ) {
+            for( uint32_t row = 0; row < 4; ++row ) {
+                float sum { 0.0f };
+                for( uint32_t k = 0; k < 4; ++k ) {
+                    sum += a.m[k * 4 + row] * b.m[column * 4 + k];
+                }
+                out.m[column * 4 + row] = sum;
+            }
+        }
+        return out;
+    }
+
+    /// The world matrix from the root down, without using any of the hierarchy's own products.
+    Matrix get_expected_world( const TransformHierarchy& h, TransformHierarchy::NodeId node ) {
+        const TransformHierarchy::NodeId parent { h.get_parent( node ) };
+        if( parent == TransformHierarchy::no_parent )
+            return h.get_local( node );
+        return multiply( get_expected_world( h, parent ), h.get_local( node ) );
+    }
+
+    void set_random_local( TransformHierarchy& h, TransformHierarchy::NodeId node, std::mt19937& rng ) {
+        std::uniform_real_distribution<float> position { -5.0f, 5.0f };
+        std::uniform_real_distribution<float> component { -1.0f, 1.0f };
+        std::uniform_real_distribution<float> size { 0.5f, 1.5f };
+        std::array<float, 4> rotation { component( rng ), component( rng ), component( rng ), component( rng ) };
+        const float length { std::sqrt( rotation[0] * rotation[0] + rotation[1] * rotation[1] + rotation[2] * rotation[2] + rotation[3] * rotation[3] ) };
+        for( auto& r : rotation ) {
+            r /= length;
+        }
+        h.set_local( node, { position( rng ), position( rng ), position( rng ) }, rotation, { size( rng ), size( rng ), size( rng ) } );
+    }
+
+    void check_worlds( const TransformHierarchy& h, const std::string& when ) {
+        bool same { true };
+        for( TransformHierarchy::NodeId n = 0; n < h.get_node_count(); ++n ) {
+            same = same && is_near( h.get_world( n ), get_expected_world( h, n ) );
+        }
+        check( same, when + ": world matrices match the products of the ancestors' local matrices" );
+    }
+
+    void check_compose() {
+        const float s { std::sqrt( 0.5f ) };
+        // A quarter turn about z, then scaled and moved.
+        const Matrix m { TransformHierarchy::compose( { 1.0f, 2.0f, 3.0f }, { 0.0f, 0.0f, s, s }, { 2.0f, 3.0f, 4.0f } ) };
+        const Matrix expected { {
+            0.0f, 2.0f, 0.0f, 0.0f,
+            -3.0f, 0.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 4.0f, 0.0f,
+            1.0f, 2.0f, 3.0f, 1.0f
+        } };
+        check( is_near( m, expected ), "compose() scales, then rotates, then translates" );
+    }
+}
+
+int main() {
+    check_compose();
+
+    std::mt19937 rng { 1234 };
+    TransformHierarchy h;
+    // Each node's parent is one of the nodes before it, so the tree is many levels deep in places.
+    for( uint32_t i = 0; i < 500; ++i ) {
+        const TransformHierarchy::NodeId parent { i % 10 == 0 ? TransformHierarchy::no_parent : std::uniform_int_distribution<uint32_t> { i > 20 ? i - 20 : 0, i - 1 }( rng ) };
+        const TransformHierarchy::NodeId node { h.add( parent ) };
+        check( node == i, "add() returns the next id" );
+        set_random_local( h, node, rng );
+    }
+
+    check( h.update() == h.get_node_count(), "the first update() computes every world matrix" );
+    check_worlds( h, "built" );
+    check( h.update() == 0, "update() without changes recomputes nothing" );
+
+    // Moving a node recomputes exactly it and its descendants, which come after it.
+    std::vector<uint8_t> moved( h.get_node_count(), 0 );
+    for( TransformHierarchy::NodeId n : { 7u, 123u, 300u } ) {
+        set_random_local( h, n, rng );
+        moved[n] = 1;
+    }
+    uint32_t expected_count { 0 };
+    bool flags_match { true };
+    const uint32_t count { h.update() };
+    for( TransformHierarchy::NodeId n = 0; n < h.get_node_count(); ++n ) {
+        const TransformHierarchy::NodeId parent { h.get_parent( n ) };
+        moved[n] = moved[n] || ( parent != TransformHierarchy::no_parent && moved[parent] );
+        expected_count += moved[n];
+        flags_match = flags_match && h.is_changed( n ) == ( moved[n] != 0 );
+    }
+    check( count == expected_count, "update() recomputes the moved nodes and their subtrees" );
+    check( flags_match, "is_changed() marks exactly the moved subtrees" );
+    check_worlds( h, "moved" );
+
+    // Padding past each matrix must be left alone, and unchanged nodes not written at all.
+    const size_t stride { sizeof( Matrix ) + 16 };
+    std::vector<float> destination( h.get_node_count() * stride / sizeof( float ), -1.0f );
+    h.write_world( destination.data(), stride, true );
+    bool written { true };
+    for( TransformHierarchy::NodeId n = 0; n < h.get_node_count(); ++n ) {
+        const float* slot { destination.data() + n * stride / sizeof( float ) };
+        for( uint32_t i = 0; i < 16; ++i ) {
+            written = written && slot[i] == ( moved[n] ? h.get_world( n ).m[i] : -1.0f );
+        }
+        written = written && std::all_of( slot + 16, slot + stride / sizeof( float ), []( float f ) { return f == -1.0f; } );
+    }
+    check( written, "write_world() writes only the changed matrices, at the stride" );
+
+    std::vector<Matrix> worlds( h.get_node_count() );
+    h.write_world( worlds.data(), sizeof( Matrix ) );
+    bool all_written { true };
+    for( TransformHierarchy::NodeId n = 0; n < h.get_node_count(); ++n ) {
+        all_written = all_written && worlds[n].m == h.get_world( n ).m;
+    }
+    check( all_written, "write_world() writes every matrix by default" );
+
+    Matrix view_projection {};
+    std::uniform_real_distribution<float> element { -2.0f, 2.0f };
+    for( auto& e : view_projection.m ) {
+        e = element( rng );
+    }
+    std::vector<Matrix> mvps( h.get_node_count() );
+    h.write_mvp( view_projection, mvps.data(), sizeof( Matrix ) );
+    bool mvps_match { true };
+    for( TransformHierarchy::NodeId n = 0; n < h.get_node_count(); ++n ) {
+        mvps_match = mvps_match && is_near( mvps[n], multiply( view_projection, get_expected_world( h, n ) ) );
+    }
+    check( mvps_match, "write_mvp() writes view_projection * world" );
+
+    if( failed )
+        return EXIT_FAILURE;
+    std::cout << "TransformHierarchy world matrices match." << std::endl;
+    return EXIT_SUCCESS;
+}
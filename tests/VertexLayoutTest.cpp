@@ -0,0 +1,110 @@
+// Checks the packed vertex encoders: every half converts to a float and back unchanged, floats round
+// to the nearest half with ties to even, and octahedral normals survive encoding and quantization.
+#include "VertexLayout.hpp"
+#include "TestUtils.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    using namespace stlr::vertex_packing;
+    using namespace stlr::test;
+
+    bool is_nan_half( uint16_t h ) {
+        return ( h & 0x7c00 ) == 0x7c00 && ( h & 0x3ff ) != 0;
+    }
+
+    void check_halves() {
+        bool round_trips { true };
+        for( uint32_t h = 0; h <= 0xffff; ++h ) {
+            const uint16_t back { float_to_half( half_to_float( static_cast<uint16_t>( h ) ) ) };
+            round_trips = round_trips && ( is_nan_half( static_cast<uint16_t>( h ) ) ? is_nan_half( back ) : back == h );
+        }
+        check( round_trips, "every half converts to a float and back unchanged" );
+
+        // Between two neighbouring halves, a float rounds to the nearer one, and to the even one on a tie.
+        std::mt19937 rng { 1234 };
+        bool nearest { true };
+        for( uint32_t i = 0; i < 1000000; ++i ) {
+            const uint16_t below { static_cast<uint16_t>( std::uniform_int_distribution<uint32_t> { 0, 0x7bfe }( rng ) ) };
+            const float lo { half_to_float( below ) };
+            const float hi { half_to_float( static_cast<uint16_t>( below + 1 ) ) };
+            const float f { i % 16 == 0 ? ( lo + hi ) * 0.5f : std::uniform_real_distribution<float> { lo, hi }( rng ) };
+            const uint16_t expected { f - lo < hi - f || ( f - lo == hi - f && ( below & 1 ) == 0 ) ? below : static_cast<uint16_t>( below + 1 ) };
+            nearest = nearest && float_to_half( f ) == expected && float_to_half( -f ) == ( expected | 0x8000 );
+        }
+        check( nearest, "floats round to the nearest half, ties to even" );
+
+        const float smallest { std::ldexp( 1.0f, -24 ) };
+        check( float_to_half( smallest ) == 0x0001 && float_to_half( smallest * 0.5f ) == 0x0000 && float_to_half( smallest * 0.75f ) == 0x0001, "the denormal halves round like the rest" );
+        check( float_to_half( 65504.0f ) == 0x7bff && float_to_half( 65519.0f ) == 0x7bff && float_to_half( 65520.0f ) == 0x7c00, "only values that round past the largest half become infinity" );
+        check( float_to_half( std::numeric_limits<float>::infinity() ) == 0x7c00 && float_to_half( -std::numeric_limits<float>::infinity() ) == 0xfc00, "infinities stay infinite" );
+        check( is_nan_half( float_to_half( std::numeric_limits<float>::quiet_NaN() ) ), "NaNs stay NaN" );
+        check( float_to_half( -0.0f ) == 0x8000, "negative zero keeps its sign" );
+    }
+
+    float get_angle( const std::array<float, 3>& a, const std::array<float, 3>& b ) {
+        const float cosine { a[0] * b[0] + a[1] * b[1] + a[2] * b[2] };
+        return std::acos( std::clamp( cosine, -1.0f, 1.0f ) );
+    }
+
+    void check_octahedral() {
+        std::vector<std::array<float, 3>> normals {
+            { 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }
+        };
+        std::mt19937 rng { 1234 };
+        std::normal_distribution<float> gaussian;
+        for( uint32_t i = 0; i < 100000; ++i ) {
+            std::array<float, 3> n { gaussian( rng ), gaussian( rng ), gaussian( rng ) };
+            const float length { std::sqrt( n[0] * n[0] + n[1] * n[1] + n[2] * n[2] ) };
+            normals.push_back( { n[0] / length, n[1] / length, n[2] / length } );
+        }
+
+        float max_error { 0.0f };
+        float max_quantized_error { 0.0f };
+        bool in_square { true };
+        for( const auto& n : normals ) {
+            const auto e { encode_octahedral( n ) };
+            in_square = in_square && std::abs( e[0] ) <= 1.0f && std::abs( e[1] ) <= 1.0f;
+            max_error = std::max( max_error, get_angle( n, decode_octahedral( e ) ) );
+
+            // Read back the way the GPU reads eR16G16Snorm.
+            const stlr::OctahedralNormal packed( n );
+            const std::array<float, 2> read { std::max( packed.v[0] / 32767.0f, -1.0f ), std::max( packed.v[1] / 32767.0f, -1.0f ) };
+            max_quantized_error = std::max( max_quantized_error, get_angle( n, decode_octahedral( read ) ) );
+        }
+        check( in_square, "octahedral encodings lie in [-1, 1]^2" );
+        check( max_error < 1e-3f, "octahedral normals decode to themselves (" + std::to_string( max_error ) + " radians off)" );
+        check( max_quantized_error < 1e-3f, "16-bit octahedral normals are accurate to a thousandth of a radian (" + std::to_string( max_quantized_error ) + " radians off)" );
+        check( encode_octahedral( { 0.0f, 0.0f, 0.0f } ) == std::array<float, 2> { 0.0f, 0.0f }, "a zero vector encodes to the center" );
+    }
+
+    struct Vertex {
+        stlr::Half4 position;
+        stlr::Half2 uv;
+        stlr::OctahedralNormal normal;
+        stlr::Unorm8x4 color;
+    };
+    using Layout = stlr::VertexLayout<Vertex, &Vertex::position, &Vertex::uv, &Vertex::normal, &Vertex::color>;
+    static_assert( Layout::stride == 20, "The packed vertex should take 20 bytes." );
+    static_assert( Layout::offsets[0] == 0 && Layout::offsets[1] == 8 && Layout::offsets[2] == 12 && Layout::offsets[3] == 16, "The offsets should follow the members." );
+    static_assert( Layout::formats[2] == vk::Format::eR16G16Snorm, "Members take their type's format." );
+}
+
+int main() {
+    check_halves();
+    check_octahedral();
+
+    const auto attributes { Layout::get_attributes( 1, 3 ) };
+    check( attributes[3].location == 6 && attributes[3].binding == 1 && attributes[3].offset == 16 && attributes[3].format == vk::Format::eR8G8B8A8Unorm, "get_attributes() numbers the locations from first_location" );
+
+    if( failed )
+        return EXIT_FAILURE;
+    std::cout << "Vertex packing round-trips." << std::endl;
+    return EXIT_SUCCESS;
+}